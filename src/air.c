@@ -1,7 +1,96 @@
 #include "air.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// how much of the spill file an iterator maps at a time
+#define AIR_SPILL_WINDOW (1u << 20)
+
+// spilled chunks are stored back to back, items only
+#define AIR_CHUNK_BYTES (AIR_CHUNK_CAPACITY * sizeof(air_instr_t))
+
+struct air_spill_s {
+    int fd;          // -1 until the first chunk is spilled
+    size_t budget;   // chunks allowed in memory
+    size_t resident; // chunks in memory, including the ones kept by reset
+    size_t chunks;   // full chunks in the file, in list order before head
+};
+
+// a place between two instructions: before items[index] of `chunk`, which
+// is dir[slot]
+typedef struct {
+    size_t slot;
+    air_instr_chunk_t *chunk;
+    size_t index;
+} list_pos_t;
+
+static bool dir_reserve(air_instr_list_t *list, size_t n)
+{
+    if (list->dir_len + n <= list->dir_cap) {
+        return true;
+    }
+    size_t cap = list->dir_cap ? list->dir_cap : 64;
+    while (cap < list->dir_len + n) {
+        cap *= 2;
+    }
+    air_instr_chunk_t **dir = (air_instr_chunk_t **)realloc(
+        list->dir, cap * sizeof(*dir));
+    if (!dir) {
+        return false;
+    }
+    list->dir = dir;
+    list->dir_cap = cap;
+    return true;
+}
+
+// records the new tail in the directory, or drops the directory when it
+// can't grow. it's built again when needed
+static void dir_push_tail(air_instr_list_t *list)
+{
+    if (!list->dir) {
+        return;
+    }
+    if (!dir_reserve(list, 1)) {
+        free(list->dir);
+        list->dir = NULL;
+        list->dir_len = 0;
+        list->dir_cap = 0;
+        return;
+    }
+    list->dir[list->dir_len++] = list->tail;
+}
+
+static bool dir_build(air_instr_list_t *list)
+{
+    if (list->spill) {
+        return false;
+    }
+    if (list->dir) {
+        return true;
+    }
+    size_t n = 0;
+    for (air_instr_chunk_t *c = list->head; c; c = c->next) {
+        n++;
+        if (c == list->tail) {
+            break;
+        }
+    }
+    if (!dir_reserve(list, n ? n : 1)) {
+        return false;
+    }
+    list->dir_len = 0;
+    for (air_instr_chunk_t *c = list->head; n--; c = c->next) {
+        list->dir[list->dir_len++] = c;
+    }
+    return true;
+}
 
 void air_instr_list_init(air_instr_list_t *list)
 {
@@ -9,6 +98,10 @@ void air_instr_list_init(air_instr_list_t *list)
     list->tail = NULL;
     list->count = 0;
     list->used_in_tail = 0;
+    list->spill = NULL;
+    list->dir = NULL;
+    list->dir_len = 0;
+    list->dir_cap = 0;
 }
 
 air_instr_list_t *air_instr_list_new()
@@ -20,6 +113,126 @@ air_instr_list_t *air_instr_list_new()
     return list;
 }
 
+void air_instr_list_reset(air_instr_list_t *list)
+{
+    list->tail = list->head;
+    list->count = 0;
+    list->used_in_tail = 0;
+    list->dir_len = list->head ? 1 : 0;
+    if (list->spill) {
+        list->spill->chunks = 0; // the file is overwritten from the start
+    }
+}
+
+bool air_instr_list_set_budget(air_instr_list_t *list, size_t bytes)
+{
+    if (!list->spill) {
+        air_spill_t *spill = (air_spill_t *)calloc(1, sizeof(*spill));
+        if (!spill) {
+            return false;
+        }
+        spill->fd = -1;
+        for (air_instr_chunk_t *c = list->head; c; c = c->next) {
+            spill->resident++;
+        }
+        list->spill = spill;
+    }
+    // spilling takes chunks off the front, the directory can't follow
+    free(list->dir);
+    list->dir = NULL;
+    list->dir_len = 0;
+    list->dir_cap = 0;
+
+    size_t chunks = bytes / sizeof(air_instr_chunk_t);
+    list->spill->budget = chunks ? chunks : 1;
+    return true;
+}
+
+static int open_spill_file(void)
+{
+    const char *dir = getenv("TMPDIR");
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/air-spill-XXXXXX",
+        dir && *dir ? dir : "/tmp");
+    int fd = mkostemp(path, O_CLOEXEC);
+    if (fd >= 0) {
+        unlink(path);
+    }
+    return fd;
+}
+
+// writes the head chunk, which is full, to the spill file and unlinks it
+// from the list for reuse. NULL if it couldn't be written
+static air_instr_chunk_t *spill_head(air_instr_list_t *list)
+{
+    air_spill_t *spill = list->spill;
+    if (spill->fd < 0 && (spill->fd = open_spill_file()) < 0) {
+        return NULL;
+    }
+
+    air_instr_chunk_t *chunk = list->head;
+    const uint8_t *p = (const uint8_t *)chunk->items;
+    size_t left = AIR_CHUNK_BYTES;
+    off_t off = (off_t)(spill->chunks * AIR_CHUNK_BYTES);
+    while (left) {
+        ssize_t n = pwrite(spill->fd, p, left, off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return NULL;
+        }
+        p += n;
+        left -= (size_t)n;
+        off += n;
+    }
+    spill->chunks++;
+
+    list->head = chunk->next;
+    if (list->tail == chunk) { // a budget of one chunk
+        list->tail = NULL;
+    }
+    chunk->next = NULL;
+    return chunk;
+}
+
+bool air_instr_list_reserve(air_instr_list_t *list, size_t n)
+{
+    size_t room = list->tail ? AIR_CHUNK_CAPACITY - list->used_in_tail : 0;
+    air_instr_chunk_t *last = list->tail;
+    for (; last && last->next; last = last->next) {
+        room += AIR_CHUNK_CAPACITY;
+    }
+
+    while (room < n) {
+        air_spill_t *spill = list->spill;
+        if (spill && spill->resident >= spill->budget) {
+            break; // the rest comes from spilled chunks
+        }
+        air_instr_chunk_t *chunk =
+            (air_instr_chunk_t *)malloc(sizeof(*chunk));
+        if (!chunk) {
+            return false;
+        }
+        if (spill) {
+            spill->resident++;
+        }
+        chunk->next = NULL;
+        if (!last) {
+            list->head = chunk;
+            list->tail = chunk;
+            list->used_in_tail = 0;
+            dir_push_tail(list);
+        }
+        else {
+            last->next = chunk;
+        }
+        last = chunk;
+        room += AIR_CHUNK_CAPACITY;
+    }
+    return true;
+}
+
 void air_instr_list_destroy(air_instr_list_t *list)
 {
     air_instr_chunk_t *chunk = list->head;
@@ -28,6 +241,13 @@ void air_instr_list_destroy(air_instr_list_t *list)
         free(chunk);
         chunk = next;
     }
+    if (list->spill) {
+        if (list->spill->fd >= 0) {
+            close(list->spill->fd);
+        }
+        free(list->spill);
+    }
+    free(list->dir);
 }
 
 void air_instr_list_free(air_instr_list_t *list)
@@ -38,23 +258,471 @@ void air_instr_list_free(air_instr_list_t *list)
 
 air_instr_t *air_instr_list_get_new(air_instr_list_t *list)
 {
-    if (!list->tail || list->used_in_tail == AIR_CHUNK_CAPACITY) {
-        air_instr_chunk_t *new_chunk =
-            (air_instr_chunk_t *)malloc(sizeof(*new_chunk));
+    if (list->tail && list->used_in_tail == AIR_CHUNK_CAPACITY &&
+        list->tail->next) { // chunk kept by air_instr_list_reset()
+        list->tail->used = AIR_CHUNK_CAPACITY;
+        list->tail = list->tail->next;
+        list->used_in_tail = 0;
+        dir_push_tail(list);
+    }
+    else if (!list->tail || list->used_in_tail == AIR_CHUNK_CAPACITY) {
+        air_spill_t *spill = list->spill;
+        air_instr_chunk_t *new_chunk = NULL;
+        if (spill && spill->resident >= spill->budget) {
+            new_chunk = spill_head(list); // over budget in memory otherwise
+        }
         if (!new_chunk) {
-            return NULL;
+            new_chunk = (air_instr_chunk_t *)malloc(sizeof(*new_chunk));
+            if (!new_chunk) {
+                return NULL;
+            }
+            if (spill) {
+                spill->resident++;
+            }
         }
         new_chunk->next = NULL;
         if (!list->head) {
             list->head = new_chunk;
         }
         else {
+            list->tail->used = AIR_CHUNK_CAPACITY;
             list->tail->next = new_chunk;
         }
         list->tail = new_chunk;
         list->used_in_tail = 0;
+        dir_push_tail(list);
     }
 
     list->count++;
     return &list->tail->items[list->used_in_tail++];
 }
+
+static size_t chunk_used(
+    const air_instr_list_t *list, const air_instr_chunk_t *c)
+{
+    return c == list->tail ? list->used_in_tail : c->used;
+}
+
+static bool ends_by(const air_instr_t *instr, size_t offset)
+{
+    return instr->offset + instr->length <= offset;
+}
+
+static bool starts_before(const air_instr_t *instr, size_t offset)
+{
+    return instr->offset < offset;
+}
+
+// the first instruction `before` isn't true for. instructions are in
+// offset order and don't overlap, so `before` holds for a prefix of them.
+// needs the directory
+static list_pos_t find_pos(const air_instr_list_t *list,
+    bool (*before)(const air_instr_t *, size_t), size_t offset)
+{
+    // only the tail can be empty
+    size_t slots = list->dir_len;
+    if (slots && !chunk_used(list, list->dir[slots - 1])) {
+        slots--;
+    }
+
+    // the last chunk that starts with an instruction before `offset`
+    size_t lo = 0;
+    size_t hi = slots;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (before(&list->dir[mid]->items[0], offset)) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    list_pos_t pos = {0, list->dir_len ? list->dir[0] : NULL, 0};
+    if (!lo) {
+        return pos;
+    }
+
+    pos.slot = lo - 1;
+    pos.chunk = list->dir[pos.slot];
+    size_t i = 1;
+    size_t end = chunk_used(list, pos.chunk);
+    while (i < end) {
+        size_t mid = i + (end - i) / 2;
+        if (before(&pos.chunk->items[mid], offset)) {
+            i = mid + 1;
+        }
+        else {
+            end = mid;
+        }
+    }
+    pos.index = i;
+    return pos;
+}
+
+// moves `pos` forward by `n` instructions. a place at the end of a chunk
+// stays in that chunk
+static void pos_forward(
+    const air_instr_list_t *list, list_pos_t *pos, size_t n)
+{
+    pos->index += n;
+    while (pos->chunk != list->tail && pos->index > pos->chunk->used) {
+        pos->index -= pos->chunk->used;
+        pos->chunk = list->dir[++pos->slot];
+    }
+}
+
+// takes dir[slot, slot + n) out of the list and frees them
+static void unlink_chunks(air_instr_list_t *list, size_t slot, size_t n)
+{
+    air_instr_chunk_t *last = list->dir[slot + n - 1];
+    if (slot) {
+        list->dir[slot - 1]->next = last->next;
+    }
+    else {
+        list->head = last->next;
+    }
+    if (list->tail == last) {
+        list->tail = slot ? list->dir[slot - 1] : NULL;
+    }
+    for (size_t i = 0; i < n; i++) {
+        free(list->dir[slot + i]);
+    }
+    memmove(&list->dir[slot], &list->dir[slot + n],
+        (list->dir_len - slot - n) * sizeof(*list->dir));
+    list->dir_len -= n;
+}
+
+// the chunks insert_at() needs to put `n` instructions at `pos`
+static size_t insert_chunks(const list_pos_t *pos, size_t n)
+{
+    const air_instr_chunk_t *c = pos->chunk;
+    if (c->used + n <= AIR_CHUNK_CAPACITY) {
+        return 0;
+    }
+    size_t room = AIR_CHUNK_CAPACITY - pos->index;
+    size_t over = n > room ? n - room : 0;
+    return (over + AIR_CHUNK_CAPACITY - 1) / AIR_CHUNK_CAPACITY +
+           (c->used > pos->index ? 1 : 0);
+}
+
+// puts `n` instructions at `pos` using the chunks in `fresh`, as many as
+// insert_chunks() asked for. the directory has room for them
+static void insert_at(air_instr_list_t *list, const list_pos_t *pos,
+    const air_instr_t *items, size_t n, air_instr_chunk_t *fresh)
+{
+    air_instr_chunk_t *c = pos->chunk;
+    size_t i = pos->index;
+    size_t rest = c->used - i;
+    if (c->used + n <= AIR_CHUNK_CAPACITY) {
+        memmove(&c->items[i + n], &c->items[i], rest * sizeof(*c->items));
+        memcpy(&c->items[i], items, n * sizeof(*items));
+        c->used += n;
+        return;
+    }
+
+    size_t room = AIR_CHUNK_CAPACITY - i;
+    size_t take = n < room ? n : room;
+    size_t added = (n - take + AIR_CHUNK_CAPACITY - 1) / AIR_CHUNK_CAPACITY +
+                   (rest ? 1 : 0);
+    air_instr_chunk_t **slot = &list->dir[pos->slot + 1];
+    memmove(slot + added, slot,
+        (list->dir_len - pos->slot - 1) * sizeof(*slot));
+    list->dir_len += added;
+
+    // the rest of `c` goes to a chunk of its own behind the new ones, so
+    // nothing further down the list moves
+    air_instr_chunk_t *after = c->next;
+    air_instr_chunk_t *r = NULL;
+    if (rest) {
+        r = fresh;
+        fresh = fresh->next;
+        memcpy(r->items, &c->items[i], rest * sizeof(*c->items));
+        r->used = rest;
+        r->next = after;
+        after = r;
+        slot[added - 1] = r;
+    }
+
+    memcpy(&c->items[i], items, take * sizeof(*items));
+    c->used = i + take;
+    items += take;
+    n -= take;
+
+    air_instr_chunk_t *at = c;
+    while (n) {
+        air_instr_chunk_t *f = fresh;
+        fresh = fresh->next;
+        take = n < AIR_CHUNK_CAPACITY ? n : AIR_CHUNK_CAPACITY;
+        memcpy(f->items, items, take * sizeof(*items));
+        f->used = take;
+        items += take;
+        n -= take;
+        at->next = f;
+        at = f;
+        *slot++ = f;
+    }
+    at->next = after;
+    if (list->tail == c) {
+        list->tail = r ? r : at;
+    }
+}
+
+// drops `n` instructions from `pos` on, freeing chunks that end up empty
+static void remove_at(air_instr_list_t *list, const list_pos_t *pos, size_t n)
+{
+    air_instr_chunk_t *c = pos->chunk;
+    size_t i = pos->index;
+    size_t take = n < c->used - i ? n : c->used - i;
+    memmove(&c->items[i], &c->items[i + take],
+        (c->used - i - take) * sizeof(*c->items));
+    c->used -= take;
+    n -= take;
+
+    size_t emptied = 0;
+    while (n) {
+        air_instr_chunk_t *next = list->dir[pos->slot + 1 + emptied];
+        if (next->used <= n) {
+            n -= next->used;
+            emptied++;
+        }
+        else {
+            memmove(next->items, &next->items[n],
+                (next->used - n) * sizeof(*next->items));
+            next->used -= n;
+            n = 0;
+        }
+    }
+
+    // an empty list keeps its head, like after air_instr_list_reset()
+    size_t slot = pos->slot + 1;
+    if (!c->used && (pos->slot || list->dir_len > 1 + emptied)) {
+        slot--;
+        emptied++;
+    }
+    if (emptied) {
+        unlink_chunks(list, slot, emptied);
+    }
+}
+
+static void free_chunks(air_instr_chunk_t *chunk)
+{
+    while (chunk) {
+        air_instr_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
+
+bool air_instr_list_splice(air_instr_list_t *list, size_t from, size_t to,
+    const air_instr_t *items, size_t n)
+{
+    if (!dir_build(list)) {
+        return false;
+    }
+    if (!list->head) {
+        for (size_t i = 0; i < n; i++) {
+            air_instr_t *instr = air_instr_list_get_new(list);
+            if (!instr) {
+                return false;
+            }
+            *instr = items[i];
+        }
+        return true;
+    }
+
+    list->tail->used = list->used_in_tail;
+    list_pos_t start = find_pos(list, starts_before, from);
+    list_pos_t end = find_pos(list, starts_before, to);
+    size_t removed = end.index;
+    for (size_t s = start.slot; s < end.slot; s++) {
+        removed += list->dir[s]->used;
+    }
+    removed -= start.index;
+
+    size_t same = removed < n ? removed : n;
+    list_pos_t pos = start;
+    pos_forward(list, &pos, same);
+
+    // every allocation happens before the list changes
+    air_instr_chunk_t *fresh = NULL;
+    if (n > removed) {
+        size_t k = insert_chunks(&pos, n - removed);
+        if (!dir_reserve(list, k)) {
+            return false;
+        }
+        for (; k; k--) {
+            air_instr_chunk_t *chunk =
+                (air_instr_chunk_t *)malloc(sizeof(*chunk));
+            if (!chunk) {
+                free_chunks(fresh);
+                return false;
+            }
+            chunk->next = fresh;
+            fresh = chunk;
+        }
+    }
+
+    // overwrite the instructions both sides have in common
+    for (size_t done = 0; done < same;) {
+        if (start.index == start.chunk->used) {
+            start.chunk = list->dir[++start.slot];
+            start.index = 0;
+        }
+        size_t take = start.chunk->used - start.index;
+        if (take > same - done) {
+            take = same - done;
+        }
+        memcpy(&start.chunk->items[start.index], &items[done],
+            take * sizeof(*items));
+        start.index += take;
+        done += take;
+    }
+
+    if (n > removed) {
+        insert_at(list, &pos, items + same, n - removed, fresh);
+    }
+    else if (removed > n) {
+        remove_at(list, &pos, removed - n);
+    }
+    list->count += n;
+    list->count -= removed;
+    list->used_in_tail = list->tail->used;
+    return true;
+}
+
+bool air_instr_list_seek(
+    air_instr_list_t *list, size_t offset, air_instr_iter_t *it)
+{
+    air_instr_iter_init(it, list);
+    if (!list->count) {
+        return true;
+    }
+    if (!dir_build(list)) {
+        return false;
+    }
+
+    list_pos_t pos = find_pos(list, ends_by, offset);
+    if (pos.index) {
+        pos.index--;
+    }
+    else if (pos.slot) {
+        pos.chunk = list->dir[--pos.slot];
+        pos.index = pos.chunk->used - 1;
+    }
+    it->chunk = pos.chunk;
+    it->skip = pos.index;
+    return true;
+}
+
+void air_instr_iter_init(air_instr_iter_t *it, const air_instr_list_t *list)
+{
+    it->list = list;
+    it->spilled = 0;
+    it->chunk = list->count ? list->head : NULL;
+    it->skip = 0;
+    it->map = NULL;
+    it->map_len = 0;
+    it->failed = false;
+}
+
+static void unmap_window(air_instr_iter_t *it)
+{
+    if (it->map) {
+        munmap(it->map, it->map_len);
+        it->map = NULL;
+        it->map_len = 0;
+    }
+}
+
+const air_instr_t *air_instr_iter_next(air_instr_iter_t *it, size_t *n)
+{
+    const air_instr_list_t *list = it->list;
+    const air_spill_t *spill = list->spill;
+    unmap_window(it);
+
+    if (spill && it->spilled < spill->chunks && !it->failed) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t chunks = AIR_SPILL_WINDOW / AIR_CHUNK_BYTES;
+        if (chunks > spill->chunks - it->spilled) {
+            chunks = spill->chunks - it->spilled;
+        }
+        uint64_t off = (uint64_t)it->spilled * AIR_CHUNK_BYTES;
+        uint64_t start = off & ~(uint64_t)(page - 1);
+        size_t len = (size_t)(off - start) + chunks * AIR_CHUNK_BYTES;
+
+        void *map = mmap(
+            NULL, len, PROT_READ, MAP_SHARED, spill->fd, (off_t)start);
+        if (map == MAP_FAILED) {
+            it->failed = true;
+            return NULL;
+        }
+        madvise(map, len, MADV_SEQUENTIAL);
+        it->map = map;
+        it->map_len = len;
+        it->spilled += chunks;
+        *n = chunks * AIR_CHUNK_CAPACITY;
+        return (const air_instr_t *)((const uint8_t *)map + (off - start));
+    }
+
+    const air_instr_chunk_t *chunk = it->chunk;
+    if (!chunk || it->failed) {
+        return NULL;
+    }
+    bool last = chunk == list->tail;
+    it->chunk = last ? NULL : chunk->next;
+    *n = (last ? list->used_in_tail : chunk->used) - it->skip;
+    const air_instr_t *run = chunk->items + it->skip;
+    it->skip = 0;
+    return run;
+}
+
+void air_instr_iter_done(air_instr_iter_t *it)
+{
+    unmap_window(it);
+}
+
+// branch displacements and RIP-relative operands count from the end of
+// the instruction
+static uint64_t next_address(const air_instr_t *instr, uint64_t base)
+{
+    return base + instr->offset + instr->length;
+}
+
+const air_operand_t *air_instr_rip_operand(const air_instr_t *instr)
+{
+    const air_operand_t *ops[2] = {&instr->ops.binary.dst, NULL};
+    if (instr->type == AIR_MOV || instr->type == AIR_EXT) {
+        ops[1] = &instr->ops.binary.src;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (ops[i] && ops[i]->type == OPERAND_MEM &&
+            ops[i]->mem.segment == SEG_NONE && ops[i]->mem.base == REG_IP) {
+            return ops[i];
+        }
+    }
+    return NULL;
+}
+
+uint64_t air_rip_target(
+    const air_instr_t *instr, const air_operand_t *op, uint64_t base)
+{
+    uint64_t target = next_address(instr, base) + (int64_t)op->mem.disp;
+    if (op->mem.size == ADDR_SIZE_32) {
+        target &= 0xffffffffu;
+    }
+    return target;
+}
+
+bool air_branch_target(
+    const air_instr_t *instr, uint64_t base, uint64_t *target)
+{
+    // AIR_EXT with a displacement is a jcc
+    if ((instr->type != AIR_CALL && instr->type != AIR_JMP &&
+            instr->type != AIR_EXT) ||
+        instr->ops.unary.operand.type != OPERAND_REL) {
+        return false;
+    }
+    *target = next_address(instr, base) +
+              (int64_t)instr->ops.unary.operand.rel.disp;
+    return true;
+}
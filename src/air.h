@@ -10,6 +10,7 @@ typedef enum {
     OPERAND_REG,
     OPERAND_MEM,
     OPERAND_IMM,
+    OPERAND_REL, // branch displacement from the end of the instruction
 
     OPERAND_NONE = 0xff,
 } air_operand_type_t;
@@ -34,6 +35,9 @@ typedef struct {
             int64_t value;
             operand_size_t size;
         } imm;
+        struct {
+            int32_t disp;
+        } rel;
     };
 } air_operand_t;
 
@@ -41,12 +45,26 @@ typedef enum {
     AIR_POP,
     AIR_PUSH,
     AIR_MOV,
+    AIR_CALL,
+    AIR_JMP,
+    AIR_EXT, // from the 0F, 0F38 or 0F3A map, see `ext`
 
     AIR_UNKNOWN = 0xff,
 } air_instr_type_t;
 
+// AIR_EXT flags in air_instr_t.ext, next to the ext_op_id_t
+#define AIR_EXT_VEX 0x8000 // VEX encoded
+#define AIR_EXT_IMM 0x4000 // `imm` is an operand
+#define AIR_EXT_L256 0x2000 // VEX.L: 256-bit vectors
+#define AIR_EXT_W 0x1000    // REX.W or VEX.W
+#define AIR_EXT_ID(ext) ((ext) & 0x0fff)
+
 typedef struct air_instr_s {
     air_instr_type_t type;
+    // AIR_EXT only, packed where the operands' alignment leaves room
+    uint16_t ext;
+    uint8_t vsrc; // VEX.vvvv register, REG_NONE when it isn't an operand
+    uint8_t imm;  // trailing imm8
     union {
         struct {
             air_operand_t dst;
@@ -57,6 +75,7 @@ typedef struct air_instr_s {
         } unary;
     } ops;
     size_t length;
+    size_t offset; // from the start of the decoded buffer
     struct air_instr_s *next;
 } air_instr_t;
 
@@ -64,22 +83,86 @@ typedef struct air_instr_s {
 
 typedef struct air_instr_chunk_s {
     air_instr_t items[AIR_CHUNK_CAPACITY];
+    // instructions held, all of them until a splice. unused in the tail,
+    // see used_in_tail
+    size_t used;
     struct air_instr_chunk_s *next;
 } air_instr_chunk_t;
 
+typedef struct air_spill_s air_spill_t;
+
 typedef struct {
-    air_instr_chunk_t *head;
+    air_instr_chunk_t *head; // first chunk still in memory
     air_instr_chunk_t *tail;
     size_t count;
     size_t used_in_tail;
+    air_spill_t *spill; // NULL unless a memory budget is set
+    // the chunks from head to tail, built by the first splice or seek so
+    // the ones after it find their place by binary search. NULL until then
+    air_instr_chunk_t **dir;
+    size_t dir_len;
+    size_t dir_cap;
 } air_instr_list_t;
 
 void air_instr_list_init(air_instr_list_t *);
 air_instr_list_t *air_instr_list_new();
 
+// empties the list but keeps its chunks for the next decode
+void air_instr_list_reset(air_instr_list_t *);
+
+// makes room for `n` more instructions up front, so the next `n` calls to
+// air_instr_list_get_new() don't allocate
+bool air_instr_list_reserve(air_instr_list_t *, size_t n);
+
+// caps the memory held in chunks at about `bytes` (at least one chunk).
+// past it, the oldest full chunks are written to an unlinked temporary
+// file and only come back through air_instr_iter_t. set it on an empty
+// list
+bool air_instr_list_set_budget(air_instr_list_t *, size_t bytes);
+
 void air_instr_list_destroy(air_instr_list_t *);
 void air_instr_list_free(air_instr_list_t *);
 
 air_instr_t *air_instr_list_get_new(air_instr_list_t *);
 
+// replaces the instructions starting in [from, to) with the `n` in
+// `items`, which must fit in that place. only the chunks around the change
+// are touched: they are split or dropped rather than the rest of the list
+// moved. fails on lists with a memory budget, whose chunks have to stay
+// full
+bool air_instr_list_splice(air_instr_list_t *, size_t from, size_t to,
+    const air_instr_t *items, size_t n);
+
+// walks a list in order, spilled chunks included
+typedef struct {
+    const air_instr_list_t *list;
+    size_t spilled;                 // next spilled chunk to map
+    const air_instr_chunk_t *chunk; // next chunk in memory
+    size_t skip;                    // instructions of `chunk` already seen
+    void *map;                      // current window over the spill file
+    size_t map_len;
+    bool failed; // a window couldn't be mapped, the walk ended early
+} air_instr_iter_t;
+
+void air_instr_iter_init(air_instr_iter_t *, const air_instr_list_t *);
+// the next run of consecutive instructions and its length in `*n`, NULL
+// at the end. a run read back from the spill file (it->map set) is only
+// valid until the next call; runs in memory last until the list changes
+const air_instr_t *air_instr_iter_next(air_instr_iter_t *, size_t *n);
+void air_instr_iter_done(air_instr_iter_t *);
+// starts `it` at the last instruction that ends at or before `offset`, or
+// at the first one when none does. fails on lists with a memory budget
+bool air_instr_list_seek(
+    air_instr_list_t *, size_t offset, air_instr_iter_t *it);
+
+// the RIP-relative memory operand of `instr`, NULL if it has none
+const air_operand_t *air_instr_rip_operand(const air_instr_t *instr);
+// the address the operand resolves to, when the decoded buffer starts at
+// `base`
+uint64_t air_rip_target(
+    const air_instr_t *instr, const air_operand_t *op, uint64_t base);
+// the destination of a direct call or jmp
+bool air_branch_target(
+    const air_instr_t *instr, uint64_t base, uint64_t *target);
+
 #endif // AIR_H
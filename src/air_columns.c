@@ -0,0 +1,341 @@
+#include "air_columns.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// queries work on blocks of 64 instructions, one bitmap word each. columns
+// are sized in whole blocks so the vector loads never leave the allocation
+#define BLOCK 64
+
+void air_columns_init(air_columns_t *cols)
+{
+    memset(cols, 0, sizeof(*cols));
+}
+
+void air_columns_destroy(air_columns_t *cols)
+{
+    free(cols->type);
+    free(cols->kind0);
+    free(cols->kind1);
+    free(cols->reg0);
+    free(cols->reg1);
+    free(cols->base);
+    free(cols->index);
+    free(cols->mem_slot);
+    free(cols->op_size);
+    free(cols->length);
+    free(cols->disp);
+    free(cols->offset);
+    air_columns_init(cols);
+}
+
+static bool grow_column(void **col, size_t elem, size_t old_cap, size_t cap)
+{
+    uint8_t *p = (uint8_t *)realloc(*col, cap * elem);
+    if (!p) {
+        return false;
+    }
+    memset(p + old_cap * elem, 0, (cap - old_cap) * elem);
+    *col = p;
+    return true;
+}
+
+static bool grow(air_columns_t *cols)
+{
+    size_t cap = cols->capacity ? cols->capacity * 2 : 16 * BLOCK;
+
+    // on failure the columns that did grow keep their larger buffers, the
+    // capacity stays at the smallest common size
+    if (!grow_column((void **)&cols->type, 1, cols->capacity, cap) ||
+        !grow_column((void **)&cols->kind0, 1, cols->capacity, cap) ||
+        !grow_column((void **)&cols->kind1, 1, cols->capacity, cap) ||
+        !grow_column((void **)&cols->reg0, 1, cols->capacity, cap) ||
+        !grow_column((void **)&cols->reg1, 1, cols->capacity, cap) ||
+        !grow_column((void **)&cols->base, 1, cols->capacity, cap) ||
+        !grow_column((void **)&cols->index, 1, cols->capacity, cap) ||
+        !grow_column((void **)&cols->mem_slot, 1, cols->capacity, cap) ||
+        !grow_column((void **)&cols->op_size, 1, cols->capacity, cap) ||
+        !grow_column((void **)&cols->length, 1, cols->capacity, cap) ||
+        !grow_column((void **)&cols->disp, sizeof(int32_t), cols->capacity,
+            cap) ||
+        !grow_column((void **)&cols->offset, sizeof(uint64_t),
+            cols->capacity, cap)) {
+        return false;
+    }
+    cols->capacity = cap;
+    return true;
+}
+
+static bool is_binary(air_instr_type_t type)
+{
+    return type == AIR_MOV || type == AIR_EXT;
+}
+
+static uint8_t operand_reg(const air_operand_t *op)
+{
+    return op->type == OPERAND_REG ? (uint8_t)op->reg.id : REG_NONE;
+}
+
+static uint8_t operand_size(const air_operand_t *op)
+{
+    switch (op->type) {
+    case OPERAND_REG:
+        return (uint8_t)op->reg.size;
+    case OPERAND_MEM:
+        return (uint8_t)op->mem.op_size;
+    case OPERAND_IMM:
+        return (uint8_t)op->imm.size;
+    default:
+        return (uint8_t)OPERAND_SIZE_NONE;
+    }
+}
+
+bool air_columns_append(air_columns_t *cols, const air_instr_t *instr)
+{
+    if (cols->count == cols->capacity && !grow(cols)) {
+        return false;
+    }
+
+    size_t i = cols->count++;
+    const air_operand_t *ops[2] = {&instr->ops.binary.dst, NULL};
+    if (is_binary(instr->type)) {
+        ops[1] = &instr->ops.binary.src;
+    }
+
+    cols->type[i] = (uint8_t)instr->type;
+    cols->kind0[i] = (uint8_t)ops[0]->type;
+    cols->kind1[i] = ops[1] ? (uint8_t)ops[1]->type : OPERAND_NONE;
+    cols->reg0[i] = operand_reg(ops[0]);
+    cols->reg1[i] = ops[1] ? operand_reg(ops[1]) : REG_NONE;
+    cols->length[i] = (uint8_t)instr->length;
+    cols->offset[i] = instr->offset;
+
+    cols->mem_slot[i] = AIR_COL_NO_MEM;
+    cols->base[i] = REG_NONE;
+    cols->index[i] = REG_NONE;
+    cols->disp[i] = 0;
+    cols->op_size[i] = operand_size(ops[0]);
+
+    for (uint8_t slot = 0; slot < 2; slot++) {
+        if (ops[slot] && ops[slot]->type == OPERAND_MEM) {
+            cols->mem_slot[i] = slot;
+            cols->base[i] = (uint8_t)ops[slot]->mem.base;
+            cols->index[i] = (uint8_t)ops[slot]->mem.index;
+            cols->disp[i] = ops[slot]->mem.disp;
+            cols->op_size[i] = (uint8_t)ops[slot]->mem.op_size;
+            break;
+        }
+    }
+    return true;
+}
+
+bool air_columns_append_list(air_columns_t *cols, const air_instr_list_t *list)
+{
+    air_instr_iter_t it;
+    air_instr_iter_init(&it, list);
+    const air_instr_t *run;
+    size_t n;
+    bool ok = true;
+    while (ok && (run = air_instr_iter_next(&it, &n))) {
+        for (size_t i = 0; ok && i < n; i++) {
+            ok = air_columns_append(cols, &run[i]);
+        }
+    }
+    ok = ok && !it.failed;
+    air_instr_iter_done(&it);
+    return ok;
+}
+
+size_t air_columns_bitmap_words(const air_columns_t *cols)
+{
+    return (cols->count + BLOCK - 1) / BLOCK;
+}
+
+static const uint8_t *byte_column(const air_columns_t *cols, air_column_id_t id)
+{
+    switch (id) {
+    case AIR_COL_TYPE:
+        return cols->type;
+    case AIR_COL_KIND0:
+        return cols->kind0;
+    case AIR_COL_KIND1:
+        return cols->kind1;
+    case AIR_COL_REG0:
+        return cols->reg0;
+    case AIR_COL_REG1:
+        return cols->reg1;
+    case AIR_COL_BASE:
+        return cols->base;
+    case AIR_COL_INDEX:
+        return cols->index;
+    case AIR_COL_MEM_SLOT:
+        return cols->mem_slot;
+    case AIR_COL_OP_SIZE:
+        return cols->op_size;
+    case AIR_COL_LENGTH:
+        return cols->length;
+    default:
+        return NULL;
+    }
+}
+
+// NE, LT and GT are evaluated as the complement of EQ, GE and LE
+static bool cmp_inverted(air_cmp_t cmp)
+{
+    return cmp == AIR_CMP_NE || cmp == AIR_CMP_LT || cmp == AIR_CMP_GT;
+}
+
+static air_cmp_t cmp_base(air_cmp_t cmp)
+{
+    switch (cmp) {
+    case AIR_CMP_NE:
+        return AIR_CMP_EQ;
+    case AIR_CMP_LT:
+        return AIR_CMP_GE;
+    case AIR_CMP_GT:
+        return AIR_CMP_LE;
+    default:
+        return cmp;
+    }
+}
+
+// result of comparing any in-range value against one outside the range
+static uint64_t cmp_out_of_range(air_cmp_t cmp, bool value_above)
+{
+    switch (cmp) {
+    case AIR_CMP_NE:
+        return ~0ull;
+    case AIR_CMP_LT:
+    case AIR_CMP_LE:
+        return value_above ? ~0ull : 0;
+    case AIR_CMP_GT:
+    case AIR_CMP_GE:
+        return value_above ? 0 : ~0ull;
+    default:
+        return 0;
+    }
+}
+
+// `base` is EQ, LE or GE
+static uint64_t match_u8(const uint8_t *col, air_cmp_t base, uint8_t value)
+{
+    uint64_t mask = 0;
+#ifdef __SSE2__
+    __m128i needle = _mm_set1_epi8((char)value);
+    for (int i = 0; i < BLOCK / 16; i++) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(col + i * 16));
+        __m128i r;
+        if (base == AIR_CMP_EQ) {
+            r = _mm_cmpeq_epi8(x, needle);
+        }
+        else if (base == AIR_CMP_LE) {
+            r = _mm_cmpeq_epi8(_mm_min_epu8(x, needle), x);
+        }
+        else {
+            r = _mm_cmpeq_epi8(_mm_max_epu8(x, needle), x);
+        }
+        mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(r) << (i * 16);
+    }
+#else
+    for (int i = 0; i < BLOCK; i++) {
+        bool hit = base == AIR_CMP_EQ   ? col[i] == value
+                   : base == AIR_CMP_LE ? col[i] <= value
+                                        : col[i] >= value;
+        mask |= (uint64_t)hit << i;
+    }
+#endif
+    return mask;
+}
+
+static uint64_t match_i32(const int32_t *col, air_cmp_t base, int32_t value)
+{
+    uint64_t mask = 0;
+#ifdef __SSE2__
+    __m128i needle = _mm_set1_epi32(value);
+    __m128i ones = _mm_set1_epi32(-1);
+    for (int i = 0; i < BLOCK / 4; i++) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(col + i * 4));
+        __m128i r;
+        if (base == AIR_CMP_EQ) {
+            r = _mm_cmpeq_epi32(x, needle);
+        }
+        else if (base == AIR_CMP_LE) {
+            r = _mm_xor_si128(_mm_cmpgt_epi32(x, needle), ones);
+        }
+        else {
+            r = _mm_xor_si128(_mm_cmplt_epi32(x, needle), ones);
+        }
+        mask |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(r)) << (i * 4);
+    }
+#else
+    for (int i = 0; i < BLOCK; i++) {
+        bool hit = base == AIR_CMP_EQ   ? col[i] == value
+                   : base == AIR_CMP_LE ? col[i] <= value
+                                        : col[i] >= value;
+        mask |= (uint64_t)hit << i;
+    }
+#endif
+    return mask;
+}
+
+static uint64_t match_block(
+    const air_columns_t *cols, const air_pred_t *pred, size_t first)
+{
+    air_cmp_t base = cmp_base(pred->cmp);
+    uint64_t mask;
+
+    if (pred->column == AIR_COL_DISP) {
+        if (pred->value < INT32_MIN || pred->value > INT32_MAX) {
+            return cmp_out_of_range(pred->cmp, pred->value > INT32_MAX);
+        }
+        mask = match_i32(cols->disp + first, base, (int32_t)pred->value);
+    }
+    else {
+        const uint8_t *col = byte_column(cols, pred->column);
+        if (!col) {
+            return 0;
+        }
+        if (pred->value < 0 || pred->value > UINT8_MAX) {
+            return cmp_out_of_range(pred->cmp, pred->value > UINT8_MAX);
+        }
+        mask = match_u8(col + first, base, (uint8_t)pred->value);
+    }
+
+    return cmp_inverted(pred->cmp) ? ~mask : mask;
+}
+
+size_t air_columns_query(const air_columns_t *cols, const air_pred_t *preds,
+    size_t npreds, uint64_t *bitmap)
+{
+    size_t nwords = air_columns_bitmap_words(cols);
+    size_t matches = 0;
+
+    for (size_t w = 0; w < nwords; w++) {
+        size_t first = w * BLOCK;
+        size_t in_block = cols->count - first;
+        uint64_t mask = in_block >= BLOCK ? ~0ull : (1ull << in_block) - 1;
+
+        for (size_t p = 0; p < npreds && mask; p++) {
+            mask &= match_block(cols, &preds[p], first);
+        }
+
+        bitmap[w] = mask;
+        matches += (size_t)__builtin_popcountll(mask);
+    }
+    return matches;
+}
+
+size_t air_bitmap_indices(const uint64_t *bitmap, size_t nwords, size_t *out)
+{
+    size_t n = 0;
+    for (size_t w = 0; w < nwords; w++) {
+        uint64_t mask = bitmap[w];
+        while (mask) {
+            out[n++] = w * BLOCK + (size_t)__builtin_ctzll(mask);
+            mask &= mask - 1;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,83 @@
+#ifndef AIR_COLUMNS_H
+#define AIR_COLUMNS_H
+
+#include "air.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * structure-of-arrays copy of decoded instructions. every field lives in
+ * its own dense column so predicates scan only the bytes they test.
+ *
+ * operand slot 0 is the destination (or the only operand), slot 1 the
+ * source. base/index/disp/op_size describe the memory operand when there
+ * is one; mem_slot says which slot holds it.
+ */
+typedef struct {
+    uint8_t *type;     // air_instr_type_t
+    uint8_t *kind0;    // air_operand_type_t of slot 0
+    uint8_t *kind1;    // air_operand_type_t of slot 1
+    uint8_t *reg0;     // register of slot 0, REG_NONE if not a register
+    uint8_t *reg1;     // register of slot 1, REG_NONE if not a register
+    uint8_t *base;     // memory base, REG_NONE without a memory operand
+    uint8_t *index;    // memory index, REG_NONE if absent
+    uint8_t *mem_slot; // 0, 1 or AIR_COL_NO_MEM
+    uint8_t *op_size;  // operand_size_t of the data being moved
+    uint8_t *length;
+    int32_t *disp;
+    uint64_t *offset;
+    size_t count;
+    size_t capacity;
+} air_columns_t;
+
+#define AIR_COL_NO_MEM 0xff
+
+typedef enum {
+    AIR_COL_TYPE,
+    AIR_COL_KIND0,
+    AIR_COL_KIND1,
+    AIR_COL_REG0,
+    AIR_COL_REG1,
+    AIR_COL_BASE,
+    AIR_COL_INDEX,
+    AIR_COL_MEM_SLOT,
+    AIR_COL_OP_SIZE,
+    AIR_COL_LENGTH,
+    AIR_COL_DISP,
+} air_column_id_t;
+
+typedef enum {
+    AIR_CMP_EQ,
+    AIR_CMP_NE,
+    AIR_CMP_LT,
+    AIR_CMP_LE,
+    AIR_CMP_GT,
+    AIR_CMP_GE,
+} air_cmp_t;
+
+// `column cmp value`. byte columns compare unsigned, disp signed
+typedef struct {
+    air_column_id_t column;
+    air_cmp_t cmp;
+    int64_t value;
+} air_pred_t;
+
+void air_columns_init(air_columns_t *cols);
+void air_columns_destroy(air_columns_t *cols);
+
+bool air_columns_append(air_columns_t *cols, const air_instr_t *instr);
+bool air_columns_append_list(air_columns_t *cols, const air_instr_list_t *list);
+
+// words needed for a result bitmap over `cols`
+size_t air_columns_bitmap_words(const air_columns_t *cols);
+
+// sets bit i of `bitmap` when instruction i satisfies every predicate.
+// returns the number of matches
+size_t air_columns_query(const air_columns_t *cols, const air_pred_t *preds,
+    size_t npreds, uint64_t *bitmap);
+
+// expands a bitmap into ascending instruction indices. `out` must hold as
+// many entries as the query reported matches
+size_t air_bitmap_indices(const uint64_t *bitmap, size_t nwords, size_t *out);
+
+#endif // AIR_COLUMNS_H
@@ -0,0 +1,650 @@
+#include "archive.h"
+#include "disasm.h"
+#include "maps.h"
+#include "pool.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} air_archive_header_t;
+
+// longest LEB128 encoding of a uint64_t
+#define VARINT_MAX 10
+
+static inline uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline uint8_t *put_varint(uint8_t *p, uint64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// NULL when the varint runs past `end` or is too long
+static inline const uint8_t *get_varint(
+    const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+    uint64_t r = 0;
+    for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        r |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = r;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static unsigned operand_slots(uint8_t type)
+{
+    return type == AIR_MOV || type == AIR_EXT ? 2 : 1;
+}
+
+static void make_template(const air_instr_t *instr, air_template_t *t)
+{
+    memset(t, 0, sizeof(*t));
+    t->type = (uint8_t)instr->type;
+    t->length = (uint8_t)instr->length;
+    t->vsrc = REG_NONE;
+    if (instr->type == AIR_EXT) {
+        t->ext = instr->ext;
+        t->vsrc = instr->vsrc;
+        t->flags = instr->imm ? AIR_TEMPLATE_IMM8 : 0;
+    }
+
+    const air_operand_t *ops[2] = {
+        &instr->ops.binary.dst, &instr->ops.binary.src};
+    for (unsigned i = 0; i < 2; i++) {
+        uint8_t *o = t->ops[i];
+        const air_operand_t *op = ops[i];
+        o[0] = i < operand_slots(t->type) ? (uint8_t)op->type : OPERAND_NONE;
+        switch (o[0]) {
+        case OPERAND_REG:
+            o[1] = (uint8_t)op->reg.id;
+            o[2] = (uint8_t)op->reg.size;
+            break;
+        case OPERAND_MEM:
+            o[1] = (uint8_t)op->mem.base;
+            o[2] = (uint8_t)op->mem.index;
+            o[3] = (uint8_t)op->mem.factor;
+            o[4] = (uint8_t)op->mem.size;
+            o[5] = (uint8_t)op->mem.op_size;
+            o[6] = (uint8_t)op->mem.segment;
+            break;
+        case OPERAND_IMM:
+            o[1] = (uint8_t)op->imm.size;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static uint64_t hash_template(const air_template_t *t)
+{
+    // FNV-1a, the template is a handful of bytes
+    const uint8_t *p = (const uint8_t *)t;
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < sizeof(*t); i++) {
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+static bool grow_slots(air_archive_writer_t *w)
+{
+    size_t cap = w->slots ? (w->slot_mask + 1) * 2 : 1024;
+    uint32_t *slots = (uint32_t *)malloc(cap * sizeof(*slots));
+    if (!slots) {
+        return false;
+    }
+    memset(slots, 0xff, cap * sizeof(*slots));
+    for (size_t i = 0; i < w->ntemplates; i++) {
+        size_t s = hash_template(&w->templates[i]) & (cap - 1);
+        while (slots[s] != UINT32_MAX) {
+            s = (s + 1) & (cap - 1);
+        }
+        slots[s] = (uint32_t)i;
+    }
+    free(w->slots);
+    w->slots = slots;
+    w->slot_mask = cap - 1;
+    return true;
+}
+
+// the dictionary id of `t`, added if it's new. UINT32_MAX when out of
+// memory
+static uint32_t template_id(air_archive_writer_t *w, const air_template_t *t)
+{
+    if (!w->slots || (w->ntemplates + 1) * 2 > w->slot_mask + 1) {
+        if (!grow_slots(w)) {
+            return UINT32_MAX;
+        }
+    }
+    size_t s = hash_template(t) & w->slot_mask;
+    while (w->slots[s] != UINT32_MAX) {
+        uint32_t id = w->slots[s];
+        if (!memcmp(&w->templates[id], t, sizeof(*t))) {
+            return id;
+        }
+        s = (s + 1) & w->slot_mask;
+    }
+
+    if (w->ntemplates == w->templates_cap) {
+        size_t cap = w->templates_cap ? w->templates_cap * 2 : 1024;
+        air_template_t *templates = (air_template_t *)realloc(
+            w->templates, cap * sizeof(*templates));
+        if (!templates) {
+            return UINT32_MAX;
+        }
+        w->templates = templates;
+        w->templates_cap = cap;
+    }
+    uint32_t id = (uint32_t)w->ntemplates++;
+    w->templates[id] = *t;
+    w->slots[s] = id;
+    return id;
+}
+
+// remembers the first error. always false
+static bool fail(air_archive_writer_t *w, int err)
+{
+    if (!w->err) {
+        w->err = err ? err : EIO;
+    }
+    return false;
+}
+
+static bool write_bytes(air_archive_writer_t *w, const void *p, size_t n)
+{
+    if (n && fwrite(p, 1, n, w->f) != n) {
+        return fail(w, errno);
+    }
+    w->written += n;
+    return true;
+}
+
+// pads the file to a multiple of 8 so the tables after it map aligned
+static bool write_align(air_archive_writer_t *w)
+{
+    static const uint8_t zeros[8];
+    return write_bytes(w, zeros, (8 - w->written % 8) % 8);
+}
+
+static bool flush_block(air_archive_writer_t *w)
+{
+    if (!w->in_block) {
+        return true;
+    }
+    if (w->nblocks == w->blocks_cap) {
+        size_t cap = w->blocks_cap ? w->blocks_cap * 2 : 64;
+        air_archive_block_t *blocks = (air_archive_block_t *)realloc(
+            w->blocks, cap * sizeof(*blocks));
+        if (!blocks) {
+            return fail(w, ENOMEM);
+        }
+        w->blocks = blocks;
+        w->blocks_cap = cap;
+    }
+    air_archive_block_t *b = &w->blocks[w->nblocks++];
+    b->file_offset = w->written;
+    b->bytes = w->len;
+    b->first = w->count - w->in_block;
+    b->count = w->in_block;
+    b->base = w->block_base;
+
+    w->len = 0;
+    w->in_block = 0;
+    w->block_base = w->end;
+    return write_bytes(w, w->buf, b->bytes);
+}
+
+bool air_archive_writer_open(
+    air_archive_writer_t *w, const char *path, size_t block_instrs)
+{
+    memset(w, 0, sizeof(*w));
+    w->block_instrs = block_instrs ? block_instrs : AIR_ARCHIVE_BLOCK_INSTRS;
+    w->f = fopen(path, "wb");
+    if (!w->f) {
+        return fail(w, errno);
+    }
+    air_archive_header_t hdr = {AIR_ARCHIVE_MAGIC, AIR_ARCHIVE_VERSION};
+    return write_bytes(w, &hdr, sizeof(hdr));
+}
+
+bool air_archive_writer_add(air_archive_writer_t *w, const air_instr_t *instr)
+{
+    if (w->err) {
+        return false;
+    }
+    air_template_t t;
+    make_template(instr, &t);
+    uint32_t id = template_id(w, &t);
+
+    // the longest instruction record: id, gap, two values and the imm8
+    size_t need = w->len + 4 * VARINT_MAX + 1;
+    if (need > w->cap) {
+        size_t cap = w->cap ? w->cap * 2 : 64 * 1024;
+        uint8_t *buf = (uint8_t *)realloc(w->buf, cap);
+        if (!buf) {
+            return fail(w, ENOMEM);
+        }
+        w->buf = buf;
+        w->cap = cap;
+    }
+    if (id == UINT32_MAX) {
+        return fail(w, ENOMEM);
+    }
+
+    uint8_t *p = w->buf + w->len;
+    int64_t gap = (int64_t)(instr->offset - w->end);
+    p = put_varint(p, (uint64_t)id << 1 | (gap != 0));
+    if (gap) {
+        p = put_varint(p, zigzag(gap));
+    }
+    const air_operand_t *ops[2] = {
+        &instr->ops.binary.dst, &instr->ops.binary.src};
+    for (unsigned i = 0; i < 2; i++) {
+        switch (t.ops[i][0]) {
+        case OPERAND_MEM:
+            p = put_varint(p, zigzag(ops[i]->mem.disp));
+            break;
+        case OPERAND_IMM:
+            p = put_varint(p, zigzag(ops[i]->imm.value));
+            break;
+        case OPERAND_REL:
+            p = put_varint(p, zigzag(ops[i]->rel.disp));
+            break;
+        default:
+            break;
+        }
+    }
+    if (t.flags & AIR_TEMPLATE_IMM8) {
+        *p++ = instr->imm;
+    }
+    w->len = (size_t)(p - w->buf);
+    w->end = instr->offset + instr->length;
+    w->count++;
+
+    if (++w->in_block == w->block_instrs) {
+        return flush_block(w);
+    }
+    return true;
+}
+
+bool air_archive_writer_add_list(
+    air_archive_writer_t *w, const air_instr_list_t *list)
+{
+    air_instr_iter_t it;
+    air_instr_iter_init(&it, list);
+    const air_instr_t *run;
+    size_t n;
+    bool ok = true;
+    while (ok && (run = air_instr_iter_next(&it, &n))) {
+        for (size_t i = 0; ok && i < n; i++) {
+            ok = air_archive_writer_add(w, &run[i]);
+        }
+    }
+    if (it.failed) {
+        ok = fail(w, EIO);
+    }
+    air_instr_iter_done(&it);
+    return ok;
+}
+
+bool air_archive_writer_close(air_archive_writer_t *w)
+{
+    bool ok = !w->err && flush_block(w) && write_align(w);
+
+    air_archive_trailer_t tr;
+    memset(&tr, 0, sizeof(tr));
+    tr.magic = AIR_ARCHIVE_MAGIC;
+    tr.version = AIR_ARCHIVE_VERSION;
+    tr.count = w->count;
+    tr.templates = w->ntemplates;
+    tr.blocks = w->nblocks;
+    tr.block_instrs = w->block_instrs;
+    tr.dict_offset = w->written;
+    ok = ok &&
+         write_bytes(w, w->templates, w->ntemplates * sizeof(*w->templates)) &&
+         write_align(w);
+    tr.index_offset = w->written;
+    ok = ok && write_bytes(w, w->blocks, w->nblocks * sizeof(*w->blocks)) &&
+         write_bytes(w, &tr, sizeof(tr));
+
+    if (w->f && fclose(w->f) != 0) {
+        ok = fail(w, errno);
+    }
+    int err = w->err;
+    free(w->buf);
+    free(w->templates);
+    free(w->slots);
+    free(w->blocks);
+    memset(w, 0, sizeof(*w));
+    errno = err;
+    return ok;
+}
+
+static bool valid_size(uint8_t size)
+{
+    return size <= OPERAND_SIZE_256; // reg_size_t has the same values
+}
+
+static bool valid_reg(uint8_t id, uint8_t size)
+{
+    if (!valid_size(size)) {
+        return false;
+    }
+    // ah..bh only exist as byte registers
+    return id <= REG_R15 || (id >= REG_AH && id <= REG_BH &&
+                                size == REG_SIZE_8);
+}
+
+static bool valid_operand(const uint8_t *o)
+{
+    switch (o[0]) {
+    case OPERAND_REG:
+        return valid_reg(o[1], o[2]);
+    case OPERAND_MEM:
+        return (o[1] <= REG_IP || o[1] == REG_NONE) &&
+               (o[2] <= REG_R15 || o[2] == REG_NONE) &&
+               (o[3] == FACTOR_1 || o[3] == FACTOR_2 || o[3] == FACTOR_4 ||
+                   o[3] == FACTOR_8) &&
+               o[4] <= ADDR_SIZE_64 &&
+               valid_size(o[5]) && (o[6] <= SEG_GS || o[6] == SEG_NONE);
+    case OPERAND_IMM:
+        return valid_size(o[1]);
+    case OPERAND_REL:
+    case OPERAND_NONE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// the dictionary comes from the file like everything else, and its
+// fields index name tables once printed
+static bool valid_template(const air_template_t *t)
+{
+    if ((t->type > AIR_EXT && t->type != AIR_UNKNOWN) || t->length == 0 ||
+        t->length > DISASM_MAX_INSTR_LEN || t->flags & ~AIR_TEMPLATE_IMM8) {
+        return false;
+    }
+    if (t->type == AIR_EXT) {
+        unsigned id = AIR_EXT_ID(t->ext);
+        if (!(id < EXT_NAMED || (id >= EXT_RAW_FIRST && id < EXT_IDS)) ||
+            (t->vsrc > REG_R15 && t->vsrc != REG_NONE)) {
+            return false;
+        }
+    }
+    else if (t->ext || t->vsrc != REG_NONE || t->flags) {
+        return false;
+    }
+    return valid_operand(t->ops[0]) && valid_operand(t->ops[1]);
+}
+
+static bool fail_open(air_archive_t *ar, int err)
+{
+    air_archive_close(ar);
+    errno = err;
+    return false;
+}
+
+bool air_archive_open(air_archive_t *ar, const char *path)
+{
+    memset(ar, 0, sizeof(*ar));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) < 0) {
+        int err = errno;
+        close(fd);
+        return fail_open(ar, err);
+    }
+    size_t len = (size_t)sb.st_size;
+    if (len < sizeof(air_archive_header_t) + sizeof(air_archive_trailer_t)) {
+        close(fd);
+        return fail_open(ar, EINVAL);
+    }
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    int err = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        return fail_open(ar, err);
+    }
+    ar->map = (const uint8_t *)map;
+    ar->len = len;
+
+    const air_archive_header_t *hdr = (const air_archive_header_t *)ar->map;
+    air_archive_trailer_t tr;
+    memcpy(&tr, ar->map + len - sizeof(tr), sizeof(tr));
+    size_t tables_end = len - sizeof(tr);
+    if (hdr->magic != AIR_ARCHIVE_MAGIC ||
+        hdr->version != AIR_ARCHIVE_VERSION ||
+        tr.magic != AIR_ARCHIVE_MAGIC || tr.version != AIR_ARCHIVE_VERSION ||
+        tr.dict_offset % 8 || tr.index_offset % 8 ||
+        tr.templates > UINT32_MAX || tr.dict_offset > tables_end ||
+        tr.templates > (tables_end - tr.dict_offset) / sizeof(air_template_t) ||
+        tr.index_offset > tables_end ||
+        tr.blocks > (tables_end - tr.index_offset) /
+                        sizeof(air_archive_block_t)) {
+        return fail_open(ar, EINVAL);
+    }
+    ar->templates = (const air_template_t *)(ar->map + tr.dict_offset);
+    ar->ntemplates = (size_t)tr.templates;
+    ar->blocks = (const air_archive_block_t *)(ar->map + tr.index_offset);
+    ar->nblocks = (size_t)tr.blocks;
+    ar->count = tr.count;
+    ar->block_instrs = tr.block_instrs;
+
+    for (size_t i = 0; i < ar->ntemplates; i++) {
+        if (!valid_template(&ar->templates[i])) {
+            return fail_open(ar, EINVAL);
+        }
+    }
+
+    // blocks must lie between the header and the dictionary and add up
+    uint64_t first = 0;
+    for (size_t i = 0; i < ar->nblocks; i++) {
+        const air_archive_block_t *b = &ar->blocks[i];
+        if (b->file_offset < sizeof(*hdr) || b->file_offset > tr.dict_offset ||
+            b->bytes > tr.dict_offset - b->file_offset || b->first != first ||
+            b->count > ar->block_instrs) {
+            return fail_open(ar, EINVAL);
+        }
+        first += b->count;
+    }
+    if (first != ar->count) {
+        return fail_open(ar, EINVAL);
+    }
+    return true;
+}
+
+void air_archive_close(air_archive_t *ar)
+{
+    if (ar->map) {
+        munmap((void *)ar->map, ar->len);
+    }
+    memset(ar, 0, sizeof(*ar));
+}
+
+static void expand_operand(const uint8_t *o, air_operand_t *op)
+{
+    memset(op, 0, sizeof(*op));
+    op->type = (air_operand_type_t)o[0];
+    switch (o[0]) {
+    case OPERAND_REG:
+        op->reg.id = (reg_id_t)o[1];
+        op->reg.size = (reg_size_t)o[2];
+        break;
+    case OPERAND_MEM:
+        op->mem.base = (reg_id_t)o[1];
+        op->mem.index = (reg_id_t)o[2];
+        op->mem.factor = (scale_factor_t)o[3];
+        op->mem.size = (addr_size_t)o[4];
+        op->mem.op_size = (operand_size_t)o[5];
+        op->mem.segment = (seg_id_t)o[6];
+        break;
+    case OPERAND_IMM:
+        op->imm.size = (operand_size_t)o[1];
+        break;
+    default:
+        break;
+    }
+}
+
+bool air_archive_read_block(
+    const air_archive_t *ar, size_t i, air_instr_t *out)
+{
+    const air_archive_block_t *b = &ar->blocks[i];
+    const uint8_t *p = ar->map + b->file_offset;
+    const uint8_t *end = p + b->bytes;
+    uint64_t pos = b->base;
+
+    for (uint64_t n = 0; n < b->count; n++) {
+        uint64_t head;
+        if (!(p = get_varint(p, end, &head)) || head >> 1 >= ar->ntemplates) {
+            return false;
+        }
+        const air_template_t *t = &ar->templates[head >> 1];
+        if (head & 1) {
+            uint64_t gap;
+            if (!(p = get_varint(p, end, &gap))) {
+                return false;
+            }
+            pos += (uint64_t)unzigzag(gap);
+        }
+
+        air_instr_t *instr = &out[n];
+        instr->type = (air_instr_type_t)t->type;
+        instr->ext = t->ext;
+        instr->vsrc = t->vsrc;
+        instr->imm = 0;
+        instr->length = t->length;
+        instr->offset = (size_t)pos;
+        instr->next = NULL;
+        air_operand_t *ops[2] = {
+            &instr->ops.binary.dst, &instr->ops.binary.src};
+        for (unsigned s = 0; s < 2; s++) {
+            expand_operand(t->ops[s], ops[s]);
+            uint64_t v;
+            switch (t->ops[s][0]) {
+            case OPERAND_MEM:
+            case OPERAND_IMM:
+            case OPERAND_REL:
+                if (!(p = get_varint(p, end, &v))) {
+                    return false;
+                }
+                break;
+            default:
+                continue;
+            }
+            if (t->ops[s][0] == OPERAND_MEM) {
+                ops[s]->mem.disp = (int32_t)unzigzag(v);
+            }
+            else if (t->ops[s][0] == OPERAND_IMM) {
+                ops[s]->imm.value = unzigzag(v);
+            }
+            else {
+                ops[s]->rel.disp = (int32_t)unzigzag(v);
+            }
+        }
+        if (t->flags & AIR_TEMPLATE_IMM8) {
+            if (p == end) {
+                return false;
+            }
+            instr->imm = *p++;
+        }
+        pos += t->length;
+    }
+    return true;
+}
+
+typedef struct {
+    const air_archive_t *ar;
+    size_t block;
+    air_instr_t *out;
+    bool ok;
+} read_task_t;
+
+static void read_task(void *arg)
+{
+    read_task_t *task = (read_task_t *)arg;
+    task->ok = air_archive_read_block(task->ar, task->block, task->out);
+}
+
+bool air_archive_read(
+    const air_archive_t *ar, unsigned threads, air_instr_list_t *out)
+{
+    size_t count = (size_t)ar->count;
+    air_instr_t *instrs =
+        (air_instr_t *)malloc((count ? count : 1) * sizeof(*instrs));
+    size_t nblocks = ar->nblocks ? ar->nblocks : 1;
+    read_task_t *tasks = (read_task_t *)malloc(nblocks * sizeof(*tasks));
+    pool_t *pool = instrs && tasks ? pool_new(threads) : NULL;
+    bool ok = pool != NULL;
+    for (size_t i = 0; ok && i < ar->nblocks; i++) {
+        tasks[i].ar = ar;
+        tasks[i].block = i;
+        tasks[i].out = instrs + ar->blocks[i].first;
+        tasks[i].ok = false;
+        ok = pool_submit(pool, read_task, &tasks[i]);
+    }
+    if (pool) {
+        pool_free(pool);
+    }
+    for (size_t i = 0; ok && i < ar->nblocks; i++) {
+        ok = tasks[i].ok;
+    }
+
+    ok = ok && air_instr_list_reserve(out, count);
+    for (size_t i = 0; ok && i < count; i++) {
+        air_instr_t *instr = air_instr_list_get_new(out);
+        if (!instr) {
+            ok = false;
+            break;
+        }
+        *instr = instrs[i];
+    }
+    free(instrs);
+    free(tasks);
+    return ok;
+}
+
+size_t air_archive_find(const air_archive_t *ar, uint64_t offset)
+{
+    // the last block starting at or before `offset`
+    size_t lo = 0;
+    size_t hi = ar->nblocks;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ar->blocks[mid].base <= offset) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo ? lo - 1 : 0;
+}
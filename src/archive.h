@@ -0,0 +1,131 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "air.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * compact long-term storage of decoded instructions. every instruction is
+ * split into a template (type, registers, sizes, addressing form, length)
+ * kept once in a dictionary, and the values that vary between copies of
+ * it: the gap to the previous instruction, displacements and immediates,
+ * written as LEB128 varints.
+ *
+ * file layout, native byte order:
+ *
+ *   header   magic, version
+ *   blocks   up to `block_instrs` instructions each, decodable on their
+ *            own given the dictionary
+ *   dict     air_template_t[templates]
+ *   index    air_archive_block_t[blocks]
+ *   trailer  air_archive_trailer_t, at the very end
+ *
+ * an instruction in a block is varint(template << 1 | moved), then
+ * zigzag varint(offset - end of the previous instruction) if `moved`, then
+ * the displacement or immediate of each operand that has one (zigzag
+ * varints) and the imm8 byte when the template says so
+ */
+
+#define AIR_ARCHIVE_MAGIC 0x41524941 // "AIRA"
+#define AIR_ARCHIVE_VERSION 2
+#define AIR_ARCHIVE_BLOCK_INSTRS 16384
+
+#define AIR_TEMPLATE_IMM8 0x01 // the instruction has a nonzero imm8
+
+// an instruction without its offset and variable values. operand slot 0
+// is the destination or only operand, slot 1 the source. each slot is
+// the operand type, then reg id and size, or base, index, factor,
+// address size, operand size and segment, or the immediate's size
+typedef struct {
+    uint8_t type;
+    uint8_t length;
+    uint8_t vsrc;
+    uint8_t flags;
+    uint16_t ext;
+    uint8_t ops[2][8];
+    uint8_t pad[2];
+} air_template_t;
+
+typedef struct {
+    uint64_t file_offset;
+    uint64_t bytes;
+    uint64_t first; // index of the block's first instruction
+    uint64_t count;
+    uint64_t base; // end of the instruction before the block
+} air_archive_block_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count; // instructions
+    uint64_t templates;
+    uint64_t blocks;
+    uint64_t dict_offset;
+    uint64_t index_offset;
+    uint64_t block_instrs;
+} air_archive_trailer_t;
+
+typedef struct {
+    FILE *f;
+    uint64_t written; // bytes in the file so far
+    size_t block_instrs;
+    // the block being filled
+    uint8_t *buf;
+    size_t len;
+    size_t cap;
+    size_t in_block;
+    uint64_t block_base;
+    uint64_t end; // end of the last instruction added
+    uint64_t count;
+    air_template_t *templates;
+    size_t ntemplates;
+    size_t templates_cap;
+    uint32_t *slots; // open addressing over `templates`
+    size_t slot_mask;
+    air_archive_block_t *blocks;
+    size_t nblocks;
+    size_t blocks_cap;
+    int err; // the first error, 0 while all is well
+} air_archive_writer_t;
+
+// starts an archive at `path`. 0 for the default block size
+bool air_archive_writer_open(
+    air_archive_writer_t *w, const char *path, size_t block_instrs);
+bool air_archive_writer_add(air_archive_writer_t *w, const air_instr_t *instr);
+bool air_archive_writer_add_list(
+    air_archive_writer_t *w, const air_instr_list_t *list);
+// writes the last block, the dictionary and the index. false if anything
+// failed on the way, errno tells what
+bool air_archive_writer_close(air_archive_writer_t *w);
+
+typedef struct {
+    const uint8_t *map;
+    size_t len;
+    const air_template_t *templates;
+    size_t ntemplates;
+    const air_archive_block_t *blocks;
+    size_t nblocks;
+    uint64_t count;
+    uint64_t block_instrs;
+} air_archive_t;
+
+// maps the archive at `path` and checks its layout and dictionary. false
+// with errno set, EINVAL when it isn't a readable archive
+bool air_archive_open(air_archive_t *ar, const char *path);
+void air_archive_close(air_archive_t *ar);
+
+// decodes block `i` into `out`, which holds blocks[i].count instructions.
+// false when the block is corrupt
+bool air_archive_read_block(
+    const air_archive_t *ar, size_t i, air_instr_t *out);
+// decodes every block on `threads` workers and appends them to `out`
+bool air_archive_read(
+    const air_archive_t *ar, unsigned threads, air_instr_list_t *out);
+// the block to start reading at for the first instruction at or after
+// `offset`, in archives of instructions in offset order. 0 when empty
+size_t air_archive_find(const air_archive_t *ar, uint64_t offset);
+
+#endif // ARCHIVE_H
@@ -0,0 +1,216 @@
+#include "classify.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define WINDOW (CLASSIFY_BLOCK * CLASSIFY_WINDOW_BLOCKS)
+
+// a window is data below this many opcode-like bytes, or below twice as
+// many when its byte values are spread out like compressed data
+#define CODE_MIN 18
+// sum of squared byte counts: 256 random bytes give about 511, code stays
+// well above 1000
+#define SQUARES_MAX 600
+#define ZEROS_MAX 160
+#define ASCII_MAX 210
+
+typedef struct {
+    unsigned zeros;
+    unsigned ascii; // printable, tab and newline
+    unsigned code;  // bytes that open or often follow x86-64 opcodes
+} block_counts_t;
+
+#ifdef __SSE2__
+// bytes of `v` in [lo, hi], unsigned
+static inline __m128i in_range(__m128i v, uint8_t lo, uint8_t hi)
+{
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8((char)lo));
+    __m128i span = _mm_set1_epi8((char)(hi - lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, span), d);
+}
+
+static inline __m128i eq(__m128i v, uint8_t b)
+{
+    return _mm_cmpeq_epi8(v, _mm_set1_epi8((char)b));
+}
+
+static inline unsigned sum_bytes(__m128i acc)
+{
+    __m128i s = _mm_sad_epu8(acc, _mm_setzero_si128());
+    return (unsigned)(_mm_cvtsi128_si32(s) +
+                      _mm_cvtsi128_si32(_mm_srli_si128(s, 8)));
+}
+
+static void count_block(const uint8_t *p, block_counts_t *out)
+{
+    __m128i zeros = _mm_setzero_si128();
+    __m128i ascii = _mm_setzero_si128();
+    __m128i code = _mm_setzero_si128();
+    for (int i = 0; i < CLASSIFY_BLOCK; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        // compares give 0xff, so subtracting counts one per match
+        zeros = _mm_sub_epi8(zeros, eq(v, 0));
+        ascii = _mm_sub_epi8(ascii,
+            _mm_or_si128(in_range(v, 0x20, 0x7e),
+                _mm_or_si128(eq(v, '\t'), eq(v, '\n'))));
+        // REX.W and its neighbours, mov and lea, then single opcodes
+        __m128i c =
+            _mm_or_si128(in_range(v, 0x48, 0x4f), in_range(v, 0x88, 0x8f));
+        c = _mm_or_si128(c, _mm_or_si128(eq(v, 0x0f), eq(v, 0x83)));
+        c = _mm_or_si128(c, _mm_or_si128(eq(v, 0x85), eq(v, 0xc3)));
+        c = _mm_or_si128(c, _mm_or_si128(eq(v, 0xc7), eq(v, 0xe8)));
+        c = _mm_or_si128(c, _mm_or_si128(eq(v, 0xe9), eq(v, 0xff)));
+        code = _mm_sub_epi8(code, c);
+    }
+    out->zeros = sum_bytes(zeros);
+    out->ascii = sum_bytes(ascii);
+    out->code = sum_bytes(code);
+}
+#else
+static void count_block(const uint8_t *p, block_counts_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < CLASSIFY_BLOCK; i++) {
+        uint8_t b = p[i];
+        out->zeros += b == 0;
+        out->ascii += (b >= 0x20 && b <= 0x7e) || b == '\t' || b == '\n';
+        out->code += (b >= 0x48 && b <= 0x4f) || (b >= 0x88 && b <= 0x8f) ||
+                     b == 0x0f || b == 0x83 || b == 0x85 || b == 0xc3 ||
+                     b == 0xc7 || b == 0xe8 || b == 0xe9 || b == 0xff;
+    }
+}
+#endif
+
+void data_ranges_init(data_ranges_t *ranges)
+{
+    memset(ranges, 0, sizeof(*ranges));
+}
+
+void data_ranges_destroy(data_ranges_t *ranges)
+{
+    free(ranges->items);
+    free(ranges->windows);
+    memset(ranges, 0, sizeof(*ranges));
+}
+
+static bool push_range(data_ranges_t *out, size_t start, size_t end)
+{
+    if (out->count == out->capacity) {
+        size_t cap = out->capacity ? out->capacity * 2 : 16;
+        data_range_t *items =
+            (data_range_t *)realloc(out->items, cap * sizeof(*items));
+        if (!items) {
+            return false;
+        }
+        out->items = items;
+        out->capacity = cap;
+    }
+    out->items[out->count].start = start;
+    out->items[out->count].end = end;
+    out->count++;
+    return true;
+}
+
+// sum of the squared byte counts of a window: a collision entropy, low
+// when a few byte values dominate
+static unsigned window_squares(const uint8_t *p)
+{
+    uint16_t hist[256];
+    memset(hist, 0, sizeof(hist));
+    unsigned squares = 0;
+    for (int i = 0; i < WINDOW; i++) {
+        squares += 2u * hist[p[i]]++ + 1;
+    }
+    return squares;
+}
+
+// flags each window whose counts look like data. the histogram is only
+// built for the few windows the cheap counts leave undecided, so code
+// costs little more than the SIMD counting
+static void score_windows(const uint8_t *buf, size_t blocks, uint8_t *flags)
+{
+    block_counts_t ring[CLASSIFY_WINDOW_BLOCKS];
+    block_counts_t win = {0, 0, 0};
+
+    for (size_t b = 0; b < blocks; b++) {
+        block_counts_t *slot = &ring[b % CLASSIFY_WINDOW_BLOCKS];
+        if (b >= CLASSIFY_WINDOW_BLOCKS) { // the block sliding out
+            win.zeros -= slot->zeros;
+            win.ascii -= slot->ascii;
+            win.code -= slot->code;
+        }
+        count_block(buf + b * CLASSIFY_BLOCK, slot);
+        win.zeros += slot->zeros;
+        win.ascii += slot->ascii;
+        win.code += slot->code;
+
+        if (b + 1 < CLASSIFY_WINDOW_BLOCKS) {
+            continue;
+        }
+        size_t w = b + 1 - CLASSIFY_WINDOW_BLOCKS;
+        bool data = win.code < CODE_MIN || win.zeros > ZEROS_MAX ||
+                    win.ascii > ASCII_MAX;
+        if (!data && win.code < 2 * CODE_MIN) {
+            data = window_squares(buf + w * CLASSIFY_BLOCK) < SQUARES_MAX;
+        }
+        flags[w] = data;
+    }
+}
+
+bool classify_data(const uint8_t *buf, size_t len, data_ranges_t *out)
+{
+    out->count = 0;
+    size_t blocks = len / CLASSIFY_BLOCK;
+    if (blocks < CLASSIFY_WINDOW_BLOCKS) {
+        return true;
+    }
+    size_t windows = blocks - CLASSIFY_WINDOW_BLOCKS + 1;
+    if (windows > out->windows_cap) {
+        uint8_t *w = (uint8_t *)realloc(out->windows, windows);
+        if (!w) {
+            return false;
+        }
+        out->windows = w;
+        out->windows_cap = windows;
+    }
+    score_windows(buf, blocks, out->windows);
+    // one window that happens to look like code doesn't split data
+    for (size_t w = 1; w + 1 < windows; w++) {
+        if (!out->windows[w] && out->windows[w - 1] && out->windows[w + 1]) {
+            out->windows[w] = 1;
+        }
+    }
+
+    // block b lies in windows b-3 .. b, clipped to the ones that exist
+    size_t run = 0;   // data windows ending at the last one looked at
+    size_t start = 0; // first block of the current data run
+    bool in_data = false;
+    for (size_t b = 0; b < blocks; b++) {
+        size_t last = b < windows ? b : windows - 1;
+        size_t first = b >= CLASSIFY_WINDOW_BLOCKS - 1
+                           ? b - (CLASSIFY_WINDOW_BLOCKS - 1)
+                           : 0;
+        if (b < windows) {
+            run = out->windows[b] ? run + 1 : 0;
+        }
+        bool data = run >= last - first + 1;
+
+        if (data && !in_data) {
+            start = b;
+        }
+        else if (!data && in_data && b - start >= CLASSIFY_MIN_BLOCKS &&
+                 !push_range(out, start * CLASSIFY_BLOCK,
+                     b * CLASSIFY_BLOCK)) {
+            return false;
+        }
+        in_data = data;
+    }
+    // a run reaching the last block takes the bytes after it along
+    if (in_data && blocks - start >= CLASSIFY_MIN_BLOCKS &&
+        !push_range(out, start * CLASSIFY_BLOCK, len)) {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// bytes are scored in blocks, and each block by the windows covering it
+#define CLASSIFY_BLOCK 64
+#define CLASSIFY_WINDOW_BLOCKS 4
+// the shortest run of blocks reported as data
+#define CLASSIFY_MIN_BLOCKS 4
+
+typedef struct {
+    size_t start;
+    size_t end;
+} data_range_t;
+
+// the likely-data ranges of a buffer, in order and not touching
+typedef struct data_ranges_s {
+    data_range_t *items;
+    size_t count;
+    size_t capacity;
+    uint8_t *windows; // scratch, one flag per window
+    size_t windows_cap;
+} data_ranges_t;
+
+void data_ranges_init(data_ranges_t *ranges);
+void data_ranges_destroy(data_ranges_t *ranges);
+
+/*
+ * finds the stretches of `buf` that are unlikely to be code: tables and
+ * constant pools (few opcode bytes, mostly zeros or text) and compressed
+ * or random blobs (high entropy). every 256-byte window sliding by a
+ * block is scored, and a block is data when all windows over it are.
+ * replaces what `out` held. false when out of memory
+ */
+bool classify_data(const uint8_t *buf, size_t len, data_ranges_t *out);
+
+#endif // CLASSIFY_H
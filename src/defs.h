@@ -27,6 +27,9 @@ typedef enum {
     REG_SIZE_16 = 0,
     REG_SIZE_32 = 1,
     REG_SIZE_64 = 2,
+    REG_SIZE_8 = 3,
+    REG_SIZE_128 = 4, // xmm
+    REG_SIZE_256 = 5, // ymm
 } reg_size_t;
 
 typedef enum {
@@ -42,6 +45,9 @@ typedef enum {
     OPERAND_SIZE_16 = 0,
     OPERAND_SIZE_32 = 1,
     OPERAND_SIZE_64 = 2,
+    OPERAND_SIZE_8 = 3,
+    OPERAND_SIZE_128 = 4,
+    OPERAND_SIZE_256 = 5,
 } operand_size_t;
 
 typedef enum {
@@ -50,6 +56,10 @@ typedef enum {
     INSTR_POP_SEG,
     INSTR_POP_RM,
     INSTR_MOV_RM_R,
+    INSTR_CALL_REL,
+    INSTR_JMP_REL,
+    INSTR_ESC_0F, // two-byte opcodes
+    INSTR_VEX,
 
     INSTR_NONE = 0xff,
 } instr_type_t;
@@ -72,6 +82,11 @@ typedef enum {
     REG_R14,
     REG_R15,
     REG_IP, // on actual hardware, IP doesn't have an id
+    // byte registers 4-7 without a REX prefix, only with REG_SIZE_8
+    REG_AH,
+    REG_CH,
+    REG_DH,
+    REG_BH,
 
     REG_NONE = 0xff,
 } reg_id_t;
@@ -1,10 +1,13 @@
 #include "disasm.h"
 #include "air.h"
+#include "classify.h"
 #include "defs.h"
+#include "maps.h"
 #include "modrm.h"
 #include "optable.h"
 #include "prefix.h"
 #include "sib.h"
+#include "stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,28 +34,27 @@ reg_size_t get_reg_size(disasm_ctx_t *ctx, reg_size_t default_size)
     return (reg_size_t)get_operand_size(ctx, (operand_size_t)default_size);
 }
 
+static inline const struct prefix_variant *variant(const disasm_ctx_t *ctx)
+{
+    return &prefix_variants[ctx->variant];
+}
+
 // extend register with REX.R bit (ModR/M.reg field)
 static inline void extend_reg_with_rex_r(disasm_ctx_t *ctx, uint8_t *reg)
 {
-    if (ctx->has_rex && ctx->rex.r) {
-        *reg += 8;
-    }
+    *reg += variant(ctx)->r_ext;
 }
 
 // extend register with REX.B bit (ModR/M.rm field)
 static inline void extend_reg_with_rex_b(disasm_ctx_t *ctx, uint8_t *reg)
 {
-    if (ctx->has_rex && ctx->rex.b) {
-        *reg += 8;
-    }
+    *reg += variant(ctx)->b_ext;
 }
 
 // extend register with REX.X bit (SIB.index field)
 static inline void extend_reg_with_rex_x(disasm_ctx_t *ctx, uint8_t *reg)
 {
-    if (ctx->has_rex && ctx->rex.x) {
-        *reg += 8;
-    }
+    *reg += variant(ctx)->x_ext;
 }
 
 void disasm_parse_prefixes(disasm_ctx_t *ctx)
@@ -64,6 +66,7 @@ void disasm_parse_prefixes(disasm_ctx_t *ctx)
         case 0x40 ... 0x4f: { // REX
             if (rex_extract(byte, &ctx->rex)) {
                 ctx->has_rex = true;
+                ctx->variant = (ctx->variant & ~0xf) | (byte & 0xf);
                 ctx->current++;
                 continue;
             }
@@ -116,11 +119,13 @@ void disasm_parse_prefixes(disasm_ctx_t *ctx)
         }
         case PREFIX_OP_SIZE_OVERRIDE: {
             SET_FLAG(ctx->prefixes, INSTR_PREFIX_OP);
+            ctx->variant |= PREFIX_VARIANT_OP;
             ctx->current++;
             continue;
         }
         case PREFIX_ADDR_SIZE_OVERRIDE: {
             SET_FLAG(ctx->prefixes, INSTR_PREFIX_ADDR_SIZE);
+            ctx->variant |= PREFIX_VARIANT_ADDR;
             ctx->current++;
             continue;
         }
@@ -134,6 +139,8 @@ static inline void reset_ctx(disasm_ctx_t *ctx)
 {
     ctx->has_rex = false;
     ctx->prefixes = 0;
+    ctx->variant = 0;
+    ctx->map = 0;
 }
 
 static inline void init_reg_operand(
@@ -158,11 +165,16 @@ static inline void init_mem_operand(air_operand_t *op, reg_id_t base,
     op->mem.segment = seg;
 }
 
+static inline bool fail(disasm_ctx_t *ctx, disasm_err_t err)
+{
+    ctx->err = err;
+    return false;
+}
+
 static int8_t get_disp8(disasm_ctx_t *ctx)
 {
     int8_t disp;
     memcpy(&disp, ctx->current, 1);
-    ctx->current += 1;
     return disp;
 }
 
@@ -170,175 +182,125 @@ static int32_t get_disp32(disasm_ctx_t *ctx)
 {
     int32_t disp;
     memcpy(&disp, ctx->current, 4);
-    ctx->current += 4;
     return disp;
 }
 
-static bool handle_sib_operand(disasm_ctx_t *ctx, struct modrm *mod,
-    air_operand_t *mem_op, addr_size_t addr_size, operand_size_t op_size)
+static inline uint64_t load_u64(const uint8_t *p)
 {
-    if (!check_bounds(ctx, 1)) {
-        printf("no sib byte\n");
-        return false;
-    }
-
-    struct sib s;
-    sib_extract(*ctx->current++, &s);
-    extend_reg_with_rex_x(ctx, &s.index);
-    extend_reg_with_rex_b(ctx, &s.base);
-
-    reg_id_t base_reg = s.base;
-    reg_id_t index_reg = (s.index == REG_SP) ? REG_NONE : s.index;
-    int32_t disp = 0;
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
 
-    if (mod->mod == 0) {
-        if (s.base == REG_BP || s.base == REG_R13) {
-            if (!check_bounds(ctx, 4)) {
-                printf("not enough bytes for 4byte disp\n");
-                return false;
-            }
+/*
+ * every handler below takes `fast`, which is always a constant. on the fast
+ * path at least DISASM_MAX_INSTR_LEN bytes follow the opcode, so bounds
+ * checks fold away and the bytes after ModR/M come from one 8-byte load in
+ * `raw`. the checked path reads field by field
+ */
 
-            disp = get_disp32(ctx);
-            base_reg = REG_NONE;
-        }
-    }
-    else if (mod->mod == 1) {
-        if (!check_bounds(ctx, 1)) {
-            printf("not enough bytes for 1byte disp\n");
-            return false;
-        }
-        disp = get_disp8(ctx);
+// takes a displacement starting `skip` bytes into `raw` (fast path) or at
+// ctx->current (checked path)
+static DISASM_INLINE bool take_disp(disasm_ctx_t *ctx, uint64_t raw,
+    unsigned skip, int size, int32_t *disp, bool fast)
+{
+    if (fast) {
+        uint64_t v = raw >> (skip * 8);
+        *disp = size == 1 ? (int8_t)v : (int32_t)v;
     }
-    else if (mod->mod == 2) {
-        if (!check_bounds(ctx, 4)) {
-            printf("not enough bytes for 4byte disp\n");
-            return false;
+    else {
+        if (!check_bounds(ctx, size)) {
+            return fail(ctx, size == 1 ? DISASM_ERR_NO_DISP8
+                                       : DISASM_ERR_NO_DISP32);
         }
-        disp = get_disp32(ctx);
+        *disp = size == 1 ? get_disp8(ctx) : get_disp32(ctx);
     }
-
-    init_mem_operand(mem_op, base_reg, index_reg, s.factor, disp, addr_size,
-        SEG_NONE, op_size);
+    ctx->current += size;
     return true;
 }
 
-static bool handle_memory_operand(disasm_ctx_t *ctx, struct modrm *mod,
-    air_operand_t *mem_op, operand_size_t op_size)
+static DISASM_INLINE bool handle_memory_operand(disasm_ctx_t *ctx,
+    const struct modrm *mod, air_operand_t *mem_op, operand_size_t op_size,
+    bool fast)
 {
-    addr_size_t addr_size = get_addr_size(ctx);
+    if (mod->mod == 3) {
+        return fail(ctx, DISASM_ERR_INVALID);
+    }
 
-    if (mod->mod == 0) {
-        switch (mod->rm) {
-        case 0:
-        case 1:
-        case 2:
-        case 3:
-        case 6:
-        case 7: {
-            extend_reg_with_rex_r(ctx, &mod->reg);
-            extend_reg_with_rex_b(ctx, &mod->rm);
-            init_mem_operand(mem_op, mod->rm, REG_NONE, FACTOR_1, 0, addr_size,
-                SEG_NONE, op_size);
-            return true;
-        }
-        case 4: {
-            return handle_sib_operand(ctx, mod, mem_op, addr_size, op_size);
-        }
-        case 5: {
-            if (!check_bounds(ctx, 4)) {
-                printf("not enough bytes for 4byte disp\n");
-                return false;
-            }
+    addr_size_t addr_size = variant(ctx)->addr_size;
+    uint64_t raw = fast ? load_u64(ctx->current) : 0;
 
-            extend_reg_with_rex_r(ctx, &mod->reg);
-            extend_reg_with_rex_b(ctx, &mod->rm);
+    uint8_t base = mod->rm;
+    uint8_t index = REG_NONE;
+    scale_factor_t factor = FACTOR_1;
+    unsigned disp_size = mod->disp_size;
+    unsigned skip = 0;
 
-            int32_t disp = get_disp32(ctx);
-            init_mem_operand(mem_op, REG_IP, REG_NONE, FACTOR_1, disp,
-                addr_size, SEG_NONE, op_size);
-            return true;
+    if (mod->has_sib) {
+        if (!fast && !check_bounds(ctx, 1)) {
+            return fail(ctx, DISASM_ERR_NO_SIB);
         }
-        }
-    }
-
-    if (mod->rm == REG_SP) {
-        return handle_sib_operand(ctx, mod, mem_op, addr_size, op_size);
-    }
 
-    extend_reg_with_rex_r(ctx, &mod->reg);
-    extend_reg_with_rex_b(ctx, &mod->rm);
+        const struct sib *s = &sib_table[fast ? (uint8_t)raw : *ctx->current];
+        ctx->current++;
+        skip = 1;
 
-    int disp_size;
-    int32_t disp = 0;
+        index = s->index;
+        extend_reg_with_rex_x(ctx, &index);
+        if (index == REG_SP) {
+            index = REG_NONE;
+        }
+        factor = s->factor;
 
-    switch (mod->mod) {
-    case 1: {
-        disp_size = 1;
-        break;
+        base = s->base;
+        extend_reg_with_rex_b(ctx, &base);
+        if (mod->mod == 0 && s->mod0_disp32) {
+            base = REG_NONE;
+            disp_size = 4;
+        }
     }
-    case 2: {
-        disp_size = 4;
-        break;
+    else if (mod->rip_relative) {
+        base = REG_IP;
     }
-    default:
-        return false;
+    else {
+        extend_reg_with_rex_b(ctx, &base);
     }
 
-    if (!check_bounds(ctx, disp_size)) {
-        printf("not enough bytes for disp\n");
+    int32_t disp = 0;
+    if (disp_size && !take_disp(ctx, raw, skip, disp_size, &disp, fast)) {
         return false;
     }
 
-    memcpy(&disp, ctx->current, disp_size);
-    ctx->current += disp_size;
-
-    if (disp_size == 1) {
-        disp = (int8_t)disp;
-    }
-
-    init_mem_operand(mem_op, mod->rm, REG_NONE, FACTOR_1, disp, addr_size,
-        SEG_NONE, op_size);
+    init_mem_operand(mem_op, base, index, factor, disp, addr_size, SEG_NONE,
+        op_size);
     return true;
 }
 
-static bool handle_instr_pop_reg(
+static DISASM_INLINE bool handle_instr_pop_reg(
     disasm_ctx_t *ctx, uint8_t opcode, air_instr_t *out)
 {
     uint8_t reg = opcode - 0x58;
     extend_reg_with_rex_b(ctx, &reg);
     out->type = AIR_POP;
     init_reg_operand(
-        &out->ops.unary.operand, reg, get_reg_size(ctx, REG_SIZE_64));
+        &out->ops.unary.operand, reg, (reg_size_t)variant(ctx)->op_size64);
     return true;
 }
 
-static bool handle_instr_pop_seg(
+static inline bool pop_seg(disasm_ctx_t *ctx, air_instr_t *out, seg_id_t seg)
+{
+    out->type = AIR_POP;
+    init_mem_operand(&out->ops.unary.operand, REG_NONE, REG_NONE, FACTOR_1, 0,
+        0, seg, variant(ctx)->op_size);
+    return true;
+}
+
+static DISASM_INLINE bool handle_instr_pop_seg(
     disasm_ctx_t *ctx, uint8_t opcode, air_instr_t *out)
 {
     seg_id_t seg = SEG_NONE;
 
     switch (opcode) {
-    case 0x0f: {
-        if (!check_bounds(ctx, 1)) {
-            printf("no second byte for 2byte pop\n");
-            return false;
-        }
-        switch (*ctx->current++) {
-        case 0xa1: {
-            seg = SEG_FS;
-            break;
-        }
-        case 0xa9: {
-            seg = SEG_GS;
-            break;
-        }
-        default: {
-            printf("pop invalid second byte\n");
-            return false;
-        }
-        }
-        break;
-    }
     case 0x1f: {
         seg = SEG_DS;
         break;
@@ -353,123 +315,937 @@ static bool handle_instr_pop_seg(
     }
     }
 
-    out->type = AIR_POP;
-    init_mem_operand(&out->ops.unary.operand, REG_NONE, REG_NONE, FACTOR_1, 0,
-        0, seg, get_operand_size(ctx, OPERAND_SIZE_NONE));
-    return true;
+    return pop_seg(ctx, out, seg);
 }
 
-static bool handle_instr_pop_rm(disasm_ctx_t *ctx, air_instr_t *out)
+static DISASM_INLINE bool handle_instr_pop_rm(
+    disasm_ctx_t *ctx, air_instr_t *out, bool fast)
 {
-    if (!check_bounds(ctx, 1)) {
-        printf("malformed. no modrm byte\n");
-        return false;
+    if (!fast && !check_bounds(ctx, 1)) {
+        return fail(ctx, DISASM_ERR_NO_MODRM);
     }
-    struct modrm mod;
-    modrm_extract(*ctx->current++, &mod);
+    const struct modrm *mod = &modrm_table[*ctx->current++];
     out->type = AIR_POP;
-    return handle_memory_operand(ctx, &mod, &out->ops.unary.operand,
-        get_operand_size(ctx, OPERAND_SIZE_64));
+
+    if (mod->mod == 3) { // 8f c0+r is the long form of pop r64
+        uint8_t rm = mod->rm;
+        extend_reg_with_rex_b(ctx, &rm);
+        init_reg_operand(
+            &out->ops.unary.operand, rm, (reg_size_t)variant(ctx)->op_size64);
+        return true;
+    }
+
+    return handle_memory_operand(ctx, mod, &out->ops.unary.operand,
+        variant(ctx)->op_size64, fast);
 }
 
-static bool handle_instr_push_reg(
+static DISASM_INLINE bool handle_instr_push_reg(
     disasm_ctx_t *ctx, uint8_t opcode, air_instr_t *out)
 {
     uint8_t reg = opcode - 0x50;
     extend_reg_with_rex_b(ctx, &reg);
     out->type = AIR_PUSH;
     init_reg_operand(
-        &out->ops.unary.operand, reg, get_reg_size(ctx, REG_SIZE_64));
+        &out->ops.unary.operand, reg, (reg_size_t)variant(ctx)->op_size64);
     return true;
 }
 
-static bool handle_instr_mov_rm_r(disasm_ctx_t *ctx, air_instr_t *out)
+static DISASM_INLINE bool handle_instr_mov_rm_r(
+    disasm_ctx_t *ctx, air_instr_t *out, bool fast)
 {
-    if (!check_bounds(ctx, 1)) {
-        printf("malformed. no modrm byte\n");
-        return false;
+    if (!fast && !check_bounds(ctx, 1)) {
+        return fail(ctx, DISASM_ERR_NO_MODRM);
     }
 
     out->type = AIR_MOV;
 
-    struct modrm mod;
-    modrm_extract(*ctx->current++, &mod);
-    extend_reg_with_rex_r(ctx, &mod.reg);
+    const struct modrm *mod = &modrm_table[*ctx->current++];
+    uint8_t reg = mod->reg;
+    extend_reg_with_rex_r(ctx, &reg);
 
-    reg_size_t reg_size = get_reg_size(ctx, REG_SIZE_NONE);
-    init_reg_operand(&out->ops.binary.src, mod.reg, reg_size);
+    reg_size_t reg_size = (reg_size_t)variant(ctx)->op_size;
+    init_reg_operand(&out->ops.binary.src, reg, reg_size);
 
-    if (mod.mod == 3) {
-        extend_reg_with_rex_b(ctx, &mod.rm);
-        init_reg_operand(&out->ops.binary.dst, mod.rm, reg_size);
+    if (mod->mod == 3) {
+        uint8_t rm = mod->rm;
+        extend_reg_with_rex_b(ctx, &rm);
+        init_reg_operand(&out->ops.binary.dst, rm, reg_size);
         return true;
     }
 
     return handle_memory_operand(
-        ctx, &mod, &out->ops.binary.dst, (operand_size_t)reg_size);
+        ctx, mod, &out->ops.binary.dst, (operand_size_t)reg_size, fast);
 }
 
-void disasm(const uint8_t *instructions, size_t len, air_instr_list_t *out)
+static DISASM_INLINE bool handle_instr_branch_rel(
+    disasm_ctx_t *ctx, uint8_t opcode, air_instr_t *out, bool fast)
 {
-    disasm_ctx_t ctx = {0};
-    ctx.start = instructions;
-    ctx.current = instructions;
-    ctx.end = instructions + len;
+    uint64_t raw = fast ? load_u64(ctx->current) : 0;
+    int32_t disp;
+    if (!take_disp(ctx, raw, 0, opcode == 0xeb ? 1 : 4, &disp, fast)) {
+        return false;
+    }
 
-    while (ctx.current < ctx.end) {
-        const uint8_t *instr_start = ctx.current;
-        disasm_parse_prefixes(&ctx);
-        if (ctx.current >= ctx.end) {
+    out->type = opcode == 0xe8 ? AIR_CALL : AIR_JMP;
+    out->ops.unary.operand.type = OPERAND_REL;
+    out->ops.unary.operand.rel.disp = disp;
+    return true;
+}
+
+// how an escape-map opcode was reached: legacy 0F escapes or VEX
+struct ext_enc {
+    opmap_t map;
+    mand_prefix_t pfx;
+    bool vex;
+    bool l256;    // VEX.L
+    bool w;       // REX.W or VEX.W
+    uint8_t vvvv; // VEX.vvvv, un-inverted
+};
+
+static const ext_op_t ext_raw_modrm = {NULL, EXT_FORM_E, 0, EXT_MEM_OP};
+static const ext_op_t ext_raw_none = {NULL, EXT_FORM_NONE, 0, EXT_MEM_OP};
+
+static inline operand_size_t ext_mem_size(
+    const ext_op_t *op, operand_size_t vec, operand_size_t gpr)
+{
+    switch (op->mem) {
+    case EXT_MEM_VEC:
+        return vec;
+    case EXT_MEM_HALF:
+        return vec == OPERAND_SIZE_256 ? OPERAND_SIZE_128 : OPERAND_SIZE_64;
+    case EXT_MEM_QUARTER:
+        return vec == OPERAND_SIZE_256 ? OPERAND_SIZE_64 : OPERAND_SIZE_32;
+    case EXT_MEM_EIGHTH:
+        return vec == OPERAND_SIZE_256 ? OPERAND_SIZE_32 : OPERAND_SIZE_16;
+    case EXT_MEM_OP:
+        return gpr;
+    default:
+        return (operand_size_t)op->mem;
+    }
+}
+
+// a general register numbered `reg`, which already carries its REX bit.
+// without REX, byte registers 4-7 are ah, ch, dh and bh
+static inline void init_gpr_operand(
+    const disasm_ctx_t *ctx, air_operand_t *op, uint8_t reg, reg_size_t size)
+{
+    if (size == REG_SIZE_8 && !ctx->has_rex && reg >= 4 && reg < 8) {
+        reg = REG_AH + reg - 4;
+    }
+    init_reg_operand(op, reg, size);
+}
+
+// the ModR/M.rm operand: memory of `mem_size`, or a register of `reg_size`
+static DISASM_INLINE bool ext_rm_operand(disasm_ctx_t *ctx,
+    const struct modrm *mod, air_operand_t *op, reg_size_t reg_size,
+    operand_size_t mem_size, bool gpr, bool fast)
+{
+    if (mod->mod != 3) {
+        return handle_memory_operand(ctx, mod, op, mem_size, fast);
+    }
+    uint8_t rm = mod->rm;
+    extend_reg_with_rex_b(ctx, &rm);
+    if (gpr) {
+        init_gpr_operand(ctx, op, rm, reg_size);
+    }
+    else {
+        init_reg_operand(op, rm, reg_size);
+    }
+    return true;
+}
+
+/*
+ * decodes an opcode of one of the escape maps, the opcode byte already
+ * consumed. the ModR/M, displacement and immediate layout comes from
+ * map_flags whether or not ext_index names the opcode, so the length is
+ * right either way
+ */
+static DISASM_INLINE bool decode_ext(disasm_ctx_t *ctx,
+    const struct ext_enc *enc, uint8_t opcode, air_instr_t *out, bool fast)
+{
+    ctx->map = 1 + enc->map;
+    ctx->opcode = opcode;
+
+    uint8_t flags = map_flags[enc->map][opcode];
+    if (flags & MAPF_INVALID) {
+        return fail(ctx, DISASM_ERR_BAD_SECOND_BYTE);
+    }
+
+    unsigned id = ext_index[enc->map][enc->pfx][opcode];
+    if (!id && !enc->vex && enc->pfx != PFX_NP) {
+        id = ext_index[enc->map][PFX_NP][opcode];
+    }
+
+    const struct modrm *mod = NULL;
+    uint8_t modrm = 0;
+    if (flags & MAPF_MODRM) {
+        if (!fast && !check_bounds(ctx, 1)) {
+            return fail(ctx, DISASM_ERR_NO_MODRM);
+        }
+        modrm = *ctx->current++;
+        mod = &modrm_table[modrm];
+    }
+
+    if (id >= EXT_GROUP_FIRST && id < EXT_RAW_FIRST) {
+        id = ext_groups[id - EXT_GROUP_FIRST][mod->reg + (mod->mod == 3) * 8];
+    }
+    // EXT_SPECIAL_MAP: opcodes whose entry also depends on ModR/M or VEX.L
+    if (enc->map == MAP_0F && opcode == 0x1e && enc->pfx == PFX_F3 &&
+        !enc->vex && (modrm == 0xfa || modrm == 0xfb)) {
+        id = modrm == 0xfa ? EXT_ENDBR64 : EXT_ENDBR32;
+        mod = NULL;
+    }
+    if (enc->map == MAP_0F && (opcode == 0x12 || opcode == 0x16) &&
+        enc->pfx == PFX_NP && mod->mod == 3) {
+        id = opcode == 0x12 ? EXT_MOVHLPS : EXT_MOVLHPS;
+    }
+    if (enc->map == MAP_0F && opcode == 0x77 && enc->vex) {
+        id = enc->l256 ? EXT_VZEROALL : EXT_VZEROUPPER;
+    }
+    // EXT_0F01_MAP: the register forms have no ModR/M operand, unnamed
+    // ones included
+    if (enc->map == MAP_0F && opcode == 0x01 && mod->mod == 3 &&
+        mod->reg != 4 && mod->reg != 6) {
+        id = enc->pfx == PFX_NP && !enc->vex ? ext_0f01_regs[modrm - 0xc0]
+                                             : EXT_UNNAMED;
+        mod = NULL;
+    }
+
+    const ext_op_t *op = id ? &ext_ops[id] : NULL;
+    if (op && (op->flags & EXT_W_NEXT) && enc->w) {
+        op = &ext_ops[++id];
+    }
+    // VEX-only rows need VEX; under VEX the general-register rows are
+    // undefined
+    if (op && ((op->flags & EXT_VEX_ONLY)
+                      ? !enc->vex
+                      : enc->vex && ext_form_is_gpr((ext_form_t)op->form))) {
+        op = NULL;
+    }
+    if (!op) {
+        id = EXT_RAW(enc->map, opcode);
+        op = mod ? &ext_raw_modrm : &ext_raw_none;
+    }
+
+    out->type = AIR_EXT;
+    out->ext = (uint16_t)id | (enc->vex ? AIR_EXT_VEX : 0) |
+               (enc->l256 ? AIR_EXT_L256 : 0) | (enc->w ? AIR_EXT_W : 0);
+    out->vsrc = REG_NONE;
+    out->imm = 0;
+    out->ops.binary.dst.type = OPERAND_NONE;
+    out->ops.binary.src.type = OPERAND_NONE;
+
+    bool gpr_form = ext_form_is_gpr((ext_form_t)op->form);
+    // general registers: the legacy operand size for the general-purpose
+    // instructions, 32 or 64 bits by W next to vectors and under VEX
+    operand_size_t gpr = gpr_form && !enc->vex
+                             ? variant(ctx)->op_size
+                             : (enc->w ? OPERAND_SIZE_64 : OPERAND_SIZE_32);
+    operand_size_t vec = enc->l256 && !(op->flags & EXT_LIG)
+                             ? OPERAND_SIZE_256
+                             : OPERAND_SIZE_128;
+    operand_size_t mem = ext_mem_size(op, vec, gpr);
+    // a register in place of memory is as wide as the memory, at least a
+    // whole xmm register for vectors
+    reg_size_t e_size = (reg_size_t)(mem == OPERAND_SIZE_8 ||
+                                             mem == OPERAND_SIZE_16
+                                         ? mem
+                                         : gpr);
+    reg_size_t w_size =
+        mem == OPERAND_SIZE_256 ? REG_SIZE_256 : REG_SIZE_128;
+    reg_size_t v_size = (op->flags & EXT_V_XMM) ? REG_SIZE_128
+                                                 : (reg_size_t)vec;
+
+    air_operand_t *dst = &out->ops.binary.dst;
+    air_operand_t *src = &out->ops.binary.src;
+    uint8_t reg = mod ? mod->reg : 0;
+    if (mod) {
+        extend_reg_with_rex_r(ctx, &reg);
+    }
+
+    bool ok = true;
+    switch ((ext_form_t)op->form) {
+    case EXT_FORM_NONE:
+        break;
+    case EXT_FORM_REL: {
+        uint64_t raw = fast ? load_u64(ctx->current) : 0;
+        int32_t disp;
+        if (!take_disp(ctx, raw, 0, 4, &disp, fast)) {
+            return false;
+        }
+        dst->type = OPERAND_REL;
+        dst->rel.disp = disp;
+        break;
+    }
+    case EXT_FORM_O: {
+        uint8_t r = opcode & 7;
+        extend_reg_with_rex_b(ctx, &r);
+        init_reg_operand(dst, r, (reg_size_t)gpr);
+        break;
+    }
+    case EXT_FORM_E:
+        ok = ext_rm_operand(ctx, mod, dst, e_size, mem, true, fast);
+        break;
+    case EXT_FORM_G_E:
+        init_gpr_operand(ctx, dst, reg, (reg_size_t)gpr);
+        ok = ext_rm_operand(ctx, mod, src, e_size, mem, true, fast);
+        break;
+    case EXT_FORM_E_G:
+        init_gpr_operand(ctx, src, reg, e_size);
+        ok = ext_rm_operand(ctx, mod, dst, e_size, mem, true, fast);
+        break;
+    case EXT_FORM_V_W:
+        init_reg_operand(dst, reg, v_size);
+        ok = ext_rm_operand(ctx, mod, src, w_size, mem, false, fast);
+        break;
+    case EXT_FORM_W_V:
+        init_reg_operand(src, reg, v_size);
+        ok = ext_rm_operand(ctx, mod, dst, w_size, mem, false, fast);
+        break;
+    case EXT_FORM_V_E:
+        init_reg_operand(dst, reg, v_size);
+        ok = ext_rm_operand(ctx, mod, src, (reg_size_t)gpr, mem, true, fast);
+        break;
+    case EXT_FORM_E_V:
+        init_reg_operand(src, reg, v_size);
+        ok = ext_rm_operand(ctx, mod, dst, (reg_size_t)gpr, mem, true, fast);
+        break;
+    case EXT_FORM_G_W:
+        init_reg_operand(dst, reg, (reg_size_t)gpr);
+        ok = ext_rm_operand(ctx, mod, src, w_size, mem, false, fast);
+        break;
+    case EXT_FORM_W:
+        ok = ext_rm_operand(ctx, mod, dst, (reg_size_t)vec, mem, false, fast);
+        break;
+    case EXT_FORM_VSIB: {
+        // VSIB always has a SIB byte
+        air_operand_t skipped;
+        if (mod->rm != 4) {
+            return fail(ctx, DISASM_ERR_INVALID);
+        }
+        ok = handle_memory_operand(ctx, mod, &skipped, mem, fast);
+        break;
+    }
+    }
+    if (!ok) {
+        return false;
+    }
+
+    if (enc->vex &&
+        ((op->flags & (EXT_NDS | EXT_NDD | EXT_VVVV_LAST)) ||
+            ((op->flags & EXT_NDS_REG) && mod && mod->mod == 3))) {
+        out->vsrc = enc->vvvv;
+    }
+
+    if (flags & MAPF_IMM8) {
+        if (!fast && !check_bounds(ctx, 1)) {
+            return fail(ctx, DISASM_ERR_NO_IMM);
+        }
+        out->imm = *ctx->current++;
+        out->ext |= AIR_EXT_IMM;
+    }
+    return true;
+}
+
+static inline mand_prefix_t legacy_mand_prefix(const disasm_ctx_t *ctx)
+{
+    if (HAS_FLAG(ctx->prefixes, INSTR_PREFIX_REPNE)) {
+        return PFX_F2;
+    }
+    if (HAS_FLAG(ctx->prefixes, INSTR_PREFIX_REP_REPE)) {
+        return PFX_F3;
+    }
+    return HAS_FLAG(ctx->prefixes, INSTR_PREFIX_OP) ? PFX_66 : PFX_NP;
+}
+
+static DISASM_INLINE bool handle_instr_esc_0f(
+    disasm_ctx_t *ctx, air_instr_t *out, bool fast)
+{
+    if (!fast && !check_bounds(ctx, 1)) {
+        return fail(ctx, DISASM_ERR_NO_SECOND_BYTE);
+    }
+    uint8_t opcode = *ctx->current++;
+
+    struct ext_enc enc = {MAP_0F, legacy_mand_prefix(ctx), false, false,
+        ctx->has_rex && ctx->rex.w, 0};
+
+    switch (opcode) {
+    case 0xa1:
+        return pop_seg(ctx, out, SEG_FS);
+    case 0xa9:
+        return pop_seg(ctx, out, SEG_GS);
+    case 0x38:
+    case 0x3a:
+        enc.map = opcode == 0x38 ? MAP_0F38 : MAP_0F3A;
+        if (!fast && !check_bounds(ctx, 1)) {
+            return fail(ctx, DISASM_ERR_NO_SECOND_BYTE);
+        }
+        opcode = *ctx->current++;
+        break;
+    default:
+        break;
+    }
+    return decode_ext(ctx, &enc, opcode, out, fast);
+}
+
+// C5 carries R, vvvv, L and pp and implies the 0F map; C4 adds X, B, the
+// map and W. the R, X and B bits go into the variant where REX puts them
+static DISASM_INLINE bool handle_instr_vex(
+    disasm_ctx_t *ctx, uint8_t opcode, air_instr_t *out, bool fast)
+{
+    if (ctx->has_rex ||
+        HAS_FLAG(ctx->prefixes, INSTR_PREFIX_OP | INSTR_PREFIX_REPNE |
+                                    INSTR_PREFIX_REP_REPE |
+                                    INSTR_PREFIX_LOCK)) {
+        return fail(ctx, DISASM_ERR_BAD_VEX);
+    }
+
+    unsigned size = opcode == 0xc5 ? 1 : 2;
+    if (!fast && !check_bounds(ctx, size)) {
+        return fail(ctx, DISASM_ERR_NO_VEX);
+    }
+    uint8_t b1 = ctx->current[0];
+    uint8_t b2 = opcode == 0xc5 ? b1 : ctx->current[1];
+    ctx->current += size;
+
+    struct ext_enc enc = {MAP_0F, (mand_prefix_t)(b2 & 3), true,
+        (b2 >> 2) & 1, false, (~b2 >> 3) & 0xf};
+    uint8_t rxb = (~b1 >> 5) & 4; // R
+    if (opcode == 0xc4) {
+        rxb = (~b1 >> 5) & 7;
+        enc.w = b2 >> 7;
+        switch (b1 & 0x1f) {
+        case 1:
+            break;
+        case 2:
+            enc.map = MAP_0F38;
+            break;
+        case 3:
+            enc.map = MAP_0F3A;
             break;
+        default:
+            return fail(ctx, DISASM_ERR_BAD_VEX);
         }
+    }
+    ctx->variant = (ctx->variant & PREFIX_VARIANT_ADDR) | (enc.w ? 8 : 0) | rxb;
+
+    if (!fast && !check_bounds(ctx, 1)) {
+        return fail(ctx, DISASM_ERR_NO_VEX);
+    }
+    return decode_ext(ctx, &enc, *ctx->current++, out, fast);
+}
+
+/*
+ * decodes what follows the opcode byte, which has already been consumed.
+ * with GNU C the opcode jumps straight to its handler through a table of
+ * label addresses built from OPCODE_MAP; labels are local to a function,
+ * so the fast and checked decoders each get their own. elsewhere, or with
+ * DISASM_NO_COMPUTED_GOTO, it is a switch on opcode_table
+ */
+#if defined(__GNUC__) && !defined(DISASM_NO_COMPUTED_GOTO)
+
+#define DISPATCH_ENTRY(opcode, type) [opcode] = &&do_##type,
+
+#define DEFINE_DECODER(name, fast)                                             \
+    static bool name(disasm_ctx_t *ctx, uint8_t opcode, air_instr_t *instr)   \
+    {                                                                          \
+        static const void *const dispatch[256] = {                            \
+            [0 ... 255] = &&do_NONE,                                           \
+            OPCODE_MAP(DISPATCH_ENTRY)};                                       \
+        goto *dispatch[opcode];                                                \
+    do_POP_SEG:                                                                \
+        return handle_instr_pop_seg(ctx, opcode, instr);                       \
+    do_POP_REG:                                                                \
+        return handle_instr_pop_reg(ctx, opcode, instr);                       \
+    do_POP_RM:                                                                 \
+        return handle_instr_pop_rm(ctx, instr, fast);                          \
+    do_PUSH_REG:                                                               \
+        return handle_instr_push_reg(ctx, opcode, instr);                      \
+    do_MOV_RM_R:                                                               \
+        return handle_instr_mov_rm_r(ctx, instr, fast);                        \
+    do_ESC_0F:                                                                 \
+        return handle_instr_esc_0f(ctx, instr, fast);                          \
+    do_VEX:                                                                    \
+        return handle_instr_vex(ctx, opcode, instr, fast);                     \
+    do_CALL_REL:                                                               \
+    do_JMP_REL:                                                                \
+        return handle_instr_branch_rel(ctx, opcode, instr, fast);              \
+    do_NONE:                                                                   \
+        return fail(ctx, DISASM_ERR_UNSUPPORTED);                              \
+    }
+
+#else
+
+static DISASM_INLINE bool decode_instr(
+    disasm_ctx_t *ctx, uint8_t opcode, air_instr_t *instr, bool fast)
+{
+    switch (opcode_table[opcode]) {
+    case INSTR_POP_SEG:
+        return handle_instr_pop_seg(ctx, opcode, instr);
+    case INSTR_POP_REG:
+        return handle_instr_pop_reg(ctx, opcode, instr);
+    case INSTR_POP_RM:
+        return handle_instr_pop_rm(ctx, instr, fast);
+    case INSTR_PUSH_REG:
+        return handle_instr_push_reg(ctx, opcode, instr);
+    case INSTR_MOV_RM_R:
+        return handle_instr_mov_rm_r(ctx, instr, fast);
+    case INSTR_ESC_0F:
+        return handle_instr_esc_0f(ctx, instr, fast);
+    case INSTR_VEX:
+        return handle_instr_vex(ctx, opcode, instr, fast);
+    case INSTR_CALL_REL:
+    case INSTR_JMP_REL:
+        return handle_instr_branch_rel(ctx, opcode, instr, fast);
+    default:
+        return fail(ctx, DISASM_ERR_UNSUPPORTED);
+    }
+}
+
+#define DEFINE_DECODER(name, fast)                                             \
+    static bool name(disasm_ctx_t *ctx, uint8_t opcode, air_instr_t *instr)   \
+    {                                                                          \
+        return decode_instr(ctx, opcode, instr, fast);                         \
+    }
+
+#endif
+
+// the dispatch tables send every opcode to do_NONE first and let
+// OPCODE_MAP override the handled ones, on purpose
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+DEFINE_DECODER(decode_instr_fast, true)
+DEFINE_DECODER(decode_instr_checked, false)
+#pragma GCC diagnostic pop
+
+// decodes the instruction at ctx->current. on failure ctx->err says why
+// and ctx->current is wherever decoding gave up
+static DISASM_INLINE bool decode_next(
+    disasm_ctx_t *ctx, air_instr_t *instr, bool padded)
+{
+    const uint8_t *instr_start = ctx->current;
+    const uint8_t *end = ctx->end;
+
+    // nothing past the architectural length limit is looked at, so an
+    // instruction decodes the same whatever follows those 15 bytes
+    if ((size_t)(end - instr_start) > DISASM_MAX_INSTR_LEN) {
+        ctx->end = instr_start + DISASM_MAX_INSTR_LEN;
+    }
+
+    reset_ctx(ctx);
+    disasm_parse_prefixes(ctx);
+
+    bool ok;
+    if (ctx->current >= ctx->end) {
+        ok = fail(ctx, ctx->end == end ? DISASM_ERR_NO_OPCODE
+                                       : DISASM_ERR_TOO_LONG);
+    }
+    else {
+        const uint8_t *opcode_pos = ctx->current;
+        uint8_t opcode = *ctx->current++;
+        ctx->opcode = opcode;
+
+        if (padded || (size_t)(end - opcode_pos) >= DISASM_MAX_INSTR_LEN) {
+            ok = decode_instr_fast(ctx, opcode, instr);
+            if (ctx->current > ctx->end) {
+                // ran past the buffer or the length limit. decode it again
+                // with the checks so the outcome matches the checked path
+                ctx->current = opcode_pos + 1;
+                ok = decode_instr_checked(ctx, opcode, instr);
+            }
+        }
+        else {
+            ok = decode_instr_checked(ctx, opcode, instr);
+        }
+    }
+    ctx->end = end;
+
+    if (ok) {
+        instr->length = ctx->current - instr_start;
+        instr->offset = instr_start - ctx->start;
+    }
+    return ok;
+}
+
+static void report_error(const disasm_ctx_t *ctx)
+{
+    switch (ctx->err) {
+    case DISASM_ERR_NO_MODRM:
+        printf("malformed. no modrm byte\n");
+        break;
+    case DISASM_ERR_NO_SIB:
+        printf("no sib byte\n");
+        break;
+    case DISASM_ERR_NO_DISP8:
+        printf("not enough bytes for 1byte disp\n");
+        break;
+    case DISASM_ERR_NO_DISP32:
+        printf("not enough bytes for 4byte disp\n");
+        break;
+    case DISASM_ERR_NO_SECOND_BYTE:
+        printf("no opcode byte after the 0x0f escape\n");
+        break;
+    case DISASM_ERR_BAD_SECOND_BYTE:
+        printf("undefined opcode in the 0x0f maps\n");
+        break;
+    case DISASM_ERR_NO_IMM:
+        printf("not enough bytes for 1byte immediate\n");
+        break;
+    case DISASM_ERR_NO_VEX:
+        printf("not enough bytes for vex prefix\n");
+        break;
+    case DISASM_ERR_BAD_VEX:
+        printf("invalid vex prefix\n");
+        break;
+    case DISASM_ERR_TOO_LONG:
+        printf("instruction longer than %d bytes\n", DISASM_MAX_INSTR_LEN);
+        break;
+    case DISASM_ERR_UNSUPPORTED:
+        printf("skipping unhandled opcode: 0x%02x\n", ctx->opcode);
+        break;
+    default:
+        break;
+    }
+}
 
-        uint8_t opcode = *ctx.current++;
-        instr_type_t type = opcode_table[opcode];
+static DISASM_INLINE size_t session_run(disasm_session_t *session,
+    size_t max_instrs, size_t max_bytes, bool padded)
+{
+    disasm_ctx_t *ctx = &session->ctx;
+    air_instr_list_t *out = session->out;
+    const uint8_t *begin = ctx->current;
 
+    for (size_t n = 0; n < max_instrs && ctx->current < ctx->end &&
+                       (size_t)(ctx->current - begin) < max_bytes;
+        n++) {
         air_instr_t *instr = air_instr_list_get_new(out);
         if (!instr) {
             printf("out of memory\n");
             break;
         }
 
-        bool ok = true;
+        if (!decode_next(ctx, instr, padded)) {
+            out->count--;
+            out->used_in_tail--;
+            report_error(ctx);
+        }
+    }
+    return (size_t)(ctx->current - begin);
+}
 
-        switch (type) {
-        case INSTR_POP_SEG: {
-            ok = handle_instr_pop_seg(&ctx, opcode, instr);
-            break;
+void disasm_session_init(disasm_session_t *session,
+    const uint8_t *instructions, size_t len, air_instr_list_t *out)
+{
+    memset(&session->ctx, 0, sizeof(session->ctx));
+    session->ctx.start = instructions;
+    session->ctx.current = instructions;
+    session->ctx.end = instructions + len;
+    session->out = out;
+}
+
+size_t disasm_session_run(
+    disasm_session_t *session, size_t max_instrs, size_t max_bytes)
+{
+    return session_run(session, max_instrs, max_bytes, false);
+}
+
+bool disasm_session_done(const disasm_session_t *session)
+{
+    return session->ctx.current >= session->ctx.end;
+}
+
+void disasm_session_seek(disasm_session_t *session, size_t offset)
+{
+    disasm_ctx_t *ctx = &session->ctx;
+    size_t len = (size_t)(ctx->end - ctx->start);
+    ctx->current = ctx->start + (offset < len ? offset : len);
+}
+
+void disasm_skipping(const uint8_t *instructions, size_t len,
+    const data_ranges_t *skip, air_instr_list_t *out)
+{
+    disasm_session_t session;
+    disasm_session_init(&session, instructions, len, out);
+    for (size_t i = 0; i < skip->count; i++) {
+        const data_range_t *r = &skip->items[i];
+        size_t at = (size_t)(session.ctx.current - instructions);
+        if (at < r->start) {
+            // an instruction may run into the range; that's fine
+            at += session_run(&session, DISASM_UNLIMITED, r->start - at,
+                false);
         }
-        case INSTR_POP_REG: {
-            ok = handle_instr_pop_reg(&ctx, opcode, instr);
-            break;
+        if (at < r->end) {
+            disasm_session_seek(&session, r->end);
         }
-        case INSTR_POP_RM: {
-            ok = handle_instr_pop_rm(&ctx, instr);
-            break;
+    }
+    session_run(&session, DISASM_UNLIMITED, DISASM_UNLIMITED, false);
+}
+
+size_t disasm_each(const uint8_t *instructions, size_t len,
+    disasm_instr_fn fn, void *arg)
+{
+    disasm_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.start = instructions;
+    ctx.current = instructions;
+    ctx.end = instructions + len;
+
+    air_instr_t instr;
+    size_t failed = 0;
+    while (ctx.current < ctx.end) {
+        memset(&instr, 0, sizeof(instr));
+        if (decode_next(&ctx, &instr, false)) {
+            fn(&instr, arg);
         }
-        case INSTR_PUSH_REG: {
-            ok = handle_instr_push_reg(&ctx, opcode, instr);
-            break;
+        else {
+            failed++;
         }
-        case INSTR_MOV_RM_R: {
-            ok = handle_instr_mov_rm_r(&ctx, instr);
-            break;
+    }
+    return failed;
+}
+
+static inline stats_mem_t mem_mode(const air_instr_t *instr)
+{
+    const air_operand_t *op = &instr->ops.binary.dst;
+    if (op->type != OPERAND_MEM &&
+        (instr->type == AIR_MOV || instr->type == AIR_EXT)) {
+        op = &instr->ops.binary.src;
+    }
+    if (op->type != OPERAND_MEM || op->mem.segment != SEG_NONE) {
+        return STATS_MEM_NONE;
+    }
+
+    reg_id_t base = op->mem.base;
+    if (base == REG_IP) {
+        return STATS_MEM_RIP;
+    }
+    if (base == REG_NONE && op->mem.index == REG_NONE) {
+        return STATS_MEM_ABSOLUTE;
+    }
+    // rsp and r12 as a base, and no base at all, need SIB too
+    if (op->mem.index != REG_NONE || base == REG_NONE || base == REG_SP ||
+        base == REG_R12) {
+        return STATS_MEM_SIB;
+    }
+    return op->mem.disp ? STATS_MEM_BASE_DISP : STATS_MEM_BASE;
+}
+
+static DISASM_INLINE void count_instr(disasm_stats_t *stats,
+    const disasm_ctx_t *ctx, const air_instr_t *instr)
+{
+    stats->instrs++;
+    stats->lengths[instr->length]++;
+    stats->types[instr->type]++;
+    stats->mem_modes[mem_mode(instr)]++;
+
+    for (unsigned p = ctx->prefixes; p; p &= p - 1) {
+        stats->prefixes[__builtin_ctz(p)]++;
+    }
+    if (ctx->has_rex) {
+        stats->prefixes[STATS_REX]++;
+        stats->prefixes[STATS_REX_W] += ctx->rex.w;
+    }
+    if (instr->type == AIR_EXT && (instr->ext & AIR_EXT_VEX)) {
+        stats->prefixes[STATS_VEX]++;
+    }
+}
+
+void disasm_count(
+    const uint8_t *instructions, size_t len, disasm_stats_t *stats)
+{
+    disasm_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.start = instructions;
+    ctx.current = instructions;
+    ctx.end = instructions + len;
+    stats->bytes += len;
+
+    air_instr_t instr;
+    while (ctx.current < ctx.end) {
+        bool ok = decode_next(&ctx, &instr, false);
+        // no opcode was read when the prefixes ran out of bytes
+        if (ok || (ctx.err != DISASM_ERR_NO_OPCODE &&
+                      ctx.err != DISASM_ERR_TOO_LONG)) {
+            stats->opcodes[ctx.map][ctx.opcode]++;
         }
-        default: {
-            printf("skipping unhandled opcode: 0x%02x\n", opcode);
-            ok = false;
-            break;
+        if (ok) {
+            count_instr(stats, &ctx, &instr);
         }
+        else {
+            stats->failed++;
         }
+    }
+}
 
-        if (ok) {
-            instr->length = ctx.current - instr_start;
+static void disasm_buffer(const uint8_t *instructions, size_t len,
+    air_instr_list_t *out, bool padded)
+{
+    disasm_session_t session;
+    disasm_session_init(&session, instructions, len, out);
+    if (padded) {
+        session_run(&session, DISASM_UNLIMITED, DISASM_UNLIMITED, true);
+    }
+    else {
+        session_run(&session, DISASM_UNLIMITED, DISASM_UNLIMITED, false);
+    }
+}
+
+void disasm(const uint8_t *instructions, size_t len, air_instr_list_t *out)
+{
+    disasm_buffer(instructions, len, out, false);
+}
+
+void disasm_padded(
+    const uint8_t *instructions, size_t len, air_instr_list_t *out)
+{
+    disasm_buffer(instructions, len, out, true);
+}
+
+// the new instructions of a disasm_update(), on the stack unless there are
+// many
+#define UPDATE_INLINE_INSTRS 32
+
+typedef struct {
+    air_instr_t inline_items[UPDATE_INLINE_INSTRS];
+    air_instr_t *items;
+    size_t count;
+    size_t capacity;
+} update_buf_t;
+
+static air_instr_t *update_buf_get_new(update_buf_t *buf)
+{
+    if (buf->count == buf->capacity) {
+        size_t cap = buf->capacity * 2;
+        air_instr_t *items = (air_instr_t *)malloc(cap * sizeof(*items));
+        if (!items) {
+            return NULL;
         }
-        else {
-            out->count--;
-            out->used_in_tail--;
+        memcpy(items, buf->items, buf->count * sizeof(*items));
+        if (buf->items != buf->inline_items) {
+            free(buf->items);
         }
+        buf->items = items;
+        buf->capacity = cap;
+    }
+    return &buf->items[buf->count++];
+}
+
+// the old instructions of a disasm_update(), walked once in order
+typedef struct {
+    air_instr_iter_t it;
+    const air_instr_t *run; // NULL past the last instruction
+    size_t run_len;
+    size_t i; // into run
+} update_cursor_t;
+
+// skips empty runs
+static void cursor_fill(update_cursor_t *cur)
+{
+    while (cur->run && cur->i == cur->run_len) {
+        cur->run = air_instr_iter_next(&cur->it, &cur->run_len);
+        cur->i = 0;
+    }
+}
+
+static void cursor_step(update_cursor_t *cur)
+{
+    cur->i++;
+    cursor_fill(cur);
+}
+
+static inline size_t instr_end(const air_instr_t *instr)
+{
+    return instr->offset + instr->length;
+}
+
+bool disasm_update(const uint8_t *instructions, size_t len, size_t at,
+    size_t n, air_instr_list_t *list)
+{
+    if (at > len) {
+        at = len;
+    }
+    size_t patch_end = n < len - at ? at + n : len;
+    if (patch_end == at) {
+        return true;
+    }
+
+    update_cursor_t cur;
+    if (!air_instr_list_seek(list, at, &cur.it)) {
+        return false;
+    }
+    cur.run = air_instr_iter_next(&cur.it, &cur.run_len);
+    cur.i = 0;
+    cursor_fill(&cur);
+
+    // an instruction that ends before the patch decodes the same, and the
+    // old decode went on right after it. restart after the last of them
+    size_t restart = 0;
+    if (cur.run && instr_end(&cur.run[cur.i]) <= at) {
+        restart = instr_end(&cur.run[cur.i]);
+        cursor_step(&cur);
+    }
+
+    disasm_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.start = instructions;
+    ctx.current = instructions + restart;
+    ctx.end = instructions + len;
+
+    update_buf_t buf;
+    buf.items = buf.inline_items;
+    buf.count = 0;
+    buf.capacity = UPDATE_INLINE_INSTRS;
+
+    // past the patch, decoding from a place the old decode also started
+    // at reads the same bytes and goes the same way. the old instructions
+    // from there on are kept
+    bool synced = false;
+    size_t pos = restart;
+    size_t prev_end = restart; // end of the old instruction before cur
+    for (;;) {
+        pos = (size_t)(ctx.current - instructions);
+        if (pos >= patch_end) {
+            while (cur.run && cur.run[cur.i].offset < pos) {
+                prev_end = instr_end(&cur.run[cur.i]);
+                cursor_step(&cur);
+            }
+            if (pos >= len || prev_end == pos ||
+                (cur.run && cur.run[cur.i].offset == pos)) {
+                synced = true;
+                break;
+            }
+        }
+
+        air_instr_t *instr = update_buf_get_new(&buf);
+        if (!instr) {
+            printf("out of memory\n");
+            break;
+        }
+        if (!decode_next(&ctx, instr, false)) {
+            buf.count--;
+            report_error(&ctx);
+        }
+    }
+    air_instr_iter_done(&cur.it);
+
+    bool ok = synced &&
+              air_instr_list_splice(list, restart, pos, buf.items, buf.count);
+    if (buf.items != buf.inline_items) {
+        free(buf.items);
+    }
+    return ok;
+}
+
+int disasm_one(const uint8_t *code, size_t len, air_instr_t *out)
+{
+    disasm_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.start = code;
+    ctx.current = code;
+    ctx.end = code + len;
 
-        reset_ctx(&ctx);
+    if (!decode_next(&ctx, out, false)) {
+        return -(int)ctx.err;
     }
+    return (int)out->length;
 }
@@ -10,6 +10,31 @@
 #define SET_FLAG(flags, x) ((flags) |= (x))
 #define HAS_FLAG(flags, x) (((flags) & (x)) != 0)
 
+#define DISASM_INLINE inline __attribute__((always_inline))
+
+// longest legal x86 instruction. decoding never reads further than this
+// from the first byte of an instruction
+#define DISASM_MAX_INSTR_LEN 15
+// readable bytes disasm_padded() may touch past the end of its input
+#define DISASM_PADDING DISASM_MAX_INSTR_LEN
+
+typedef enum {
+    DISASM_ERR_NONE,
+    DISASM_ERR_NO_OPCODE, // the input ends after the prefixes
+    DISASM_ERR_NO_MODRM,
+    DISASM_ERR_NO_SIB,
+    DISASM_ERR_NO_DISP8,
+    DISASM_ERR_NO_DISP32,
+    DISASM_ERR_NO_SECOND_BYTE,
+    DISASM_ERR_BAD_SECOND_BYTE,
+    DISASM_ERR_INVALID,
+    DISASM_ERR_TOO_LONG, // prefixes run past DISASM_MAX_INSTR_LEN
+    DISASM_ERR_UNSUPPORTED, // a valid opcode the decoder doesn't handle
+    DISASM_ERR_NO_IMM,
+    DISASM_ERR_NO_VEX,  // the input ends inside a VEX prefix
+    DISASM_ERR_BAD_VEX, // VEX after REX, 66, F2, F3 or LOCK, or a bad map
+} disasm_err_t;
+
 typedef struct {
     const uint8_t *start;
     const uint8_t *current;
@@ -17,18 +42,87 @@ typedef struct {
     bool has_rex;
     struct rex_prefix rex;
     uint16_t prefixes;
+    uint8_t variant; // index into prefix_variants
+    uint8_t map;     // 0, or 1 + the opmap_t `opcode` was taken from
+    uint8_t opcode;
+    disasm_err_t err; // why the last decode failed
 } disasm_ctx_t;
 
 static inline bool check_bounds(const disasm_ctx_t *ctx, size_t needed)
 {
-    return (ctx->current + needed) < ctx->end;
+    return ctx->current + needed <= ctx->end;
 }
 
+// a decode that can be advanced in slices. all state lives in the struct,
+// so the caller decides where it is stored and when to continue
+typedef struct {
+    disasm_ctx_t ctx;
+    air_instr_list_t *out;
+} disasm_session_t;
+
+// no budget on that axis
+#define DISASM_UNLIMITED SIZE_MAX
+
 addr_size_t get_addr_size(disasm_ctx_t *ctx);
 operand_size_t get_operand_size(disasm_ctx_t *ctx, operand_size_t default_size);
 reg_size_t get_reg_size(disasm_ctx_t *ctx, reg_size_t default_size);
 
 void disasm_parse_prefixes(disasm_ctx_t *ctx);
 void disasm(const uint8_t *instructions, size_t len, air_instr_list_t *out);
+// same result as disasm(), but the caller guarantees DISASM_PADDING readable
+// bytes after the buffer so every instruction takes the unchecked path
+void disasm_padded(
+    const uint8_t *instructions, size_t len, air_instr_list_t *out);
+
+// decodes the single instruction at `code`, reading at most `len` bytes.
+// returns its length, or the negated disasm_err_t. touches no heap,
+// globals or stdio, so it is safe from signal handlers and any number of
+// threads
+int disasm_one(const uint8_t *code, size_t len, air_instr_t *out);
+
+// brings `list`, the result of a disasm() of `instructions`, up to date
+// after the `n` bytes at `at` were changed in place. decoding restarts at
+// the last instruction boundary before the change and stops as soon as it
+// meets a boundary of the old decode behind it; only the instructions in
+// between are replaced. false when out of memory or `list` has a memory
+// budget, and `list` is left as it was
+bool disasm_update(const uint8_t *instructions, size_t len, size_t at,
+    size_t n, air_instr_list_t *list);
+
+typedef struct data_ranges_s data_ranges_t;
+
+// same as disasm(), but the bytes in the ranges of `skip` (see classify.h)
+// aren't decoded. decoding picks up again at the end of each range
+void disasm_skipping(const uint8_t *instructions, size_t len,
+    const data_ranges_t *skip, air_instr_list_t *out);
+
+typedef void (*disasm_instr_fn)(const air_instr_t *instr, void *arg);
+
+// decodes like disasm() but hands each instruction to `fn` as it goes
+// instead of storing it. every instruction starts out zeroed, padding
+// and unused operand bytes included. failed decodes are skipped without a
+// message and counted in the return value
+size_t disasm_each(const uint8_t *instructions, size_t len,
+    disasm_instr_fn fn, void *arg);
+
+typedef struct disasm_stats_s disasm_stats_t;
+
+// decodes like disasm() but only adds to the counters in `stats` (see
+// stats.h): nothing is allocated and nothing is printed
+void disasm_count(
+    const uint8_t *instructions, size_t len, disasm_stats_t *stats);
+
+void disasm_session_init(disasm_session_t *session,
+    const uint8_t *instructions, size_t len, air_instr_list_t *out);
+// decodes until `max_instrs` instructions were attempted or at least
+// `max_bytes` were consumed, whichever comes first, and returns the bytes
+// consumed. an instruction is never split across calls. nothing is
+// allocated once `out` has room, see air_instr_list_reserve()
+size_t disasm_session_run(
+    disasm_session_t *session, size_t max_instrs, size_t max_bytes);
+bool disasm_session_done(const disasm_session_t *session);
+// continues at `offset` into the buffer, which should be an instruction
+// boundary found by an earlier run over the same buffer
+void disasm_session_seek(disasm_session_t *session, size_t offset);
 
 #endif // DISASM_H
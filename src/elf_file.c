@@ -0,0 +1,217 @@
+#include "elf_file.h"
+#include <elf.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool in_bounds(const elf_file_t *elf, uint64_t off, uint64_t size)
+{
+    return off <= elf->len && size <= elf->len - off;
+}
+
+static const Elf64_Shdr *get_shdr(const elf_file_t *elf, size_t i)
+{
+    return (const Elf64_Shdr *)(elf->data + elf->shoff +
+                                i * sizeof(Elf64_Shdr));
+}
+
+static const char *get_string(
+    const char *table, size_t table_size, uint64_t off)
+{
+    if (!table || off >= table_size) {
+        return NULL;
+    }
+    // the name must be terminated inside the table
+    if (!memchr(table + off, '\0', table_size - off)) {
+        return NULL;
+    }
+    return table + off;
+}
+
+bool elf_is_elf(const uint8_t *data, size_t len)
+{
+    return len >= SELFMAG && memcmp(data, ELFMAG, SELFMAG) == 0;
+}
+
+bool elf_parse(elf_file_t *elf, const uint8_t *data, size_t len)
+{
+    memset(elf, 0, sizeof(*elf));
+    elf->data = data;
+    elf->len = len;
+
+    if (!elf_is_elf(data, len) || len < sizeof(Elf64_Ehdr)) {
+        return false;
+    }
+
+    Elf64_Ehdr ehdr;
+    memcpy(&ehdr, data, sizeof(ehdr));
+    if (ehdr.e_ident[EI_CLASS] != ELFCLASS64 ||
+        ehdr.e_ident[EI_DATA] != ELFDATA2LSB || ehdr.e_machine != EM_X86_64) {
+        return false;
+    }
+
+    if (ehdr.e_shnum && ehdr.e_shentsize == sizeof(Elf64_Shdr) &&
+        ehdr.e_shoff % _Alignof(Elf64_Shdr) == 0 &&
+        in_bounds(elf, ehdr.e_shoff,
+            (uint64_t)ehdr.e_shnum * sizeof(Elf64_Shdr))) {
+        elf->shoff = ehdr.e_shoff;
+        elf->shnum = ehdr.e_shnum;
+
+        if (ehdr.e_shstrndx < elf->shnum) {
+            const Elf64_Shdr *strs = get_shdr(elf, ehdr.e_shstrndx);
+            if (in_bounds(elf, strs->sh_offset, strs->sh_size)) {
+                elf->shstrtab = (const char *)data + strs->sh_offset;
+                elf->shstrtab_size = strs->sh_size;
+            }
+        }
+    }
+
+    if (ehdr.e_phnum && ehdr.e_phentsize == sizeof(Elf64_Phdr) &&
+        ehdr.e_phoff % _Alignof(Elf64_Phdr) == 0 &&
+        in_bounds(elf, ehdr.e_phoff,
+            (uint64_t)ehdr.e_phnum * sizeof(Elf64_Phdr))) {
+        elf->phoff = ehdr.e_phoff;
+        elf->phnum = ehdr.e_phnum;
+    }
+
+    return true;
+}
+
+bool elf_open(elf_file_t *elf, const char *path)
+{
+    memset(elf, 0, sizeof(*elf));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+
+    if (!elf_parse(elf, (const uint8_t *)p, (size_t)st.st_size)) {
+        munmap(p, (size_t)st.st_size);
+        memset(elf, 0, sizeof(*elf));
+        return false;
+    }
+    elf->mapped = true;
+    return true;
+}
+
+void elf_close(elf_file_t *elf)
+{
+    if (elf->mapped) {
+        munmap((void *)elf->data, elf->len);
+    }
+    memset(elf, 0, sizeof(*elf));
+}
+
+size_t elf_section_count(const elf_file_t *elf)
+{
+    return elf->shnum;
+}
+
+bool elf_section(const elf_file_t *elf, size_t i, elf_section_t *out)
+{
+    if (i >= elf->shnum) {
+        return false;
+    }
+
+    const Elf64_Shdr *sh = get_shdr(elf, i);
+    const char *name =
+        get_string(elf->shstrtab, elf->shstrtab_size, sh->sh_name);
+
+    out->name = name ? name : "";
+    out->addr = sh->sh_addr;
+    out->offset = sh->sh_offset;
+    out->size = sh->sh_size;
+    out->exec = (sh->sh_flags & SHF_EXECINSTR) && sh->sh_type != SHT_NOBITS &&
+                in_bounds(elf, sh->sh_offset, sh->sh_size);
+    return true;
+}
+
+static void walk_symtab(const elf_file_t *elf, const Elf64_Shdr *symtab,
+    elf_symbol_fn fn, void *arg)
+{
+    if (symtab->sh_link >= elf->shnum ||
+        symtab->sh_entsize != sizeof(Elf64_Sym) ||
+        symtab->sh_offset % _Alignof(Elf64_Sym) != 0 ||
+        !in_bounds(elf, symtab->sh_offset, symtab->sh_size)) {
+        return;
+    }
+
+    const Elf64_Shdr *strtab = get_shdr(elf, symtab->sh_link);
+    if (!in_bounds(elf, strtab->sh_offset, strtab->sh_size)) {
+        return;
+    }
+    const char *strs = (const char *)elf->data + strtab->sh_offset;
+
+    const Elf64_Sym *syms =
+        (const Elf64_Sym *)(elf->data + symtab->sh_offset);
+    size_t count = symtab->sh_size / sizeof(Elf64_Sym);
+
+    for (size_t i = 1; i < count; i++) {
+        const Elf64_Sym *sym = &syms[i];
+        uint8_t type = ELF64_ST_TYPE(sym->st_info);
+
+        if (sym->st_shndx == SHN_UNDEF || type == STT_SECTION ||
+            type == STT_FILE) {
+            continue;
+        }
+
+        const char *name = get_string(strs, strtab->sh_size, sym->st_name);
+        if (!name || !*name) {
+            continue;
+        }
+        fn(name, sym->st_value, sym->st_size, type,
+            ELF64_ST_BIND(sym->st_info), arg);
+    }
+}
+
+void elf_for_each_symbol(const elf_file_t *elf, elf_symbol_fn fn, void *arg)
+{
+    for (size_t i = 0; i < elf->shnum; i++) {
+        const Elf64_Shdr *sh = get_shdr(elf, i);
+        if (sh->sh_type == SHT_SYMTAB || sh->sh_type == SHT_DYNSYM) {
+            walk_symtab(elf, sh, fn, arg);
+        }
+    }
+}
+
+bool elf_vaddr_to_offset(
+    const elf_file_t *elf, uint64_t vaddr, uint64_t *offset, uint64_t *avail)
+{
+    const Elf64_Phdr *phdrs = (const Elf64_Phdr *)(elf->data + elf->phoff);
+
+    for (size_t i = 0; i < elf->phnum; i++) {
+        const Elf64_Phdr *ph = &phdrs[i];
+        if (ph->p_type != PT_LOAD || vaddr < ph->p_vaddr ||
+            vaddr - ph->p_vaddr >= ph->p_filesz) {
+            continue;
+        }
+
+        uint64_t off = ph->p_offset + (vaddr - ph->p_vaddr);
+        uint64_t left = ph->p_filesz - (vaddr - ph->p_vaddr);
+        if (!in_bounds(elf, off, 0)) {
+            return false;
+        }
+        if (left > elf->len - off) {
+            left = elf->len - off;
+        }
+        *offset = off;
+        *avail = left;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,52 @@
+#ifndef ELF_FILE_H
+#define ELF_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    const char *name;
+    uint64_t addr;
+    uint64_t offset;
+    uint64_t size;
+    bool exec; // SHF_EXECINSTR with contents in the file
+} elf_section_t;
+
+// a validated little-endian ELF64 x86_64 image. all accessors are bounds
+// checked against `len`
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    bool mapped; // data is owned, from elf_open()
+    size_t shnum;
+    size_t shoff;
+    size_t phnum;
+    size_t phoff;
+    const char *shstrtab;
+    size_t shstrtab_size;
+} elf_file_t;
+
+typedef void (*elf_symbol_fn)(const char *name, uint64_t addr, uint64_t size,
+    uint8_t type, uint8_t bind, void *arg);
+
+bool elf_is_elf(const uint8_t *data, size_t len);
+
+// the buffer must outlive `elf`
+bool elf_parse(elf_file_t *elf, const uint8_t *data, size_t len);
+// maps `path` read-only and parses it
+bool elf_open(elf_file_t *elf, const char *path);
+void elf_close(elf_file_t *elf);
+
+size_t elf_section_count(const elf_file_t *elf);
+bool elf_section(const elf_file_t *elf, size_t i, elf_section_t *out);
+
+// calls `fn` for every defined symbol in .symtab and .dynsym
+void elf_for_each_symbol(const elf_file_t *elf, elf_symbol_fn fn, void *arg);
+
+// maps a virtual address to its file offset through the PT_LOAD segments.
+// `avail` receives the bytes backed by the file from that offset on
+bool elf_vaddr_to_offset(
+    const elf_file_t *elf, uint64_t vaddr, uint64_t *offset, uint64_t *avail);
+
+#endif // ELF_FILE_H
@@ -0,0 +1,312 @@
+#include "fingerprint.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FP_MAGIC 0x49504641 // "AFPI"
+#define FP_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    uint64_t strs_len;
+} fp_header_t;
+
+static inline uint64_t mix(uint64_t h, uint64_t v)
+{
+    h ^= v;
+    h *= 0x9e3779b97f4a7c15ull;
+    return h ^ (h >> 29);
+}
+
+static uint64_t hash_operand(uint64_t h, const air_operand_t *op,
+    const air_instr_t *instr, size_t size)
+{
+    h = mix(h, op->type);
+    switch (op->type) {
+    case OPERAND_REG:
+        return mix(h, (uint64_t)op->reg.id << 8 | op->reg.size);
+    case OPERAND_MEM: {
+        h = mix(h, (uint64_t)op->mem.base << 40 |
+                       (uint64_t)op->mem.index << 32 |
+                       (uint64_t)op->mem.factor << 24 |
+                       (uint64_t)op->mem.size << 16 |
+                       (uint64_t)op->mem.op_size << 8 | op->mem.segment);
+        // where RIP-relative data lands depends on the load address
+        bool rip = op->mem.base == REG_IP && op->mem.segment == SEG_NONE;
+        return rip ? h : mix(h, (uint32_t)op->mem.disp);
+    }
+    case OPERAND_IMM:
+        return mix(mix(h, op->imm.size), (uint64_t)op->imm.value);
+    case OPERAND_REL: {
+        int64_t target = (int64_t)(instr->offset + instr->length) +
+                         op->rel.disp;
+        if (target < 0 || (uint64_t)target >= size) {
+            return h; // another function, wherever it was put
+        }
+        return mix(h, (uint64_t)target);
+    }
+    default:
+        return h;
+    }
+}
+
+uint64_t fingerprint_instrs(const air_instr_list_t *instrs, size_t size)
+{
+    uint64_t h = mix(0, size);
+    size_t end = 0;
+
+    air_instr_iter_t it;
+    air_instr_iter_init(&it, instrs);
+    const air_instr_t *run;
+    size_t n;
+    while ((run = air_instr_iter_next(&it, &n))) {
+        for (size_t i = 0; i < n; i++) {
+            const air_instr_t *instr = &run[i];
+            // undecoded bytes, and the instruction's own shape
+            h = mix(h, instr->offset - end);
+            h = mix(h, (uint64_t)instr->type << 32 |
+                           (uint64_t)instr->ext << 16 |
+                           (uint64_t)instr->vsrc << 8 | instr->imm);
+            h = mix(h, instr->length);
+            h = hash_operand(h, &instr->ops.binary.dst, instr, size);
+            if (instr->type == AIR_MOV || instr->type == AIR_EXT) {
+                h = hash_operand(h, &instr->ops.binary.src, instr, size);
+            }
+            end = instr->offset + instr->length;
+        }
+    }
+    air_instr_iter_done(&it);
+
+    h = mix(h, size - end);
+    // murmur3's finalizer, so every input bit reaches every output bit
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    return h ^ (h >> 33);
+}
+
+void fp_index_init(fp_index_t *idx)
+{
+    memset(idx, 0, sizeof(*idx));
+    idx->last_path = UINT32_MAX;
+}
+
+void fp_index_destroy(fp_index_t *idx)
+{
+    free(idx->entries);
+    free(idx->strs);
+    free(idx->slots);
+    fp_index_init(idx);
+}
+
+static size_t slot_of(const fp_index_t *idx, uint64_t fp)
+{
+    return (size_t)((fp * 0x9e3779b97f4a7c15ull) >> 17) & idx->slot_mask;
+}
+
+static void insert_slot(fp_index_t *idx, uint32_t row)
+{
+    size_t s = slot_of(idx, idx->entries[row].fp);
+    while (idx->slots[s] != UINT32_MAX) {
+        s = (s + 1) & idx->slot_mask;
+    }
+    idx->slots[s] = row;
+}
+
+// keeps the table at most half full
+static bool grow_slots(fp_index_t *idx, size_t rows)
+{
+    if (idx->slots && rows * 2 <= idx->slot_mask + 1) {
+        return true;
+    }
+    size_t cap = idx->slots ? (idx->slot_mask + 1) * 2 : 1024;
+    while (cap < rows * 2) {
+        cap *= 2;
+    }
+    uint32_t *slots = (uint32_t *)malloc(cap * sizeof(*slots));
+    if (!slots) {
+        return false;
+    }
+    free(idx->slots);
+    idx->slots = slots;
+    idx->slot_mask = cap - 1;
+    memset(slots, 0xff, cap * sizeof(*slots));
+    for (size_t r = 0; r < idx->count; r++) {
+        insert_slot(idx, (uint32_t)r);
+    }
+    return true;
+}
+
+const fp_entry_t *fp_index_find(const fp_index_t *idx, uint64_t fp)
+{
+    if (!idx->slots) {
+        return NULL;
+    }
+    size_t s = slot_of(idx, fp);
+    while (idx->slots[s] != UINT32_MAX) {
+        const fp_entry_t *e = &idx->entries[idx->slots[s]];
+        if (e->fp == fp) {
+            return e;
+        }
+        s = (s + 1) & idx->slot_mask;
+    }
+    return NULL;
+}
+
+// copies `s` into the string table, its offset in `*out`
+static bool add_str(fp_index_t *idx, const char *s, uint32_t *out)
+{
+    size_t len = strlen(s) + 1;
+    if (idx->strs_len + len > UINT32_MAX) {
+        return false;
+    }
+    if (idx->strs_len + len > idx->strs_cap) {
+        size_t cap = idx->strs_cap ? idx->strs_cap * 2 : 4096;
+        while (cap < idx->strs_len + len) {
+            cap *= 2;
+        }
+        char *strs = (char *)realloc(idx->strs, cap);
+        if (!strs) {
+            return false;
+        }
+        idx->strs = strs;
+        idx->strs_cap = cap;
+    }
+    memcpy(idx->strs + idx->strs_len, s, len);
+    *out = (uint32_t)idx->strs_len;
+    idx->strs_len += len;
+    return true;
+}
+
+bool fp_index_add(fp_index_t *idx, uint64_t fp, const char *path,
+    const char *name, uint64_t addr, uint64_t size)
+{
+    if (idx->count >= UINT32_MAX - 1 || !grow_slots(idx, idx->count + 1)) {
+        return false;
+    }
+    if (idx->count == idx->capacity) {
+        size_t cap = idx->capacity ? idx->capacity * 2 : 1024;
+        fp_entry_t *entries =
+            (fp_entry_t *)realloc(idx->entries, cap * sizeof(*entries));
+        if (!entries) {
+            return false;
+        }
+        idx->entries = entries;
+        idx->capacity = cap;
+    }
+
+    fp_entry_t *e = &idx->entries[idx->count];
+    e->fp = fp;
+    e->addr = addr;
+    e->size = size;
+    if (idx->last_path == UINT32_MAX ||
+        strcmp(idx->strs + idx->last_path, path) != 0) {
+        if (!add_str(idx, path, &idx->last_path)) {
+            idx->last_path = UINT32_MAX;
+            return false;
+        }
+    }
+    e->path = idx->last_path;
+    if (!add_str(idx, name ? name : "", &e->name)) {
+        return false;
+    }
+    insert_slot(idx, (uint32_t)idx->count++);
+    return true;
+}
+
+bool fp_index_load(fp_index_t *idx, const char *path)
+{
+    fp_index_init(idx);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        if (errno == ENOENT) {
+            return true;
+        }
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    fp_header_t hdr;
+    bool ok = fread(&hdr, sizeof(hdr), 1, f) == 1 &&
+              hdr.magic == FP_MAGIC && hdr.version == FP_VERSION &&
+              hdr.count < UINT32_MAX && hdr.strs_len <= UINT32_MAX;
+    if (!ok) {
+        fprintf(stderr, "%s: not a fingerprint index\n", path);
+        fclose(f);
+        return false;
+    }
+
+    size_t count = (size_t)hdr.count;
+    size_t strs_len = (size_t)hdr.strs_len;
+    idx->entries = (fp_entry_t *)malloc(
+        (count ? count : 1) * sizeof(*idx->entries));
+    idx->strs = (char *)malloc(strs_len ? strs_len : 1);
+    if (!idx->entries || !idx->strs) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        fclose(f);
+        fp_index_destroy(idx);
+        return false;
+    }
+    idx->capacity = count ? count : 1;
+    idx->strs_cap = strs_len ? strs_len : 1;
+
+    ok = fread(idx->entries, sizeof(*idx->entries), count, f) == count &&
+         fread(idx->strs, 1, strs_len, f) == strs_len;
+    fclose(f);
+    for (size_t i = 0; ok && i < count; i++) {
+        const fp_entry_t *e = &idx->entries[i];
+        ok = e->path < strs_len && e->name < strs_len;
+    }
+    if (!ok || (strs_len && idx->strs[strs_len - 1] != '\0')) {
+        fprintf(stderr, "%s: truncated or corrupt fingerprint index\n", path);
+        fp_index_destroy(idx);
+        return false;
+    }
+    idx->count = count;
+    idx->strs_len = strs_len;
+
+    if (!grow_slots(idx, count)) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        fp_index_destroy(idx);
+        return false;
+    }
+    return true;
+}
+
+bool fp_index_save(const fp_index_t *idx, const char *path)
+{
+    size_t len = strlen(path) + sizeof(".tmp");
+    char *tmp = (char *)malloc(len);
+    if (!tmp) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        return false;
+    }
+    snprintf(tmp, len, "%s.tmp", path);
+
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", tmp, strerror(errno));
+        free(tmp);
+        return false;
+    }
+    fp_header_t hdr = {FP_MAGIC, FP_VERSION, idx->count, idx->strs_len};
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+              fwrite(idx->entries, sizeof(*idx->entries), idx->count, f) ==
+                  idx->count &&
+              fwrite(idx->strs, 1, idx->strs_len, f) == idx->strs_len &&
+              fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        free(tmp);
+        return false;
+    }
+    free(tmp);
+    return true;
+}
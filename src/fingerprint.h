@@ -0,0 +1,73 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include "air.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * a hash of a function's decoded instructions that doesn't change when
+ * the function is linked at another address: types, 0F-map ids, operand
+ * kinds, registers, sizes and immediates are hashed, RIP-relative
+ * displacements and branches leaving the function are not. branches
+ * within it are hashed as offsets from its start. bytes that didn't
+ * decode only count by their number
+ */
+uint64_t fingerprint_instrs(const air_instr_list_t *instrs, size_t size);
+
+// the first function seen with a fingerprint
+typedef struct {
+    uint64_t fp;
+    uint64_t addr;
+    uint64_t size;
+    uint32_t path; // offsets into fp_index_t.strs
+    uint32_t name;
+} fp_entry_t;
+
+/*
+ * fingerprint -> first occurrence, kept in a file across runs. the file
+ * is a header, the entries in the order they were added, then their
+ * NUL-terminated strings, all in native byte order
+ */
+typedef struct {
+    fp_entry_t *entries;
+    size_t count;
+    size_t capacity;
+    char *strs;
+    size_t strs_len;
+    size_t strs_cap;
+    uint32_t last_path; // the path added last, shared by its functions
+    // open addressing over `entries`
+    uint32_t *slots;
+    size_t slot_mask;
+} fp_index_t;
+
+void fp_index_init(fp_index_t *idx);
+void fp_index_destroy(fp_index_t *idx);
+// reads the index saved at `path`; a missing file is an empty index.
+// prints what's wrong and returns false otherwise
+bool fp_index_load(fp_index_t *idx, const char *path);
+// replaces the file at `path` with the index, through a rename so a
+// failed save leaves the old one in place
+bool fp_index_save(const fp_index_t *idx, const char *path);
+
+// the first occurrence of `fp`, NULL when it's new
+const fp_entry_t *fp_index_find(const fp_index_t *idx, uint64_t fp);
+// records the first occurrence of a fingerprint not in the index yet
+bool fp_index_add(fp_index_t *idx, uint64_t fp, const char *path,
+    const char *name, uint64_t addr, uint64_t size);
+
+static inline const char *fp_entry_path(
+    const fp_index_t *idx, const fp_entry_t *e)
+{
+    return idx->strs + e->path;
+}
+
+static inline const char *fp_entry_name(
+    const fp_index_t *idx, const fp_entry_t *e)
+{
+    return idx->strs + e->name;
+}
+
+#endif // FINGERPRINT_H
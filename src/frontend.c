@@ -1,31 +1,39 @@
 #include "frontend.h"
+#include "maps.h"
 #include <stdbool.h>
 #include <stdio.h>
 
 const reg_name_t reg_names[] = {
-    {"ax", "eax", "rax"},
-    {"cx", "ecx", "rcx"},
-    {"dx", "edx", "rdx"},
-    {"bx", "ebx", "rbx"},
-    {"sp", "esp", "rsp"},
-    {"bp", "ebp", "rbp"},
-    {"si", "esi", "rsi"},
-    {"di", "edi", "rdi"},
-    {"r8w", "r8d", "r8"},
-    {"r9w", "r9d", "r9"},
-    {"r10w", "r10d", "r10"},
-    {"r11w", "r11d", "r11"},
-    {"r12w", "r12d", "r12"},
-    {"r13w", "r13d", "r13"},
-    {"r14w", "r14d", "r14"},
-    {"r15w", "r15d", "r15"},
-    {"ip", "eip", "rip"},
+    {"ax", "eax", "rax", "al", "xmm0", "ymm0"},
+    {"cx", "ecx", "rcx", "cl", "xmm1", "ymm1"},
+    {"dx", "edx", "rdx", "dl", "xmm2", "ymm2"},
+    {"bx", "ebx", "rbx", "bl", "xmm3", "ymm3"},
+    {"sp", "esp", "rsp", "spl", "xmm4", "ymm4"},
+    {"bp", "ebp", "rbp", "bpl", "xmm5", "ymm5"},
+    {"si", "esi", "rsi", "sil", "xmm6", "ymm6"},
+    {"di", "edi", "rdi", "dil", "xmm7", "ymm7"},
+    {"r8w", "r8d", "r8", "r8b", "xmm8", "ymm8"},
+    {"r9w", "r9d", "r9", "r9b", "xmm9", "ymm9"},
+    {"r10w", "r10d", "r10", "r10b", "xmm10", "ymm10"},
+    {"r11w", "r11d", "r11", "r11b", "xmm11", "ymm11"},
+    {"r12w", "r12d", "r12", "r12b", "xmm12", "ymm12"},
+    {"r13w", "r13d", "r13", "r13b", "xmm13", "ymm13"},
+    {"r14w", "r14d", "r14", "r14b", "xmm14", "ymm14"},
+    {"r15w", "r15d", "r15", "r15b", "xmm15", "ymm15"},
+    {"ip", "eip", "rip", NULL, NULL, NULL},
+    {NULL, NULL, NULL, "ah", NULL, NULL},
+    {NULL, NULL, NULL, "ch", NULL, NULL},
+    {NULL, NULL, NULL, "dh", NULL, NULL},
+    {NULL, NULL, NULL, "bh", NULL, NULL},
 };
 
-const char *op_size_suffixes[3] = {
+const char *op_size_suffixes[6] = {
     "word",
     "dword",
     "qword",
+    "byte",
+    "xmmword",
+    "ymmword",
 };
 
 const char *segment_names[] = {
@@ -39,26 +47,38 @@ const char *segment_names[] = {
 
 const char *get_reg_name(uint8_t reg, reg_size_t size)
 {
-    if (reg > REG_IP) {
+    if (reg > REG_BH) {
         printf("going outside bounds. reg: %u\n", reg);
         return "unk";
     }
 
+    const char *name;
     switch (size) {
     case REG_SIZE_16:
-        return reg_names[reg].r16;
-    case REG_SIZE_32:
-        return reg_names[reg].r32;
+        name = reg_names[reg].r16;
+        break;
     case REG_SIZE_64:
-        return reg_names[reg].r64;
+        name = reg_names[reg].r64;
+        break;
+    case REG_SIZE_8:
+        name = reg_names[reg].r8;
+        break;
+    case REG_SIZE_128:
+        name = reg_names[reg].xmm;
+        break;
+    case REG_SIZE_256:
+        name = reg_names[reg].ymm;
+        break;
     default:
-        return reg_names[reg].r32;
+        name = reg_names[reg].r32;
+        break;
     }
+    return name ? name : "unk";
 }
 
 const char *get_op_size_suffix(operand_size_t size)
 {
-    if (size > OPERAND_SIZE_64) {
+    if (size > OPERAND_SIZE_256) {
         return "unk_size";
     }
     return op_size_suffixes[size];
@@ -72,35 +92,56 @@ const char *get_segment_name(seg_id_t id)
     return segment_names[id];
 }
 
-void print_operand(const air_operand_t *op, reg_size_t size_hint)
+const char *get_instr_type_name(air_instr_type_t type)
+{
+    switch (type) {
+    case AIR_POP:
+        return "pop";
+    case AIR_PUSH:
+        return "push";
+    case AIR_MOV:
+        return "mov";
+    case AIR_CALL:
+        return "call";
+    case AIR_JMP:
+        return "jmp";
+    case AIR_EXT:
+        return "ext";
+    default:
+        return "unk";
+    }
+}
+
+void fprint_operand(FILE *out, const air_operand_t *op, reg_size_t size_hint)
 {
     switch (op->type) {
     case OPERAND_REG: {
         const char *reg_name = get_reg_name(op->reg.id, op->reg.size);
-        printf("%s", reg_name);
+        fprintf(out, "%s", reg_name);
         break;
     }
     case OPERAND_MEM: {
         if (op->mem.segment != SEG_NONE) {
-            printf("%s", get_segment_name(op->mem.segment));
+            fprintf(out, "%s", get_segment_name(op->mem.segment));
             break;
         }
 
         const char *size_str = get_op_size_suffix((operand_size_t)size_hint);
-        printf("%s ptr [", size_str);
+        fprintf(out, "%s ptr [", size_str);
 
         bool need_plus = false;
 
         if (op->mem.base != REG_NONE) {
-            printf("%s", get_reg_name(op->mem.base, (reg_size_t)op->mem.size));
+            fprintf(out, "%s",
+                get_reg_name(op->mem.base, (reg_size_t)op->mem.size));
             need_plus = true;
         }
 
         if (op->mem.index != REG_NONE) {
             if (need_plus) {
-                printf("+");
+                fprintf(out, "+");
             }
-            printf("%s*%d",
+            fprintf(out, "%s*%d",
                 get_reg_name(op->mem.index, (reg_size_t)op->mem.size),
                 op->mem.factor);
             need_plus = true;
@@ -111,80 +152,264 @@ void print_operand(const air_operand_t *op, reg_size_t size_hint)
         if (disp != 0 || (!need_plus && op->mem.base == REG_NONE &&
                              op->mem.index == REG_NONE)) {
             if (disp < 0) {
-                printf("-%#x", -disp);
+                fprintf(out, "-%#x", -disp);
             }
             else {
                 if (need_plus) {
-                    printf("+");
+                    fprintf(out, "+");
                 }
-                printf("%#x", disp);
+                fprintf(out, "%#x", disp);
             }
         }
 
-        printf("]");
+        fprintf(out, "]");
         break;
     }
     case OPERAND_IMM: {
-        printf("0x%llx", (unsigned long long)op->imm.value);
+        fprintf(out, "0x%llx", (unsigned long long)op->imm.value);
+        break;
+    }
+    case OPERAND_REL: {
+        fprintf(out, "$%+d", op->rel.disp);
         break;
     }
     default:
-        printf("<?>");
+        fprintf(out, "<?>");
         break;
     }
 }
 
-void print_instr(const air_instr_t *instr)
+static void fprint_symbol(FILE *out, const sym_t *sym, uint64_t addr)
+{
+    if (addr == sym->addr) {
+        fprintf(out, " <%s>", sym->name);
+    }
+    else {
+        fprintf(out, " <%s+%#llx>", sym->name,
+            (unsigned long long)(addr - sym->addr));
+    }
+}
+
+void fprint_address(FILE *out, uint64_t addr, const fmt_opts_t *opts)
+{
+    fprintf(out, "%#llx", (unsigned long long)addr);
+    if (opts && opts->syms) {
+        const sym_t *sym = sym_index_lookup(opts->syms, addr);
+        if (sym) {
+            fprint_symbol(out, sym, addr);
+        }
+    }
+}
+
+static const char *const ext_map_names[MAPS] = {"0f", "0f38", "0f3a"};
+
+static void fprint_ext_name(FILE *out, const air_instr_t *instr)
+{
+    unsigned id = AIR_EXT_ID(instr->ext);
+    bool vex = instr->ext & AIR_EXT_VEX;
+    if (id >= EXT_RAW_FIRST) { // opcodes without an entry print as is
+        unsigned raw = id - EXT_RAW_FIRST;
+        fprintf(out, "%sop_%s_%02x", vex ? "vex_" : "",
+            ext_map_names[raw / 256], raw % 256);
+        return;
+    }
+    const ext_op_t *op = &ext_ops[id];
+    fprintf(out, "%s%s", vex && !(op->flags & EXT_VEX_ONLY) ? "v" : "",
+        op->name);
+}
+
+static void fprint_ext_operand(FILE *out, const air_instr_t *instr,
+    const air_operand_t *op, const fmt_opts_t *opts)
+{
+    if (op->type == OPERAND_REL) {
+        uint64_t target;
+        air_branch_target(instr, opts ? opts->base : 0, &target);
+        fprint_address(out, target, opts);
+    }
+    else if (op->type == OPERAND_MEM) {
+        fprint_operand(out, op, (reg_size_t)op->mem.op_size);
+    }
+    else {
+        fprint_operand(out, op, op->reg.size);
+    }
+}
+
+// operands in Intel order. the VEX.vvvv register is as wide as the
+// destination and goes where its entry's flags put it
+static void fprint_ext(
+    FILE *out, const air_instr_t *instr, const fmt_opts_t *opts)
+{
+    unsigned id = AIR_EXT_ID(instr->ext);
+    uint16_t flags = id < EXT_NAMED ? ext_ops[id].flags : 0;
+    const air_operand_t *dst = &instr->ops.binary.dst;
+    const air_operand_t *src = &instr->ops.binary.src;
+
+    air_operand_t vsrc = {.type = OPERAND_NONE};
+    if (instr->vsrc != REG_NONE) {
+        vsrc.type = OPERAND_REG;
+        vsrc.reg.id = (reg_id_t)instr->vsrc;
+        vsrc.reg.size = dst->type == OPERAND_MEM
+                            ? (reg_size_t)dst->mem.op_size
+                            : dst->reg.size;
+    }
+    const air_operand_t *order[4] = {dst, src};
+    if (flags & EXT_NDD) {
+        order[0] = &vsrc;
+        order[1] = dst;
+        order[2] = src;
+    }
+    else if (flags & EXT_VVVV_LAST) {
+        order[2] = &vsrc;
+    }
+    else {
+        order[1] = &vsrc;
+        order[2] = src;
+    }
+
+    fprint_ext_name(out, instr);
+    const char *sep = " ";
+    for (int i = 0; i < 4 && order[i]; i++) {
+        if (order[i]->type != OPERAND_NONE) {
+            fprintf(out, "%s", sep);
+            fprint_ext_operand(out, instr, order[i], opts);
+            sep = ", ";
+        }
+    }
+    if (flags & EXT_CL) {
+        fprintf(out, "%scl", sep);
+    }
+    if (flags & EXT_IS4) {
+        fprintf(out, "%s%s", sep,
+            get_reg_name(instr->imm >> 4, vsrc.reg.size));
+    }
+    else if (instr->ext & AIR_EXT_IMM) {
+        fprintf(out, "%s0x%x", sep, instr->imm);
+    }
+}
+
+static void fprint_instr_body(
+    FILE *out, const air_instr_t *instr, const fmt_opts_t *opts)
 {
     switch (instr->type) {
     case AIR_POP: {
         const air_operand_t *op = &instr->ops.unary.operand;
-        printf("pop ");
+        fprintf(out, "pop ");
         if (op->type == OPERAND_REG) {
-            print_operand(op, op->reg.size);
+            fprint_operand(out, op, op->reg.size);
         }
         else if (op->type == OPERAND_MEM) {
-            print_operand(op, (reg_size_t)op->mem.op_size);
+            fprint_operand(out, op, (reg_size_t)op->mem.op_size);
         }
-        printf("\n");
         break;
     }
     case AIR_PUSH: {
         const air_operand_t *op = &instr->ops.binary.dst;
-        printf("push ");
+        fprintf(out, "push ");
         if (op->type == OPERAND_REG) {
-            print_operand(op, op->reg.size);
+            fprint_operand(out, op, op->reg.size);
         }
-        printf("\n");
         break;
     }
     case AIR_MOV: {
         const air_operand_t *dst = &instr->ops.binary.dst;
         const air_operand_t *src = &instr->ops.binary.src;
 
-        printf("mov ");
+        fprintf(out, "mov ");
 
         if (dst->type == OPERAND_MEM && src->type == OPERAND_REG) {
-            print_operand(dst, src->reg.size);
-            printf(", ");
-            print_operand(src, src->reg.size);
+            fprint_operand(out, dst, src->reg.size);
+            fprintf(out, ", ");
+            fprint_operand(out, src, src->reg.size);
         }
         else if (dst->type == OPERAND_REG && src->type == OPERAND_MEM) {
-            print_operand(dst, dst->reg.size);
-            printf(", ");
-            print_operand(src, dst->reg.size);
+            fprint_operand(out, dst, dst->reg.size);
+            fprintf(out, ", ");
+            fprint_operand(out, src, dst->reg.size);
         }
         else { // fallback
-            print_operand(dst, REG_SIZE_64);
-            printf(", ");
-            print_operand(src, REG_SIZE_64);
+            fprint_operand(out, dst, REG_SIZE_64);
+            fprintf(out, ", ");
+            fprint_operand(out, src, REG_SIZE_64);
         }
 
-        printf("\n");
         break;
     }
+    case AIR_CALL:
+    case AIR_JMP: {
+        uint64_t target;
+        fprintf(out, instr->type == AIR_CALL ? "call " : "jmp ");
+        air_branch_target(instr, opts ? opts->base : 0, &target);
+        fprint_address(out, target, opts);
+        break;
+    }
+    case AIR_EXT:
+        fprint_ext(out, instr, opts);
+        break;
     default:
-        printf("unknown or unimplemented instruction (type %d)\n", instr->type);
+        fprintf(out, "unknown or unimplemented instruction (type %d)",
+            instr->type);
         break;
     }
 }
+
+void fprint_instr_fmt(
+    FILE *out, const air_instr_t *instr, const fmt_opts_t *opts)
+{
+    if (opts && opts->addresses) {
+        fprintf(out, "%#llx: ",
+            (unsigned long long)(opts->base + instr->offset));
+    }
+
+    fprint_instr_body(out, instr, opts);
+
+    const air_operand_t *rip;
+    if (opts && opts->syms && (rip = air_instr_rip_operand(instr))) {
+        fprintf(out, "  # ");
+        fprint_address(out, air_rip_target(instr, rip, opts->base), opts);
+    }
+
+    fprintf(out, "\n");
+}
+
+void fprint_instr(FILE *out, const air_instr_t *instr)
+{
+    fprint_instr_fmt(out, instr, NULL);
+}
+
+void fprint_instr_list_fmt(
+    FILE *out, const air_instr_list_t *list, const fmt_opts_t *opts)
+{
+    air_instr_iter_t it;
+    air_instr_iter_init(&it, list);
+    const air_instr_t *run;
+    size_t n;
+    while ((run = air_instr_iter_next(&it, &n))) {
+        for (size_t i = 0; i < n; i++) {
+            fprint_instr_fmt(out, &run[i], opts);
+        }
+    }
+    if (it.failed) {
+        fprintf(stderr, "couldn't map spilled instructions back in\n");
+    }
+    air_instr_iter_done(&it);
+}
+
+void fprint_instr_list(FILE *out, const air_instr_list_t *list)
+{
+    fprint_instr_list_fmt(out, list, NULL);
+}
+
+void print_operand(const air_operand_t *op, reg_size_t size_hint)
+{
+    fprint_operand(stdout, op, size_hint);
+}
+
+void print_instr(const air_instr_t *instr)
+{
+    fprint_instr(stdout, instr);
+}
+
+void print_instr_list(const air_instr_list_t *list)
+{
+    fprint_instr_list(stdout, list);
+}
@@ -3,23 +3,47 @@
 
 #include "air.h"
 #include "defs.h"
+#include "symbols.h"
 #include <stdint.h>
+#include <stdio.h>
 
 typedef struct {
     const char *r16;
     const char *r32;
     const char *r64;
+    const char *r8;
+    const char *xmm;
+    const char *ymm;
 } reg_name_t;
 
+typedef struct {
+    uint64_t base;           // address of the first decoded byte
+    const sym_index_t *syms; // names branch and RIP-relative targets
+    bool addresses;          // prefix every line with its address
+} fmt_opts_t;
+
 extern const reg_name_t reg_names[];
-extern const char *op_size_suffixes[3];
+extern const char *op_size_suffixes[6];
 extern const char *segment_names[];
 
 const char *get_reg_name(uint8_t reg, reg_size_t size);
 const char *get_op_size_suffix(operand_size_t size);
 const char *get_segment_name(seg_id_t id);
+const char *get_instr_type_name(air_instr_type_t type);
+
+void fprint_operand(FILE *out, const air_operand_t *op, reg_size_t size_hint);
+// `addr` followed by <symbol+offset> when opts has a covering symbol
+void fprint_address(FILE *out, uint64_t addr, const fmt_opts_t *opts);
+void fprint_instr(FILE *out, const air_instr_t *instr);
+void fprint_instr_list(FILE *out, const air_instr_list_t *list);
+// opts may be NULL: base 0, no symbols, no addresses
+void fprint_instr_fmt(
+    FILE *out, const air_instr_t *instr, const fmt_opts_t *opts);
+void fprint_instr_list_fmt(
+    FILE *out, const air_instr_list_t *list, const fmt_opts_t *opts);
 
 void print_operand(const air_operand_t *op, reg_size_t size_hint);
 void print_instr(const air_instr_t *instr);
+void print_instr_list(const air_instr_list_t *list);
 
 #endif // FRONTEND_H
@@ -0,0 +1,184 @@
+#include "funcs.h"
+#include "disasm.h"
+#include "pool.h"
+#include <elf.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    func_units_t *units;
+    size_t capacity;
+    const uint8_t *data;
+    uint64_t sec_addr;
+    uint64_t sec_offset;
+} builder_t;
+
+static bool add_unit(
+    builder_t *b, uint64_t start, uint64_t end, const sym_t *func)
+{
+    func_units_t *units = b->units;
+    if (units->count == b->capacity) {
+        size_t cap = b->capacity ? b->capacity * 2 : 256;
+        func_unit_t *p =
+            (func_unit_t *)realloc(units->units, cap * sizeof(*p));
+        if (!p) {
+            return false;
+        }
+        units->units = p;
+        b->capacity = cap;
+    }
+
+    func_unit_t *u = &units->units[units->count++];
+    u->addr = start;
+    u->code = b->data + b->sec_offset + (start - b->sec_addr);
+    u->size = (size_t)(end - start);
+    u->func = func;
+    air_instr_list_init(&u->instrs);
+    xref_buf_init(&u->xrefs);
+    u->collect_xrefs = false;
+    u->xrefs_failed = false;
+    return true;
+}
+
+// splits one section at its function boundaries. overlapping functions
+// are clipped so no byte is decoded twice
+static bool split_section(
+    builder_t *b, const elf_section_t *sec, const sym_index_t *syms)
+{
+    uint64_t end = sec->addr + sec->size;
+    uint64_t cursor = sec->addr;
+
+    for (size_t i = 0; i < syms->count; i++) {
+        const sym_t *sym = &syms->syms[i];
+        if (sym->type != STT_FUNC || !sym->size || sym->addr < sec->addr) {
+            continue;
+        }
+        if (sym->addr >= end) {
+            break;
+        }
+
+        uint64_t start = sym->addr > cursor ? sym->addr : cursor;
+        uint64_t stop =
+            sym->size > end - sym->addr ? end : sym->addr + sym->size;
+        if (start >= stop) {
+            continue;
+        }
+        if (start > cursor && !add_unit(b, cursor, start, NULL)) {
+            return false;
+        }
+        if (!add_unit(b, start, stop, sym)) {
+            return false;
+        }
+        cursor = stop;
+    }
+
+    return cursor == end || add_unit(b, cursor, end, NULL);
+}
+
+bool func_units_build(
+    func_units_t *units, const elf_file_t *elf, const sym_index_t *syms)
+{
+    memset(units, 0, sizeof(*units));
+    builder_t b = {units, 0, elf->data, 0, 0};
+
+    for (size_t i = 0; i < elf_section_count(elf); i++) {
+        elf_section_t sec;
+        if (!elf_section(elf, i, &sec) || !sec.exec || !sec.size) {
+            continue;
+        }
+        b.sec_addr = sec.addr;
+        b.sec_offset = sec.offset;
+        if (!split_section(&b, &sec, syms)) {
+            func_units_destroy(units);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void decode_unit(void *arg)
+{
+    func_unit_t *u = (func_unit_t *)arg;
+    disasm(u->code, u->size, &u->instrs);
+    if (u->collect_xrefs) {
+        u->xrefs_failed = !xref_collect(&u->xrefs, &u->instrs, u->addr);
+    }
+}
+
+static int cmp_size_desc(const void *a, const void *b)
+{
+    const func_unit_t *x = *(const func_unit_t *const *)a;
+    const func_unit_t *y = *(const func_unit_t *const *)b;
+    if (x->size != y->size) {
+        return x->size > y->size ? -1 : 1;
+    }
+    return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+bool func_units_decode(func_units_t *units, unsigned threads, bool xrefs)
+{
+    if (!units->count) {
+        return true;
+    }
+
+    // the biggest functions start first so a straggler can't hold up the
+    // end of the batch
+    func_unit_t **order =
+        (func_unit_t **)malloc(units->count * sizeof(*order));
+    if (!order) {
+        return false;
+    }
+    for (size_t i = 0; i < units->count; i++) {
+        order[i] = &units->units[i];
+        order[i]->collect_xrefs = xrefs;
+        order[i]->xrefs_failed = false;
+    }
+    qsort(order, units->count, sizeof(*order), cmp_size_desc);
+
+    pool_t *pool = pool_new(threads);
+    if (!pool) {
+        free(order);
+        return false;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < units->count; i++) {
+        if (!pool_submit(pool, decode_unit, order[i])) {
+            ok = false;
+            break;
+        }
+    }
+    pool_free(pool);
+    free(order);
+
+    for (size_t i = 0; ok && i < units->count; i++) {
+        ok = !units->units[i].xrefs_failed;
+    }
+    return ok;
+}
+
+bool func_units_xrefs(
+    const func_units_t *units, xref_index_t *idx, unsigned threads)
+{
+    xref_buf_t *bufs =
+        (xref_buf_t *)malloc((units->count + 1) * sizeof(*bufs));
+    if (!bufs) {
+        return false;
+    }
+    for (size_t i = 0; i < units->count; i++) {
+        bufs[i] = units->units[i].xrefs;
+    }
+    bool ok = xref_index_build(idx, bufs, units->count, threads);
+    free(bufs);
+    return ok;
+}
+
+void func_units_destroy(func_units_t *units)
+{
+    for (size_t i = 0; i < units->count; i++) {
+        air_instr_list_destroy(&units->units[i].instrs);
+        xref_buf_destroy(&units->units[i].xrefs);
+    }
+    free(units->units);
+    memset(units, 0, sizeof(*units));
+}
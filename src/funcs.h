@@ -0,0 +1,45 @@
+#ifndef FUNCS_H
+#define FUNCS_H
+
+#include "air.h"
+#include "elf_file.h"
+#include "symbols.h"
+#include "xref.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// a run of code decoded on its own: one STT_FUNC range, or the bytes
+// between two functions
+typedef struct {
+    uint64_t addr;
+    const uint8_t *code;
+    size_t size;
+    const sym_t *func; // NULL for a gap
+    air_instr_list_t instrs;
+    xref_buf_t xrefs; // filled by the worker that decoded the unit
+    bool collect_xrefs;
+    bool xrefs_failed;
+} func_unit_t;
+
+// units cover every executable section, in address order
+typedef struct {
+    func_unit_t *units;
+    size_t count;
+} func_units_t;
+
+// `elf` and `syms` must outlive the units
+bool func_units_build(
+    func_units_t *units, const elf_file_t *elf, const sym_index_t *syms);
+
+// decodes every unit on `threads` workers, largest first. with `xrefs`
+// each unit also records the references its code makes
+bool func_units_decode(func_units_t *units, unsigned threads, bool xrefs);
+
+// builds the cross-reference index from units decoded with `xrefs`
+bool func_units_xrefs(
+    const func_units_t *units, xref_index_t *idx, unsigned threads);
+
+void func_units_destroy(func_units_t *units);
+
+#endif // FUNCS_H
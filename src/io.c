@@ -0,0 +1,493 @@
+#include "io.h"
+#include "pool.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// largest single read submitted to the kernel
+#define IO_READ_MAX (1u << 30)
+
+typedef struct {
+    pool_t *workers;
+    io_consume_fn consume;
+    void *arg;
+
+    // files between "read started" and "consumed". bounding this keeps
+    // memory flat when decoding is slower than reading
+    pthread_mutex_t lock;
+    pthread_cond_t slot_freed;
+    unsigned outstanding;
+    unsigned limit;
+} io_batch_t;
+
+typedef struct {
+    io_batch_t *batch;
+    io_file_t file;
+    int fd;
+    size_t done;
+} io_req_t;
+
+void io_opts_init(io_opts_t *opts)
+{
+    opts->depth = IO_DEFAULT_DEPTH;
+    opts->workers = pool_default_threads();
+    opts->no_uring = false;
+}
+
+static bool acquire_slot(io_batch_t *batch, bool wait)
+{
+    bool ok = false;
+    pthread_mutex_lock(&batch->lock);
+    while (wait && batch->outstanding >= batch->limit) {
+        pthread_cond_wait(&batch->slot_freed, &batch->lock);
+    }
+    if (batch->outstanding < batch->limit) {
+        batch->outstanding++;
+        ok = true;
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return ok;
+}
+
+static void release_slot(io_batch_t *batch)
+{
+    pthread_mutex_lock(&batch->lock);
+    batch->outstanding--;
+    pthread_cond_signal(&batch->slot_freed);
+    pthread_mutex_unlock(&batch->lock);
+}
+
+static void consume_task(void *arg)
+{
+    io_req_t *req = (io_req_t *)arg;
+    io_batch_t *batch = req->batch;
+
+    batch->consume(&req->file, batch->arg);
+
+    free(req->file.data);
+    free(req);
+    release_slot(batch);
+}
+
+// hands a finished (or failed) request over to the decoder workers
+static void complete_req(io_req_t *req, int err)
+{
+    if (req->fd >= 0) {
+        close(req->fd);
+        req->fd = -1;
+    }
+    if (err) {
+        free(req->file.data);
+        req->file.data = NULL;
+        req->file.len = 0;
+        req->file.err = err;
+    }
+    else {
+        req->file.len = req->done;
+    }
+
+    if (!pool_submit(req->batch->workers, consume_task, req)) {
+        consume_task(req);
+    }
+}
+
+static io_req_t *new_req(io_batch_t *batch, const char *path, size_t index)
+{
+    io_req_t *req = (io_req_t *)calloc(1, sizeof(*req));
+    if (!req) {
+        return NULL;
+    }
+    req->batch = batch;
+    req->file.path = path;
+    req->file.index = index;
+    req->fd = -1;
+    return req;
+}
+
+// sizes the buffer for an opened file. returns an errno value
+static int alloc_for_fd(io_req_t *req)
+{
+    struct stat st;
+    if (fstat(req->fd, &st) < 0) {
+        return errno;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return EINVAL;
+    }
+
+    req->file.len = (size_t)st.st_size;
+    req->file.data = (uint8_t *)malloc(req->file.len ? req->file.len : 1);
+    return req->file.data ? 0 : ENOMEM;
+}
+
+/*
+ * thread pool backend: `depth` threads each doing a blocking open + read
+ */
+
+static void read_task(void *arg)
+{
+    io_req_t *req = (io_req_t *)arg;
+
+    req->fd = open(req->file.path, O_RDONLY | O_CLOEXEC);
+    if (req->fd < 0) {
+        complete_req(req, errno);
+        return;
+    }
+
+    int err = alloc_for_fd(req);
+    while (!err && req->done < req->file.len) {
+        ssize_t n = pread(req->fd, req->file.data + req->done,
+            req->file.len - req->done, (off_t)req->done);
+        if (n < 0) {
+            if (errno != EINTR) {
+                err = errno;
+            }
+            continue;
+        }
+        if (n == 0) {
+            break; // file shrank under us
+        }
+        req->done += (size_t)n;
+    }
+    complete_req(req, err);
+}
+
+static bool read_files_pool(io_batch_t *batch, const char *const *paths,
+    size_t count, unsigned depth)
+{
+    pool_t *readers = pool_new(depth);
+    if (!readers) {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        acquire_slot(batch, true);
+        io_req_t *req = new_req(batch, paths[i], i);
+        if (!req || !pool_submit(readers, read_task, req)) {
+            free(req);
+            release_slot(batch);
+            continue;
+        }
+    }
+
+    pool_free(readers);
+    return true;
+}
+
+/*
+ * io_uring backend: opens and reads go through the submission ring, the
+ * only blocking call on this thread is waiting for completions
+ */
+
+typedef struct {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned to_submit;
+} io_ring_t;
+
+static void ring_close(io_ring_t *ring)
+{
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+}
+
+// openat and read need 5.6+; older kernels get the thread pool instead
+static bool ring_supports_ops(int fd)
+{
+    struct {
+        struct io_uring_probe probe;
+        struct io_uring_probe_op ops[IORING_OP_LAST];
+    } p;
+    memset(&p, 0, sizeof(p));
+
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, &p,
+            IORING_OP_LAST) < 0) {
+        return false;
+    }
+    return p.probe.last_op >= IORING_OP_READ &&
+           (p.ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) &&
+           (p.ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+}
+
+static bool ring_open(io_ring_t *ring, unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0) {
+        return false;
+    }
+    if (!ring_supports_ops(ring->fd)) {
+        ring_close(ring);
+        return false;
+    }
+
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size =
+        p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        ring_close(ring);
+        return false;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    }
+    else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            ring_close(ring);
+            return false;
+        }
+    }
+
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size,
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+        IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        ring_close(ring);
+        return false;
+    }
+
+    uint8_t *sq = (uint8_t *)ring->sq_ring;
+    uint8_t *cq = (uint8_t *)ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return true;
+}
+
+static struct io_uring_sqe *ring_get_sqe(io_ring_t *ring)
+{
+    unsigned tail = *ring->sq_tail;
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head > *ring->sq_mask) {
+        return NULL;
+    }
+
+    unsigned idx = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    return sqe;
+}
+
+static int ring_enter(io_ring_t *ring, unsigned min_complete)
+{
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    int ret;
+    do {
+        ret = (int)syscall(__NR_io_uring_enter, ring->fd, ring->to_submit,
+            min_complete, flags, NULL, 0);
+    } while (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+
+    if (ret >= 0) {
+        ring->to_submit -= (unsigned)ret < ring->to_submit
+                               ? (unsigned)ret
+                               : ring->to_submit;
+    }
+    return ret;
+}
+
+static bool prep_open(io_ring_t *ring, io_req_t *req)
+{
+    struct io_uring_sqe *sqe = ring_get_sqe(ring);
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)req->file.path;
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    sqe->user_data = (uint64_t)(uintptr_t)req;
+    return true;
+}
+
+static bool prep_read(io_ring_t *ring, io_req_t *req)
+{
+    struct io_uring_sqe *sqe = ring_get_sqe(ring);
+    if (!sqe) {
+        return false;
+    }
+    size_t left = req->file.len - req->done;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = req->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(req->file.data + req->done);
+    sqe->len = left > IO_READ_MAX ? IO_READ_MAX : (uint32_t)left;
+    sqe->off = req->done;
+    sqe->user_data = (uint64_t)(uintptr_t)req;
+    return true;
+}
+
+// advances one request after its open or read completed. returns true while
+// the request still has an operation in the ring
+static bool on_completion(io_ring_t *ring, io_req_t *req, int res)
+{
+    if (res < 0) {
+        complete_req(req, -res);
+        return false;
+    }
+
+    if (req->fd < 0) { // open finished
+        req->fd = res;
+        int err = alloc_for_fd(req);
+        if (err) {
+            complete_req(req, err);
+            return false;
+        }
+    }
+    else if (res == 0) { // file shrank under us
+        complete_req(req, 0);
+        return false;
+    }
+    else {
+        req->done += (size_t)res;
+    }
+
+    if (req->done == req->file.len) {
+        complete_req(req, 0);
+        return false;
+    }
+
+    // each request owns at most one sqe, so there is always room here
+    prep_read(ring, req);
+    return true;
+}
+
+// returns -1 when io_uring is unusable here, so the caller can fall back
+static int read_files_uring(io_batch_t *batch, const char *const *paths,
+    size_t count, unsigned depth)
+{
+    io_ring_t ring;
+    if (!ring_open(&ring, depth)) {
+        return -1;
+    }
+
+    size_t next = 0;
+    unsigned inflight = 0;
+
+    while (next < count || inflight) {
+        while (next < count && inflight < depth && acquire_slot(batch, false)) {
+            io_req_t *req = new_req(batch, paths[next], next);
+            if (!req || !prep_open(&ring, req)) {
+                free(req);
+                release_slot(batch);
+                break;
+            }
+            next++;
+            inflight++;
+        }
+
+        if (!inflight) {
+            // every slot is held by a buffer waiting for a decoder
+            acquire_slot(batch, true);
+            release_slot(batch);
+            continue;
+        }
+
+        if (ring_enter(&ring, 1) < 0) {
+            // requests still owned by the kernel can't be reclaimed safely
+            break;
+        }
+
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            io_req_t *req = (io_req_t *)(uintptr_t)cqe->user_data;
+            if (!on_completion(&ring, req, cqe->res)) {
+                inflight--;
+            }
+            head++;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    if (inflight) {
+        return 0;
+    }
+    ring_close(&ring);
+    return 1;
+}
+
+bool io_read_files(const char *const *paths, size_t count,
+    const io_opts_t *opts, io_consume_fn consume, void *arg)
+{
+    unsigned depth = opts->depth ? opts->depth : IO_DEFAULT_DEPTH;
+
+    io_batch_t batch;
+    batch.workers = pool_new(opts->workers);
+    if (!batch.workers) {
+        return false;
+    }
+    batch.consume = consume;
+    batch.arg = arg;
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.slot_freed, NULL);
+    batch.outstanding = 0;
+    batch.limit = depth + (opts->workers ? opts->workers : 1);
+
+    int ret = -1;
+    if (!opts->no_uring) {
+        ret = read_files_uring(&batch, paths, count, depth);
+    }
+    bool ok = ret < 0 ? read_files_pool(&batch, paths, count, depth) : ret;
+
+    pool_free(batch.workers);
+    pthread_cond_destroy(&batch.slot_freed);
+    pthread_mutex_destroy(&batch.lock);
+    return ok;
+}
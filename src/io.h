@@ -0,0 +1,36 @@
+#ifndef IO_H
+#define IO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define IO_DEFAULT_DEPTH 64
+
+typedef struct {
+    const char *path;
+    size_t index; // position in the list passed to io_read_files()
+    uint8_t *data;
+    size_t len;
+    int err; // errno of the failed open/read, 0 on success
+} io_file_t;
+
+// called on a worker thread once a file has been read completely. the
+// buffer is released when the callback returns
+typedef void (*io_consume_fn)(const io_file_t *file, void *arg);
+
+typedef struct {
+    unsigned depth;   // file reads kept in flight
+    unsigned workers; // threads running the consume callback
+    bool no_uring;    // force the thread pool backend
+} io_opts_t;
+
+void io_opts_init(io_opts_t *opts);
+
+// reads every path and hands the buffers to `consume` as they complete.
+// io_uring is used when the kernel allows it, otherwise a pool of `depth`
+// blocking reader threads. returns false if the batch could not be started
+bool io_read_files(const char *const *paths, size_t count,
+    const io_opts_t *opts, io_consume_fn consume, void *arg);
+
+#endif // IO_H
@@ -1,9 +1,946 @@
 #include "air.h"
+#include "archive.h"
+#include "classify.h"
 #include "disasm.h"
+#include "elf_file.h"
+#include "fingerprint.h"
 #include "frontend.h"
+#include "funcs.h"
+#include "io.h"
+#include "pattern.h"
+#include "proc.h"
+#include "samples.h"
+#include "server.h"
+#include "shared.h"
+#include "sock.h"
+#include "stats.h"
+#include "stream.h"
+#include "symbols.h"
+#include "view.h"
+#include "xref.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-int main(void)
+// instructions printed by --at without a count
+#define AT_DEFAULT_COUNT 32
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [options] [file...]\n"
+        "  -j, --jobs N          decoder threads\n"
+        "  -q, --queue-depth N   file reads kept in flight (default %d)\n"
+        "      --no-uring        read files with a thread pool\n"
+        "      --raw             decode ELF files as raw bytes too\n"
+        "      --skip-data       don't decode stretches of executable\n"
+        "                        sections that look like tables, text or\n"
+        "                        compressed data\n"
+        "      --window SIZE     stream files through mmap windows of SIZE\n"
+        "                        bytes (k/m/g suffixes) instead of reading\n"
+        "                        them whole\n"
+        "      --at OFF[,N]      print N (default %d) instructions from the\n"
+        "                        first one at or after byte OFF, decoding\n"
+        "                        only as far as needed\n"
+        "      --air-budget SIZE keep at most about SIZE bytes of decoded\n"
+        "                        instructions per file in memory, spilling\n"
+        "                        the rest to a temporary file\n"
+        "      --functions       split ELF files at their function symbols\n"
+        "                        and decode the functions in parallel\n"
+        "      --index FILE      fingerprint the functions of ELF files,\n"
+        "                        report those already in the index FILE and\n"
+        "                        add the new ones to it\n"
+        "      --xrefs           list the calls, jumps and RIP-relative data\n"
+        "                        references of ELF files by target\n"
+        "      --xrefs-to A[-B]  only references to A or to targets in [A, B)\n"
+        "      --samples FILE    decode the sampled addresses listed in FILE\n"
+        "                        from the one ELF file given\n"
+        "      --pid PID         decode the executable mappings of a process\n"
+        "      --stats           print opcode, prefix, addressing mode and\n"
+        "                        length histograms of all files instead of\n"
+        "                        their instructions\n"
+        "      --grep PATTERN    list where the instruction pattern PATTERN\n"
+        "                        matches instead of printing instructions,\n"
+        "                        repeatable (see pattern.h for the syntax)\n"
+        "      --grep-file FILE  the same for each line of FILE\n"
+        "      --archive OUT     store the instructions of the one file given\n"
+        "                        in the compressed archive OUT\n"
+        "      --unarchive       print the instructions of archive files\n"
+        "      --serve PATH      serve disassembly requests on a unix socket\n"
+        "      --publish PATH    decode the one file given into shared memory\n"
+        "                        and hand it to processes connecting to the\n"
+        "                        unix socket PATH\n"
+        "      --attach PATH     print the instructions published on PATH\n"
+        "with no files, a built-in sample is disassembled\n",
+        prog, IO_DEFAULT_DEPTH, AT_DEFAULT_COUNT);
+}
+
+static bool parse_uint(const char *s, unsigned *out)
+{
+    char *end;
+    unsigned long v = strtoul(s, &end, 0);
+    if (*s == '\0' || *end != '\0' || v == 0 || v > 1u << 16) {
+        return false;
+    }
+    *out = (unsigned)v;
+    return true;
+}
+
+// decodes every executable section, addressed and symbolized
+typedef struct {
+    bool raw;
+    bool skip_data;
+    size_t air_budget;  // 0 for no limit
+    stats_set_t *stats; // count into these instead of printing
+    const pattern_set_t *grep; // or list the matches of these
+    bool failed; // a file couldn't be read, set from the workers
+} file_opts_t;
+
+// decodes `len` bytes at `code` into `out`. with --skip-data the likely
+// data in them is left out and listed first, at `base`
+static void decode_code(const uint8_t *code, size_t len, uint64_t base,
+    const file_opts_t *opts, data_ranges_t *data, air_instr_list_t *out)
+{
+    if (!opts->skip_data || !classify_data(code, len, data)) {
+        disasm(code, len, out);
+        return;
+    }
+    for (size_t i = 0; i < data->count; i++) {
+        printf("skipped likely data %#llx-%#llx\n",
+            (unsigned long long)(base + data->items[i].start),
+            (unsigned long long)(base + data->items[i].end));
+    }
+    disasm_skipping(code, len, data, out);
+}
+
+static void disasm_elf(
+    const io_file_t *file, const elf_file_t *elf, const file_opts_t *opts)
+{
+    sym_index_t syms;
+    if (!sym_index_build(&syms, elf)) {
+        fprintf(stderr, "%s: out of memory reading symbols\n", file->path);
+        return;
+    }
+
+    air_instr_list_t instr_list;
+    air_instr_list_init(&instr_list);
+    if (opts->air_budget &&
+        !air_instr_list_set_budget(&instr_list, opts->air_budget)) {
+        fprintf(stderr, "%s: out of memory\n", file->path);
+    }
+    data_ranges_t data;
+    data_ranges_init(&data);
+
+    flockfile(stdout);
+    printf("%s:\n", file->path);
+    for (size_t i = 0; i < elf_section_count(elf); i++) {
+        elf_section_t sec;
+        if (!elf_section(elf, i, &sec) || !sec.exec) {
+            continue;
+        }
+
+        air_instr_list_reset(&instr_list);
+        printf("\nsection %s:\n", sec.name);
+        decode_code(file->data + sec.offset, sec.size, sec.addr, opts, &data,
+            &instr_list);
+
+        fmt_opts_t fmt = {sec.addr, &syms, true};
+        fprint_instr_list_fmt(stdout, &instr_list, &fmt);
+    }
+    funlockfile(stdout);
+
+    data_ranges_destroy(&data);
+    air_instr_list_destroy(&instr_list);
+    sym_index_destroy(&syms);
+}
+
+// adds each line of `path` to `set`, skipping blank lines and # comments
+static bool read_patterns(const char *path, pattern_set_t *set)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    bool ok = true;
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while (ok && (len = getline(&line, &cap, f)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        const char *p = line + strspn(line, " \t");
+        if (*p != '\0' && *p != '#') {
+            ok = pattern_set_add(set, p);
+        }
+    }
+    free(line);
+    fclose(f);
+    return ok;
+}
+
+// bytes with an optional k, m or g suffix
+static bool parse_size(const char *s, size_t *out)
+{
+    char *end;
+    unsigned long long v = strtoull(s, &end, 0);
+    unsigned shift = 0;
+    switch (*end) {
+    case 'k':
+    case 'K':
+        shift = 10;
+        end++;
+        break;
+    case 'm':
+    case 'M':
+        shift = 20;
+        end++;
+        break;
+    case 'g':
+    case 'G':
+        shift = 30;
+        end++;
+        break;
+    }
+    if (*s == '\0' || *end != '\0' || v == 0 || v > (SIZE_MAX >> shift)) {
+        return false;
+    }
+    *out = (size_t)(v << shift);
+    return true;
+}
+
+// "OFF" or "OFF,N"
+static bool parse_at(const char *s, size_t *offset, size_t *count)
+{
+    char *end;
+    *offset = (size_t)strtoull(s, &end, 0);
+    if (end == s) {
+        return false;
+    }
+    *count = AT_DEFAULT_COUNT;
+    if (*end == '\0') {
+        return true;
+    }
+    if (*end != ',') {
+        return false;
+    }
+    const char *second = end + 1;
+    unsigned long long v = strtoull(second, &end, 0);
+    if (end == second || *end != '\0' || v == 0 || v > 1u << 20) {
+        return false;
+    }
+    *count = (size_t)v;
+    return true;
+}
+
+// maps the regular file `path` read-only. `*data` is NULL when it's empty
+static bool map_file(const char *path, const uint8_t **data, size_t *len)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || !S_ISREG(sb.st_mode)) {
+        fprintf(stderr, "%s: not a regular file\n", path);
+        close(fd);
+        return false;
+    }
+
+    *len = (size_t)sb.st_size;
+    *data = NULL;
+    if (*len) {
+        void *p = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            close(fd);
+            return false;
+        }
+        *data = (const uint8_t *)p;
+    }
+    close(fd);
+    return true;
+}
+
+// maps `path` and decodes just the windows of it --at needs
+static bool disasm_at(const char *path, size_t offset, size_t count)
+{
+    const uint8_t *code;
+    size_t len;
+    if (!map_file(path, &code, &len)) {
+        return false;
+    }
+
+    disasm_view_t view;
+    air_instr_t *instrs = (air_instr_t *)malloc(count * sizeof(*instrs));
+    bool ok = instrs && disasm_view_init(&view, code, len, 0);
+    if (ok) {
+        size_t n = disasm_view_read(&view, offset, instrs, count);
+        fmt_opts_t opts = {0, NULL, true};
+        printf("%s:\n", path);
+        for (size_t i = 0; i < n; i++) {
+            fprint_instr_fmt(stdout, &instrs[i], &opts);
+        }
+        disasm_view_destroy(&view);
+    }
+    else {
+        fprintf(stderr, "%s: out of memory\n", path);
+    }
+
+    free(instrs);
+    if (code) {
+        munmap((void *)code, len);
+    }
+    return ok;
+}
+
+typedef struct {
+    disasm_instr_fn fn;
+    void *arg;
+    uint64_t shift; // file offset of the decoded bytes
+} file_each_ctx_t;
+
+static void shift_instr(const air_instr_t *instr, void *arg)
+{
+    file_each_ctx_t *ctx = (file_each_ctx_t *)arg;
+    air_instr_t copy = *instr;
+    copy.offset += ctx->shift;
+    ctx->fn(&copy, ctx->arg);
+}
+
+// decodes `data`, its executable sections for ELF files, handing each
+// instruction to `fn` with its file offset
+static void file_each(const uint8_t *data, size_t len, bool raw,
+    disasm_instr_fn fn, void *arg)
+{
+    file_each_ctx_t ctx = {fn, arg, 0};
+    elf_file_t elf;
+    if (raw || !elf_parse(&elf, data, len)) {
+        disasm_each(data, len, shift_instr, &ctx);
+        return;
+    }
+    for (size_t i = 0; i < elf_section_count(&elf); i++) {
+        elf_section_t sec;
+        if (elf_section(&elf, i, &sec) && sec.exec) {
+            ctx.shift = sec.offset;
+            disasm_each(data + sec.offset, sec.size, shift_instr, &ctx);
+        }
+    }
+}
+
+static void archive_instr(const air_instr_t *instr, void *arg)
+{
+    air_archive_writer_add((air_archive_writer_t *)arg, instr);
+}
+
+// decodes `path` straight into an archive at `out`. offsets in the
+// archive are file offsets
+static bool archive_file(const char *path, const char *out, bool raw)
+{
+    const uint8_t *data;
+    size_t len;
+    if (!map_file(path, &data, &len)) {
+        return false;
+    }
+
+    air_archive_writer_t w;
+    if (air_archive_writer_open(&w, out, 0)) {
+        file_each(data, len, raw, archive_instr, &w);
+    }
+    uint64_t count = w.count;
+    size_t templates = w.ntemplates;
+    bool ok = air_archive_writer_close(&w);
+
+    struct stat sb;
+    if (ok && stat(out, &sb) == 0) {
+        uint64_t mem = count * sizeof(air_instr_t);
+        printf("%s: %llu instructions, %zu templates, %llu bytes, %.1fx "
+               "smaller than in memory\n",
+            out, (unsigned long long)count, templates,
+            (unsigned long long)sb.st_size,
+            sb.st_size ? (double)mem / (double)sb.st_size : 0.0);
+    }
+    else if (!ok) {
+        fprintf(stderr, "%s: %s\n", out, strerror(errno));
+    }
+
+    if (data) {
+        munmap((void *)data, len);
+    }
+    return ok;
+}
+
+// decodes the archive at `path` on `threads` workers and prints it
+static bool print_archive(const char *path, unsigned threads)
+{
+    air_archive_t ar;
+    if (!air_archive_open(&ar, path)) {
+        fprintf(stderr, "%s: %s\n", path,
+            errno == EINVAL ? "not an instruction archive" : strerror(errno));
+        return false;
+    }
+    air_instr_list_t instrs;
+    air_instr_list_init(&instrs);
+    bool ok = air_archive_read(&ar, threads, &instrs);
+    if (ok) {
+        printf("%s:\n", path);
+        print_instr_list(&instrs);
+    }
+    else {
+        fprintf(stderr, "%s: corrupt archive or out of memory\n", path);
+    }
+    air_instr_list_destroy(&instrs);
+    air_archive_close(&ar);
+    return ok;
+}
+
+static void publish_instr(const air_instr_t *instr, void *arg)
+{
+    air_shared_writer_add((air_shared_writer_t *)arg, instr);
+}
+
+// decodes `path` once into a sealed memfd and hands it to every process
+// that connects to `sock`. offsets in it are file offsets
+static bool publish_file(const char *path, const char *sock, bool raw)
+{
+    int listener = sock_listen(sock);
+    if (listener < 0) {
+        return false;
+    }
+    const uint8_t *data;
+    size_t len;
+    if (!map_file(path, &data, &len)) {
+        close(listener);
+        return false;
+    }
+
+    air_shared_writer_t w;
+    if (air_shared_writer_open(&w, path)) {
+        file_each(data, len, raw, publish_instr, &w);
+    }
+    uint64_t count = w.count;
+    int fd;
+    bool ok = air_shared_writer_seal(&w, &fd);
+    if (data) {
+        munmap((void *)data, len);
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        close(listener);
+        return false;
+    }
+
+    printf("%s: %llu instructions published on %s\n", path,
+        (unsigned long long)count, sock);
+    fflush(stdout);
+    ok = air_shared_publish(listener, fd);
+    close(fd);
+    close(listener);
+    return ok;
+}
+
+// maps the instructions published on `sock` and prints them in place
+static bool print_shared(const char *sock)
+{
+    air_shared_t s;
+    if (!air_shared_attach(&s, sock)) {
+        fprintf(stderr, "%s: %s\n", sock,
+            errno == EINVAL ? "not a published instruction region"
+                            : strerror(errno));
+        return false;
+    }
+    fmt_opts_t opts = {0, NULL, true};
+    printf("%s:\n", sock);
+    for (size_t i = 0; i < s.count; i++) {
+        fprint_instr_fmt(stdout, &s.instrs[i], &opts);
+    }
+    air_shared_close(&s);
+    return true;
+}
+
+static void print_stream_slice(
+    const air_instr_list_t *instrs, uint64_t base, void *arg)
+{
+    (void)arg;
+    fmt_opts_t opts = {base, NULL, false};
+    fprint_instr_list_fmt(stdout, instrs, &opts);
+}
+
+// adds the file to the calling worker's counters, the executable
+// sections only for ELF files
+static void count_file(const io_file_t *file, const file_opts_t *opts)
+{
+    disasm_stats_t *stats = stats_set_local(opts->stats);
+    if (!stats) {
+        fprintf(stderr, "%s: out of memory\n", file->path);
+        return;
+    }
+    stats->files++;
+
+    elf_file_t elf;
+    if (opts->raw || !elf_parse(&elf, file->data, file->len)) {
+        disasm_count(file->data, file->len, stats);
+        return;
+    }
+    for (size_t i = 0; i < elf_section_count(&elf); i++) {
+        elf_section_t sec;
+        if (elf_section(&elf, i, &sec) && sec.exec) {
+            disasm_count(file->data + sec.offset, sec.size, stats);
+        }
+    }
+}
+
+typedef struct {
+    const char *path;
+    const pattern_set_t *set;
+    uint64_t base; // address of the bytes being scanned
+} grep_ctx_t;
+
+static void print_hit(size_t pattern, size_t start, size_t end, void *arg)
+{
+    const grep_ctx_t *ctx = (const grep_ctx_t *)arg;
+    printf("%s: %#llx-%#llx: %s\n", ctx->path,
+        (unsigned long long)(ctx->base + start),
+        (unsigned long long)(ctx->base + end), ctx->set->texts[pattern]);
+}
+
+static void scan_instr(const air_instr_t *instr, void *arg)
+{
+    pattern_scan_instr((pattern_scan_t *)arg, instr);
+}
+
+// prints the matches of opts->grep, per executable section for ELF files
+static void grep_file(const io_file_t *file, const file_opts_t *opts)
+{
+    grep_ctx_t ctx = {file->path, opts->grep, 0};
+    pattern_scan_t scan;
+    if (!pattern_scan_init(&scan, opts->grep, print_hit, &ctx)) {
+        fprintf(stderr, "%s: out of memory\n", file->path);
+        return;
+    }
+
+    elf_file_t elf;
+    if (opts->raw || !elf_parse(&elf, file->data, file->len)) {
+        disasm_each(file->data, file->len, scan_instr, &scan);
+    } else {
+        for (size_t i = 0; i < elf_section_count(&elf); i++) {
+            elf_section_t sec;
+            if (!elf_section(&elf, i, &sec) || !sec.exec) {
+                continue;
+            }
+            ctx.base = sec.addr;
+            pattern_scan_reset(&scan);
+            disasm_each(file->data + sec.offset, sec.size, scan_instr, &scan);
+        }
+    }
+    pattern_scan_destroy(&scan);
+}
+
+static void disasm_file(const io_file_t *file, void *arg)
+{
+    file_opts_t *opts = (file_opts_t *)arg;
+
+    if (file->err) {
+        fprintf(stderr, "%s: %s\n", file->path, strerror(file->err));
+        __atomic_store_n(&opts->failed, true, __ATOMIC_RELAXED);
+        return;
+    }
+
+    if (opts->stats) {
+        count_file(file, opts);
+        return;
+    }
+
+    if (opts->grep) {
+        grep_file(file, opts);
+        return;
+    }
+
+    elf_file_t elf;
+    if (!opts->raw && elf_parse(&elf, file->data, file->len)) {
+        disasm_elf(file, &elf, opts);
+        return;
+    }
+
+    air_instr_list_t instr_list;
+    air_instr_list_init(&instr_list);
+    if (opts->air_budget &&
+        !air_instr_list_set_budget(&instr_list, opts->air_budget)) {
+        fprintf(stderr, "%s: out of memory\n", file->path);
+    }
+    data_ranges_t data;
+    data_ranges_init(&data);
+
+    flockfile(stdout);
+    printf("%s:\n", file->path);
+    decode_code(file->data, file->len, 0, opts, &data, &instr_list);
+    print_instr_list(&instr_list);
+    funlockfile(stdout);
+
+    data_ranges_destroy(&data);
+    air_instr_list_destroy(&instr_list);
+}
+
+// one file at a time, its functions spread over `threads` workers
+static bool disasm_functions(const char *path, unsigned threads)
+{
+    elf_file_t elf;
+    if (!elf_open(&elf, path)) {
+        fprintf(stderr, "%s: not a readable x86_64 ELF file\n", path);
+        return false;
+    }
+
+    sym_index_t syms;
+    func_units_t units;
+    if (!sym_index_build(&syms, &elf)) {
+        fprintf(stderr, "%s: out of memory reading symbols\n", path);
+        elf_close(&elf);
+        return false;
+    }
+    if (!func_units_build(&units, &elf, &syms) ||
+        !func_units_decode(&units, threads, false)) {
+        fprintf(stderr, "%s: out of memory decoding functions\n", path);
+        func_units_destroy(&units);
+        sym_index_destroy(&syms);
+        elf_close(&elf);
+        return false;
+    }
+
+    printf("%s:\n", path);
+    for (size_t i = 0; i < units.count; i++) {
+        const func_unit_t *u = &units.units[i];
+        if (u->func) {
+            printf("\n%#llx <%s>:\n", (unsigned long long)u->addr,
+                u->func->name);
+        }
+        else {
+            printf("\n%#llx:\n", (unsigned long long)u->addr);
+        }
+        fmt_opts_t opts = {u->addr, &syms, true};
+        fprint_instr_list_fmt(stdout, &u->instrs, &opts);
+    }
+
+    func_units_destroy(&units);
+    sym_index_destroy(&syms);
+    elf_close(&elf);
+    return true;
+}
+
+// fingerprints the functions of `path`, printing each one's first
+// occurrence when the index has it and recording it otherwise
+static bool index_functions(const char *path, unsigned threads,
+    fp_index_t *idx)
+{
+    elf_file_t elf;
+    if (!elf_open(&elf, path)) {
+        fprintf(stderr, "%s: not a readable x86_64 ELF file\n", path);
+        return false;
+    }
+
+    sym_index_t syms;
+    func_units_t units;
+    if (!sym_index_build(&syms, &elf)) {
+        fprintf(stderr, "%s: out of memory reading symbols\n", path);
+        elf_close(&elf);
+        return false;
+    }
+    if (!func_units_build(&units, &elf, &syms) ||
+        !func_units_decode(&units, threads, false)) {
+        fprintf(stderr, "%s: out of memory decoding functions\n", path);
+        func_units_destroy(&units);
+        sym_index_destroy(&syms);
+        elf_close(&elf);
+        return false;
+    }
+
+    bool ok = true;
+    size_t funcs = 0;
+    size_t known = 0;
+    printf("%s:\n", path);
+    for (size_t i = 0; i < units.count && ok; i++) {
+        const func_unit_t *u = &units.units[i];
+        if (!u->func) {
+            continue;
+        }
+        funcs++;
+        uint64_t fp = fingerprint_instrs(&u->instrs, u->size);
+        printf("%016llx %#llx %s", (unsigned long long)fp,
+            (unsigned long long)u->addr, u->func->name);
+
+        const fp_entry_t *e = fp_index_find(idx, fp);
+        if (e) {
+            known++;
+            printf(" = %s:%#llx %s\n", fp_entry_path(idx, e),
+                (unsigned long long)e->addr, fp_entry_name(idx, e));
+        }
+        else {
+            printf("\n");
+            ok = fp_index_add(idx, fp, path, u->func->name, u->addr, u->size);
+        }
+    }
+    if (ok) {
+        printf("%zu functions, %zu already indexed\n", funcs, known);
+    }
+    else {
+        fprintf(stderr, "%s: out of memory indexing functions\n", path);
+    }
+
+    func_units_destroy(&units);
+    sym_index_destroy(&syms);
+    elf_close(&elf);
+    return ok;
+}
+
+static const char *xref_kind_name(uint8_t kind)
+{
+    switch (kind) {
+    case XREF_CALL:
+        return "call";
+    case XREF_JMP:
+        return "jmp";
+    default:
+        return "data";
+    }
+}
+
+static void print_xref_row(
+    const xref_index_t *idx, size_t row, const fmt_opts_t *opts)
+{
+    size_t n = idx->first[row + 1] - idx->first[row];
+    fprint_address(stdout, idx->targets[row], opts);
+    printf(": %zu reference%s\n", n, n == 1 ? "" : "s");
+    for (size_t i = idx->first[row]; i < idx->first[row + 1]; i++) {
+        printf("    %-4s ", xref_kind_name(idx->kinds[i]));
+        fprint_address(stdout, idx->sources[i], opts);
+        printf("\n");
+    }
+}
+
+// decodes the functions of `path` in parallel, indexes their references
+// and prints those to targets in [lo, hi)
+static bool disasm_xrefs(
+    const char *path, unsigned threads, uint64_t lo, uint64_t hi)
+{
+    elf_file_t elf;
+    if (!elf_open(&elf, path)) {
+        fprintf(stderr, "%s: not a readable x86_64 ELF file\n", path);
+        return false;
+    }
+
+    sym_index_t syms;
+    func_units_t units;
+    xref_index_t idx;
+    bool ok = sym_index_build(&syms, &elf);
+    if (ok) {
+        ok = func_units_build(&units, &elf, &syms);
+        if (ok) {
+            ok = func_units_decode(&units, threads, true) &&
+                 func_units_xrefs(&units, &idx, threads);
+            func_units_destroy(&units);
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: out of memory indexing references\n", path);
+        sym_index_destroy(&syms);
+        elf_close(&elf);
+        return false;
+    }
+
+    fmt_opts_t opts = {0, &syms, false};
+    printf("%s:\n", path);
+    if (hi == lo + 1) {
+        ptrdiff_t row = xref_index_find(&idx, lo);
+        if (row >= 0) {
+            print_xref_row(&idx, (size_t)row, &opts);
+        }
+    }
+    else {
+        size_t first;
+        size_t rows = xref_index_range(&idx, lo, hi, &first);
+        for (size_t r = first; r < first + rows; r++) {
+            print_xref_row(&idx, r, &opts);
+        }
+    }
+
+    xref_index_destroy(&idx);
+    sym_index_destroy(&syms);
+    elf_close(&elf);
+    return true;
+}
+
+// "A" or "A-B", as the target range [A, A + 1) or [A, B)
+static bool parse_range(const char *s, uint64_t *lo, uint64_t *hi)
+{
+    char *end;
+    *lo = strtoull(s, &end, 0);
+    if (end == s) {
+        return false;
+    }
+    if (*end == '\0') {
+        *hi = *lo + 1;
+        return true;
+    }
+    if (*end != '-') {
+        return false;
+    }
+    const char *second = end + 1;
+    *hi = strtoull(second, &end, 0);
+    return end != second && *end == '\0' && *hi > *lo;
+}
+
+static const char *bucket_name(unsigned bucket)
+{
+    switch (bucket) {
+    case SAMPLES_UNDECODED:
+        return "(bad)";
+    case SAMPLES_UNMAPPED:
+        return "(unmapped)";
+    default:
+        return get_instr_type_name((air_instr_type_t)bucket);
+    }
+}
+
+// every sample in input order with its address's hit count, then where
+// the samples landed by instruction type
+static bool disasm_samples(const char *path, const char *samples_path)
+{
+    elf_file_t elf;
+    if (!elf_open(&elf, path)) {
+        fprintf(stderr, "%s: not a readable x86_64 ELF file\n", path);
+        return false;
+    }
+
+    samples_t samples;
+    sym_index_t syms;
+    if (!samples_load(&samples, samples_path)) {
+        elf_close(&elf);
+        return false;
+    }
+    if (!sym_index_build(&syms, &elf) || !samples_decode(&samples, &elf)) {
+        fprintf(stderr, "%s: out of memory decoding samples\n", path);
+        sym_index_destroy(&syms);
+        samples_destroy(&samples);
+        elf_close(&elf);
+        return false;
+    }
+
+    static size_t histogram[SAMPLES_UNMAPPED + 1];
+    for (size_t i = 0; i < samples.nuniq; i++) {
+        histogram[samples_bucket(&samples, i)] += samples.hits[i];
+    }
+
+    for (size_t i = 0; i < samples.count; i++) {
+        uint32_t u = samples.slot[i];
+        printf("%10zu  ", samples.hits[u]);
+        if (samples.status[u] <= 0) {
+            printf("%#llx: %s\n", (unsigned long long)samples.uniq[u],
+                bucket_name(samples_bucket(&samples, u)));
+            continue;
+        }
+        fmt_opts_t opts = {samples.uniq[u], &syms, true};
+        fprint_instr_fmt(stdout, &samples.instrs[u], &opts);
+    }
+
+    printf("\n%zu samples, %zu distinct addresses\n", samples.count,
+        samples.nuniq);
+    for (unsigned b = 0; b <= SAMPLES_UNMAPPED; b++) {
+        if (histogram[b]) {
+            printf("%-12s %10zu %6.2f%%\n", bucket_name(b), histogram[b],
+                100.0 * (double)histogram[b] / (double)samples.count);
+        }
+    }
+
+    sym_index_destroy(&syms);
+    samples_destroy(&samples);
+    elf_close(&elf);
+    return true;
+}
+
+typedef struct {
+    pid_t pid;
+    const char *path;
+    air_instr_list_t *list;
+} pid_run_t;
+
+// decodes one run of a mapping, or reports it when it couldn't be read
+static void disasm_pid_run(
+    uint64_t addr, const uint8_t *data, size_t len, void *arg)
+{
+    const pid_run_t *run = (const pid_run_t *)arg;
+    if (!data) {
+        fprintf(stderr, "%d: %#llx-%#llx %s is not readable, skipped\n",
+            (int)run->pid, (unsigned long long)addr,
+            (unsigned long long)(addr + len), run->path);
+        return;
+    }
+
+    air_instr_list_reset(run->list);
+    disasm(data, len, run->list);
+
+    printf("\n%#llx-%#llx %s:\n", (unsigned long long)addr,
+        (unsigned long long)(addr + len), run->path);
+    fmt_opts_t opts = {addr, NULL, true};
+    fprint_instr_list_fmt(stdout, run->list, &opts);
+}
+
+static bool disasm_pid(pid_t pid)
+{
+    proc_map_t *maps;
+    size_t count;
+    if (!proc_maps_read(pid, &maps, &count)) {
+        return false;
+    }
+
+    proc_mem_t mem;
+    if (!proc_mem_init(&mem, pid)) {
+        proc_maps_free(maps, count);
+        return false;
+    }
+
+    air_instr_list_t instr_list;
+    air_instr_list_init(&instr_list);
+    uint8_t *buf = NULL;
+    size_t buf_cap = 0;
+    bool ok = true;
+
+    // every mapping is read once, so the page cache is bypassed
+    for (size_t i = 0; i < count; i++) {
+        const proc_map_t *map = &maps[i];
+        size_t len = (size_t)(map->end - map->start);
+        if (!map->exec) {
+            continue;
+        }
+        if (len > buf_cap) {
+            uint8_t *p = (uint8_t *)realloc(buf, len);
+            if (!p) {
+                ok = false;
+                break;
+            }
+            buf = p;
+            buf_cap = len;
+        }
+        pid_run_t run = {pid, map->path, &instr_list};
+        proc_mem_each_run(&mem, map->start, buf, len, disasm_pid_run, &run);
+    }
+
+    free(buf);
+    air_instr_list_destroy(&instr_list);
+    proc_mem_destroy(&mem);
+    proc_maps_free(maps, count);
+    return ok;
+}
+
+static int disasm_sample(void)
 {
     const unsigned char instructions[] = {
         0x55,                         // push rbp
@@ -102,18 +1039,373 @@ int main(void)
     air_instr_list_init(&instr_list);
 
     disasm(instructions, sizeof(instructions), &instr_list);
+    print_instr_list(&instr_list);
+    air_instr_list_destroy(&instr_list);
+
+    return 0;
+}
+
+// everything main() does once the pattern set exists, so every way out
+// of it goes past the one cleanup
+static int run(int argc, char **argv, pattern_set_t *patterns)
+{
+    enum {
+        OPT_NO_URING = 0x100,
+        OPT_RAW,
+        OPT_WINDOW,
+        OPT_AIR_BUDGET,
+        OPT_AT,
+        OPT_FUNCTIONS,
+        OPT_SAMPLES,
+        OPT_XREFS,
+        OPT_XREFS_TO,
+        OPT_PID,
+        OPT_STATS,
+        OPT_SERVE,
+        OPT_GREP,
+        OPT_GREP_FILE,
+        OPT_INDEX,
+        OPT_SKIP_DATA,
+        OPT_ARCHIVE,
+        OPT_UNARCHIVE,
+        OPT_PUBLISH,
+        OPT_ATTACH,
+    };
+    static const struct option long_opts[] = {
+        {"jobs", required_argument, NULL, 'j'},
+        {"queue-depth", required_argument, NULL, 'q'},
+        {"no-uring", no_argument, NULL, OPT_NO_URING},
+        {"raw", no_argument, NULL, OPT_RAW},
+        {"window", required_argument, NULL, OPT_WINDOW},
+        {"air-budget", required_argument, NULL, OPT_AIR_BUDGET},
+        {"at", required_argument, NULL, OPT_AT},
+        {"functions", no_argument, NULL, OPT_FUNCTIONS},
+        {"samples", required_argument, NULL, OPT_SAMPLES},
+        {"xrefs", no_argument, NULL, OPT_XREFS},
+        {"xrefs-to", required_argument, NULL, OPT_XREFS_TO},
+        {"pid", required_argument, NULL, OPT_PID},
+        {"stats", no_argument, NULL, OPT_STATS},
+        {"serve", required_argument, NULL, OPT_SERVE},
+        {"grep", required_argument, NULL, OPT_GREP},
+        {"grep-file", required_argument, NULL, OPT_GREP_FILE},
+        {"index", required_argument, NULL, OPT_INDEX},
+        {"skip-data", no_argument, NULL, OPT_SKIP_DATA},
+        {"archive", required_argument, NULL, OPT_ARCHIVE},
+        {"unarchive", no_argument, NULL, OPT_UNARCHIVE},
+        {"publish", required_argument, NULL, OPT_PUBLISH},
+        {"attach", required_argument, NULL, OPT_ATTACH},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    io_opts_t io_opts;
+    io_opts_init(&io_opts);
+    const char *serve_path = NULL;
+    const char *publish_path = NULL;
+    const char *attach_path = NULL;
+    bool at = false;
+    size_t at_offset = 0;
+    size_t at_count = 0;
+    file_opts_t file_opts = {false, false, 0, NULL, NULL, false};
+    bool stats = false;
+    bool grep = false;
+    bool functions = false;
+    const char *index_path = NULL;
+    const char *archive_path = NULL;
+    bool unarchive = false;
+    size_t window = 0;
+    const char *samples_path = NULL;
+    bool xrefs = false;
+    uint64_t xref_lo = 0;
+    uint64_t xref_hi = UINT64_MAX;
+    unsigned pid = 0;
+
+    int c;
+    while ((c = getopt_long(argc, argv, "j:q:h", long_opts, NULL)) != -1) {
+        switch (c) {
+        case 'j': {
+            if (!parse_uint(optarg, &io_opts.workers)) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        }
+        case 'q': {
+            if (!parse_uint(optarg, &io_opts.depth)) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        }
+        case OPT_NO_URING: {
+            io_opts.no_uring = true;
+            break;
+        }
+        case OPT_RAW: {
+            file_opts.raw = true;
+            break;
+        }
+        case OPT_WINDOW: {
+            if (!parse_size(optarg, &window)) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        }
+        case OPT_AIR_BUDGET: {
+            if (!parse_size(optarg, &file_opts.air_budget)) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        }
+        case OPT_AT: {
+            if (!parse_at(optarg, &at_offset, &at_count)) {
+                usage(argv[0]);
+                return 1;
+            }
+            at = true;
+            break;
+        }
+        case OPT_FUNCTIONS: {
+            functions = true;
+            break;
+        }
+        case OPT_SAMPLES: {
+            samples_path = optarg;
+            break;
+        }
+        case OPT_XREFS: {
+            xrefs = true;
+            break;
+        }
+        case OPT_XREFS_TO: {
+            if (!parse_range(optarg, &xref_lo, &xref_hi)) {
+                usage(argv[0]);
+                return 1;
+            }
+            xrefs = true;
+            break;
+        }
+        case OPT_PID: {
+            char *end;
+            unsigned long v = strtoul(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || v == 0 || v > INT32_MAX) {
+                usage(argv[0]);
+                return 1;
+            }
+            pid = (unsigned)v;
+            break;
+        }
+        case OPT_STATS: {
+            stats = true;
+            break;
+        }
+        case OPT_SERVE: {
+            serve_path = optarg;
+            break;
+        }
+        case OPT_GREP: {
+            if (!pattern_set_add(patterns, optarg)) {
+                return 1;
+            }
+            grep = true;
+            break;
+        }
+        case OPT_GREP_FILE: {
+            if (!read_patterns(optarg, patterns)) {
+                return 1;
+            }
+            grep = true;
+            break;
+        }
+        case OPT_INDEX: {
+            index_path = optarg;
+            break;
+        }
+        case OPT_SKIP_DATA: {
+            file_opts.skip_data = true;
+            break;
+        }
+        case OPT_ARCHIVE: {
+            archive_path = optarg;
+            break;
+        }
+        case OPT_UNARCHIVE: {
+            unarchive = true;
+            break;
+        }
+        case OPT_PUBLISH: {
+            publish_path = optarg;
+            break;
+        }
+        case OPT_ATTACH: {
+            attach_path = optarg;
+            break;
+        }
+        case 'h': {
+            usage(argv[0]);
+            return 0;
+        }
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (serve_path) {
+        return server_run(serve_path) ? 0 : 1;
+    }
 
-    air_instr_chunk_t *chunk = instr_list.head;
-    while (chunk) {
-        size_t max = chunk == instr_list.tail ? instr_list.used_in_tail
-                                              : AIR_CHUNK_CAPACITY;
-        for (size_t i = 0; i < max; i++) {
-            print_instr(&chunk->items[i]);
+    if (attach_path) {
+        return print_shared(attach_path) ? 0 : 1;
+    }
+
+    if (publish_path) {
+        if (argc - optind != 1) {
+            usage(argv[0]);
+            return 1;
         }
-        air_instr_chunk_t *next = chunk->next;
-        free(chunk);
-        chunk = next;
+        bool ok = publish_file(argv[optind], publish_path, file_opts.raw);
+        return ok ? 0 : 1;
     }
 
-    return 0;
+    if (pid) {
+        return disasm_pid((pid_t)pid) ? 0 : 1;
+    }
+
+    if (samples_path) {
+        if (argc - optind != 1) {
+            usage(argv[0]);
+            return 1;
+        }
+        return disasm_samples(argv[optind], samples_path) ? 0 : 1;
+    }
+
+    if (optind == argc) {
+        if (grep || stats) { // only files are searched or counted
+            usage(argv[0]);
+            return 1;
+        }
+        return disasm_sample();
+    }
+
+    if (xrefs) {
+        int status = 0;
+        for (int i = optind; i < argc; i++) {
+            if (!disasm_xrefs(argv[i], io_opts.workers, xref_lo, xref_hi)) {
+                status = 1;
+            }
+        }
+        return status;
+    }
+
+    if (archive_path) {
+        if (argc - optind != 1) {
+            usage(argv[0]);
+            return 1;
+        }
+        bool ok = archive_file(argv[optind], archive_path, file_opts.raw);
+        return ok ? 0 : 1;
+    }
+
+    if (unarchive) {
+        int status = 0;
+        for (int i = optind; i < argc; i++) {
+            if (!print_archive(argv[i], io_opts.workers)) {
+                status = 1;
+            }
+        }
+        return status;
+    }
+
+    if (index_path) {
+        fp_index_t idx;
+        if (!fp_index_load(&idx, index_path)) {
+            return 1;
+        }
+        int status = 0;
+        for (int i = optind; i < argc; i++) {
+            if (!index_functions(argv[i], io_opts.workers, &idx)) {
+                status = 1;
+            }
+        }
+        if (!fp_index_save(&idx, index_path)) {
+            status = 1;
+        }
+        fp_index_destroy(&idx);
+        return status;
+    }
+
+    if (functions) {
+        int status = 0;
+        for (int i = optind; i < argc; i++) {
+            if (!disasm_functions(argv[i], io_opts.workers)) {
+                status = 1;
+            }
+        }
+        return status;
+    }
+
+    if (at) {
+        int status = 0;
+        for (int i = optind; i < argc; i++) {
+            if (!disasm_at(argv[i], at_offset, at_count)) {
+                status = 1;
+            }
+        }
+        return status;
+    }
+
+    if (window) {
+        int status = 0;
+        for (int i = optind; i < argc; i++) {
+            printf("%s:\n", argv[i]);
+            if (!stream_disasm_file(argv[i], window, print_stream_slice,
+                    NULL)) {
+                status = 1;
+            }
+        }
+        return status;
+    }
+
+    if (patterns->count) {
+        if (!pattern_set_compile(patterns)) {
+            fprintf(stderr, "out of memory compiling patterns\n");
+            return 1;
+        }
+        file_opts.grep = patterns;
+    }
+
+    stats_set_t stats_set;
+    if (stats) {
+        stats_set_init(&stats_set);
+        file_opts.stats = &stats_set;
+    }
+
+    if (!io_read_files((const char *const *)&argv[optind],
+            (size_t)(argc - optind), &io_opts, disasm_file, &file_opts)) {
+        fprintf(stderr, "failed to start reading input files\n");
+        if (stats) {
+            stats_set_destroy(&stats_set);
+        }
+        return 1;
+    }
+
+    if (stats) {
+        disasm_stats_t total;
+        stats_set_merge(&stats_set, &total);
+        stats_fprint(stdout, &total);
+        stats_set_destroy(&stats_set);
+    }
+    return file_opts.failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    pattern_set_t patterns;
+    pattern_set_init(&patterns);
+    int status = run(argc, argv, &patterns);
+    pattern_set_destroy(&patterns);
+    return status;
 }
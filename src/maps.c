@@ -0,0 +1,101 @@
+#include "maps.h"
+#include "air.h"
+
+_Static_assert(EXT_IDS <= AIR_EXT_ID(0xffff) + 1,
+    "ext_op_id_t doesn't fit air_instr_t.ext");
+
+// opcodes the decoder takes apart before the table (0F 38, 0F 3A, the
+// pop/push of fs and gs) keep the flags of their neighbours; nothing
+// looks them up. the ranges don't overlap, every opcode is set once
+const uint8_t map_flags[MAPS][256] = {
+    [MAP_0F] = {
+        [0x00 ... 0x03] = MAPF_MODRM,
+        [0x04] = MAPF_INVALID,
+        [0x05 ... 0x09] = 0,
+        [0x0a] = MAPF_INVALID,
+        [0x0b] = 0,
+        [0x0c] = MAPF_INVALID,
+        [0x0d] = MAPF_MODRM,
+        [0x0e] = 0,
+        [0x0f] = MAPF_MODRM | MAPF_IMM8, // 3DNow!, the suffix is an imm8
+        [0x10 ... 0x23] = MAPF_MODRM,
+        [0x24 ... 0x27] = MAPF_INVALID,
+        [0x28 ... 0x2f] = MAPF_MODRM,
+        [0x30 ... 0x35] = 0,
+        [0x36] = MAPF_INVALID,
+        [0x37] = 0,
+        [0x38] = MAPF_MODRM,
+        [0x39] = MAPF_INVALID,
+        [0x3a] = MAPF_MODRM,
+        [0x3b ... 0x3f] = MAPF_INVALID,
+        [0x40 ... 0x6f] = MAPF_MODRM,
+        [0x70 ... 0x73] = MAPF_MODRM | MAPF_IMM8,
+        [0x74 ... 0x76] = MAPF_MODRM,
+        [0x77] = 0,
+        [0x78 ... 0x7f] = MAPF_MODRM,
+        [0x80 ... 0x8f] = MAPF_REL32,
+        [0x90 ... 0x9f] = MAPF_MODRM,
+        [0xa0 ... 0xa2] = 0,
+        [0xa3] = MAPF_MODRM,
+        [0xa4] = MAPF_MODRM | MAPF_IMM8,
+        [0xa5 ... 0xa7] = MAPF_MODRM,
+        [0xa8 ... 0xaa] = 0,
+        [0xab] = MAPF_MODRM,
+        [0xac] = MAPF_MODRM | MAPF_IMM8,
+        [0xad ... 0xb9] = MAPF_MODRM,
+        [0xba] = MAPF_MODRM | MAPF_IMM8,
+        [0xbb ... 0xc1] = MAPF_MODRM,
+        [0xc2] = MAPF_MODRM | MAPF_IMM8,
+        [0xc3] = MAPF_MODRM,
+        [0xc4 ... 0xc6] = MAPF_MODRM | MAPF_IMM8,
+        [0xc7] = MAPF_MODRM,
+        [0xc8 ... 0xcf] = 0,
+        [0xd0 ... 0xff] = MAPF_MODRM,
+    },
+    [MAP_0F38] = {[0x00 ... 0xff] = MAPF_MODRM},
+    [MAP_0F3A] = {[0x00 ... 0xff] = MAPF_MODRM | MAPF_IMM8},
+};
+
+#define OPS_ENTRY(id, name, form, flags, mem)                                  \
+    [EXT_##id] = {name, EXT_FORM_##form, flags, EXT_MEM_##mem},
+#define OPS_ENTRY_X(id, map, pfx, opcode, name, form, flags, mem)              \
+    OPS_ENTRY(id, name, form, flags, mem)
+#define OPS_ENTRY_G(id, group, forms, reg, name, form, flags, mem)             \
+    OPS_ENTRY(id, name, form, flags, mem)
+#define OPS_ENTRY_R(id, modrm, name) OPS_ENTRY(id, name, NONE, 0, OP)
+
+const ext_op_t ext_ops[EXT_NAMED] = {
+    [EXT_UNNAMED] = {NULL, EXT_FORM_E, 0, EXT_MEM_OP},
+    EXT_OP_MAP(OPS_ENTRY_X, OPS_ENTRY)
+    EXT_GROUP_MAP(OPS_ENTRY_G, OPS_ENTRY)
+    EXT_SPECIAL_MAP(OPS_ENTRY)
+    EXT_0F01_MAP(OPS_ENTRY_R)
+};
+
+#define INDEX_ENTRY(id, map, pfx, opcode, name, form, flags, mem)              \
+    [MAP_##map][PFX_##pfx][opcode] = EXT_##id,
+#define INDEX_SKIP(id, name, form, flags, mem)
+#define INDEX_HEAD(group, map, pfx, opcode)                                    \
+    [MAP_##map][PFX_##pfx][opcode] = EXT_GROUP_FIRST + group,
+
+const uint16_t ext_index[MAPS][PFXS][256] = {
+    EXT_OP_MAP(INDEX_ENTRY, INDEX_SKIP)
+    EXT_GROUP_HEADS(INDEX_HEAD)
+};
+
+#define GROUP_SLOTS_MEM(group, reg, id) [group][reg] = id,
+#define GROUP_SLOTS_REG(group, reg, id) [group][(reg) + 8] = id,
+#define GROUP_SLOTS_ANY(group, reg, id)                                        \
+    GROUP_SLOTS_MEM(group, reg, id) GROUP_SLOTS_REG(group, reg, id)
+#define GROUP_ENTRY(id, group, forms, reg, name, form, flags, mem)             \
+    GROUP_SLOTS_##forms(group, reg, EXT_##id)
+
+const uint16_t ext_groups[EXT_GROUPS][16] = {
+    EXT_GROUP_MAP(GROUP_ENTRY, INDEX_SKIP)
+};
+
+#define REGS_ENTRY(id, modrm, name) [(modrm) - 0xc0] = EXT_##id,
+
+const uint16_t ext_0f01_regs[64] = {
+    EXT_0F01_MAP(REGS_ENTRY)
+};
@@ -0,0 +1,700 @@
+#ifndef MAPS_H
+#define MAPS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * the escape opcode maps: 0F, 0F 38 and 0F 3A, reached through escape bytes
+ * or a VEX prefix. every opcode's encoding shape (ModR/M, immediate) is in
+ * map_flags, so instruction lengths are right even for opcodes without a
+ * name below. the named ones are listed once and the enum, the name table
+ * and the lookup index are all generated from those lists
+ */
+
+typedef enum {
+    MAP_0F,
+    MAP_0F38,
+    MAP_0F3A,
+    MAPS,
+} opmap_t;
+
+// mandatory prefix, in VEX.pp order
+typedef enum {
+    PFX_NP,
+    PFX_66,
+    PFX_F3,
+    PFX_F2,
+    PFXS,
+} mand_prefix_t;
+
+#define MAPF_MODRM 0x01
+#define MAPF_IMM8 0x02
+#define MAPF_REL32 0x04
+#define MAPF_INVALID 0x80
+
+extern const uint8_t map_flags[MAPS][256];
+
+// where the operands come from. G/E: general register in ModR/M.reg and
+// ModR/M.rm, V/W: vector register in ModR/M.reg and ModR/M.rm. the first
+// one is the destination
+typedef enum {
+    EXT_FORM_NONE,
+    EXT_FORM_REL, // rel32 (jcc)
+    EXT_FORM_O,   // general register in the low opcode bits (bswap)
+    EXT_FORM_E,
+    EXT_FORM_G_E,
+    EXT_FORM_E_G,
+    EXT_FORM_V_W,
+    EXT_FORM_W_V,
+    EXT_FORM_V_E,
+    EXT_FORM_E_V,
+    EXT_FORM_G_W,
+    EXT_FORM_W,    // shift by immediate
+    EXT_FORM_VSIB, // gathers: the VSIB memory is only skipped, AIR has no
+                   // vector index, so no operands are kept
+} ext_form_t;
+
+#define EXT_NDS 0x01       // under VEX, vvvv is the first source
+#define EXT_NDS_REG 0x02   // the same, but only with a register in r/m
+#define EXT_NDD 0x04       // under VEX, vvvv is the destination
+#define EXT_VVVV_LAST 0x08 // vvvv is the last source (bzhi, shlx, ...)
+#define EXT_VEX_ONLY 0x10  // no legacy form, the name is printed as is
+#define EXT_W_NEXT 0x20    // REX.W or VEX.W selects the entry after this
+#define EXT_LIG 0x40       // vector registers are xmm whatever VEX.L says
+#define EXT_V_XMM 0x80     // the ModR/M.reg vector is xmm (vcvtpd2ps)
+#define EXT_CL 0x100       // an implicit cl operand comes last
+#define EXT_IS4 0x200      // imm8[7:4] is a fourth register operand
+
+// size of a memory operand: an operand_size_t, or relative to the vector
+// length or the general operand size
+#define EXT_MEM_B 3
+#define EXT_MEM_W 0
+#define EXT_MEM_D 1
+#define EXT_MEM_Q 2
+#define EXT_MEM_X 4
+#define EXT_MEM_VEC 0x10
+#define EXT_MEM_HALF 0x11
+#define EXT_MEM_QUARTER 0x12
+#define EXT_MEM_EIGHTH 0x13
+#define EXT_MEM_OP 0x14
+
+typedef enum {
+    GRP_0F18,
+    GRP_0FAE,
+    GRP_0FBA,
+    GRP_0FC7,
+    GRP_0F71,
+    GRP_0F72,
+    GRP_0F73,
+    GRP_0F38F3,
+    EXT_GROUPS,
+} ext_group_t;
+
+/*
+ * ROW(id, map, prefix, opcode, name, form, flags, mem) names one opcode.
+ * ROW_W(id, name, form, flags, mem) is the REX.W/VEX.W form of the row
+ * before it, which carries EXT_W_NEXT. under a legacy 66, F3 or F2 prefix
+ * without a row of its own the NP row applies, the prefix keeping its usual
+ * meaning
+ */
+// clang-format off
+#define EXT_OP_MAP(ROW, ROW_W)                                                 \
+    ROW(SYSCALL, 0F, NP, 0x05, "syscall", NONE, 0, OP)                         \
+    ROW(CLTS, 0F, NP, 0x06, "clts", NONE, 0, OP)                               \
+    ROW(SYSRET, 0F, NP, 0x07, "sysret", NONE, 0, OP)                           \
+    ROW(INVD, 0F, NP, 0x08, "invd", NONE, 0, OP)                               \
+    ROW(WBINVD, 0F, NP, 0x09, "wbinvd", NONE, 0, OP)                           \
+    ROW(UD2, 0F, NP, 0x0b, "ud2", NONE, 0, OP)                                 \
+    ROW(PREFETCHW, 0F, NP, 0x0d, "prefetchw", E, 0, B)                         \
+    ROW(MOVUPS, 0F, NP, 0x10, "movups", V_W, 0, VEC)                           \
+    ROW(MOVUPD, 0F, 66, 0x10, "movupd", V_W, 0, VEC)                           \
+    ROW(MOVSS, 0F, F3, 0x10, "movss", V_W, EXT_NDS_REG | EXT_LIG, D)           \
+    ROW(MOVSD, 0F, F2, 0x10, "movsd", V_W, EXT_NDS_REG | EXT_LIG, Q)           \
+    ROW(MOVUPS_ST, 0F, NP, 0x11, "movups", W_V, 0, VEC)                        \
+    ROW(MOVUPD_ST, 0F, 66, 0x11, "movupd", W_V, 0, VEC)                        \
+    ROW(MOVSS_ST, 0F, F3, 0x11, "movss", W_V, EXT_NDS_REG | EXT_LIG, D)        \
+    ROW(MOVSD_ST, 0F, F2, 0x11, "movsd", W_V, EXT_NDS_REG | EXT_LIG, Q)        \
+    ROW(MOVLPS, 0F, NP, 0x12, "movlps", V_W, EXT_NDS | EXT_LIG, Q)             \
+    ROW(MOVLPD, 0F, 66, 0x12, "movlpd", V_W, EXT_NDS | EXT_LIG, Q)             \
+    ROW(MOVSLDUP, 0F, F3, 0x12, "movsldup", V_W, 0, VEC)                       \
+    ROW(MOVDDUP, 0F, F2, 0x12, "movddup", V_W, 0, HALF)                        \
+    ROW(MOVLPS_ST, 0F, NP, 0x13, "movlps", W_V, EXT_LIG, Q)                    \
+    ROW(MOVLPD_ST, 0F, 66, 0x13, "movlpd", W_V, EXT_LIG, Q)                    \
+    ROW(UNPCKLPS, 0F, NP, 0x14, "unpcklps", V_W, EXT_NDS, VEC)                 \
+    ROW(UNPCKLPD, 0F, 66, 0x14, "unpcklpd", V_W, EXT_NDS, VEC)                 \
+    ROW(UNPCKHPS, 0F, NP, 0x15, "unpckhps", V_W, EXT_NDS, VEC)                 \
+    ROW(UNPCKHPD, 0F, 66, 0x15, "unpckhpd", V_W, EXT_NDS, VEC)                 \
+    ROW(MOVHPS, 0F, NP, 0x16, "movhps", V_W, EXT_NDS | EXT_LIG, Q)             \
+    ROW(MOVHPD, 0F, 66, 0x16, "movhpd", V_W, EXT_NDS | EXT_LIG, Q)             \
+    ROW(MOVSHDUP, 0F, F3, 0x16, "movshdup", V_W, 0, VEC)                       \
+    ROW(MOVHPS_ST, 0F, NP, 0x17, "movhps", W_V, EXT_LIG, Q)                    \
+    ROW(MOVHPD_ST, 0F, 66, 0x17, "movhpd", W_V, EXT_LIG, Q)                    \
+    ROW(NOP, 0F, NP, 0x1f, "nop", E, 0, OP)                                    \
+    ROW(MOVAPS, 0F, NP, 0x28, "movaps", V_W, 0, VEC)                           \
+    ROW(MOVAPD, 0F, 66, 0x28, "movapd", V_W, 0, VEC)                           \
+    ROW(MOVAPS_ST, 0F, NP, 0x29, "movaps", W_V, 0, VEC)                        \
+    ROW(MOVAPD_ST, 0F, 66, 0x29, "movapd", W_V, 0, VEC)                        \
+    ROW(CVTSI2SS, 0F, F3, 0x2a, "cvtsi2ss", V_E, EXT_NDS | EXT_LIG, OP)        \
+    ROW(CVTSI2SD, 0F, F2, 0x2a, "cvtsi2sd", V_E, EXT_NDS | EXT_LIG, OP)        \
+    ROW(MOVNTPS, 0F, NP, 0x2b, "movntps", W_V, 0, VEC)                         \
+    ROW(MOVNTPD, 0F, 66, 0x2b, "movntpd", W_V, 0, VEC)                         \
+    ROW(CVTTSS2SI, 0F, F3, 0x2c, "cvttss2si", G_W, EXT_LIG, D)                 \
+    ROW(CVTTSD2SI, 0F, F2, 0x2c, "cvttsd2si", G_W, EXT_LIG, Q)                 \
+    ROW(CVTSS2SI, 0F, F3, 0x2d, "cvtss2si", G_W, EXT_LIG, D)                   \
+    ROW(CVTSD2SI, 0F, F2, 0x2d, "cvtsd2si", G_W, EXT_LIG, Q)                   \
+    ROW(UCOMISS, 0F, NP, 0x2e, "ucomiss", V_W, EXT_LIG, D)                     \
+    ROW(UCOMISD, 0F, 66, 0x2e, "ucomisd", V_W, EXT_LIG, Q)                     \
+    ROW(COMISS, 0F, NP, 0x2f, "comiss", V_W, EXT_LIG, D)                       \
+    ROW(COMISD, 0F, 66, 0x2f, "comisd", V_W, EXT_LIG, Q)                       \
+    ROW(WRMSR, 0F, NP, 0x30, "wrmsr", NONE, 0, OP)                             \
+    ROW(RDTSC, 0F, NP, 0x31, "rdtsc", NONE, 0, OP)                             \
+    ROW(RDMSR, 0F, NP, 0x32, "rdmsr", NONE, 0, OP)                             \
+    ROW(RDPMC, 0F, NP, 0x33, "rdpmc", NONE, 0, OP)                             \
+    ROW(CMOVO, 0F, NP, 0x40, "cmovo", G_E, 0, OP)                              \
+    ROW(CMOVNO, 0F, NP, 0x41, "cmovno", G_E, 0, OP)                            \
+    ROW(CMOVB, 0F, NP, 0x42, "cmovb", G_E, 0, OP)                              \
+    ROW(CMOVAE, 0F, NP, 0x43, "cmovae", G_E, 0, OP)                            \
+    ROW(CMOVE, 0F, NP, 0x44, "cmove", G_E, 0, OP)                              \
+    ROW(CMOVNE, 0F, NP, 0x45, "cmovne", G_E, 0, OP)                            \
+    ROW(CMOVBE, 0F, NP, 0x46, "cmovbe", G_E, 0, OP)                            \
+    ROW(CMOVA, 0F, NP, 0x47, "cmova", G_E, 0, OP)                              \
+    ROW(CMOVS, 0F, NP, 0x48, "cmovs", G_E, 0, OP)                              \
+    ROW(CMOVNS, 0F, NP, 0x49, "cmovns", G_E, 0, OP)                            \
+    ROW(CMOVP, 0F, NP, 0x4a, "cmovp", G_E, 0, OP)                              \
+    ROW(CMOVNP, 0F, NP, 0x4b, "cmovnp", G_E, 0, OP)                            \
+    ROW(CMOVL, 0F, NP, 0x4c, "cmovl", G_E, 0, OP)                              \
+    ROW(CMOVGE, 0F, NP, 0x4d, "cmovge", G_E, 0, OP)                            \
+    ROW(CMOVLE, 0F, NP, 0x4e, "cmovle", G_E, 0, OP)                            \
+    ROW(CMOVG, 0F, NP, 0x4f, "cmovg", G_E, 0, OP)                              \
+    ROW(MOVMSKPS, 0F, NP, 0x50, "movmskps", G_W, 0, VEC)                       \
+    ROW(MOVMSKPD, 0F, 66, 0x50, "movmskpd", G_W, 0, VEC)                       \
+    ROW(SQRTPS, 0F, NP, 0x51, "sqrtps", V_W, 0, VEC)                           \
+    ROW(SQRTPD, 0F, 66, 0x51, "sqrtpd", V_W, 0, VEC)                           \
+    ROW(SQRTSS, 0F, F3, 0x51, "sqrtss", V_W, EXT_NDS | EXT_LIG, D)             \
+    ROW(SQRTSD, 0F, F2, 0x51, "sqrtsd", V_W, EXT_NDS | EXT_LIG, Q)             \
+    ROW(RSQRTPS, 0F, NP, 0x52, "rsqrtps", V_W, 0, VEC)                         \
+    ROW(RSQRTSS, 0F, F3, 0x52, "rsqrtss", V_W, EXT_NDS | EXT_LIG, D)           \
+    ROW(RCPPS, 0F, NP, 0x53, "rcpps", V_W, 0, VEC)                             \
+    ROW(RCPSS, 0F, F3, 0x53, "rcpss", V_W, EXT_NDS | EXT_LIG, D)               \
+    ROW(ANDPS, 0F, NP, 0x54, "andps", V_W, EXT_NDS, VEC)                       \
+    ROW(ANDPD, 0F, 66, 0x54, "andpd", V_W, EXT_NDS, VEC)                       \
+    ROW(ANDNPS, 0F, NP, 0x55, "andnps", V_W, EXT_NDS, VEC)                     \
+    ROW(ANDNPD, 0F, 66, 0x55, "andnpd", V_W, EXT_NDS, VEC)                     \
+    ROW(ORPS, 0F, NP, 0x56, "orps", V_W, EXT_NDS, VEC)                         \
+    ROW(ORPD, 0F, 66, 0x56, "orpd", V_W, EXT_NDS, VEC)                         \
+    ROW(XORPS, 0F, NP, 0x57, "xorps", V_W, EXT_NDS, VEC)                       \
+    ROW(XORPD, 0F, 66, 0x57, "xorpd", V_W, EXT_NDS, VEC)                       \
+    ROW(ADDPS, 0F, NP, 0x58, "addps", V_W, EXT_NDS, VEC)                       \
+    ROW(ADDPD, 0F, 66, 0x58, "addpd", V_W, EXT_NDS, VEC)                       \
+    ROW(ADDSS, 0F, F3, 0x58, "addss", V_W, EXT_NDS | EXT_LIG, D)               \
+    ROW(ADDSD, 0F, F2, 0x58, "addsd", V_W, EXT_NDS | EXT_LIG, Q)               \
+    ROW(MULPS, 0F, NP, 0x59, "mulps", V_W, EXT_NDS, VEC)                       \
+    ROW(MULPD, 0F, 66, 0x59, "mulpd", V_W, EXT_NDS, VEC)                       \
+    ROW(MULSS, 0F, F3, 0x59, "mulss", V_W, EXT_NDS | EXT_LIG, D)               \
+    ROW(MULSD, 0F, F2, 0x59, "mulsd", V_W, EXT_NDS | EXT_LIG, Q)               \
+    ROW(CVTPS2PD, 0F, NP, 0x5a, "cvtps2pd", V_W, 0, HALF)                      \
+    ROW(CVTPD2PS, 0F, 66, 0x5a, "cvtpd2ps", V_W, EXT_V_XMM, VEC)               \
+    ROW(CVTSS2SD, 0F, F3, 0x5a, "cvtss2sd", V_W, EXT_NDS | EXT_LIG, D)         \
+    ROW(CVTSD2SS, 0F, F2, 0x5a, "cvtsd2ss", V_W, EXT_NDS | EXT_LIG, Q)         \
+    ROW(CVTDQ2PS, 0F, NP, 0x5b, "cvtdq2ps", V_W, 0, VEC)                       \
+    ROW(CVTPS2DQ, 0F, 66, 0x5b, "cvtps2dq", V_W, 0, VEC)                       \
+    ROW(CVTTPS2DQ, 0F, F3, 0x5b, "cvttps2dq", V_W, 0, VEC)                     \
+    ROW(SUBPS, 0F, NP, 0x5c, "subps", V_W, EXT_NDS, VEC)                       \
+    ROW(SUBPD, 0F, 66, 0x5c, "subpd", V_W, EXT_NDS, VEC)                       \
+    ROW(SUBSS, 0F, F3, 0x5c, "subss", V_W, EXT_NDS | EXT_LIG, D)               \
+    ROW(SUBSD, 0F, F2, 0x5c, "subsd", V_W, EXT_NDS | EXT_LIG, Q)               \
+    ROW(MINPS, 0F, NP, 0x5d, "minps", V_W, EXT_NDS, VEC)                       \
+    ROW(MINPD, 0F, 66, 0x5d, "minpd", V_W, EXT_NDS, VEC)                       \
+    ROW(MINSS, 0F, F3, 0x5d, "minss", V_W, EXT_NDS | EXT_LIG, D)               \
+    ROW(MINSD, 0F, F2, 0x5d, "minsd", V_W, EXT_NDS | EXT_LIG, Q)               \
+    ROW(DIVPS, 0F, NP, 0x5e, "divps", V_W, EXT_NDS, VEC)                       \
+    ROW(DIVPD, 0F, 66, 0x5e, "divpd", V_W, EXT_NDS, VEC)                       \
+    ROW(DIVSS, 0F, F3, 0x5e, "divss", V_W, EXT_NDS | EXT_LIG, D)               \
+    ROW(DIVSD, 0F, F2, 0x5e, "divsd", V_W, EXT_NDS | EXT_LIG, Q)               \
+    ROW(MAXPS, 0F, NP, 0x5f, "maxps", V_W, EXT_NDS, VEC)                       \
+    ROW(MAXPD, 0F, 66, 0x5f, "maxpd", V_W, EXT_NDS, VEC)                       \
+    ROW(MAXSS, 0F, F3, 0x5f, "maxss", V_W, EXT_NDS | EXT_LIG, D)               \
+    ROW(MAXSD, 0F, F2, 0x5f, "maxsd", V_W, EXT_NDS | EXT_LIG, Q)               \
+    ROW(PUNPCKLBW, 0F, 66, 0x60, "punpcklbw", V_W, EXT_NDS, VEC)               \
+    ROW(PUNPCKLWD, 0F, 66, 0x61, "punpcklwd", V_W, EXT_NDS, VEC)               \
+    ROW(PUNPCKLDQ, 0F, 66, 0x62, "punpckldq", V_W, EXT_NDS, VEC)               \
+    ROW(PACKSSWB, 0F, 66, 0x63, "packsswb", V_W, EXT_NDS, VEC)                 \
+    ROW(PCMPGTB, 0F, 66, 0x64, "pcmpgtb", V_W, EXT_NDS, VEC)                   \
+    ROW(PCMPGTW, 0F, 66, 0x65, "pcmpgtw", V_W, EXT_NDS, VEC)                   \
+    ROW(PCMPGTD, 0F, 66, 0x66, "pcmpgtd", V_W, EXT_NDS, VEC)                   \
+    ROW(PACKUSWB, 0F, 66, 0x67, "packuswb", V_W, EXT_NDS, VEC)                 \
+    ROW(PUNPCKHBW, 0F, 66, 0x68, "punpckhbw", V_W, EXT_NDS, VEC)               \
+    ROW(PUNPCKHWD, 0F, 66, 0x69, "punpckhwd", V_W, EXT_NDS, VEC)               \
+    ROW(PUNPCKHDQ, 0F, 66, 0x6a, "punpckhdq", V_W, EXT_NDS, VEC)               \
+    ROW(PACKSSDW, 0F, 66, 0x6b, "packssdw", V_W, EXT_NDS, VEC)                 \
+    ROW(PUNPCKLQDQ, 0F, 66, 0x6c, "punpcklqdq", V_W, EXT_NDS, VEC)             \
+    ROW(PUNPCKHQDQ, 0F, 66, 0x6d, "punpckhqdq", V_W, EXT_NDS, VEC)             \
+    ROW(MOVD_TO, 0F, 66, 0x6e, "movd", V_E, EXT_LIG | EXT_W_NEXT, D)           \
+    ROW_W(MOVQ_TO, "movq", V_E, EXT_LIG, Q)                                    \
+    ROW(MOVDQA, 0F, 66, 0x6f, "movdqa", V_W, 0, VEC)                           \
+    ROW(MOVDQU, 0F, F3, 0x6f, "movdqu", V_W, 0, VEC)                           \
+    ROW(PSHUFD, 0F, 66, 0x70, "pshufd", V_W, 0, VEC)                           \
+    ROW(PSHUFHW, 0F, F3, 0x70, "pshufhw", V_W, 0, VEC)                         \
+    ROW(PSHUFLW, 0F, F2, 0x70, "pshuflw", V_W, 0, VEC)                         \
+    ROW(PCMPEQB, 0F, 66, 0x74, "pcmpeqb", V_W, EXT_NDS, VEC)                   \
+    ROW(PCMPEQW, 0F, 66, 0x75, "pcmpeqw", V_W, EXT_NDS, VEC)                   \
+    ROW(PCMPEQD, 0F, 66, 0x76, "pcmpeqd", V_W, EXT_NDS, VEC)                   \
+    ROW(EMMS, 0F, NP, 0x77, "emms", NONE, 0, OP)                               \
+    ROW(HADDPD, 0F, 66, 0x7c, "haddpd", V_W, EXT_NDS, VEC)                     \
+    ROW(HADDPS, 0F, F2, 0x7c, "haddps", V_W, EXT_NDS, VEC)                     \
+    ROW(HSUBPD, 0F, 66, 0x7d, "hsubpd", V_W, EXT_NDS, VEC)                     \
+    ROW(HSUBPS, 0F, F2, 0x7d, "hsubps", V_W, EXT_NDS, VEC)                     \
+    ROW(MOVD_FROM, 0F, 66, 0x7e, "movd", E_V, EXT_LIG | EXT_W_NEXT, D)         \
+    ROW_W(MOVQ_FROM, "movq", E_V, EXT_LIG, Q)                                  \
+    ROW(MOVQ_LOAD, 0F, F3, 0x7e, "movq", V_W, EXT_LIG, Q)                      \
+    ROW(MOVDQA_ST, 0F, 66, 0x7f, "movdqa", W_V, 0, VEC)                        \
+    ROW(MOVDQU_ST, 0F, F3, 0x7f, "movdqu", W_V, 0, VEC)                        \
+    ROW(JO, 0F, NP, 0x80, "jo", REL, 0, OP)                                    \
+    ROW(JNO, 0F, NP, 0x81, "jno", REL, 0, OP)                                  \
+    ROW(JB, 0F, NP, 0x82, "jb", REL, 0, OP)                                    \
+    ROW(JAE, 0F, NP, 0x83, "jae", REL, 0, OP)                                  \
+    ROW(JE, 0F, NP, 0x84, "je", REL, 0, OP)                                    \
+    ROW(JNE, 0F, NP, 0x85, "jne", REL, 0, OP)                                  \
+    ROW(JBE, 0F, NP, 0x86, "jbe", REL, 0, OP)                                  \
+    ROW(JA, 0F, NP, 0x87, "ja", REL, 0, OP)                                    \
+    ROW(JS, 0F, NP, 0x88, "js", REL, 0, OP)                                    \
+    ROW(JNS, 0F, NP, 0x89, "jns", REL, 0, OP)                                  \
+    ROW(JP, 0F, NP, 0x8a, "jp", REL, 0, OP)                                    \
+    ROW(JNP, 0F, NP, 0x8b, "jnp", REL, 0, OP)                                  \
+    ROW(JL, 0F, NP, 0x8c, "jl", REL, 0, OP)                                    \
+    ROW(JGE, 0F, NP, 0x8d, "jge", REL, 0, OP)                                  \
+    ROW(JLE, 0F, NP, 0x8e, "jle", REL, 0, OP)                                  \
+    ROW(JG, 0F, NP, 0x8f, "jg", REL, 0, OP)                                    \
+    ROW(SETO, 0F, NP, 0x90, "seto", E, 0, B)                                   \
+    ROW(SETNO, 0F, NP, 0x91, "setno", E, 0, B)                                 \
+    ROW(SETB, 0F, NP, 0x92, "setb", E, 0, B)                                   \
+    ROW(SETAE, 0F, NP, 0x93, "setae", E, 0, B)                                 \
+    ROW(SETE, 0F, NP, 0x94, "sete", E, 0, B)                                   \
+    ROW(SETNE, 0F, NP, 0x95, "setne", E, 0, B)                                 \
+    ROW(SETBE, 0F, NP, 0x96, "setbe", E, 0, B)                                 \
+    ROW(SETA, 0F, NP, 0x97, "seta", E, 0, B)                                   \
+    ROW(SETS, 0F, NP, 0x98, "sets", E, 0, B)                                   \
+    ROW(SETNS, 0F, NP, 0x99, "setns", E, 0, B)                                 \
+    ROW(SETP, 0F, NP, 0x9a, "setp", E, 0, B)                                   \
+    ROW(SETNP, 0F, NP, 0x9b, "setnp", E, 0, B)                                 \
+    ROW(SETL, 0F, NP, 0x9c, "setl", E, 0, B)                                   \
+    ROW(SETGE, 0F, NP, 0x9d, "setge", E, 0, B)                                 \
+    ROW(SETLE, 0F, NP, 0x9e, "setle", E, 0, B)                                 \
+    ROW(SETG, 0F, NP, 0x9f, "setg", E, 0, B)                                   \
+    ROW(PUSH_FS, 0F, NP, 0xa0, "push fs", NONE, 0, OP)                         \
+    ROW(CPUID, 0F, NP, 0xa2, "cpuid", NONE, 0, OP)                             \
+    ROW(BT, 0F, NP, 0xa3, "bt", E_G, 0, OP)                                    \
+    ROW(SHLD, 0F, NP, 0xa4, "shld", E_G, 0, OP)                                \
+    ROW(SHLD_CL, 0F, NP, 0xa5, "shld", E_G, EXT_CL, OP)                        \
+    ROW(PUSH_GS, 0F, NP, 0xa8, "push gs", NONE, 0, OP)                         \
+    ROW(BTS, 0F, NP, 0xab, "bts", E_G, 0, OP)                                  \
+    ROW(SHRD, 0F, NP, 0xac, "shrd", E_G, 0, OP)                                \
+    ROW(SHRD_CL, 0F, NP, 0xad, "shrd", E_G, EXT_CL, OP)                        \
+    ROW(IMUL, 0F, NP, 0xaf, "imul", G_E, 0, OP)                                \
+    ROW(CMPXCHG8, 0F, NP, 0xb0, "cmpxchg", E_G, 0, B)                          \
+    ROW(CMPXCHG, 0F, NP, 0xb1, "cmpxchg", E_G, 0, OP)                          \
+    ROW(BTR, 0F, NP, 0xb3, "btr", E_G, 0, OP)                                  \
+    ROW(MOVZX8, 0F, NP, 0xb6, "movzx", G_E, 0, B)                              \
+    ROW(MOVZX16, 0F, NP, 0xb7, "movzx", G_E, 0, W)                             \
+    ROW(POPCNT, 0F, F3, 0xb8, "popcnt", G_E, 0, OP)                            \
+    ROW(BTC, 0F, NP, 0xbb, "btc", E_G, 0, OP)                                  \
+    ROW(BSF, 0F, NP, 0xbc, "bsf", G_E, 0, OP)                                  \
+    ROW(TZCNT, 0F, F3, 0xbc, "tzcnt", G_E, 0, OP)                              \
+    ROW(BSR, 0F, NP, 0xbd, "bsr", G_E, 0, OP)                                  \
+    ROW(LZCNT, 0F, F3, 0xbd, "lzcnt", G_E, 0, OP)                              \
+    ROW(MOVSX8, 0F, NP, 0xbe, "movsx", G_E, 0, B)                              \
+    ROW(MOVSX16, 0F, NP, 0xbf, "movsx", G_E, 0, W)                             \
+    ROW(XADD8, 0F, NP, 0xc0, "xadd", E_G, 0, B)                                \
+    ROW(XADD, 0F, NP, 0xc1, "xadd", E_G, 0, OP)                                \
+    ROW(CMPPS, 0F, NP, 0xc2, "cmpps", V_W, EXT_NDS, VEC)                       \
+    ROW(CMPPD, 0F, 66, 0xc2, "cmppd", V_W, EXT_NDS, VEC)                       \
+    ROW(CMPSS, 0F, F3, 0xc2, "cmpss", V_W, EXT_NDS | EXT_LIG, D)               \
+    ROW(CMPSD, 0F, F2, 0xc2, "cmpsd", V_W, EXT_NDS | EXT_LIG, Q)               \
+    ROW(MOVNTI, 0F, NP, 0xc3, "movnti", E_G, 0, OP)                            \
+    ROW(PINSRW, 0F, 66, 0xc4, "pinsrw", V_E, EXT_NDS | EXT_LIG, W)             \
+    ROW(PEXTRW, 0F, 66, 0xc5, "pextrw", G_W, EXT_LIG, X)                       \
+    ROW(SHUFPS, 0F, NP, 0xc6, "shufps", V_W, EXT_NDS, VEC)                     \
+    ROW(SHUFPD, 0F, 66, 0xc6, "shufpd", V_W, EXT_NDS, VEC)                     \
+    ROW(BSWAP0, 0F, NP, 0xc8, "bswap", O, 0, OP)                               \
+    ROW(BSWAP1, 0F, NP, 0xc9, "bswap", O, 0, OP)                               \
+    ROW(BSWAP2, 0F, NP, 0xca, "bswap", O, 0, OP)                               \
+    ROW(BSWAP3, 0F, NP, 0xcb, "bswap", O, 0, OP)                               \
+    ROW(BSWAP4, 0F, NP, 0xcc, "bswap", O, 0, OP)                               \
+    ROW(BSWAP5, 0F, NP, 0xcd, "bswap", O, 0, OP)                               \
+    ROW(BSWAP6, 0F, NP, 0xce, "bswap", O, 0, OP)                               \
+    ROW(BSWAP7, 0F, NP, 0xcf, "bswap", O, 0, OP)                               \
+    ROW(ADDSUBPD, 0F, 66, 0xd0, "addsubpd", V_W, EXT_NDS, VEC)                 \
+    ROW(ADDSUBPS, 0F, F2, 0xd0, "addsubps", V_W, EXT_NDS, VEC)                 \
+    ROW(PSRLW, 0F, 66, 0xd1, "psrlw", V_W, EXT_NDS, X)                         \
+    ROW(PSRLD, 0F, 66, 0xd2, "psrld", V_W, EXT_NDS, X)                         \
+    ROW(PSRLQ, 0F, 66, 0xd3, "psrlq", V_W, EXT_NDS, X)                         \
+    ROW(PADDQ, 0F, 66, 0xd4, "paddq", V_W, EXT_NDS, VEC)                       \
+    ROW(PMULLW, 0F, 66, 0xd5, "pmullw", V_W, EXT_NDS, VEC)                     \
+    ROW(MOVQ_ST, 0F, 66, 0xd6, "movq", W_V, EXT_LIG, Q)                        \
+    ROW(PMOVMSKB, 0F, 66, 0xd7, "pmovmskb", G_W, 0, VEC)                       \
+    ROW(PSUBUSB, 0F, 66, 0xd8, "psubusb", V_W, EXT_NDS, VEC)                   \
+    ROW(PSUBUSW, 0F, 66, 0xd9, "psubusw", V_W, EXT_NDS, VEC)                   \
+    ROW(PMINUB, 0F, 66, 0xda, "pminub", V_W, EXT_NDS, VEC)                     \
+    ROW(PAND, 0F, 66, 0xdb, "pand", V_W, EXT_NDS, VEC)                         \
+    ROW(PADDUSB, 0F, 66, 0xdc, "paddusb", V_W, EXT_NDS, VEC)                   \
+    ROW(PADDUSW, 0F, 66, 0xdd, "paddusw", V_W, EXT_NDS, VEC)                   \
+    ROW(PMAXUB, 0F, 66, 0xde, "pmaxub", V_W, EXT_NDS, VEC)                     \
+    ROW(PANDN, 0F, 66, 0xdf, "pandn", V_W, EXT_NDS, VEC)                       \
+    ROW(PAVGB, 0F, 66, 0xe0, "pavgb", V_W, EXT_NDS, VEC)                       \
+    ROW(PSRAW, 0F, 66, 0xe1, "psraw", V_W, EXT_NDS, X)                         \
+    ROW(PSRAD, 0F, 66, 0xe2, "psrad", V_W, EXT_NDS, X)                         \
+    ROW(PAVGW, 0F, 66, 0xe3, "pavgw", V_W, EXT_NDS, VEC)                       \
+    ROW(PMULHUW, 0F, 66, 0xe4, "pmulhuw", V_W, EXT_NDS, VEC)                   \
+    ROW(PMULHW, 0F, 66, 0xe5, "pmulhw", V_W, EXT_NDS, VEC)                     \
+    ROW(CVTTPD2DQ, 0F, 66, 0xe6, "cvttpd2dq", V_W, EXT_V_XMM, VEC)             \
+    ROW(CVTDQ2PD, 0F, F3, 0xe6, "cvtdq2pd", V_W, 0, HALF)                      \
+    ROW(CVTPD2DQ, 0F, F2, 0xe6, "cvtpd2dq", V_W, EXT_V_XMM, VEC)               \
+    ROW(MOVNTDQ, 0F, 66, 0xe7, "movntdq", W_V, 0, VEC)                         \
+    ROW(PSUBSB, 0F, 66, 0xe8, "psubsb", V_W, EXT_NDS, VEC)                     \
+    ROW(PSUBSW, 0F, 66, 0xe9, "psubsw", V_W, EXT_NDS, VEC)                     \
+    ROW(PMINSW, 0F, 66, 0xea, "pminsw", V_W, EXT_NDS, VEC)                     \
+    ROW(POR, 0F, 66, 0xeb, "por", V_W, EXT_NDS, VEC)                           \
+    ROW(PADDSB, 0F, 66, 0xec, "paddsb", V_W, EXT_NDS, VEC)                     \
+    ROW(PADDSW, 0F, 66, 0xed, "paddsw", V_W, EXT_NDS, VEC)                     \
+    ROW(PMAXSW, 0F, 66, 0xee, "pmaxsw", V_W, EXT_NDS, VEC)                     \
+    ROW(PXOR, 0F, 66, 0xef, "pxor", V_W, EXT_NDS, VEC)                         \
+    ROW(LDDQU, 0F, F2, 0xf0, "lddqu", V_W, 0, VEC)                             \
+    ROW(PSLLW, 0F, 66, 0xf1, "psllw", V_W, EXT_NDS, X)                         \
+    ROW(PSLLD, 0F, 66, 0xf2, "pslld", V_W, EXT_NDS, X)                         \
+    ROW(PSLLQ, 0F, 66, 0xf3, "psllq", V_W, EXT_NDS, X)                         \
+    ROW(PMULUDQ, 0F, 66, 0xf4, "pmuludq", V_W, EXT_NDS, VEC)                   \
+    ROW(PMADDWD, 0F, 66, 0xf5, "pmaddwd", V_W, EXT_NDS, VEC)                   \
+    ROW(PSADBW, 0F, 66, 0xf6, "psadbw", V_W, EXT_NDS, VEC)                     \
+    ROW(MASKMOVDQU, 0F, 66, 0xf7, "maskmovdqu", V_W, EXT_LIG, X)               \
+    ROW(PSUBB, 0F, 66, 0xf8, "psubb", V_W, EXT_NDS, VEC)                       \
+    ROW(PSUBW, 0F, 66, 0xf9, "psubw", V_W, EXT_NDS, VEC)                       \
+    ROW(PSUBD, 0F, 66, 0xfa, "psubd", V_W, EXT_NDS, VEC)                       \
+    ROW(PSUBQ, 0F, 66, 0xfb, "psubq", V_W, EXT_NDS, VEC)                       \
+    ROW(PADDB, 0F, 66, 0xfc, "paddb", V_W, EXT_NDS, VEC)                       \
+    ROW(PADDW, 0F, 66, 0xfd, "paddw", V_W, EXT_NDS, VEC)                       \
+    ROW(PADDD, 0F, 66, 0xfe, "paddd", V_W, EXT_NDS, VEC)                       \
+    ROW(PSHUFB, 0F38, 66, 0x00, "pshufb", V_W, EXT_NDS, VEC)                   \
+    ROW(PHADDW, 0F38, 66, 0x01, "phaddw", V_W, EXT_NDS, VEC)                   \
+    ROW(PHADDD, 0F38, 66, 0x02, "phaddd", V_W, EXT_NDS, VEC)                   \
+    ROW(PMADDUBSW, 0F38, 66, 0x04, "pmaddubsw", V_W, EXT_NDS, VEC)             \
+    ROW(PMULHRSW, 0F38, 66, 0x0b, "pmulhrsw", V_W, EXT_NDS, VEC)               \
+    ROW(PTEST, 0F38, 66, 0x17, "ptest", V_W, 0, VEC)                           \
+    ROW(VBROADCASTSS, 0F38, 66, 0x18, "vbroadcastss", V_W, EXT_VEX_ONLY, D)    \
+    ROW(VBROADCASTSD, 0F38, 66, 0x19, "vbroadcastsd", V_W, EXT_VEX_ONLY, Q)    \
+    ROW(VBROADCASTF128, 0F38, 66, 0x1a, "vbroadcastf128",                      \
+        V_W, EXT_VEX_ONLY, X)                                                  \
+    ROW(PABSB, 0F38, 66, 0x1c, "pabsb", V_W, 0, VEC)                           \
+    ROW(PABSW, 0F38, 66, 0x1d, "pabsw", V_W, 0, VEC)                           \
+    ROW(PABSD, 0F38, 66, 0x1e, "pabsd", V_W, 0, VEC)                           \
+    ROW(PMOVSXBW, 0F38, 66, 0x20, "pmovsxbw", V_W, 0, HALF)                    \
+    ROW(PMOVSXBD, 0F38, 66, 0x21, "pmovsxbd", V_W, 0, QUARTER)                 \
+    ROW(PMOVSXBQ, 0F38, 66, 0x22, "pmovsxbq", V_W, 0, EIGHTH)                  \
+    ROW(PMOVSXWD, 0F38, 66, 0x23, "pmovsxwd", V_W, 0, HALF)                    \
+    ROW(PMOVSXWQ, 0F38, 66, 0x24, "pmovsxwq", V_W, 0, QUARTER)                 \
+    ROW(PMOVSXDQ, 0F38, 66, 0x25, "pmovsxdq", V_W, 0, HALF)                    \
+    ROW(PMULDQ, 0F38, 66, 0x28, "pmuldq", V_W, EXT_NDS, VEC)                   \
+    ROW(PCMPEQQ, 0F38, 66, 0x29, "pcmpeqq", V_W, EXT_NDS, VEC)                 \
+    ROW(MOVNTDQA, 0F38, 66, 0x2a, "movntdqa", V_W, 0, VEC)                     \
+    ROW(PACKUSDW, 0F38, 66, 0x2b, "packusdw", V_W, EXT_NDS, VEC)               \
+    ROW(PMOVZXBW, 0F38, 66, 0x30, "pmovzxbw", V_W, 0, HALF)                    \
+    ROW(PMOVZXBD, 0F38, 66, 0x31, "pmovzxbd", V_W, 0, QUARTER)                 \
+    ROW(PMOVZXBQ, 0F38, 66, 0x32, "pmovzxbq", V_W, 0, EIGHTH)                  \
+    ROW(PMOVZXWD, 0F38, 66, 0x33, "pmovzxwd", V_W, 0, HALF)                    \
+    ROW(PMOVZXWQ, 0F38, 66, 0x34, "pmovzxwq", V_W, 0, QUARTER)                 \
+    ROW(PMOVZXDQ, 0F38, 66, 0x35, "pmovzxdq", V_W, 0, HALF)                    \
+    ROW(VPERMD, 0F38, 66, 0x36, "vpermd", V_W, EXT_NDS | EXT_VEX_ONLY, VEC)    \
+    ROW(PCMPGTQ, 0F38, 66, 0x37, "pcmpgtq", V_W, EXT_NDS, VEC)                 \
+    ROW(PMINSB, 0F38, 66, 0x38, "pminsb", V_W, EXT_NDS, VEC)                   \
+    ROW(PMINSD, 0F38, 66, 0x39, "pminsd", V_W, EXT_NDS, VEC)                   \
+    ROW(PMINUW, 0F38, 66, 0x3a, "pminuw", V_W, EXT_NDS, VEC)                   \
+    ROW(PMINUD, 0F38, 66, 0x3b, "pminud", V_W, EXT_NDS, VEC)                   \
+    ROW(PMAXSB, 0F38, 66, 0x3c, "pmaxsb", V_W, EXT_NDS, VEC)                   \
+    ROW(PMAXSD, 0F38, 66, 0x3d, "pmaxsd", V_W, EXT_NDS, VEC)                   \
+    ROW(PMAXUW, 0F38, 66, 0x3e, "pmaxuw", V_W, EXT_NDS, VEC)                   \
+    ROW(PMAXUD, 0F38, 66, 0x3f, "pmaxud", V_W, EXT_NDS, VEC)                   \
+    ROW(PMULLD, 0F38, 66, 0x40, "pmulld", V_W, EXT_NDS, VEC)                   \
+    ROW(VPSRLVD, 0F38, 66, 0x45, "vpsrlvd", V_W,                               \
+        EXT_NDS | EXT_VEX_ONLY | EXT_W_NEXT, VEC)                              \
+    ROW_W(VPSRLVQ, "vpsrlvq", V_W, EXT_NDS | EXT_VEX_ONLY, VEC)                \
+    ROW(VPSRAVD, 0F38, 66, 0x46, "vpsravd", V_W, EXT_NDS | EXT_VEX_ONLY, VEC)  \
+    ROW(VPSLLVD, 0F38, 66, 0x47, "vpsllvd", V_W,                               \
+        EXT_NDS | EXT_VEX_ONLY | EXT_W_NEXT, VEC)                              \
+    ROW_W(VPSLLVQ, "vpsllvq", V_W, EXT_NDS | EXT_VEX_ONLY, VEC)                \
+    ROW(VPBROADCASTD, 0F38, 66, 0x58, "vpbroadcastd", V_W, EXT_VEX_ONLY, D)    \
+    ROW(VPBROADCASTQ, 0F38, 66, 0x59, "vpbroadcastq", V_W, EXT_VEX_ONLY, Q)    \
+    ROW(VBROADCASTI128, 0F38, 66, 0x5a, "vbroadcasti128",                      \
+        V_W, EXT_VEX_ONLY, X)                                                  \
+    ROW(VPBROADCASTB, 0F38, 66, 0x78, "vpbroadcastb", V_W, EXT_VEX_ONLY, B)    \
+    ROW(VPBROADCASTW, 0F38, 66, 0x79, "vpbroadcastw", V_W, EXT_VEX_ONLY, W)    \
+    ROW(VPMASKMOVD, 0F38, 66, 0x8c, "vpmaskmovd", V_W,                         \
+        EXT_NDS | EXT_VEX_ONLY | EXT_W_NEXT, VEC)                              \
+    ROW_W(VPMASKMOVQ, "vpmaskmovq", V_W, EXT_NDS | EXT_VEX_ONLY, VEC)          \
+    ROW(VPGATHERDD, 0F38, 66, 0x90, "vpgatherdd", VSIB,                        \
+        EXT_VEX_ONLY | EXT_W_NEXT, OP)                                         \
+    ROW_W(VPGATHERDQ, "vpgatherdq", VSIB, EXT_VEX_ONLY, OP)                    \
+    ROW(VPGATHERQD, 0F38, 66, 0x91, "vpgatherqd", VSIB,                        \
+        EXT_VEX_ONLY | EXT_W_NEXT, OP)                                         \
+    ROW_W(VPGATHERQQ, "vpgatherqq", VSIB, EXT_VEX_ONLY, OP)                    \
+    ROW(VGATHERDPS, 0F38, 66, 0x92, "vgatherdps", VSIB,                        \
+        EXT_VEX_ONLY | EXT_W_NEXT, OP)                                         \
+    ROW_W(VGATHERDPD, "vgatherdpd", VSIB, EXT_VEX_ONLY, OP)                    \
+    ROW(VGATHERQPS, 0F38, 66, 0x93, "vgatherqps", VSIB,                        \
+        EXT_VEX_ONLY | EXT_W_NEXT, OP)                                         \
+    ROW_W(VGATHERQPD, "vgatherqpd", VSIB, EXT_VEX_ONLY, OP)                    \
+    ROW(VFMADD132PS, 0F38, 66, 0x98, "vfmadd132ps", V_W,                       \
+        EXT_NDS | EXT_VEX_ONLY | EXT_W_NEXT, VEC)                              \
+    ROW_W(VFMADD132PD, "vfmadd132pd", V_W, EXT_NDS | EXT_VEX_ONLY, VEC)        \
+    ROW(VFMADD132SS, 0F38, 66, 0x99, "vfmadd132ss", V_W,                       \
+        EXT_NDS | EXT_VEX_ONLY | EXT_LIG | EXT_W_NEXT, D)                      \
+    ROW_W(VFMADD132SD, "vfmadd132sd",                                          \
+        V_W, EXT_NDS | EXT_VEX_ONLY | EXT_LIG, Q)                              \
+    ROW(VFMSUB132PS, 0F38, 66, 0x9a, "vfmsub132ps", V_W,                       \
+        EXT_NDS | EXT_VEX_ONLY | EXT_W_NEXT, VEC)                              \
+    ROW_W(VFMSUB132PD, "vfmsub132pd", V_W, EXT_NDS | EXT_VEX_ONLY, VEC)        \
+    ROW(VFNMADD132PS, 0F38, 66, 0x9c, "vfnmadd132ps", V_W,                     \
+        EXT_NDS | EXT_VEX_ONLY | EXT_W_NEXT, VEC)                              \
+    ROW_W(VFNMADD132PD, "vfnmadd132pd", V_W, EXT_NDS | EXT_VEX_ONLY, VEC)      \
+    ROW(VFMADD213PS, 0F38, 66, 0xa8, "vfmadd213ps", V_W,                       \
+        EXT_NDS | EXT_VEX_ONLY | EXT_W_NEXT, VEC)                              \
+    ROW_W(VFMADD213PD, "vfmadd213pd", V_W, EXT_NDS | EXT_VEX_ONLY, VEC)        \
+    ROW(VFMADD213SS, 0F38, 66, 0xa9, "vfmadd213ss", V_W,                       \
+        EXT_NDS | EXT_VEX_ONLY | EXT_LIG | EXT_W_NEXT, D)                      \
+    ROW_W(VFMADD213SD, "vfmadd213sd",                                          \
+        V_W, EXT_NDS | EXT_VEX_ONLY | EXT_LIG, Q)                              \
+    ROW(VFMSUB213PS, 0F38, 66, 0xaa, "vfmsub213ps", V_W,                       \
+        EXT_NDS | EXT_VEX_ONLY | EXT_W_NEXT, VEC)                              \
+    ROW_W(VFMSUB213PD, "vfmsub213pd", V_W, EXT_NDS | EXT_VEX_ONLY, VEC)        \
+    ROW(VFNMADD213PS, 0F38, 66, 0xac, "vfnmadd213ps", V_W,                     \
+        EXT_NDS | EXT_VEX_ONLY | EXT_W_NEXT, VEC)                              \
+    ROW_W(VFNMADD213PD, "vfnmadd213pd", V_W, EXT_NDS | EXT_VEX_ONLY, VEC)      \
+    ROW(VFMADD231PS, 0F38, 66, 0xb8, "vfmadd231ps", V_W,                       \
+        EXT_NDS | EXT_VEX_ONLY | EXT_W_NEXT, VEC)                              \
+    ROW_W(VFMADD231PD, "vfmadd231pd", V_W, EXT_NDS | EXT_VEX_ONLY, VEC)        \
+    ROW(VFMADD231SS, 0F38, 66, 0xb9, "vfmadd231ss", V_W,                       \
+        EXT_NDS | EXT_VEX_ONLY | EXT_LIG | EXT_W_NEXT, D)                      \
+    ROW_W(VFMADD231SD, "vfmadd231sd",                                          \
+        V_W, EXT_NDS | EXT_VEX_ONLY | EXT_LIG, Q)                              \
+    ROW(VFMSUB231PS, 0F38, 66, 0xba, "vfmsub231ps", V_W,                       \
+        EXT_NDS | EXT_VEX_ONLY | EXT_W_NEXT, VEC)                              \
+    ROW_W(VFMSUB231PD, "vfmsub231pd", V_W, EXT_NDS | EXT_VEX_ONLY, VEC)        \
+    ROW(VFNMADD231PS, 0F38, 66, 0xbc, "vfnmadd231ps", V_W,                     \
+        EXT_NDS | EXT_VEX_ONLY | EXT_W_NEXT, VEC)                              \
+    ROW_W(VFNMADD231PD, "vfnmadd231pd", V_W, EXT_NDS | EXT_VEX_ONLY, VEC)      \
+    ROW(AESIMC, 0F38, 66, 0xdb, "aesimc", V_W, 0, X)                           \
+    ROW(AESENC, 0F38, 66, 0xdc, "aesenc", V_W, EXT_NDS, VEC)                   \
+    ROW(AESENCLAST, 0F38, 66, 0xdd, "aesenclast", V_W, EXT_NDS, VEC)           \
+    ROW(AESDEC, 0F38, 66, 0xde, "aesdec", V_W, EXT_NDS, VEC)                   \
+    ROW(AESDECLAST, 0F38, 66, 0xdf, "aesdeclast", V_W, EXT_NDS, VEC)           \
+    ROW(MOVBE, 0F38, NP, 0xf0, "movbe", G_E, 0, OP)                            \
+    ROW(CRC32_8, 0F38, F2, 0xf0, "crc32", G_E, 0, B)                           \
+    ROW(MOVBE_ST, 0F38, NP, 0xf1, "movbe", E_G, 0, OP)                         \
+    ROW(CRC32, 0F38, F2, 0xf1, "crc32", G_E, 0, OP)                            \
+    ROW(ANDN, 0F38, NP, 0xf2, "andn", G_E, EXT_NDS | EXT_VEX_ONLY, OP)         \
+    ROW(BZHI, 0F38, NP, 0xf5, "bzhi", G_E,                                     \
+        EXT_NDS | EXT_VVVV_LAST | EXT_VEX_ONLY, OP)                            \
+    ROW(PEXT, 0F38, F3, 0xf5, "pext", G_E, EXT_NDS | EXT_VEX_ONLY, OP)         \
+    ROW(PDEP, 0F38, F2, 0xf5, "pdep", G_E, EXT_NDS | EXT_VEX_ONLY, OP)         \
+    ROW(MULX, 0F38, F2, 0xf6, "mulx", G_E, EXT_NDS | EXT_VEX_ONLY, OP)         \
+    ROW(BEXTR, 0F38, NP, 0xf7, "bextr", G_E,                                   \
+        EXT_NDS | EXT_VVVV_LAST | EXT_VEX_ONLY, OP)                            \
+    ROW(SHLX, 0F38, 66, 0xf7, "shlx", G_E,                                     \
+        EXT_NDS | EXT_VVVV_LAST | EXT_VEX_ONLY, OP)                            \
+    ROW(SARX, 0F38, F3, 0xf7, "sarx", G_E,                                     \
+        EXT_NDS | EXT_VVVV_LAST | EXT_VEX_ONLY, OP)                            \
+    ROW(SHRX, 0F38, F2, 0xf7, "shrx", G_E,                                     \
+        EXT_NDS | EXT_VVVV_LAST | EXT_VEX_ONLY, OP)                            \
+    ROW(VPERMQ, 0F3A, 66, 0x00, "vpermq", V_W, EXT_VEX_ONLY, VEC)              \
+    ROW(VPERMPD, 0F3A, 66, 0x01, "vpermpd", V_W, EXT_VEX_ONLY, VEC)            \
+    ROW(VPBLENDD, 0F3A, 66, 0x02, "vpblendd",                                  \
+        V_W, EXT_NDS | EXT_VEX_ONLY, VEC)                                      \
+    ROW(VPERMILPS, 0F3A, 66, 0x04, "vpermilps", V_W, EXT_VEX_ONLY, VEC)        \
+    ROW(VPERMILPD, 0F3A, 66, 0x05, "vpermilpd", V_W, EXT_VEX_ONLY, VEC)        \
+    ROW(VPERM2F128, 0F3A, 66, 0x06, "vperm2f128", V_W,                         \
+        EXT_NDS | EXT_VEX_ONLY, VEC)                                           \
+    ROW(ROUNDPS, 0F3A, 66, 0x08, "roundps", V_W, 0, VEC)                       \
+    ROW(ROUNDPD, 0F3A, 66, 0x09, "roundpd", V_W, 0, VEC)                       \
+    ROW(ROUNDSS, 0F3A, 66, 0x0a, "roundss", V_W, EXT_NDS | EXT_LIG, D)         \
+    ROW(ROUNDSD, 0F3A, 66, 0x0b, "roundsd", V_W, EXT_NDS | EXT_LIG, Q)         \
+    ROW(BLENDPS, 0F3A, 66, 0x0c, "blendps", V_W, EXT_NDS, VEC)                 \
+    ROW(BLENDPD, 0F3A, 66, 0x0d, "blendpd", V_W, EXT_NDS, VEC)                 \
+    ROW(PBLENDW, 0F3A, 66, 0x0e, "pblendw", V_W, EXT_NDS, VEC)                 \
+    ROW(PALIGNR, 0F3A, 66, 0x0f, "palignr", V_W, EXT_NDS, VEC)                 \
+    ROW(PEXTRB, 0F3A, 66, 0x14, "pextrb", E_V, EXT_LIG, B)                     \
+    ROW(PEXTRW_ST, 0F3A, 66, 0x15, "pextrw", E_V, EXT_LIG, W)                  \
+    ROW(PEXTRD, 0F3A, 66, 0x16, "pextrd", E_V, EXT_LIG | EXT_W_NEXT, D)        \
+    ROW_W(PEXTRQ, "pextrq", E_V, EXT_LIG, Q)                                   \
+    ROW(EXTRACTPS, 0F3A, 66, 0x17, "extractps", E_V, EXT_LIG, D)               \
+    ROW(VINSERTF128, 0F3A, 66, 0x18, "vinsertf128", V_W,                       \
+        EXT_NDS | EXT_VEX_ONLY, X)                                             \
+    ROW(VEXTRACTF128, 0F3A, 66, 0x19, "vextractf128", W_V, EXT_VEX_ONLY, X)    \
+    ROW(PINSRB, 0F3A, 66, 0x20, "pinsrb", V_E, EXT_NDS | EXT_LIG, B)           \
+    ROW(INSERTPS, 0F3A, 66, 0x21, "insertps", V_W, EXT_NDS | EXT_LIG, D)       \
+    ROW(PINSRD, 0F3A, 66, 0x22, "pinsrd", V_E,                                 \
+        EXT_NDS | EXT_LIG | EXT_W_NEXT, D)                                     \
+    ROW_W(PINSRQ, "pinsrq", V_E, EXT_NDS | EXT_LIG, Q)                         \
+    ROW(VINSERTI128, 0F3A, 66, 0x38, "vinserti128", V_W,                       \
+        EXT_NDS | EXT_VEX_ONLY, X)                                             \
+    ROW(VEXTRACTI128, 0F3A, 66, 0x39, "vextracti128", W_V, EXT_VEX_ONLY, X)    \
+    ROW(DPPS, 0F3A, 66, 0x40, "dpps", V_W, EXT_NDS, VEC)                       \
+    ROW(DPPD, 0F3A, 66, 0x41, "dppd", V_W, EXT_NDS, VEC)                       \
+    ROW(MPSADBW, 0F3A, 66, 0x42, "mpsadbw", V_W, EXT_NDS, VEC)                 \
+    ROW(PCLMULQDQ, 0F3A, 66, 0x44, "pclmulqdq", V_W, EXT_NDS, VEC)             \
+    ROW(VPERM2I128, 0F3A, 66, 0x46, "vperm2i128", V_W,                         \
+        EXT_NDS | EXT_VEX_ONLY, VEC)                                           \
+    ROW(VBLENDVPS, 0F3A, 66, 0x4a, "vblendvps", V_W,                           \
+        EXT_NDS | EXT_VEX_ONLY | EXT_IS4, VEC)                                 \
+    ROW(VBLENDVPD, 0F3A, 66, 0x4b, "vblendvpd", V_W,                           \
+        EXT_NDS | EXT_VEX_ONLY | EXT_IS4, VEC)                                 \
+    ROW(VPBLENDVB, 0F3A, 66, 0x4c, "vpblendvb", V_W,                           \
+        EXT_NDS | EXT_VEX_ONLY | EXT_IS4, VEC)                                 \
+    ROW(PCMPESTRM, 0F3A, 66, 0x60, "pcmpestrm", V_W, EXT_LIG, X)               \
+    ROW(PCMPESTRI, 0F3A, 66, 0x61, "pcmpestri", V_W, EXT_LIG, X)               \
+    ROW(PCMPISTRM, 0F3A, 66, 0x62, "pcmpistrm", V_W, EXT_LIG, X)               \
+    ROW(PCMPISTRI, 0F3A, 66, 0x63, "pcmpistri", V_W, EXT_LIG, X)               \
+    ROW(AESKEYGENASSIST, 0F3A, 66, 0xdf, "aeskeygenassist", V_W, 0, X)         \
+    ROW(RORX, 0F3A, F2, 0xf0, "rorx", G_E, EXT_VEX_ONLY, OP)
+
+// opcodes that pick their entry by ModR/M.reg: HEAD(group, map, prefix,
+// opcode) then GROUP_ROW(id, group, forms, reg, name, form, flags, mem),
+// where forms is MEM, REG or ANY for the ModR/M.mod values it covers
+#define EXT_GROUP_HEADS(HEAD)                                                  \
+    HEAD(GRP_0F18, 0F, NP, 0x18)                                               \
+    HEAD(GRP_0FAE, 0F, NP, 0xae)                                               \
+    HEAD(GRP_0FBA, 0F, NP, 0xba)                                               \
+    HEAD(GRP_0FC7, 0F, NP, 0xc7)                                               \
+    HEAD(GRP_0F71, 0F, 66, 0x71)                                               \
+    HEAD(GRP_0F72, 0F, 66, 0x72)                                               \
+    HEAD(GRP_0F73, 0F, 66, 0x73)                                               \
+    HEAD(GRP_0F38F3, 0F38, NP, 0xf3)
+
+#define EXT_GROUP_MAP(GROUP_ROW, ROW_W)                                        \
+    GROUP_ROW(PREFETCHNTA, GRP_0F18, MEM, 0, "prefetchnta", E, 0, B)           \
+    GROUP_ROW(PREFETCHT0, GRP_0F18, MEM, 1, "prefetcht0", E, 0, B)             \
+    GROUP_ROW(PREFETCHT1, GRP_0F18, MEM, 2, "prefetcht1", E, 0, B)             \
+    GROUP_ROW(PREFETCHT2, GRP_0F18, MEM, 3, "prefetcht2", E, 0, B)             \
+    GROUP_ROW(FXSAVE, GRP_0FAE, MEM, 0, "fxsave", E, 0, B)                     \
+    GROUP_ROW(FXRSTOR, GRP_0FAE, MEM, 1, "fxrstor", E, 0, B)                   \
+    GROUP_ROW(LDMXCSR, GRP_0FAE, MEM, 2, "ldmxcsr", E, 0, D)                   \
+    GROUP_ROW(STMXCSR, GRP_0FAE, MEM, 3, "stmxcsr", E, 0, D)                   \
+    GROUP_ROW(XSAVE, GRP_0FAE, MEM, 4, "xsave", E, 0, B)                       \
+    GROUP_ROW(XRSTOR, GRP_0FAE, MEM, 5, "xrstor", E, 0, B)                     \
+    GROUP_ROW(XSAVEOPT, GRP_0FAE, MEM, 6, "xsaveopt", E, 0, B)                 \
+    GROUP_ROW(CLFLUSH, GRP_0FAE, MEM, 7, "clflush", E, 0, B)                   \
+    GROUP_ROW(LFENCE, GRP_0FAE, REG, 5, "lfence", NONE, 0, OP)                 \
+    GROUP_ROW(MFENCE, GRP_0FAE, REG, 6, "mfence", NONE, 0, OP)                 \
+    GROUP_ROW(SFENCE, GRP_0FAE, REG, 7, "sfence", NONE, 0, OP)                 \
+    GROUP_ROW(BT_IMM, GRP_0FBA, ANY, 4, "bt", E, 0, OP)                        \
+    GROUP_ROW(BTS_IMM, GRP_0FBA, ANY, 5, "bts", E, 0, OP)                      \
+    GROUP_ROW(BTR_IMM, GRP_0FBA, ANY, 6, "btr", E, 0, OP)                      \
+    GROUP_ROW(BTC_IMM, GRP_0FBA, ANY, 7, "btc", E, 0, OP)                      \
+    GROUP_ROW(CMPXCHG8B, GRP_0FC7, MEM, 1, "cmpxchg8b", E, EXT_W_NEXT, Q)      \
+    ROW_W(CMPXCHG16B, "cmpxchg16b", E, 0, X)                                   \
+    GROUP_ROW(RDRAND, GRP_0FC7, REG, 6, "rdrand", E, 0, OP)                    \
+    GROUP_ROW(RDSEED, GRP_0FC7, REG, 7, "rdseed", E, 0, OP)                    \
+    GROUP_ROW(PSRLW_IMM, GRP_0F71, REG, 2, "psrlw", W, EXT_NDD, VEC)           \
+    GROUP_ROW(PSRAW_IMM, GRP_0F71, REG, 4, "psraw", W, EXT_NDD, VEC)           \
+    GROUP_ROW(PSLLW_IMM, GRP_0F71, REG, 6, "psllw", W, EXT_NDD, VEC)           \
+    GROUP_ROW(PSRLD_IMM, GRP_0F72, REG, 2, "psrld", W, EXT_NDD, VEC)           \
+    GROUP_ROW(PSRAD_IMM, GRP_0F72, REG, 4, "psrad", W, EXT_NDD, VEC)           \
+    GROUP_ROW(PSLLD_IMM, GRP_0F72, REG, 6, "pslld", W, EXT_NDD, VEC)           \
+    GROUP_ROW(PSRLQ_IMM, GRP_0F73, REG, 2, "psrlq", W, EXT_NDD, VEC)           \
+    GROUP_ROW(PSRLDQ_IMM, GRP_0F73, REG, 3, "psrldq", W, EXT_NDD, VEC)         \
+    GROUP_ROW(PSLLQ_IMM, GRP_0F73, REG, 6, "psllq", W, EXT_NDD, VEC)           \
+    GROUP_ROW(PSLLDQ_IMM, GRP_0F73, REG, 7, "pslldq", W, EXT_NDD, VEC)         \
+    GROUP_ROW(BLSR, GRP_0F38F3, ANY, 1, "blsr", E, EXT_NDD | EXT_VEX_ONLY, OP) \
+    GROUP_ROW(BLSMSK, GRP_0F38F3, ANY, 2, "blsmsk",                            \
+        E, EXT_NDD | EXT_VEX_ONLY, OP)                                         \
+    GROUP_ROW(BLSI, GRP_0F38F3, ANY, 3, "blsi", E, EXT_NDD | EXT_VEX_ONLY, OP)
+
+// entries the decoder picks itself: ROW(id, name, form, flags, mem)
+#define EXT_SPECIAL_MAP(ROW)                                                   \
+    ROW(ENDBR64, "endbr64", NONE, 0, OP)                                       \
+    ROW(ENDBR32, "endbr32", NONE, 0, OP)                                       \
+    ROW(VZEROUPPER, "vzeroupper", NONE, EXT_VEX_ONLY, OP)                      \
+    ROW(VZEROALL, "vzeroall", NONE, EXT_VEX_ONLY, OP)                          \
+    ROW(MOVHLPS, "movhlps", V_W, EXT_NDS | EXT_LIG, X)                         \
+    ROW(MOVLHPS, "movlhps", V_W, EXT_NDS | EXT_LIG, X)
+
+// 0F 01 with a register in ModR/M: the whole ModR/M byte picks the
+// instruction and none of them has an explicit operand, except smsw and
+// lmsw (reg 4 and 6), which stay unnamed. ROW(id, modrm, name)
+#define EXT_0F01_MAP(ROW)                                                      \
+    ROW(ENCLV, 0xc0, "enclv")                                                  \
+    ROW(VMCALL, 0xc1, "vmcall")                                                \
+    ROW(VMLAUNCH, 0xc2, "vmlaunch")                                            \
+    ROW(VMRESUME, 0xc3, "vmresume")                                            \
+    ROW(VMXOFF, 0xc4, "vmxoff")                                                \
+    ROW(PCONFIG, 0xc5, "pconfig")                                              \
+    ROW(MONITOR, 0xc8, "monitor")                                              \
+    ROW(MWAIT, 0xc9, "mwait")                                                  \
+    ROW(CLAC, 0xca, "clac")                                                    \
+    ROW(STAC, 0xcb, "stac")                                                    \
+    ROW(ENCLS, 0xcf, "encls")                                                  \
+    ROW(XGETBV, 0xd0, "xgetbv")                                                \
+    ROW(XSETBV, 0xd1, "xsetbv")                                                \
+    ROW(VMFUNC, 0xd4, "vmfunc")                                                \
+    ROW(XEND, 0xd5, "xend")                                                    \
+    ROW(XTEST, 0xd6, "xtest")                                                  \
+    ROW(ENCLU, 0xd7, "enclu")                                                  \
+    ROW(VMRUN, 0xd8, "vmrun")                                                  \
+    ROW(VMMCALL, 0xd9, "vmmcall")                                              \
+    ROW(VMLOAD, 0xda, "vmload")                                                \
+    ROW(VMSAVE, 0xdb, "vmsave")                                                \
+    ROW(STGI, 0xdc, "stgi")                                                    \
+    ROW(CLGI, 0xdd, "clgi")                                                    \
+    ROW(SKINIT, 0xde, "skinit")                                                \
+    ROW(INVLPGA, 0xdf, "invlpga")                                              \
+    ROW(SERIALIZE, 0xe8, "serialize")                                          \
+    ROW(RDPKRU, 0xee, "rdpkru")                                                \
+    ROW(WRPKRU, 0xef, "wrpkru")                                                \
+    ROW(SWAPGS, 0xf8, "swapgs")                                                \
+    ROW(RDTSCP, 0xf9, "rdtscp")                                                \
+    ROW(MONITORX, 0xfa, "monitorx")                                            \
+    ROW(MWAITX, 0xfb, "mwaitx")                                                \
+    ROW(CLZERO, 0xfc, "clzero")                                                \
+    ROW(RDPRU, 0xfd, "rdpru")
+// clang-format on
+
+#define EXT_ENUM_X(id, map, pfx, opcode, name, form, flags, mem) EXT_##id,
+#define EXT_ENUM_W(id, name, form, flags, mem) EXT_##id,
+#define EXT_ENUM_G(id, group, forms, reg, name, form, flags, mem) EXT_##id,
+#define EXT_ENUM_R(id, modrm, name) EXT_##id,
+
+typedef enum {
+    EXT_UNNAMED, // an opcode of the maps without an entry
+    EXT_OP_MAP(EXT_ENUM_X, EXT_ENUM_W)
+    EXT_GROUP_MAP(EXT_ENUM_G, EXT_ENUM_W)
+    EXT_SPECIAL_MAP(EXT_ENUM_W)
+    EXT_0F01_MAP(EXT_ENUM_R)
+    EXT_NAMED,
+} ext_op_id_t;
+
+// ids past the named ones: group heads, which only appear in ext_index,
+// then one unnamed id per map opcode
+#define EXT_GROUP_FIRST EXT_NAMED
+#define EXT_RAW_FIRST (EXT_GROUP_FIRST + EXT_GROUPS)
+#define EXT_RAW(map, opcode) (EXT_RAW_FIRST + (map) * 256 + (opcode))
+#define EXT_IDS (EXT_RAW_FIRST + MAPS * 256)
+
+static inline bool ext_form_is_gpr(ext_form_t form)
+{
+    return form <= EXT_FORM_E_G;
+}
+
+typedef struct {
+    const char *name;
+    uint8_t form;   // ext_form_t
+    uint16_t flags; // EXT_NDS ...
+    uint8_t mem;    // EXT_MEM_*
+} ext_op_t;
+
+extern const ext_op_t ext_ops[EXT_NAMED];
+// [map][prefix][opcode]: the entry, a group head, or EXT_UNNAMED
+extern const uint16_t ext_index[MAPS][PFXS][256];
+// [group][ModR/M.reg, plus 8 for a register operand]
+extern const uint16_t ext_groups[EXT_GROUPS][16];
+// [ModR/M - 0xc0]: the EXT_0F01_MAP entry, or EXT_UNNAMED
+extern const uint16_t ext_0f01_regs[64];
+
+#endif // MAPS_H
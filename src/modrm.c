@@ -1,8 +1,44 @@
 #include "modrm.h"
 
-void modrm_extract(uint8_t modrm, struct modrm *out)
-{
-    out->rm = modrm & 0x7;
-    out->reg = (modrm >> 3) & 0x7;
-    out->mod = modrm >> 6;
-}
+#define MODRM_MOD(b) ((b) >> 6)
+#define MODRM_RM(b) ((b) & 0x7)
+#define MODRM_RIP(b) (MODRM_MOD(b) == 0 && MODRM_RM(b) == 5)
+
+#define MODRM_ENTRY(b)                                                         \
+    {                                                                          \
+        .mod = MODRM_MOD(b),                                                   \
+        .reg = ((b) >> 3) & 0x7,                                               \
+        .rm = MODRM_RM(b),                                                     \
+        .has_sib = MODRM_MOD(b) != 3 && MODRM_RM(b) == 4,                      \
+        .rip_relative = MODRM_RIP(b),                                          \
+        .disp_size = MODRM_MOD(b) == 1                     ? 1                 \
+                     : MODRM_MOD(b) == 2 || MODRM_RIP(b) ? 4                   \
+                                                         : 0,                  \
+    }
+
+#define MODRM_ROW(b)                                                           \
+    MODRM_ENTRY(b), MODRM_ENTRY(b + 1), MODRM_ENTRY(b + 2),                    \
+        MODRM_ENTRY(b + 3), MODRM_ENTRY(b + 4), MODRM_ENTRY(b + 5),            \
+        MODRM_ENTRY(b + 6), MODRM_ENTRY(b + 7), MODRM_ENTRY(b + 8),            \
+        MODRM_ENTRY(b + 9), MODRM_ENTRY(b + 10), MODRM_ENTRY(b + 11),          \
+        MODRM_ENTRY(b + 12), MODRM_ENTRY(b + 13), MODRM_ENTRY(b + 14),         \
+        MODRM_ENTRY(b + 15)
+
+const struct modrm modrm_table[256] = {
+    MODRM_ROW(0x00),
+    MODRM_ROW(0x10),
+    MODRM_ROW(0x20),
+    MODRM_ROW(0x30),
+    MODRM_ROW(0x40),
+    MODRM_ROW(0x50),
+    MODRM_ROW(0x60),
+    MODRM_ROW(0x70),
+    MODRM_ROW(0x80),
+    MODRM_ROW(0x90),
+    MODRM_ROW(0xa0),
+    MODRM_ROW(0xb0),
+    MODRM_ROW(0xc0),
+    MODRM_ROW(0xd0),
+    MODRM_ROW(0xe0),
+    MODRM_ROW(0xf0),
+};
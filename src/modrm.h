@@ -8,8 +8,13 @@ struct modrm {
     uint8_t mod;
     uint8_t reg;
     uint8_t rm;
+    bool has_sib;      // memory form with rm == 4
+    bool rip_relative; // mod == 0, rm == 5
+    // bytes of displacement after ModR/M (and SIB). a SIB byte with
+    // base == 5 under mod == 0 adds a disp32 this can't see
+    uint8_t disp_size;
 };
 
-void modrm_extract(uint8_t modrm, struct modrm *out);
+extern const struct modrm modrm_table[256];
 
 #endif // MODRM_H
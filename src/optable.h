@@ -3,6 +3,40 @@
 
 #include <stdint.h>
 
+/*
+ * every decoded one-byte opcode and its instr_type_t, without the INSTR_
+ * prefix. both opcode_table and the decoder's dispatch table are generated
+ * from this list
+ */
+#define OPCODE_MAP(X)                                                          \
+    X(0x07, POP_SEG)                                                           \
+    X(0x0f, ESC_0F)                                                            \
+    X(0x17, POP_SEG)                                                           \
+    X(0x1f, POP_SEG)                                                           \
+    X(0x50, PUSH_REG)                                                          \
+    X(0x51, PUSH_REG)                                                          \
+    X(0x52, PUSH_REG)                                                          \
+    X(0x53, PUSH_REG)                                                          \
+    X(0x54, PUSH_REG)                                                          \
+    X(0x55, PUSH_REG)                                                          \
+    X(0x56, PUSH_REG)                                                          \
+    X(0x57, PUSH_REG)                                                          \
+    X(0x58, POP_REG)                                                           \
+    X(0x59, POP_REG)                                                           \
+    X(0x5a, POP_REG)                                                           \
+    X(0x5b, POP_REG)                                                           \
+    X(0x5c, POP_REG)                                                           \
+    X(0x5d, POP_REG)                                                           \
+    X(0x5e, POP_REG)                                                           \
+    X(0x5f, POP_REG)                                                           \
+    X(0x89, MOV_RM_R)                                                          \
+    X(0x8f, POP_RM)                                                            \
+    X(0xc4, VEX)                                                               \
+    X(0xc5, VEX)                                                               \
+    X(0xe8, CALL_REL)                                                          \
+    X(0xe9, JMP_REL)                                                           \
+    X(0xeb, JMP_REL) /* rel8 */
+
 extern const uint8_t opcode_table[256];
 
 #endif // OPTABLE_H
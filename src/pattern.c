@@ -0,0 +1,1162 @@
+#include "pattern.h"
+#include "frontend.h"
+#include "maps.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PAT_MAX_OPS 3
+#define PAT_ANY_TYPE 0xff
+#define PAT_ANY_REG 0xfe // REG_NONE means no register
+#define PAT_ANY_SIZE -2  // REG_SIZE_NONE and friends are -1
+#define PAT_ANY_SCALE 0
+#define PAT_GAP UINT32_MAX // the predicate of a gap state: any instruction
+#define PAT_UNBOUNDED UINT16_MAX
+
+#define EXT_ID_WORDS ((EXT_NAMED + 63) / 64)
+
+typedef enum {
+    PAT_OP_ANY,
+    PAT_OP_REG,
+    PAT_OP_MEM,  // any memory operand of a size
+    PAT_OP_ADDR, // a memory operand by base, index and displacement
+    PAT_OP_IMM,
+    PAT_OP_REL,
+} pat_op_kind_t;
+
+typedef struct {
+    uint8_t kind;  // pat_op_kind_t
+    uint8_t reg;   // the register, or the base of an address
+    uint8_t index; // of an address
+    uint8_t scale; // scale_factor_t, or PAT_ANY_SCALE
+    int8_t size;   // reg_size_t or operand_size_t, or PAT_ANY_SIZE
+    int8_t addr;   // addr_size_t the address registers imply
+    int64_t lo;    // displacement or immediate range
+    int64_t hi;
+} pat_operand_t;
+
+struct pat_pred_s {
+    uint8_t type; // air_instr_type_t, or PAT_ANY_TYPE
+    uint8_t nops;
+    int32_t name; // into names, -1 for any AIR_EXT
+    pat_operand_t ops[PAT_MAX_OPS];
+};
+
+// a 0F-map mnemonic: the ext_op_id_t it stands for, without and with VEX
+struct pat_name_s {
+    char *name;
+    uint64_t ids[2][EXT_ID_WORDS];
+};
+
+struct pat_state_s {
+    uint32_t pred;   // PAT_GAP in a gap
+    uint32_t gap;    // the gap a step's state is reached through
+    uint32_t accept; // 1 + the first pattern ending here, 0 for none
+};
+
+// the instructions skipped between a state and the next step. its states
+// are one per instruction up to `min`, then one per instruction up to
+// `max` or a single looping one when there's no bound
+typedef struct {
+    uint32_t parent;
+    uint16_t min;
+    uint16_t max; // PAT_UNBOUNDED
+    uint32_t first;
+    uint32_t nstates;
+} pat_gap_t;
+
+// what pattern_set_add() needs beyond the tables a scan reads
+struct pat_build_s {
+    size_t texts_cap;
+    size_t preds_cap;
+    size_t names_cap;
+    size_t states_cap;
+    pat_gap_t *gaps;
+    size_t ngaps;
+    size_t gaps_cap;
+    uint32_t *edges; // from, to
+    size_t nedges;
+    size_t edges_cap;
+};
+
+static bool reserve(void **items, size_t *cap, size_t n, size_t size)
+{
+    if (n <= *cap) {
+        return true;
+    }
+    size_t new_cap = *cap ? *cap * 2 : 16;
+    while (new_cap < n) {
+        new_cap *= 2;
+    }
+    void *p = realloc(*items, new_cap * size);
+    if (!p) {
+        return false;
+    }
+    *items = p;
+    *cap = new_cap;
+    return true;
+}
+
+void pattern_set_init(pattern_set_t *set)
+{
+    memset(set, 0, sizeof(*set));
+}
+
+static void free_tables(pattern_set_t *set)
+{
+    free(set->succs);
+    free(set->first);
+    free(set->starts);
+    free(set->start_first);
+    set->succs = NULL;
+    set->first = NULL;
+    set->starts = NULL;
+    set->start_first = NULL;
+}
+
+void pattern_set_destroy(pattern_set_t *set)
+{
+    for (size_t i = 0; i < set->count; i++) {
+        free(set->texts[i]);
+    }
+    for (size_t i = 0; i < set->nnames; i++) {
+        free(set->names[i].name);
+    }
+    free(set->texts);
+    free(set->preds);
+    free(set->names);
+    free(set->states);
+    free(set->accepts);
+    free_tables(set);
+    if (set->build) {
+        free(set->build->gaps);
+        free(set->build->edges);
+        free(set->build);
+    }
+    memset(set, 0, sizeof(*set));
+}
+
+typedef struct {
+    const char *text;
+    const char *p;
+    const char *err; // the first thing that went wrong
+    const char *err_at;
+} parser_t;
+
+static bool parse_error(parser_t *ps, const char *msg)
+{
+    if (!ps->err) {
+        ps->err = msg;
+        ps->err_at = ps->p;
+    }
+    return false;
+}
+
+static void skip_space(parser_t *ps)
+{
+    while (isspace((unsigned char)*ps->p)) {
+        ps->p++;
+    }
+}
+
+static bool accept_char(parser_t *ps, char c)
+{
+    skip_space(ps);
+    if (*ps->p != c) {
+        return false;
+    }
+    ps->p++;
+    return true;
+}
+
+static bool is_word_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// the word at the cursor, consumed, in `buf`. false if there is none
+static bool parse_word(parser_t *ps, char *buf, size_t size)
+{
+    skip_space(ps);
+    size_t n = 0;
+    while (is_word_char(ps->p[n])) {
+        n++;
+    }
+    if (!n || n >= size) {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = (char)tolower((unsigned char)ps->p[i]);
+    }
+    buf[n] = '\0';
+    ps->p += n;
+    return true;
+}
+
+static bool starts_number(const char *p)
+{
+    return isdigit((unsigned char)*p) ||
+           (*p == '-' && isdigit((unsigned char)p[1]));
+}
+
+static bool parse_number(parser_t *ps, int64_t *out)
+{
+    skip_space(ps);
+    bool neg = *ps->p == '-';
+    const char *digits = ps->p + neg;
+    if (!isdigit((unsigned char)*digits)) {
+        return parse_error(ps, "expected a number");
+    }
+    char *end;
+    unsigned long long v = strtoull(digits, &end, 0);
+    if (v > (unsigned long long)INT64_MAX) {
+        return parse_error(ps, "number out of range");
+    }
+    *out = neg ? -(int64_t)v : (int64_t)v;
+    ps->p = end;
+    return true;
+}
+
+// N, LO..HI with either end left out, or _ for any
+static bool parse_range(parser_t *ps, int64_t *lo, int64_t *hi)
+{
+    *lo = INT64_MIN;
+    *hi = INT64_MAX;
+    skip_space(ps);
+    if (*ps->p == '_' && !is_word_char(ps->p[1])) {
+        ps->p++;
+        return true;
+    }
+
+    bool has_lo = strncmp(ps->p, "..", 2) != 0;
+    if (has_lo && !parse_number(ps, lo)) {
+        return false;
+    }
+    skip_space(ps);
+    if (strncmp(ps->p, "..", 2) != 0) {
+        *hi = *lo;
+        return true;
+    }
+    ps->p += 2;
+    skip_space(ps);
+    if (starts_number(ps->p)) {
+        if (!parse_number(ps, hi)) {
+            return false;
+        }
+    }
+    else if (!has_lo) {
+        return parse_error(ps, "empty range");
+    }
+    if (*lo > *hi) {
+        return parse_error(ps, "empty range");
+    }
+    return true;
+}
+
+// -x, with the open ends of a range staying open
+static int64_t negate(int64_t x)
+{
+    if (x == INT64_MIN) {
+        return INT64_MAX;
+    }
+    if (x == INT64_MAX) {
+        return INT64_MIN;
+    }
+    return -x;
+}
+
+static bool lookup_reg(const char *name, uint8_t *id, int8_t *size)
+{
+    for (unsigned r = 0; r <= REG_BH; r++) {
+        const reg_name_t *row = &reg_names[r];
+        // in reg_size_t order
+        const char *cols[] = {
+            row->r16, row->r32, row->r64, row->r8, row->xmm, row->ymm};
+        for (int s = REG_SIZE_16; s <= REG_SIZE_256; s++) {
+            if (cols[s] && !strcmp(cols[s], name)) {
+                *id = (uint8_t)r;
+                *size = (int8_t)s;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static int lookup_size(const char *name)
+{
+    for (int s = OPERAND_SIZE_16; s <= OPERAND_SIZE_256; s++) {
+        if (!strcmp(op_size_suffixes[s], name)) {
+            return s;
+        }
+    }
+    return PAT_ANY_SIZE;
+}
+
+// a base or index register of an address, or _ for any
+static bool parse_addr_reg(parser_t *ps, const char *word, pat_operand_t *o,
+    uint8_t *reg)
+{
+    if (!strcmp(word, "_")) {
+        *reg = PAT_ANY_REG;
+        return true;
+    }
+    int8_t size;
+    if (!lookup_reg(word, reg, &size) ||
+        (size != REG_SIZE_64 && size != REG_SIZE_32)) {
+        return parse_error(ps, "expected a 32 or 64-bit register");
+    }
+    if (o->addr != PAT_ANY_SIZE && o->addr != size) {
+        return parse_error(ps, "address registers of different sizes");
+    }
+    o->addr = size; // ADDR_SIZE_* match REG_SIZE_32 and REG_SIZE_64
+    return true;
+}
+
+// the index register is parsed, `*S` may follow
+static bool parse_scale(parser_t *ps, pat_operand_t *o)
+{
+    o->scale = FACTOR_1;
+    if (!accept_char(ps, '*')) {
+        return true;
+    }
+    skip_space(ps);
+    if (*ps->p == '_' && !is_word_char(ps->p[1])) {
+        ps->p++;
+        o->scale = PAT_ANY_SCALE;
+        return true;
+    }
+    int64_t scale;
+    if (!parse_number(ps, &scale)) {
+        return false;
+    }
+    if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+        return parse_error(ps, "scale must be 1, 2, 4 or 8");
+    }
+    o->scale = (uint8_t)scale;
+    return true;
+}
+
+// after the '['
+static bool parse_address(parser_t *ps, pat_operand_t *o)
+{
+    o->kind = PAT_OP_ADDR;
+    o->reg = REG_NONE;
+    o->index = REG_NONE;
+    o->lo = 0;
+    o->hi = 0;
+    bool has_disp = false;
+    char word[16];
+
+    skip_space(ps);
+    if (is_word_char(*ps->p) && !isdigit((unsigned char)*ps->p)) {
+        uint8_t reg;
+        if (!parse_word(ps, word, sizeof(word)) ||
+            !parse_addr_reg(ps, word, o, &reg)) {
+            return parse_error(ps, "expected a register");
+        }
+        skip_space(ps);
+        if (*ps->p == '*') { // no base, [I*S+D]
+            o->index = reg;
+            if (!parse_scale(ps, o)) {
+                return false;
+            }
+        }
+        else {
+            o->reg = reg;
+        }
+    }
+    else if (*ps->p != ']') {
+        if (!parse_range(ps, &o->lo, &o->hi)) {
+            return false;
+        }
+        has_disp = true;
+    }
+
+    for (;;) {
+        bool minus = accept_char(ps, '-');
+        if (!minus && !accept_char(ps, '+')) {
+            break;
+        }
+        skip_space(ps);
+        // a register, or _ followed by '*', is the index
+        bool index = is_word_char(*ps->p) && !isdigit((unsigned char)*ps->p);
+        if (index && *ps->p == '_' && !is_word_char(ps->p[1])) {
+            const char *q = ps->p + 1;
+            while (isspace((unsigned char)*q)) {
+                q++;
+            }
+            index = *q == '*';
+        }
+        if (index) {
+            if (minus || o->index != REG_NONE) {
+                return parse_error(ps, "unexpected index");
+            }
+            if (!parse_word(ps, word, sizeof(word)) ||
+                !parse_addr_reg(ps, word, o, &o->index) ||
+                !parse_scale(ps, o)) {
+                return parse_error(ps, "expected an index register");
+            }
+            continue;
+        }
+        if (has_disp) {
+            return parse_error(ps, "more than one displacement");
+        }
+        int64_t lo;
+        int64_t hi;
+        if (!parse_range(ps, &lo, &hi)) {
+            return false;
+        }
+        o->lo = minus ? negate(hi) : lo;
+        o->hi = minus ? negate(lo) : hi;
+        has_disp = true;
+    }
+
+    if (!accept_char(ps, ']')) {
+        return parse_error(ps, "expected ']'");
+    }
+    return true;
+}
+
+static bool parse_operand(parser_t *ps, pat_operand_t *o)
+{
+    memset(o, 0, sizeof(*o));
+    o->kind = PAT_OP_ANY;
+    o->reg = PAT_ANY_REG;
+    o->index = REG_NONE;
+    o->size = PAT_ANY_SIZE;
+    o->addr = PAT_ANY_SIZE;
+    o->lo = INT64_MIN;
+    o->hi = INT64_MAX;
+
+    skip_space(ps);
+    if (starts_number(ps->p) || !strncmp(ps->p, "..", 2)) {
+        o->kind = PAT_OP_IMM;
+        return parse_range(ps, &o->lo, &o->hi);
+    }
+    if (accept_char(ps, '[')) {
+        return parse_address(ps, o);
+    }
+
+    char word[16];
+    if (!parse_word(ps, word, sizeof(word))) {
+        return parse_error(ps, "expected an operand");
+    }
+    if (!strcmp(word, "_")) {
+        return true;
+    }
+    if (!strcmp(word, "imm")) {
+        o->kind = PAT_OP_IMM;
+        return true;
+    }
+    if (!strcmp(word, "rel")) {
+        o->kind = PAT_OP_REL;
+        return true;
+    }
+    if (!strcmp(word, "mem")) {
+        o->kind = PAT_OP_MEM;
+        return true;
+    }
+
+    static const struct {
+        const char *name;
+        reg_size_t size;
+    } classes[] = {
+        {"reg", REG_SIZE_NONE},
+        {"reg8", REG_SIZE_8},
+        {"reg16", REG_SIZE_16},
+        {"reg32", REG_SIZE_32},
+        {"reg64", REG_SIZE_64},
+        {"xmm", REG_SIZE_128},
+        {"ymm", REG_SIZE_256},
+    };
+    for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+        if (!strcmp(word, classes[i].name)) {
+            o->kind = PAT_OP_REG;
+            if (classes[i].size != REG_SIZE_NONE) {
+                o->size = (int8_t)classes[i].size;
+            }
+            return true;
+        }
+    }
+
+    int size = lookup_size(word);
+    if (size != PAT_ANY_SIZE) {
+        const char *save = ps->p;
+        if (!parse_word(ps, word, sizeof(word)) || strcmp(word, "ptr")) {
+            ps->p = save;
+        }
+        if (accept_char(ps, '[')) {
+            if (!parse_address(ps, o)) {
+                return false;
+            }
+        }
+        else if (parse_word(ps, word, sizeof(word)) && !strcmp(word, "mem")) {
+            o->kind = PAT_OP_MEM;
+        }
+        else {
+            return parse_error(ps, "expected mem or an address after a size");
+        }
+        o->size = (int8_t)size;
+        return true;
+    }
+
+    if (lookup_reg(word, &o->reg, &o->size)) {
+        o->kind = PAT_OP_REG;
+        return true;
+    }
+    return parse_error(ps, "unknown operand");
+}
+
+static bool name_matches(const char *want, const ext_op_t *op, bool vex)
+{
+    if (op->flags & EXT_VEX_ONLY) {
+        return vex && !strcmp(want, op->name);
+    }
+    if (vex) {
+        return want[0] == 'v' && !strcmp(want + 1, op->name);
+    }
+    return !strcmp(want, op->name);
+}
+
+// the names entry for a 0F-map mnemonic, -1 if there's no such
+// instruction or no memory
+static int32_t lookup_name(pattern_set_t *set, const char *name)
+{
+    for (size_t i = 0; i < set->nnames; i++) {
+        if (!strcmp(set->names[i].name, name)) {
+            return (int32_t)i;
+        }
+    }
+
+    pat_name_t entry;
+    memset(&entry, 0, sizeof(entry));
+    bool any = false;
+    for (unsigned id = 0; id < EXT_NAMED; id++) {
+        if (!ext_ops[id].name) {
+            continue;
+        }
+        for (int vex = 0; vex < 2; vex++) {
+            if (name_matches(name, &ext_ops[id], vex)) {
+                entry.ids[vex][id / 64] |= 1ull << (id % 64);
+                any = true;
+            }
+        }
+    }
+    if (!any || !reserve((void **)&set->names, &set->build->names_cap,
+                    set->nnames + 1, sizeof(*set->names))) {
+        return -1;
+    }
+    entry.name = strdup(name);
+    if (!entry.name) {
+        return -1;
+    }
+    set->names[set->nnames] = entry;
+    return (int32_t)set->nnames++;
+}
+
+static bool parse_instr(parser_t *ps, pattern_set_t *set, pat_pred_t *pred)
+{
+    memset(pred, 0, sizeof(*pred));
+    pred->type = PAT_ANY_TYPE;
+    pred->name = -1;
+
+    char word[32];
+    if (!accept_char(ps, '*')) {
+        if (!parse_word(ps, word, sizeof(word))) {
+            return parse_error(ps, "expected a mnemonic");
+        }
+        for (int t = AIR_POP; t <= AIR_EXT; t++) {
+            if (!strcmp(word, get_instr_type_name((air_instr_type_t)t))) {
+                pred->type = (uint8_t)t;
+            }
+        }
+        if (pred->type == PAT_ANY_TYPE) {
+            pred->type = AIR_EXT;
+            pred->name = lookup_name(set, word);
+            if (pred->name < 0) {
+                return parse_error(ps, "unknown mnemonic");
+            }
+        }
+    }
+
+    skip_space(ps);
+    if (*ps->p == ';' || *ps->p == '\0') {
+        return true;
+    }
+    do {
+        if (pred->nops == PAT_MAX_OPS) {
+            return parse_error(ps, "too many operands");
+        }
+        if (!parse_operand(ps, &pred->ops[pred->nops++])) {
+            return false;
+        }
+    } while (accept_char(ps, ','));
+
+    // operands matching anything at the end change nothing. cleared so
+    // equal steps compare equal
+    while (pred->nops && pred->ops[pred->nops - 1].kind == PAT_OP_ANY) {
+        memset(&pred->ops[--pred->nops], 0, sizeof(*pred->ops));
+    }
+    return true;
+}
+
+// after the "..."
+static bool parse_gap(parser_t *ps, uint16_t *min, uint16_t *max)
+{
+    *min = 0;
+    *max = PAT_UNBOUNDED;
+    if (!accept_char(ps, '{')) {
+        return true;
+    }
+    int64_t lo = 0;
+    int64_t hi = -1;
+    skip_space(ps);
+    if (*ps->p != ',' && !parse_number(ps, &lo)) {
+        return false;
+    }
+    if (!accept_char(ps, ',')) {
+        hi = lo;
+    }
+    else {
+        skip_space(ps);
+        if (*ps->p != '}' && !parse_number(ps, &hi)) {
+            return false;
+        }
+    }
+    if (!accept_char(ps, '}')) {
+        return parse_error(ps, "expected '}'");
+    }
+    if (lo < 0 || lo > PATTERN_MAX_GAP || hi > PATTERN_MAX_GAP ||
+        (hi >= 0 && hi < lo)) {
+        return parse_error(ps, "bad gap");
+    }
+    *min = (uint16_t)lo;
+    *max = hi < 0 ? PAT_UNBOUNDED : (uint16_t)hi;
+    return true;
+}
+
+typedef struct {
+    pat_pred_t pred;
+    uint16_t min; // the gap before it
+    uint16_t max;
+} pat_step_t;
+
+// the steps of `ps->text`, in a malloc'd array
+static pat_step_t *parse_pattern(
+    parser_t *ps, pattern_set_t *set, size_t *nsteps)
+{
+    pat_step_t *steps = NULL;
+    size_t cap = 0;
+    size_t n = 0;
+    uint16_t min = 0;
+    uint16_t max = 0;
+    bool gap = false;
+
+    for (;;) {
+        skip_space(ps);
+        if (!strncmp(ps->p, "...", 3)) {
+            ps->p += 3;
+            uint16_t lo;
+            uint16_t hi;
+            if (!parse_gap(ps, &lo, &hi)) {
+                break;
+            }
+            if (!n) {
+                parse_error(ps, "a pattern can't start with a gap");
+                break;
+            }
+            min += lo;
+            max = max == PAT_UNBOUNDED || hi == PAT_UNBOUNDED ? PAT_UNBOUNDED
+                                                              : max + hi;
+            if (min > PATTERN_MAX_GAP ||
+                (max != PAT_UNBOUNDED && max > PATTERN_MAX_GAP)) {
+                parse_error(ps, "gap too long");
+                break;
+            }
+            gap = true;
+        }
+        else {
+            if (!reserve((void **)&steps, &cap, n + 1, sizeof(*steps))) {
+                parse_error(ps, "out of memory");
+                break;
+            }
+            if (!parse_instr(ps, set, &steps[n].pred)) {
+                break;
+            }
+            steps[n].min = min;
+            steps[n].max = max;
+            n++;
+            min = 0;
+            max = 0;
+            gap = false;
+        }
+
+        skip_space(ps);
+        if (*ps->p == '\0') {
+            if (gap) {
+                parse_error(ps, "a pattern can't end with a gap");
+            }
+            break;
+        }
+        if (!accept_char(ps, ';')) {
+            parse_error(ps, "expected ';'");
+            break;
+        }
+    }
+
+    if (ps->err || !n) {
+        if (!ps->err) {
+            parse_error(ps, "empty pattern");
+        }
+        free(steps);
+        return NULL;
+    }
+    *nsteps = n;
+    return steps;
+}
+
+static int64_t add_pred(pattern_set_t *set, const pat_pred_t *pred)
+{
+    for (size_t i = 0; i < set->npreds; i++) {
+        if (!memcmp(&set->preds[i], pred, sizeof(*pred))) {
+            return (int64_t)i;
+        }
+    }
+    if (!reserve((void **)&set->preds, &set->build->preds_cap,
+            set->npreds + 1, sizeof(*set->preds))) {
+        return -1;
+    }
+    set->preds[set->npreds] = *pred;
+    return (int64_t)set->npreds++;
+}
+
+static int64_t add_state(pattern_set_t *set, uint32_t pred, uint32_t gap)
+{
+    if (!reserve((void **)&set->states, &set->build->states_cap,
+            set->nstates + 1, sizeof(*set->states))) {
+        return -1;
+    }
+    pat_state_t *s = &set->states[set->nstates];
+    s->pred = pred;
+    s->gap = gap;
+    s->accept = 0;
+    return (int64_t)set->nstates++;
+}
+
+static bool add_edge(pattern_set_t *set, uint32_t from, uint32_t to)
+{
+    struct pat_build_s *b = set->build;
+    if (!reserve((void **)&b->edges, &b->edges_cap, 2 * (b->nedges + 1),
+            sizeof(*b->edges))) {
+        return false;
+    }
+    b->edges[2 * b->nedges] = from;
+    b->edges[2 * b->nedges + 1] = to;
+    b->nedges++;
+    return true;
+}
+
+// the states a step after `gap` is entered from
+static size_t gap_exits(const pat_gap_t *gap, uint32_t *out)
+{
+    size_t n = 0;
+    if (!gap->min) {
+        out[n++] = gap->parent;
+    }
+    if (gap->max == PAT_UNBOUNDED) {
+        if (gap->min) {
+            out[n++] = gap->first + gap->min - 1;
+        }
+        out[n++] = gap->first + gap->nstates - 1; // the loop
+        return n;
+    }
+    for (uint32_t j = gap->min ? gap->min : 1; j <= gap->max; j++) {
+        out[n++] = gap->first + j - 1;
+    }
+    return n;
+}
+
+static int64_t add_gap(
+    pattern_set_t *set, uint32_t parent, uint16_t min, uint16_t max)
+{
+    struct pat_build_s *b = set->build;
+    for (size_t i = 0; i < b->ngaps; i++) {
+        const pat_gap_t *g = &b->gaps[i];
+        if (g->parent == parent && g->min == min && g->max == max) {
+            return (int64_t)i;
+        }
+    }
+    if (!reserve((void **)&b->gaps, &b->gaps_cap, b->ngaps + 1,
+            sizeof(*b->gaps))) {
+        return -1;
+    }
+
+    uint32_t id = (uint32_t)b->ngaps;
+    uint32_t n = max == PAT_UNBOUNDED ? min + 1u : max;
+    uint32_t first = (uint32_t)set->nstates;
+    uint32_t prev = parent;
+    for (uint32_t j = 0; j < n; j++) {
+        int64_t s = add_state(set, PAT_GAP, id);
+        if (s < 0 || !add_edge(set, prev, (uint32_t)s)) {
+            return -1;
+        }
+        prev = (uint32_t)s;
+    }
+    if (max == PAT_UNBOUNDED && !add_edge(set, prev, prev)) {
+        return -1;
+    }
+
+    pat_gap_t *g = &b->gaps[b->ngaps++];
+    g->parent = parent;
+    g->min = min;
+    g->max = max;
+    g->first = first;
+    g->nstates = n;
+    return id;
+}
+
+static int64_t add_step(pattern_set_t *set, uint32_t gap, uint32_t pred)
+{
+    for (size_t i = 1; i < set->nstates; i++) {
+        const pat_state_t *s = &set->states[i];
+        if (s->pred == pred && s->gap == gap) {
+            return (int64_t)i;
+        }
+    }
+    int64_t state = add_state(set, pred, gap);
+    if (state < 0) {
+        return -1;
+    }
+    uint32_t exits[PATTERN_MAX_GAP + 2];
+    size_t n = gap_exits(&set->build->gaps[gap], exits);
+    for (size_t i = 0; i < n; i++) {
+        if (!add_edge(set, exits[i], (uint32_t)state)) {
+            return -1;
+        }
+    }
+    return state;
+}
+
+bool pattern_set_add(pattern_set_t *set, const char *text)
+{
+    if (!set->build) {
+        set->build = (struct pat_build_s *)calloc(1, sizeof(*set->build));
+        if (!set->build || add_state(set, PAT_GAP, 0) < 0) {
+            fprintf(stderr, "out of memory\n");
+            return false;
+        }
+    }
+
+    parser_t ps = {text, text, NULL, NULL};
+    size_t nsteps;
+    pat_step_t *steps = parse_pattern(&ps, set, &nsteps);
+    if (!steps) {
+        fprintf(stderr, "pattern \"%s\": %s at column %d\n", text, ps.err,
+            (int)(ps.err_at - text) + 1);
+        return false;
+    }
+
+    char *copy = strdup(text);
+    bool ok = copy && reserve((void **)&set->texts, &set->build->texts_cap,
+                          set->count + 1, sizeof(*set->texts));
+    uint32_t at = 0; // the root
+    for (size_t i = 0; ok && i < nsteps; i++) {
+        int64_t pred = add_pred(set, &steps[i].pred);
+        int64_t gap =
+            pred < 0 ? -1 : add_gap(set, at, steps[i].min, steps[i].max);
+        int64_t state =
+            gap < 0 ? -1 : add_step(set, (uint32_t)gap, (uint32_t)pred);
+        ok = state >= 0;
+        at = (uint32_t)state;
+    }
+    free(steps);
+
+    uint32_t *accepts = ok ? (uint32_t *)realloc(set->accepts,
+                                 (set->count + 1) * sizeof(*accepts))
+                           : NULL;
+    if (!accepts) {
+        // states added for the pattern stay, they just never accept
+        fprintf(stderr, "out of memory\n");
+        free(copy);
+        return false;
+    }
+    set->accepts = accepts;
+    set->texts[set->count] = copy;
+    accepts[set->count] = set->states[at].accept;
+    set->states[at].accept = (uint32_t)set->count + 1;
+    set->count++;
+    return true;
+}
+
+bool pattern_set_compile(pattern_set_t *set)
+{
+    free_tables(set);
+    size_t nedges = set->build ? set->build->nedges : 0;
+    const uint32_t *edges = nedges ? set->build->edges : NULL;
+
+    set->first = (uint32_t *)calloc(set->nstates + 1, sizeof(*set->first));
+    set->succs = (uint32_t *)malloc((nedges + 1) * sizeof(*set->succs));
+    set->start_first =
+        (uint32_t *)calloc(AIR_EXT + 2, sizeof(*set->start_first));
+    if (!set->first || !set->succs || !set->start_first) {
+        free_tables(set);
+        return false;
+    }
+
+    // successors by state, in the order they were added
+    for (size_t i = 0; i < nedges; i++) {
+        set->first[edges[2 * i] + 1]++;
+    }
+    for (size_t s = 0; s < set->nstates; s++) {
+        set->first[s + 1] += set->first[s];
+    }
+    for (size_t i = 0; i < nedges; i++) {
+        uint32_t from = edges[2 * i];
+        // first[from] is used as a cursor and put back below
+        set->succs[set->first[from]++] = edges[2 * i + 1];
+    }
+    for (size_t s = set->nstates; s > 0; s--) {
+        set->first[s] = set->first[s - 1];
+    }
+    set->first[0] = 0;
+
+    // the first steps grouped by the instruction type they can match,
+    // steps matching any type in every group
+    size_t nroot = set->nstates ? set->first[1] : 0;
+    set->starts = (uint32_t *)malloc(
+        (nroot * (AIR_EXT + 1) + 1) * sizeof(*set->starts));
+    if (!set->starts) {
+        free_tables(set);
+        return false;
+    }
+    size_t n = 0;
+    for (int t = 0; t <= AIR_EXT; t++) {
+        set->start_first[t] = (uint32_t)n;
+        for (size_t i = 0; i < nroot; i++) {
+            uint32_t s = set->succs[i];
+            uint8_t type = set->preds[set->states[s].pred].type;
+            if (type == PAT_ANY_TYPE || type == t) {
+                set->starts[n++] = s;
+            }
+        }
+    }
+    set->start_first[AIR_EXT + 1] = (uint32_t)n;
+    return true;
+}
+
+bool pattern_scan_init(pattern_scan_t *scan, const pattern_set_t *set,
+    pattern_hit_fn hit, void *arg)
+{
+    memset(scan, 0, sizeof(*scan));
+    scan->set = set;
+    scan->hit = hit;
+    scan->arg = arg;
+
+    size_t n = set->nstates ? set->nstates : 1;
+    size_t npreds = set->npreds ? set->npreds : 1;
+    scan->cur = (uint32_t *)malloc(n * sizeof(*scan->cur));
+    scan->next = (uint32_t *)malloc(n * sizeof(*scan->next));
+    scan->cur_start = (size_t *)malloc(n * sizeof(*scan->cur_start));
+    scan->next_start = (size_t *)malloc(n * sizeof(*scan->next_start));
+    scan->state_step = (uint32_t *)calloc(n, sizeof(*scan->state_step));
+    scan->state_slot = (size_t *)malloc(n * sizeof(*scan->state_slot));
+    scan->pred_step = (uint32_t *)calloc(npreds, sizeof(*scan->pred_step));
+    scan->pred_value = (bool *)malloc(npreds * sizeof(*scan->pred_value));
+    if (!scan->cur || !scan->next || !scan->cur_start || !scan->next_start ||
+        !scan->state_step || !scan->state_slot || !scan->pred_step ||
+        !scan->pred_value) {
+        pattern_scan_destroy(scan);
+        return false;
+    }
+    return true;
+}
+
+void pattern_scan_destroy(pattern_scan_t *scan)
+{
+    free(scan->cur);
+    free(scan->next);
+    free(scan->cur_start);
+    free(scan->next_start);
+    free(scan->state_step);
+    free(scan->state_slot);
+    free(scan->pred_step);
+    free(scan->pred_value);
+    memset(scan, 0, sizeof(*scan));
+}
+
+void pattern_scan_reset(pattern_scan_t *scan)
+{
+    scan->ncur = 0;
+}
+
+// operand `i` of `instr` in pattern order, NULL when it has none. the imm8
+// of a 0F-map instruction is made up in `tmp`
+static const air_operand_t *operand_at(
+    const air_instr_t *instr, unsigned i, air_operand_t *tmp)
+{
+    const air_operand_t *op;
+    switch (i) {
+    case 0:
+        op = &instr->ops.binary.dst;
+        break;
+    case 1:
+        if (instr->type != AIR_MOV && instr->type != AIR_EXT) {
+            return NULL;
+        }
+        op = &instr->ops.binary.src;
+        break;
+    default:
+        if (instr->type != AIR_EXT || !(instr->ext & AIR_EXT_IMM)) {
+            return NULL;
+        }
+        tmp->type = OPERAND_IMM;
+        tmp->imm.value = instr->imm;
+        tmp->imm.size = OPERAND_SIZE_8;
+        return tmp;
+    }
+    return op->type == OPERAND_NONE ? NULL : op;
+}
+
+static bool operand_matches(const pat_operand_t *o, const air_operand_t *op)
+{
+    if (o->kind == PAT_OP_ANY) {
+        return true;
+    }
+    if (!op) {
+        return false;
+    }
+
+    switch (o->kind) {
+    case PAT_OP_REG:
+        return op->type == OPERAND_REG &&
+               (o->reg == PAT_ANY_REG || o->reg == op->reg.id) &&
+               (o->size == PAT_ANY_SIZE || o->size == op->reg.size);
+    case PAT_OP_MEM:
+        return op->type == OPERAND_MEM &&
+               (o->size == PAT_ANY_SIZE || o->size == op->mem.op_size);
+    case PAT_OP_ADDR:
+        if (op->type != OPERAND_MEM || op->mem.segment != SEG_NONE ||
+            (o->size != PAT_ANY_SIZE && o->size != op->mem.op_size) ||
+            (o->addr != PAT_ANY_SIZE && o->addr != op->mem.size) ||
+            (o->reg != PAT_ANY_REG && o->reg != op->mem.base) ||
+            (o->index != PAT_ANY_REG && o->index != op->mem.index)) {
+            return false;
+        }
+        if (op->mem.index != REG_NONE && o->scale != PAT_ANY_SCALE &&
+            o->scale != op->mem.factor) {
+            return false;
+        }
+        return op->mem.disp >= o->lo && op->mem.disp <= o->hi;
+    case PAT_OP_IMM:
+        return op->type == OPERAND_IMM && op->imm.value >= o->lo &&
+               op->imm.value <= o->hi;
+    case PAT_OP_REL:
+        return op->type == OPERAND_REL;
+    default:
+        return false;
+    }
+}
+
+static bool pred_matches(const pattern_set_t *set, const pat_pred_t *pred,
+    const air_instr_t *instr)
+{
+    if (pred->type != PAT_ANY_TYPE && pred->type != instr->type) {
+        return false;
+    }
+    if (pred->name >= 0) {
+        unsigned id = AIR_EXT_ID(instr->ext);
+        const uint64_t *ids =
+            set->names[pred->name].ids[(instr->ext & AIR_EXT_VEX) ? 1 : 0];
+        if (id >= EXT_NAMED || !((ids[id / 64] >> (id % 64)) & 1)) {
+            return false;
+        }
+    }
+    air_operand_t tmp;
+    for (unsigned i = 0; i < pred->nops; i++) {
+        if (!operand_matches(&pred->ops[i], operand_at(instr, i, &tmp))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// tries to take state `s` on `instr`, for a match that began at `start`
+static inline void enter(
+    pattern_scan_t *scan, uint32_t s, size_t start, const air_instr_t *instr)
+{
+    const pattern_set_t *set = scan->set;
+    uint32_t pred = set->states[s].pred;
+    if (pred != PAT_GAP) {
+        if (scan->pred_step[pred] != scan->step) {
+            scan->pred_step[pred] = scan->step;
+            scan->pred_value[pred] =
+                pred_matches(set, &set->preds[pred], instr);
+        }
+        if (!scan->pred_value[pred]) {
+            return;
+        }
+    }
+
+    if (scan->state_step[s] == scan->step) {
+        // reached twice: keep the shorter match
+        size_t slot = scan->state_slot[s];
+        if (start > scan->next_start[slot]) {
+            scan->next_start[slot] = start;
+        }
+        return;
+    }
+    scan->state_step[s] = scan->step;
+    scan->state_slot[s] = scan->nnext;
+    scan->next[scan->nnext] = s;
+    scan->next_start[scan->nnext] = start;
+    scan->nnext++;
+}
+
+void pattern_scan_instr(pattern_scan_t *scan, const air_instr_t *instr)
+{
+    const pattern_set_t *set = scan->set;
+    if (++scan->step == 0) { // the stamps wrapped
+        memset(scan->state_step, 0,
+            (set->nstates ? set->nstates : 1) * sizeof(*scan->state_step));
+        memset(scan->pred_step, 0,
+            (set->npreds ? set->npreds : 1) * sizeof(*scan->pred_step));
+        scan->step = 1;
+    }
+    scan->nnext = 0;
+    // bytes that didn't decode break every partial match
+    if (instr->offset != scan->end) {
+        scan->ncur = 0;
+    }
+
+    if (instr->type <= AIR_EXT) {
+        for (uint32_t i = set->start_first[instr->type];
+             i < set->start_first[instr->type + 1]; i++) {
+            enter(scan, set->starts[i], instr->offset, instr);
+        }
+    }
+    for (size_t i = 0; i < scan->ncur; i++) {
+        uint32_t s = scan->cur[i];
+        for (uint32_t e = set->first[s]; e < set->first[s + 1]; e++) {
+            enter(scan, set->succs[e], scan->cur_start[i], instr);
+        }
+    }
+
+    size_t end = instr->offset + instr->length;
+    scan->end = end;
+    for (size_t i = 0; i < scan->nnext; i++) {
+        for (uint32_t a = set->states[scan->next[i]].accept; a;
+             a = set->accepts[a - 1]) {
+            scan->hit(a - 1, scan->next_start[i], end, scan->arg);
+        }
+    }
+
+    uint32_t *states = scan->cur;
+    size_t *starts = scan->cur_start;
+    scan->cur = scan->next;
+    scan->cur_start = scan->next_start;
+    scan->ncur = scan->nnext;
+    scan->next = states;
+    scan->next_start = starts;
+}
@@ -0,0 +1,118 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include "air.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * instruction idioms matched on AIR fields, no text involved. a pattern is
+ * a list of steps separated by ';', each an instruction or a gap:
+ *
+ *   mov [rbp-1..], reg ; ...{,2} ; call
+ *   pop reg64 ; pop reg64 ; jmp
+ *
+ * an instruction is a mnemonic and optional operands. the mnemonic is *
+ * for any instruction, pop, push, mov, call, jmp, ext for any 0F-map
+ * instruction, or the name of one (cmove, movaps, vmovaps). operands are
+ * compared in AIR order: destination, source, then the imm8 of a 0F-map
+ * instruction. the ones left out match anything:
+ *
+ *   _              anything, or no operand at all
+ *   reg            a register. reg8 .. reg64, xmm and ymm by size
+ *   rax, r9d       that register
+ *   mem            a memory operand, also sized: qword mem
+ *   [B+I*S+D]      memory with base B, index I times S and displacement D,
+ *                  also sized: dword [rsp+_]. B and I are registers or _.
+ *                  a missing index or displacement must be missing in the
+ *                  instruction too. D is a number, _, or LO..HI with either
+ *                  end left open; after '-' it's negated, so [rbp-8..] is
+ *                  rbp minus 8 or more
+ *   imm, 3, 1..8   an immediate, any or in a range
+ *   rel            a branch displacement
+ *
+ * a gap skips instructions: ... any number of them, ...{N} exactly N, and
+ * ...{M,N}, ...{M,} or ...{,N}. a pattern starts and ends with an
+ * instruction. a match never spans bytes that didn't decode
+ */
+
+// bounded gaps are unrolled into one state per skipped instruction
+#define PATTERN_MAX_GAP 64
+
+typedef struct pat_pred_s pat_pred_t;
+typedef struct pat_state_s pat_state_t;
+typedef struct pat_name_s pat_name_t;
+struct pat_build_s;
+
+/*
+ * the patterns of a search, merged into one automaton: patterns sharing
+ * their first steps share states, and equal steps are tested once per
+ * instruction however many patterns use them
+ */
+typedef struct {
+    char **texts; // as given to pattern_set_add()
+    size_t count;
+
+    pat_pred_t *preds;
+    size_t npreds;
+    pat_name_t *names; // mnemonics of 0F-map instructions
+    size_t nnames;
+
+    // state 0 is the root the first steps hang off
+    pat_state_t *states;
+    size_t nstates;
+    uint32_t *accepts; // per pattern: the next pattern the state accepts
+
+    // built by pattern_set_compile()
+    uint32_t *succs;      // successors of state s: succs[first[s]..]
+    uint32_t *first;      // nstates + 1 entries
+    uint32_t *starts;     // root successors by instruction type
+    uint32_t *start_first; // AIR_EXT + 2 entries
+
+    struct pat_build_s *build; // bookkeeping for pattern_set_add()
+} pattern_set_t;
+
+void pattern_set_init(pattern_set_t *set);
+void pattern_set_destroy(pattern_set_t *set);
+// parses and adds a pattern. prints what's wrong and returns false on a
+// syntax error
+bool pattern_set_add(pattern_set_t *set, const char *text);
+// builds the transition tables once every pattern is added
+bool pattern_set_compile(pattern_set_t *set);
+
+// a hit of pattern number `pattern`, from the instruction at `start` to
+// the end of the one ending at `end` (offsets into the decoded buffer)
+typedef void (*pattern_hit_fn)(
+    size_t pattern, size_t start, size_t end, void *arg);
+
+// one pass over an instruction stream. the set must stay unchanged while
+// it runs
+typedef struct {
+    const pattern_set_t *set;
+    pattern_hit_fn hit;
+    void *arg;
+
+    uint32_t step;   // instructions seen, stamps what was done for the last
+    size_t end;      // where the last instruction ended
+    uint32_t *cur;   // active states after the last instruction
+    size_t *cur_start; // offset each of them started matching at
+    size_t ncur;
+    uint32_t *next;
+    size_t *next_start;
+    size_t nnext;
+    uint32_t *state_step; // per state: the step it was last entered at
+    size_t *state_slot;   // and its place in `next`
+    uint32_t *pred_step;  // per predicate: the step it was last tested at
+    bool *pred_value;
+} pattern_scan_t;
+
+bool pattern_scan_init(pattern_scan_t *scan, const pattern_set_t *set,
+    pattern_hit_fn hit, void *arg);
+void pattern_scan_destroy(pattern_scan_t *scan);
+// forgets partial matches, before a stream unrelated to the last one
+void pattern_scan_reset(pattern_scan_t *scan);
+// feeds the next instruction, in offset order
+void pattern_scan_instr(pattern_scan_t *scan, const air_instr_t *instr);
+
+#endif // PATTERN_H
@@ -0,0 +1,145 @@
+#include "pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct pool_task_s {
+    pool_task_fn fn;
+    void *arg;
+    struct pool_task_s *next;
+} pool_task_t;
+
+struct pool_s {
+    pthread_mutex_t lock;
+    pthread_cond_t has_work;
+    pthread_cond_t idle;
+    pool_task_t *head;
+    pool_task_t *tail;
+    size_t pending; // queued + running
+    bool stopping;
+    unsigned nthreads;
+    pthread_t threads[];
+};
+
+static void *pool_worker(void *arg)
+{
+    pool_t *pool = (pool_t *)arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->head && !pool->stopping) {
+            pthread_cond_wait(&pool->has_work, &pool->lock);
+        }
+        if (!pool->head) {
+            break;
+        }
+
+        pool_task_t *task = pool->head;
+        pool->head = task->next;
+        if (!pool->head) {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        task->fn(task->arg);
+        free(task);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_broadcast(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+pool_t *pool_new(unsigned threads)
+{
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    pool_t *pool =
+        (pool_t *)malloc(sizeof(*pool) + threads * sizeof(pthread_t));
+    if (!pool) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->has_work, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    pool->head = NULL;
+    pool->tail = NULL;
+    pool->pending = 0;
+    pool->stopping = false;
+    pool->nthreads = 0;
+
+    for (unsigned i = 0; i < threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, pool_worker, pool) != 0) {
+            break;
+        }
+        pool->nthreads++;
+    }
+
+    if (pool->nthreads == 0) {
+        pool_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+bool pool_submit(pool_t *pool, pool_task_fn fn, void *arg)
+{
+    pool_task_t *task = (pool_task_t *)malloc(sizeof(*task));
+    if (!task) {
+        return false;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    task->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail) {
+        pool->tail->next = task;
+    }
+    else {
+        pool->head = task;
+    }
+    pool->tail = task;
+    pool->pending++;
+    pthread_cond_signal(&pool->has_work);
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+
+void pool_wait(pool_t *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_free(pool_t *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->has_work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned i = 0; i < pool->nthreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->idle);
+    pthread_cond_destroy(&pool->has_work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+unsigned pool_default_threads(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned)n : 1;
+}
@@ -0,0 +1,25 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef void (*pool_task_fn)(void *arg);
+
+typedef struct pool_s pool_t;
+
+// spawns `threads` workers (at least one)
+pool_t *pool_new(unsigned threads);
+
+// queues fn(arg). the task is run by exactly one worker
+bool pool_submit(pool_t *pool, pool_task_fn fn, void *arg);
+
+// blocks until every submitted task has finished
+void pool_wait(pool_t *pool);
+
+// waits for pending tasks, joins the workers and frees the pool
+void pool_free(pool_t *pool);
+
+unsigned pool_default_threads(void);
+
+#endif // POOL_H
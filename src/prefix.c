@@ -15,3 +15,37 @@ bool rex_extract(uint8_t prefix, struct rex_prefix *out)
     out->w = (prefix >> 3) & 0x1;
     return true;
 }
+
+#define PV_REX_W(i) (((i) & 0x8) != 0)
+#define PV_OP16(i) (((i) & PREFIX_VARIANT_OP) != 0)
+
+#define PREFIX_VARIANT_ENTRY(i)                                                \
+    {                                                                          \
+        .r_ext = ((i) & 0x4) ? 8 : 0,                                          \
+        .x_ext = ((i) & 0x2) ? 8 : 0,                                          \
+        .b_ext = ((i) & 0x1) ? 8 : 0,                                          \
+        .op_size = PV_REX_W(i) ? OPERAND_SIZE_64                               \
+                   : PV_OP16(i) ? OPERAND_SIZE_16                              \
+                                : OPERAND_SIZE_32,                             \
+        .op_size64 = PV_REX_W(i) || !PV_OP16(i) ? OPERAND_SIZE_64              \
+                                                : OPERAND_SIZE_16,             \
+        .addr_size =                                                           \
+            ((i) & PREFIX_VARIANT_ADDR) ? ADDR_SIZE_32 : ADDR_SIZE_64,         \
+    }
+
+#define PREFIX_VARIANT_ROW(i)                                                  \
+    PREFIX_VARIANT_ENTRY(i), PREFIX_VARIANT_ENTRY(i + 1),                      \
+        PREFIX_VARIANT_ENTRY(i + 2), PREFIX_VARIANT_ENTRY(i + 3),              \
+        PREFIX_VARIANT_ENTRY(i + 4), PREFIX_VARIANT_ENTRY(i + 5),              \
+        PREFIX_VARIANT_ENTRY(i + 6), PREFIX_VARIANT_ENTRY(i + 7),              \
+        PREFIX_VARIANT_ENTRY(i + 8), PREFIX_VARIANT_ENTRY(i + 9),              \
+        PREFIX_VARIANT_ENTRY(i + 10), PREFIX_VARIANT_ENTRY(i + 11),            \
+        PREFIX_VARIANT_ENTRY(i + 12), PREFIX_VARIANT_ENTRY(i + 13),            \
+        PREFIX_VARIANT_ENTRY(i + 14), PREFIX_VARIANT_ENTRY(i + 15)
+
+const struct prefix_variant prefix_variants[PREFIX_VARIANTS] = {
+    PREFIX_VARIANT_ROW(0x00),
+    PREFIX_VARIANT_ROW(0x10),
+    PREFIX_VARIANT_ROW(0x20),
+    PREFIX_VARIANT_ROW(0x30),
+};
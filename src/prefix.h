@@ -1,6 +1,7 @@
 #ifndef PREFIX_H
 #define PREFIX_H
 
+#include "defs.h"
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -33,4 +34,24 @@ struct rex_prefix {
 
 bool rex_extract(uint8_t prefix, struct rex_prefix *out);
 
+/*
+ * everything REX, 0x66 and 0x67 decide, precomputed per combination. the
+ * index is the low nibble of the REX byte (WRXB, 0 without REX) ORed with
+ * the PREFIX_VARIANT_* bits
+ */
+#define PREFIX_VARIANT_OP 0x10
+#define PREFIX_VARIANT_ADDR 0x20
+#define PREFIX_VARIANTS 0x40
+
+struct prefix_variant {
+    uint8_t r_ext; // added to ModR/M.reg
+    uint8_t x_ext; // added to SIB.index
+    uint8_t b_ext; // added to ModR/M.rm, SIB.base and opcode registers
+    operand_size_t op_size;   // for instructions defaulting to 32 bits
+    operand_size_t op_size64; // for instructions defaulting to 64 bits
+    addr_size_t addr_size;
+};
+
+extern const struct prefix_variant prefix_variants[PREFIX_VARIANTS];
+
 #endif // PREFIX_H
@@ -0,0 +1,381 @@
+#include "proc.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// runs of missing pages passed to one process_vm_readv call
+#define PROC_IOV_BATCH 64
+// longest run in one iovec
+#define PROC_RUN_PAGES 256
+
+struct proc_block_s {
+    struct proc_block_s *next;
+    uint8_t data[];
+};
+
+bool proc_maps_read(pid_t pid, proc_map_t **maps, size_t *count)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/maps", (int)pid);
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    proc_map_t *out = NULL;
+    size_t n = 0;
+    size_t cap = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    bool ok = true;
+
+    while (getline(&line, &line_cap, in) != -1) {
+        uint64_t start, end, offset;
+        char perms[5];
+        int name_at = 0;
+        if (sscanf(line, "%" SCNx64 "-%" SCNx64 " %4s %" SCNx64 " %*s %*u %n",
+                &start, &end, perms, &offset, &name_at) < 4) {
+            continue;
+        }
+
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            proc_map_t *p = (proc_map_t *)realloc(out, cap * sizeof(*p));
+            if (!p) {
+                ok = false;
+                break;
+            }
+            out = p;
+        }
+
+        char *name = name_at ? line + name_at : (char *)"";
+        name[strcspn(name, "\n")] = '\0';
+
+        proc_map_t *map = &out[n];
+        map->start = start;
+        map->end = end;
+        map->offset = offset;
+        map->exec = perms[2] == 'x';
+        map->path = strdup(name);
+        if (!map->path) {
+            ok = false;
+            break;
+        }
+        n++;
+    }
+
+    free(line);
+    fclose(in);
+    if (!ok) {
+        proc_maps_free(out, n);
+        return false;
+    }
+    *maps = out;
+    *count = n;
+    return true;
+}
+
+void proc_maps_free(proc_map_t *maps, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        free(maps[i].path);
+    }
+    free(maps);
+}
+
+bool proc_mem_init(proc_mem_t *mem, pid_t pid)
+{
+    memset(mem, 0, sizeof(*mem));
+    mem->pid = pid;
+    mem->page_size = (size_t)sysconf(_SC_PAGESIZE);
+    mem->capacity = 1024;
+    mem->keys = (uint64_t *)calloc(mem->capacity, sizeof(*mem->keys));
+    mem->pages =
+        (const uint8_t **)calloc(mem->capacity, sizeof(*mem->pages));
+    if (!mem->keys || !mem->pages) {
+        proc_mem_destroy(mem);
+        return false;
+    }
+    return true;
+}
+
+void proc_mem_destroy(proc_mem_t *mem)
+{
+    proc_block_t *block = mem->blocks;
+    while (block) {
+        proc_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(mem->keys);
+    free(mem->pages);
+    memset(mem, 0, sizeof(*mem));
+}
+
+static size_t slot_of(const proc_mem_t *mem, uint64_t page)
+{
+    size_t mask = mem->capacity - 1;
+    size_t i = (size_t)((page * 0x9e3779b97f4a7c15ull) >> 20) & mask;
+    while (mem->keys[i] && mem->keys[i] != page + 1) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static bool is_cached(const proc_mem_t *mem, uint64_t page)
+{
+    return mem->keys[slot_of(mem, page)] != 0;
+}
+
+static bool grow_cache(proc_mem_t *mem)
+{
+    proc_mem_t bigger = *mem;
+    bigger.capacity = mem->capacity * 2;
+    bigger.keys = (uint64_t *)calloc(bigger.capacity, sizeof(*bigger.keys));
+    bigger.pages =
+        (const uint8_t **)calloc(bigger.capacity, sizeof(*bigger.pages));
+    if (!bigger.keys || !bigger.pages) {
+        free(bigger.keys);
+        free(bigger.pages);
+        return false;
+    }
+
+    for (size_t i = 0; i < mem->capacity; i++) {
+        if (mem->keys[i]) {
+            size_t s = slot_of(&bigger, mem->keys[i] - 1);
+            bigger.keys[s] = mem->keys[i];
+            bigger.pages[s] = mem->pages[i];
+        }
+    }
+    free(mem->keys);
+    free(mem->pages);
+    mem->keys = bigger.keys;
+    mem->pages = bigger.pages;
+    mem->capacity = bigger.capacity;
+    return true;
+}
+
+static bool cache_page(proc_mem_t *mem, uint64_t page, const uint8_t *data)
+{
+    // keep the load under 3/4
+    if ((mem->used + 1) * 4 > mem->capacity * 3 && !grow_cache(mem)) {
+        return false;
+    }
+    size_t s = slot_of(mem, page);
+    if (!mem->keys[s]) {
+        mem->used++;
+    }
+    mem->keys[s] = page + 1;
+    mem->pages[s] = data;
+    return true;
+}
+
+static uint8_t *new_block(proc_mem_t *mem, size_t pages)
+{
+    proc_block_t *block = (proc_block_t *)malloc(
+        sizeof(*block) + pages * mem->page_size);
+    if (!block) {
+        return NULL;
+    }
+    block->next = mem->blocks;
+    mem->blocks = block;
+    return block->data;
+}
+
+// reads a single page on its own. a page that fails here is a hole
+static bool fetch_page(proc_mem_t *mem, uint64_t page)
+{
+    uint8_t *data = new_block(mem, 1);
+    if (!data) {
+        return false;
+    }
+    struct iovec local = {data, mem->page_size};
+    struct iovec remote = {(void *)(uintptr_t)(page * mem->page_size),
+        mem->page_size};
+    ssize_t n = process_vm_readv(mem->pid, &local, 1, &remote, 1, 0);
+    return cache_page(mem, page, n == (ssize_t)mem->page_size ? data : NULL);
+}
+
+// fetches every uncached page in [first, last] in as few syscalls as the
+// batch limits allow
+static bool fetch_pages(proc_mem_t *mem, uint64_t first, uint64_t last)
+{
+    uint64_t page = first;
+    while (page <= last) {
+        struct iovec local[PROC_IOV_BATCH];
+        struct iovec remote[PROC_IOV_BATCH];
+        uint64_t run_start[PROC_IOV_BATCH];
+        size_t run_pages[PROC_IOV_BATCH];
+        size_t runs = 0;
+        size_t total = 0;
+
+        // gather runs of missing pages
+        while (page <= last && runs < PROC_IOV_BATCH) {
+            if (is_cached(mem, page)) {
+                page++;
+                continue;
+            }
+            size_t len = 0;
+            while (page + len <= last && len < PROC_RUN_PAGES &&
+                   !is_cached(mem, page + len)) {
+                len++;
+            }
+            run_start[runs] = page;
+            run_pages[runs] = len;
+            runs++;
+            total += len;
+            page += len;
+        }
+        if (!runs) {
+            break;
+        }
+
+        uint8_t *data = new_block(mem, total);
+        if (!data) {
+            return false;
+        }
+        size_t at = 0;
+        for (size_t r = 0; r < runs; r++) {
+            local[r].iov_base = data + at * mem->page_size;
+            local[r].iov_len = run_pages[r] * mem->page_size;
+            remote[r].iov_base =
+                (void *)(uintptr_t)(run_start[r] * mem->page_size);
+            remote[r].iov_len = run_pages[r] * mem->page_size;
+            at += run_pages[r];
+        }
+
+        ssize_t n = process_vm_readv(mem->pid, local, (unsigned long)runs,
+            remote, (unsigned long)runs, 0);
+        size_t got = n > 0 ? (size_t)n / mem->page_size : 0;
+
+        // cache what arrived. the page where the transfer stopped is
+        // retried alone, and the next round resumes after it
+        at = 0;
+        for (size_t r = 0; r < runs; r++) {
+            for (size_t i = 0; i < run_pages[r]; i++, at++) {
+                if (at < got) {
+                    if (!cache_page(mem, run_start[r] + i,
+                            data + at * mem->page_size)) {
+                        return false;
+                    }
+                }
+                else if (at == got) {
+                    if (!fetch_page(mem, run_start[r] + i)) {
+                        return false;
+                    }
+                    page = run_start[r] + i + 1;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool proc_mem_read(proc_mem_t *mem, uint64_t addr, void *buf, size_t len)
+{
+    if (!len) {
+        return true;
+    }
+
+    uint64_t first = addr / mem->page_size;
+    uint64_t last = (addr + len - 1) / mem->page_size;
+    if (!fetch_pages(mem, first, last)) {
+        memset(buf, 0, len);
+        return false;
+    }
+
+    bool complete = true;
+    uint8_t *out = (uint8_t *)buf;
+    for (uint64_t page = first; page <= last; page++) {
+        uint64_t page_addr = page * mem->page_size;
+        uint64_t from = addr > page_addr ? addr : page_addr;
+        uint64_t to = page_addr + mem->page_size;
+        if (to > addr + len) {
+            to = addr + len;
+        }
+
+        const uint8_t *data = mem->pages[slot_of(mem, page)];
+        if (data) {
+            memcpy(out + (from - addr), data + (from - page_addr), to - from);
+        }
+        else {
+            memset(out + (from - addr), 0, to - from);
+            complete = false;
+        }
+    }
+    return complete;
+}
+
+// bytes from `addr` to the end of its page, at most `left`
+static size_t page_rest(const proc_mem_t *mem, uint64_t addr, size_t left)
+{
+    size_t rest = mem->page_size - (size_t)(addr % mem->page_size);
+    return rest < left ? rest : left;
+}
+
+// reads the start of [addr, addr + len) with one iovec per page, so a
+// transfer that stops early stops at the page that failed. true when all
+// that was asked for arrived; `*got` is the bytes that did
+static bool read_pages(const proc_mem_t *mem, uint64_t addr, uint8_t *buf,
+    size_t len, size_t *got)
+{
+    struct iovec local[PROC_RUN_PAGES];
+    struct iovec remote[PROC_RUN_PAGES];
+    size_t iovs = 0;
+    size_t want = 0;
+    while (want < len && iovs < PROC_RUN_PAGES) {
+        size_t chunk = page_rest(mem, addr + want, len - want);
+        local[iovs].iov_base = buf + want;
+        local[iovs].iov_len = chunk;
+        remote[iovs].iov_base = (void *)(uintptr_t)(addr + want);
+        remote[iovs].iov_len = chunk;
+        iovs++;
+        want += chunk;
+    }
+
+    ssize_t n = process_vm_readv(mem->pid, local, (unsigned long)iovs,
+        remote, (unsigned long)iovs, 0);
+    *got = n > 0 ? (size_t)n : 0;
+    return *got == want;
+}
+
+void proc_mem_each_run(const proc_mem_t *mem, uint64_t addr, uint8_t *buf,
+    size_t len, proc_run_fn fn, void *arg)
+{
+    size_t at = 0;
+    size_t run = 0;       // where the current run began
+    bool readable = true; // and what it is
+    while (at < len) {
+        // past a failed page, the rest is probed a page at a time
+        size_t want = readable ? len - at : page_rest(mem, addr + at, len - at);
+        size_t got;
+        bool full = read_pages(mem, addr + at, buf + at, want, &got);
+        if (!readable && full) {
+            fn(addr + run, NULL, at - run, arg);
+            run = at;
+            readable = true;
+            at += got;
+            continue;
+        }
+        if (readable) {
+            at += got;
+            if (full) {
+                continue;
+            }
+            if (at > run) {
+                fn(addr + run, buf + run, at - run, arg);
+            }
+            run = at;
+            readable = false;
+        }
+        at += page_rest(mem, addr + at, len - at); // the page that failed
+    }
+    if (at > run) {
+        fn(addr + run, readable ? buf + run : NULL, at - run, arg);
+    }
+}
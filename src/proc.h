@@ -0,0 +1,54 @@
+#ifndef PROC_H
+#define PROC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint64_t offset;
+    bool exec;
+    char *path; // empty for anonymous mappings
+} proc_map_t;
+
+// parses /proc/<pid>/maps
+bool proc_maps_read(pid_t pid, proc_map_t **maps, size_t *count);
+void proc_maps_free(proc_map_t *maps, size_t count);
+
+typedef struct proc_block_s proc_block_t;
+
+/*
+ * reads another process's memory with process_vm_readv. pages are fetched
+ * in batches of runs and cached, so overlapping or repeated reads stay in
+ * user space. pages that can't be read are cached as holes
+ */
+typedef struct {
+    pid_t pid;
+    size_t page_size;
+    uint64_t *keys;        // page number + 1, 0 marks an empty slot
+    const uint8_t **pages; // NULL for a hole
+    size_t used;
+    size_t capacity; // power of two
+    proc_block_t *blocks;
+} proc_mem_t;
+
+bool proc_mem_init(proc_mem_t *mem, pid_t pid);
+void proc_mem_destroy(proc_mem_t *mem);
+
+// copies [addr, addr + len) into `buf`. holes read as zeros and make the
+// call return false
+bool proc_mem_read(proc_mem_t *mem, uint64_t addr, void *buf, size_t len);
+
+// `data` is NULL for a run of pages that couldn't be read
+typedef void (*proc_run_fn)(
+    uint64_t addr, const uint8_t *data, size_t len, void *arg);
+
+// reads [addr, addr + len) into `buf` in one pass past the cache, then
+// hands it to `fn` in runs of readable and unreadable pages, in order
+void proc_mem_each_run(const proc_mem_t *mem, uint64_t addr, uint8_t *buf,
+    size_t len, proc_run_fn fn, void *arg);
+
+#endif // PROC_H
@@ -0,0 +1,173 @@
+#include "samples.h"
+#include "disasm.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint64_t addr;
+    uint32_t sample;
+} sample_ref_t;
+
+static bool push_addr(samples_t *samples, size_t *capacity, uint64_t addr)
+{
+    if (samples->count == *capacity) {
+        size_t cap = *capacity ? *capacity * 2 : 4096;
+        uint64_t *addrs =
+            (uint64_t *)realloc(samples->addrs, cap * sizeof(*addrs));
+        if (!addrs) {
+            return false;
+        }
+        samples->addrs = addrs;
+        *capacity = cap;
+    }
+    samples->addrs[samples->count++] = addr;
+    return true;
+}
+
+bool samples_load(samples_t *samples, const char *path)
+{
+    memset(samples, 0, sizeof(*samples));
+
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    size_t capacity = 0;
+    size_t lineno = 0;
+    bool ok = true;
+
+    while (ok && getline(&line, &line_cap, in) != -1) {
+        lineno++;
+        const char *p = line;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+
+        char *end;
+        errno = 0;
+        unsigned long long addr = strtoull(p, &end, 16);
+        if (end == p || errno || (*end && !isspace((unsigned char)*end))) {
+            fprintf(stderr, "%s:%zu: expected an address\n", path, lineno);
+            ok = false;
+        }
+        else if (samples->count == UINT32_MAX ||
+                 !push_addr(samples, &capacity, addr)) {
+            fprintf(stderr, "%s: too many samples\n", path);
+            ok = false;
+        }
+    }
+
+    free(line);
+    fclose(in);
+    if (!ok) {
+        samples_destroy(samples);
+    }
+    return ok;
+}
+
+static int cmp_ref(const void *a, const void *b)
+{
+    const sample_ref_t *x = (const sample_ref_t *)a;
+    const sample_ref_t *y = (const sample_ref_t *)b;
+    return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+// sorts the samples by address and numbers the distinct addresses
+static bool dedupe(samples_t *samples)
+{
+    size_t n = samples->count;
+    sample_ref_t *refs = (sample_ref_t *)malloc(n * sizeof(*refs));
+    samples->slot = (uint32_t *)malloc(n * sizeof(*samples->slot));
+    if (!refs || !samples->slot) {
+        free(refs);
+        return false;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        refs[i].addr = samples->addrs[i];
+        refs[i].sample = (uint32_t)i;
+    }
+    qsort(refs, n, sizeof(*refs), cmp_ref);
+
+    size_t nuniq = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (i == 0 || refs[i].addr != refs[i - 1].addr) {
+            nuniq++;
+        }
+    }
+
+    samples->uniq = (uint64_t *)malloc(nuniq * sizeof(*samples->uniq));
+    samples->hits = (size_t *)calloc(nuniq, sizeof(*samples->hits));
+    samples->instrs = (air_instr_t *)calloc(nuniq, sizeof(*samples->instrs));
+    samples->status = (int *)calloc(nuniq, sizeof(*samples->status));
+    if (!samples->uniq || !samples->hits || !samples->instrs ||
+        !samples->status) {
+        free(refs);
+        return false;
+    }
+
+    size_t u = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0 && refs[i].addr != refs[i - 1].addr) {
+            u++;
+        }
+        samples->uniq[u] = refs[i].addr;
+        samples->hits[u]++;
+        samples->slot[refs[i].sample] = (uint32_t)u;
+    }
+    samples->nuniq = nuniq;
+
+    free(refs);
+    return true;
+}
+
+bool samples_decode(samples_t *samples, const elf_file_t *elf)
+{
+    if (!samples->count) {
+        return true;
+    }
+    if (!dedupe(samples)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < samples->nuniq; i++) {
+        uint64_t offset, avail;
+        if (elf_vaddr_to_offset(elf, samples->uniq[i], &offset, &avail)) {
+            samples->status[i] = disasm_one(
+                elf->data + offset, (size_t)avail, &samples->instrs[i]);
+        }
+    }
+    return true;
+}
+
+unsigned samples_bucket(const samples_t *samples, size_t i)
+{
+    if (samples->status[i] == 0) {
+        return SAMPLES_UNMAPPED;
+    }
+    if (samples->status[i] < 0) {
+        return SAMPLES_UNDECODED;
+    }
+    return samples->instrs[i].type;
+}
+
+void samples_destroy(samples_t *samples)
+{
+    free(samples->addrs);
+    free(samples->slot);
+    free(samples->uniq);
+    free(samples->hits);
+    free(samples->instrs);
+    free(samples->status);
+    memset(samples, 0, sizeof(*samples));
+}
@@ -0,0 +1,45 @@
+#ifndef SAMPLES_H
+#define SAMPLES_H
+
+#include "air.h"
+#include "elf_file.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// a decoded unique address is one of the air_instr_type_t values; these
+// extra buckets count samples that produced no instruction
+#define SAMPLES_UNDECODED 0x100
+#define SAMPLES_UNMAPPED 0x101
+
+/*
+ * profiler samples in input order, plus the distinct addresses among them.
+ * every distinct address is decoded once and shared by all its samples
+ */
+typedef struct {
+    uint64_t *addrs; // per sample, input order
+    uint32_t *slot;  // per sample, index into the per-address arrays
+    size_t count;
+
+    uint64_t *uniq;      // distinct addresses, ascending
+    size_t *hits;        // samples per distinct address
+    air_instr_t *instrs; // decoded instruction per distinct address
+    int *status;         // disasm_one() result, 0 when not in the image
+    size_t nuniq;
+} samples_t;
+
+// reads one address per line, hex with or without 0x. blank lines and
+// lines starting with '#' are skipped. other text after the address is
+// ignored, so `perf script -F ip` style output works as is
+bool samples_load(samples_t *samples, const char *path);
+
+// dedupes the addresses and decodes each distinct one from `elf`
+bool samples_decode(samples_t *samples, const elf_file_t *elf);
+
+// SAMPLES_UNDECODED, SAMPLES_UNMAPPED or the instruction type of the
+// distinct address `i`
+unsigned samples_bucket(const samples_t *samples, size_t i);
+
+void samples_destroy(samples_t *samples);
+
+#endif // SAMPLES_H
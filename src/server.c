@@ -0,0 +1,469 @@
+#include "server.h"
+#include "air.h"
+#include "disasm.h"
+#include "frontend.h"
+#include "sock.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define SERVER_IOV_BATCH 64
+// decode state kept for later connections, the rest is freed
+#define SERVER_MAX_IDLE 8
+
+// decode state recycled between requests and connections
+typedef struct server_worker_s {
+    air_instr_list_t instrs;
+    uint8_t *in;
+    size_t in_cap;
+    FILE *text;
+    char *text_buf;
+    size_t text_size;
+    struct server_worker_s *next;
+} server_worker_t;
+
+typedef struct {
+    int fd;
+    server_worker_t *worker;
+    const uint8_t *shm;
+    size_t shm_len;
+} server_conn_t;
+
+// guards everything below
+static pthread_mutex_t server_lock = PTHREAD_MUTEX_INITIALIZER;
+static server_worker_t *idle_workers;
+static unsigned idle_count;
+static unsigned active_conns;
+
+static server_worker_t *worker_acquire(void)
+{
+    pthread_mutex_lock(&server_lock);
+    server_worker_t *worker = idle_workers;
+    if (worker) {
+        idle_workers = worker->next;
+        idle_count--;
+    }
+    pthread_mutex_unlock(&server_lock);
+
+    if (worker) {
+        return worker;
+    }
+
+    worker = (server_worker_t *)calloc(1, sizeof(*worker));
+    if (!worker) {
+        return NULL;
+    }
+    air_instr_list_init(&worker->instrs);
+    worker->text = open_memstream(&worker->text_buf, &worker->text_size);
+    if (!worker->text) {
+        free(worker);
+        return NULL;
+    }
+    return worker;
+}
+
+static void worker_free(server_worker_t *worker)
+{
+    air_instr_list_destroy(&worker->instrs);
+    free(worker->in);
+    fclose(worker->text);
+    free(worker->text_buf);
+    free(worker);
+}
+
+static void worker_release(server_worker_t *worker)
+{
+    pthread_mutex_lock(&server_lock);
+    if (idle_count < SERVER_MAX_IDLE) {
+        worker->next = idle_workers;
+        idle_workers = worker;
+        idle_count++;
+        worker = NULL;
+    }
+    pthread_mutex_unlock(&server_lock);
+
+    if (worker) {
+        worker_free(worker);
+    }
+}
+
+// takes one of the SERVER_MAX_CONNS connection slots
+static bool conn_reserve(void)
+{
+    pthread_mutex_lock(&server_lock);
+    bool ok = active_conns < SERVER_MAX_CONNS;
+    if (ok) {
+        active_conns++;
+    }
+    pthread_mutex_unlock(&server_lock);
+    return ok;
+}
+
+static void conn_done(void)
+{
+    pthread_mutex_lock(&server_lock);
+    active_conns--;
+    pthread_mutex_unlock(&server_lock);
+}
+
+static bool recv_all(int fd, void *buf, size_t len)
+{
+    uint8_t *p = (uint8_t *)buf;
+    while (len) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool send_iov(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return false;
+        }
+
+        size_t sent = (size_t)n;
+        while (iovcnt && sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt) {
+            iov->iov_base = (uint8_t *)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    return true;
+}
+
+// reads one request header, picking up a descriptor if one is attached.
+// returns 0 on a clean end of stream, -1 on error
+static int recv_request(int fd, server_request_t *req, int *passed_fd)
+{
+    size_t got = 0;
+    *passed_fd = -1;
+
+    while (got < sizeof(*req)) {
+        union {
+            char buf[CMSG_SPACE(sizeof(int))];
+            struct cmsghdr align;
+        } control;
+        struct iovec iov = {(uint8_t *)req + got, sizeof(*req) - got};
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return (n == 0 && got == 0) ? 0 : -1;
+        }
+
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c;
+            c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+                if (*passed_fd >= 0) {
+                    close(*passed_fd);
+                }
+                memcpy(passed_fd, CMSG_DATA(c), sizeof(int));
+            }
+        }
+        got += (size_t)n;
+    }
+    return 1;
+}
+
+// the bytes have to stay put while requests decode them: a client that
+// could still truncate its memfd would take the daemon down with SIGBUS,
+// and one that could still write to it would change them mid-decode
+#define SERVER_SHM_SEALS (F_SEAL_SHRINK | F_SEAL_WRITE)
+
+static int map_shared_buffer(server_conn_t *conn, int fd)
+{
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0) {
+        return errno == EINVAL ? EPERM : errno; // can't be sealed at all
+    }
+    if ((seals & SERVER_SHM_SEALS) != SERVER_SHM_SEALS) {
+        return EPERM;
+    }
+
+    // sealed against shrinking, so the size can only grow from here
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return errno;
+    }
+
+    void *p = NULL;
+    if (st.st_size > 0) {
+        p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            return errno;
+        }
+    }
+
+    if (conn->shm) {
+        munmap((void *)conn->shm, conn->shm_len);
+    }
+    conn->shm = (const uint8_t *)p;
+    conn->shm_len = (size_t)st.st_size;
+    return 0;
+}
+
+static bool send_status(server_conn_t *conn, int status)
+{
+    server_response_t resp = {SERVER_MAGIC, status, 0, 0, 0};
+    struct iovec iov = {&resp, sizeof(resp)};
+    return send_iov(conn->fd, &iov, 1);
+}
+
+// offsets in the AIR stay relative to the request buffer
+static bool send_air(server_conn_t *conn, uint64_t errors)
+{
+    air_instr_list_t *list = &conn->worker->instrs;
+    server_response_t resp = {SERVER_MAGIC, 0, list->count,
+        list->count * sizeof(air_instr_t), errors};
+
+    struct iovec iov[SERVER_IOV_BATCH];
+    int n = 0;
+    iov[n].iov_base = &resp;
+    iov[n++].iov_len = sizeof(resp);
+
+    air_instr_iter_t it;
+    air_instr_iter_init(&it, list);
+    const air_instr_t *run;
+    size_t used;
+    bool ok = true;
+    while (ok && (run = air_instr_iter_next(&it, &used))) {
+        if (used) {
+            iov[n].iov_base = (void *)run;
+            iov[n++].iov_len = used * sizeof(air_instr_t);
+        }
+        // a run mapped from a spill file goes away with the next one
+        if (n == SERVER_IOV_BATCH || (n && it.map)) {
+            ok = send_iov(conn->fd, iov, n);
+            n = 0;
+        }
+    }
+    ok = ok && !it.failed && (n == 0 || send_iov(conn->fd, iov, n));
+    air_instr_iter_done(&it);
+    return ok;
+}
+
+static bool send_text(server_conn_t *conn, uint64_t base, uint64_t errors)
+{
+    server_worker_t *worker = conn->worker;
+    air_instr_list_t *list = &worker->instrs;
+
+    fmt_opts_t opts = {base, NULL, true};
+    rewind(worker->text);
+    fprint_instr_list_fmt(worker->text, list, &opts);
+    if (fflush(worker->text) != 0) {
+        return send_status(conn, ENOMEM);
+    }
+
+    size_t len = (size_t)ftello(worker->text);
+    server_response_t resp = {SERVER_MAGIC, 0, list->count, len, errors};
+    struct iovec iov[2] = {
+        {&resp, sizeof(resp)},
+        {worker->text_buf, len},
+    };
+    return send_iov(conn->fd, iov, 2);
+}
+
+typedef struct {
+    air_instr_list_t *out;
+    bool ok;
+} collect_ctx_t;
+
+static void collect_instr(const air_instr_t *instr, void *arg)
+{
+    collect_ctx_t *ctx = (collect_ctx_t *)arg;
+    air_instr_t *slot = air_instr_list_get_new(ctx->out);
+    if (!slot) {
+        ctx->ok = false;
+        return;
+    }
+    // all of it, padding too: the chunks are recycled across clients
+    memcpy(slot, instr, sizeof(*slot));
+}
+
+// returns false when the connection has to be dropped
+static bool serve_request(server_conn_t *conn, const server_request_t *req)
+{
+    server_worker_t *worker = conn->worker;
+    const uint8_t *code;
+
+    if (req->flags & SERVER_REQ_SHM) {
+        if (!conn->shm || req->shm_offset > conn->shm_len ||
+            req->len > conn->shm_len - req->shm_offset) {
+            return send_status(conn, EINVAL);
+        }
+        code = conn->shm + req->shm_offset;
+    }
+    else {
+        if (req->len > SERVER_MAX_REQUEST) {
+            send_status(conn, E2BIG);
+            return false; // the payload can't be skipped cheaply
+        }
+        if (req->len > worker->in_cap) {
+            uint8_t *in = (uint8_t *)realloc(worker->in, req->len);
+            if (!in) {
+                send_status(conn, ENOMEM);
+                return false;
+            }
+            worker->in = in;
+            worker->in_cap = req->len;
+        }
+        if (!recv_all(conn->fd, worker->in, req->len)) {
+            return false;
+        }
+        code = worker->in;
+    }
+
+    if (req->mode != SERVER_MODE_64 ||
+        (req->format != SERVER_FMT_AIR && req->format != SERVER_FMT_TEXT)) {
+        return send_status(conn, EINVAL);
+    }
+
+    // quietly: a client's garbage must not end up in the daemon's output
+    air_instr_list_reset(&worker->instrs);
+    collect_ctx_t ctx = {&worker->instrs, true};
+    size_t errors = disasm_each(code, req->len, collect_instr, &ctx);
+    if (!ctx.ok) {
+        return send_status(conn, ENOMEM);
+    }
+
+    if (req->format == SERVER_FMT_TEXT) {
+        return send_text(conn, req->base, errors);
+    }
+    return send_air(conn, errors);
+}
+
+static void *serve_conn(void *arg)
+{
+    server_conn_t *conn = (server_conn_t *)arg;
+
+    for (;;) {
+        server_request_t req;
+        int passed_fd;
+        if (recv_request(conn->fd, &req, &passed_fd) <= 0) {
+            break;
+        }
+        if (req.magic != SERVER_MAGIC) {
+            if (passed_fd >= 0) {
+                close(passed_fd);
+            }
+            break;
+        }
+
+        if (passed_fd >= 0) {
+            int err = map_shared_buffer(conn, passed_fd);
+            close(passed_fd);
+            if (err) {
+                if (!(req.flags & SERVER_REQ_SHM) ||
+                    !send_status(conn, err)) {
+                    break;
+                }
+                continue;
+            }
+        }
+
+        if (!serve_request(conn, &req)) {
+            break;
+        }
+    }
+
+    if (conn->shm) {
+        munmap((void *)conn->shm, conn->shm_len);
+    }
+    close(conn->fd);
+    worker_release(conn->worker);
+    free(conn);
+    conn_done();
+    return NULL;
+}
+
+bool server_run(const char *path)
+{
+    int fd = sock_listen(path);
+    if (fd < 0) {
+        return false;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    for (;;) {
+        int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+
+        if (!conn_reserve()) {
+            // best effort, the accept loop must not block on it
+            server_response_t busy = {SERVER_MAGIC, EBUSY, 0, 0, 0};
+            send(client, &busy, sizeof(busy), MSG_NOSIGNAL | MSG_DONTWAIT);
+            close(client);
+            continue;
+        }
+
+        server_conn_t *conn = (server_conn_t *)calloc(1, sizeof(*conn));
+        server_worker_t *worker = conn ? worker_acquire() : NULL;
+        if (!worker) {
+            free(conn);
+            close(client);
+            conn_done();
+            continue;
+        }
+        conn->fd = client;
+        conn->worker = worker;
+
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, serve_conn, conn) != 0) {
+            worker_release(worker);
+            free(conn);
+            close(client);
+            conn_done();
+        }
+    }
+
+    pthread_attr_destroy(&attr);
+    close(fd);
+    return false;
+}
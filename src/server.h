@@ -0,0 +1,65 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * wire protocol on the unix socket. every request is a header followed by
+ * `len` bytes of code, unless SERVER_REQ_SHM is set: then the bytes are
+ * taken from [shm_offset, shm_offset + len) of a memfd descriptor. the
+ * descriptor is passed once with SCM_RIGHTS alongside a request header and
+ * stays mapped for the rest of the connection. it has to be sealed with
+ * F_SEAL_SHRINK and F_SEAL_WRITE, otherwise the request fails with EPERM.
+ *
+ * every response is a header followed by `len` payload bytes: an array of
+ * `count` air_instr_t for SERVER_FMT_AIR, or one text line per instruction
+ * ("<address>: <instruction>") for SERVER_FMT_TEXT. bytes that don't
+ * decode are skipped and counted in `errors`; the instructions are zeroed
+ * before decoding, so unused fields and padding are always 0.
+ */
+
+#define SERVER_MAGIC 0x4d534944 // "DISM"
+#define SERVER_MAX_REQUEST (64u << 20)
+// connections served at once. the ones over it get an EBUSY response
+// and are closed
+#define SERVER_MAX_CONNS 64
+
+typedef enum {
+    SERVER_MODE_64 = 64,
+} server_mode_t;
+
+typedef enum {
+    SERVER_FMT_AIR = 0,
+    SERVER_FMT_TEXT = 1,
+} server_format_t;
+
+typedef enum {
+    SERVER_REQ_SHM = 1 << 0,
+} server_req_flag_t;
+
+typedef struct {
+    uint32_t magic;
+    uint8_t mode;   // server_mode_t
+    uint8_t format; // server_format_t
+    uint8_t flags;  // server_req_flag_t
+    uint8_t reserved;
+    uint64_t base; // address of the first byte
+    uint64_t len;
+    uint64_t shm_offset;
+} server_request_t;
+
+typedef struct {
+    uint32_t magic;
+    int32_t status; // 0 or an errno value
+    uint64_t count; // decoded instructions
+    uint64_t len;   // payload bytes
+    uint64_t errors; // failed decodes
+} server_response_t;
+
+// serves requests on `path` until a fatal error. each connection gets its
+// own thread, up to SERVER_MAX_CONNS; decode buffers are recycled across
+// connections
+bool server_run(const char *path);
+
+#endif // SERVER_H
@@ -0,0 +1,316 @@
+#include "shared.h"
+#include "sock.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// where the array starts, a cache line in
+#define INSTRS_OFFSET 64
+#define INITIAL_CAP 4096
+
+#define REQUIRED_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+static size_t region_size(size_t instrs)
+{
+    return INSTRS_OFFSET + instrs * sizeof(air_instr_t);
+}
+
+static bool fail(air_shared_writer_t *w, int err)
+{
+    if (!w->err) {
+        w->err = err ? err : EIO;
+    }
+    return false;
+}
+
+bool air_shared_writer_open(air_shared_writer_t *w, const char *name)
+{
+    memset(w, 0, sizeof(*w));
+    w->map = MAP_FAILED;
+    w->fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (w->fd < 0) {
+        return fail(w, errno);
+    }
+    if (ftruncate(w->fd, (off_t)region_size(INITIAL_CAP)) < 0) {
+        return fail(w, errno);
+    }
+    void *p = mmap(NULL, region_size(INITIAL_CAP), PROT_READ | PROT_WRITE,
+        MAP_SHARED, w->fd, 0);
+    if (p == MAP_FAILED) {
+        return fail(w, errno);
+    }
+    w->map = (uint8_t *)p;
+    w->cap = INITIAL_CAP;
+    return true;
+}
+
+// doubles the room in the region. the mapping may move
+static bool grow(air_shared_writer_t *w)
+{
+    size_t cap = w->cap * 2;
+    if (ftruncate(w->fd, (off_t)region_size(cap)) < 0) {
+        return fail(w, errno);
+    }
+    void *p = mremap(
+        w->map, region_size(w->cap), region_size(cap), MREMAP_MAYMOVE);
+    if (p == MAP_FAILED) {
+        return fail(w, errno);
+    }
+    w->map = (uint8_t *)p;
+    w->cap = cap;
+    return true;
+}
+
+bool air_shared_writer_add(air_shared_writer_t *w, const air_instr_t *instr)
+{
+    if (w->err || (w->count == w->cap && !grow(w))) {
+        return false;
+    }
+    air_instr_t *slot = (air_instr_t *)(w->map + INSTRS_OFFSET) + w->count;
+    *slot = *instr;
+    slot->next = NULL;
+    w->count++;
+    return true;
+}
+
+bool air_shared_writer_add_list(
+    air_shared_writer_t *w, const air_instr_list_t *list)
+{
+    air_instr_iter_t it;
+    air_instr_iter_init(&it, list);
+    const air_instr_t *run;
+    size_t n;
+    bool ok = true;
+    while (ok && (run = air_instr_iter_next(&it, &n))) {
+        for (size_t i = 0; ok && i < n; i++) {
+            ok = air_shared_writer_add(w, &run[i]);
+        }
+    }
+    if (it.failed) {
+        ok = fail(w, EIO);
+    }
+    air_instr_iter_done(&it);
+    return ok;
+}
+
+bool air_shared_writer_seal(air_shared_writer_t *w, int *fd)
+{
+    if (w->map != MAP_FAILED) {
+        if (!w->err) {
+            air_shared_header_t hdr = {AIR_SHARED_MAGIC, AIR_SHARED_VERSION,
+                w->count, INSTRS_OFFSET, sizeof(air_instr_t)};
+            memcpy(w->map, &hdr, sizeof(hdr));
+        }
+        // F_SEAL_WRITE is refused while a writable mapping exists
+        munmap(w->map, region_size(w->cap));
+        w->map = MAP_FAILED;
+    }
+    if (!w->err &&
+        (ftruncate(w->fd, (off_t)region_size(w->count)) < 0 ||
+            fcntl(w->fd, F_ADD_SEALS, REQUIRED_SEALS | F_SEAL_SEAL) < 0)) {
+        fail(w, errno);
+    }
+
+    if (w->err) {
+        if (w->fd >= 0) {
+            close(w->fd);
+        }
+        w->fd = -1;
+        errno = w->err;
+        return false;
+    }
+    *fd = w->fd;
+    w->fd = -1;
+    return true;
+}
+
+static bool send_fd(int sock, int fd)
+{
+    air_shared_hello_t hello = {AIR_SHARED_MAGIC, AIR_SHARED_VERSION};
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = {&hello, sizeof(hello)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(c), &fd, sizeof(int));
+
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == (ssize_t)sizeof(hello);
+}
+
+bool air_shared_publish(int sock, int fd)
+{
+    // a client that hangs up early only loses its own copy of the fd
+    for (;;) {
+        int client = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        send_fd(client, fd);
+        close(client);
+    }
+    return false;
+}
+
+static bool fail_map(air_shared_t *s, int err)
+{
+    air_shared_close(s);
+    errno = err;
+    return false;
+}
+
+bool air_shared_map(air_shared_t *s, int fd)
+{
+    memset(s, 0, sizeof(*s));
+
+    // without these seals the publisher could rewrite or truncate the
+    // region under us
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0) {
+        return fail_map(s, errno == EINVAL ? EPERM : errno);
+    }
+    if ((seals & REQUIRED_SEALS) != REQUIRED_SEALS) {
+        return fail_map(s, EPERM);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return fail_map(s, errno);
+    }
+    if ((size_t)st.st_size < sizeof(air_shared_header_t)) {
+        return fail_map(s, EINVAL);
+    }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        return fail_map(s, errno);
+    }
+    s->map = (const uint8_t *)p;
+    s->len = (size_t)st.st_size;
+
+    air_shared_header_t hdr;
+    memcpy(&hdr, s->map, sizeof(hdr));
+    bool ok = hdr.magic == AIR_SHARED_MAGIC &&
+              hdr.version == AIR_SHARED_VERSION &&
+              hdr.instr_size == sizeof(air_instr_t) &&
+              hdr.instrs_offset >= sizeof(hdr) &&
+              hdr.instrs_offset <= s->len &&
+              hdr.instrs_offset % _Alignof(air_instr_t) == 0 &&
+              hdr.count <= (s->len - hdr.instrs_offset) / sizeof(air_instr_t);
+    if (!ok) {
+        return fail_map(s, EINVAL);
+    }
+    s->instrs = (const air_instr_t *)(s->map + hdr.instrs_offset);
+    s->count = (size_t)hdr.count;
+    return true;
+}
+
+// reads the hello and the descriptor that comes with it
+static int recv_fd(int sock)
+{
+    air_shared_hello_t hello;
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = {&hello, sizeof(hello)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c;
+        c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            memcpy(&fd, CMSG_DATA(c), sizeof(int));
+        }
+    }
+    if (n != (ssize_t)sizeof(hello) || hello.magic != AIR_SHARED_MAGIC ||
+        hello.version != AIR_SHARED_VERSION || fd < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        errno = EPROTO;
+        return -1;
+    }
+    return fd;
+}
+
+bool air_shared_attach(air_shared_t *s, const char *path)
+{
+    memset(s, 0, sizeof(*s));
+    struct sockaddr_un addr;
+    if (!sock_addr(path, &addr)) {
+        return false;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return false;
+    }
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int err = errno;
+        close(sock);
+        errno = err;
+        return false;
+    }
+    int fd = recv_fd(sock);
+    int err = errno;
+    close(sock);
+    if (fd < 0) {
+        errno = err;
+        return false;
+    }
+
+    // the mapping keeps the region alive without the descriptor
+    bool ok = air_shared_map(s, fd);
+    err = errno;
+    close(fd);
+    errno = err;
+    return ok;
+}
+
+void air_shared_close(air_shared_t *s)
+{
+    if (s->map) {
+        munmap((void *)s->map, s->len);
+    }
+    memset(s, 0, sizeof(*s));
+}
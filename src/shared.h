@@ -0,0 +1,79 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include "air.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * decoded instructions published once for many processes. the decoding
+ * process writes them into a memfd as one flat array, seals it against
+ * writes and resizing, and hands the descriptor to every client that
+ * connects to a unix socket (SCM_RIGHTS, with an air_shared_hello_t).
+ * clients map it read-only and read the array in place, so the pages are
+ * shared however many of them there are.
+ *
+ * region layout, native byte order:
+ *
+ *   header   air_shared_header_t
+ *   instrs   air_instr_t[count] at `instrs_offset`, in offset order
+ *
+ * nothing in the region is a pointer: instructions follow each other in
+ * the array and their `next` is always NULL
+ */
+
+#define AIR_SHARED_MAGIC 0x53524941 // "AIRS"
+#define AIR_SHARED_VERSION 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    uint64_t instrs_offset;
+    uint64_t instr_size; // sizeof(air_instr_t) of the writer
+} air_shared_header_t;
+
+// sent along with the descriptor
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+} air_shared_hello_t;
+
+typedef struct {
+    int fd;
+    uint8_t *map; // writable until sealed
+    size_t cap;   // instructions the region has room for
+    uint64_t count;
+    int err; // the first error, 0 while all is well
+} air_shared_writer_t;
+
+// creates an empty region, `name` only shows in /proc/<pid>/fd
+bool air_shared_writer_open(air_shared_writer_t *w, const char *name);
+bool air_shared_writer_add(air_shared_writer_t *w, const air_instr_t *instr);
+bool air_shared_writer_add_list(
+    air_shared_writer_t *w, const air_instr_list_t *list);
+// trims the region, unmaps it and seals it. the sealed descriptor is
+// stored in `*fd`. false with errno set when anything failed; the
+// region is gone then
+bool air_shared_writer_seal(air_shared_writer_t *w, int *fd);
+
+// hands `fd` to every client connecting to the listening socket `sock`
+// (see sock_listen()) until a fatal error
+bool air_shared_publish(int sock, int fd);
+
+typedef struct {
+    const uint8_t *map;
+    size_t len;
+    const air_instr_t *instrs;
+    size_t count;
+} air_shared_t;
+
+// maps a sealed region read-only. false with errno set, EINVAL when it
+// isn't a region or EPERM when it could still change under the mapping
+bool air_shared_map(air_shared_t *s, int fd);
+// connects to a publisher at `path` and maps what it hands out
+bool air_shared_attach(air_shared_t *s, const char *path);
+void air_shared_close(air_shared_t *s);
+
+#endif // SHARED_H
@@ -1,26 +1,36 @@
 #include "sib.h"
 
-void sib_extract(uint8_t sib, struct sib *out)
-{
-    out->base = sib & 0x7;
-    out->index = (sib >> 3) & 0x7;
-    out->scale = sib >> 6;
-    switch (out->scale) {
-    case 0: {
-        out->factor = FACTOR_1;
-        break;
+#define SIB_ENTRY(b)                                                           \
+    {                                                                          \
+        .scale = (b) >> 6,                                                     \
+        .index = ((b) >> 3) & 0x7,                                             \
+        .base = (b) & 0x7,                                                     \
+        .mod0_disp32 = ((b) & 0x7) == 5,                                       \
+        .factor = (scale_factor_t)(1 << ((b) >> 6)),                           \
     }
-    case 1: {
-        out->factor = FACTOR_2;
-        break;
-    }
-    case 2: {
-        out->factor = FACTOR_4;
-        break;
-    }
-    case 3: {
-        out->factor = FACTOR_8;
-        break;
-    }
-    }
-}
+
+#define SIB_ROW(b)                                                             \
+    SIB_ENTRY(b), SIB_ENTRY(b + 1), SIB_ENTRY(b + 2), SIB_ENTRY(b + 3),        \
+        SIB_ENTRY(b + 4), SIB_ENTRY(b + 5), SIB_ENTRY(b + 6),                  \
+        SIB_ENTRY(b + 7), SIB_ENTRY(b + 8), SIB_ENTRY(b + 9),                  \
+        SIB_ENTRY(b + 10), SIB_ENTRY(b + 11), SIB_ENTRY(b + 12),               \
+        SIB_ENTRY(b + 13), SIB_ENTRY(b + 14), SIB_ENTRY(b + 15)
+
+const struct sib sib_table[256] = {
+    SIB_ROW(0x00),
+    SIB_ROW(0x10),
+    SIB_ROW(0x20),
+    SIB_ROW(0x30),
+    SIB_ROW(0x40),
+    SIB_ROW(0x50),
+    SIB_ROW(0x60),
+    SIB_ROW(0x70),
+    SIB_ROW(0x80),
+    SIB_ROW(0x90),
+    SIB_ROW(0xa0),
+    SIB_ROW(0xb0),
+    SIB_ROW(0xc0),
+    SIB_ROW(0xd0),
+    SIB_ROW(0xe0),
+    SIB_ROW(0xf0),
+};
@@ -1,6 +1,7 @@
 #ifndef SIB_H
 #define SIB_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 typedef enum {
@@ -14,9 +15,11 @@ struct sib {
     uint8_t scale;
     uint8_t index;
     uint8_t base;
+    // base == 5: under mod == 0 there is no base register, a disp32 follows
+    bool mod0_disp32;
     scale_factor_t factor;
 };
 
-void sib_extract(uint8_t sib, struct sib *out);
+extern const struct sib sib_table[256];
 
 #endif // SIB_H
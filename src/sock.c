@@ -0,0 +1,66 @@
+#include "sock.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool sock_addr(const char *path, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+int sock_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    if (!sock_addr(path, &addr)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "%s: exists and is not a socket\n", path);
+            close(fd);
+            return -1;
+        }
+        // only a socket nobody listens on any more is left over from an
+        // earlier run; one that accepts belongs to a live server
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 ||
+            errno != ECONNREFUSED) {
+            fprintf(stderr, "%s: %s\n", path, strerror(EADDRINUSE));
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+        // a failed connect leaves the socket unusable, start over
+        close(fd);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            perror("socket");
+            return -1;
+        }
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,16 @@
+#ifndef SOCK_H
+#define SOCK_H
+
+#include <stdbool.h>
+#include <sys/un.h>
+
+// fills `addr` for the unix socket at `path`. false with ENAMETOOLONG
+// when the path doesn't fit
+bool sock_addr(const char *path, struct sockaddr_un *addr);
+
+// binds a listening unix stream socket at `path`, replacing a stale socket
+// left there but never a live one or any other kind of file. returns the
+// descriptor, or -1 after printing why
+int sock_listen(const char *path);
+
+#endif // SOCK_H
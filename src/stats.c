@@ -0,0 +1,214 @@
+#include "stats.h"
+#include "frontend.h"
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(sizeof(disasm_stats_t) % sizeof(uint64_t) == 0,
+    "disasm_stats_t must hold uint64_t counters only");
+
+static const char *const prefix_names[STATS_PREFIXES] = {
+    "lock",
+    "repne",
+    "rep",
+    "2e",
+    "ss",
+    "3e",
+    "es",
+    "fs",
+    "gs",
+    "hint-nt",
+    "hint-t",
+    "66",
+    "67",
+    "rex",
+    "rex.w",
+    "vex",
+};
+
+static const char *const mem_mode_names[STATS_MEM_MODES] = {
+    "none",
+    "[base]",
+    "[base+disp]",
+    "sib",
+    "rip",
+    "absolute",
+};
+
+static const char *const opcode_map_prefixes[STATS_OPCODE_MAPS] = {
+    "",
+    "0f ",
+    "0f 38 ",
+    "0f 3a ",
+};
+
+// the last set this thread asked for and its counters in it
+static __thread struct {
+    stats_set_t *set;
+    disasm_stats_t *stats;
+} local;
+
+void stats_set_init(stats_set_t *set)
+{
+    memset(set, 0, sizeof(*set));
+    pthread_mutex_init(&set->lock, NULL);
+}
+
+void stats_set_destroy(stats_set_t *set)
+{
+    if (local.set == set) {
+        local.set = NULL;
+    }
+    for (size_t i = 0; i < set->count; i++) {
+        free(set->slots[i]);
+    }
+    free(set->slots);
+    pthread_mutex_destroy(&set->lock);
+    memset(set, 0, sizeof(*set));
+}
+
+disasm_stats_t *stats_set_local(stats_set_t *set)
+{
+    if (local.set == set) {
+        return local.stats;
+    }
+
+    disasm_stats_t *stats = (disasm_stats_t *)aligned_alloc(
+        STATS_CACHE_LINE, sizeof(disasm_stats_t));
+    if (!stats) {
+        return NULL;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    pthread_mutex_lock(&set->lock);
+    if (set->count == set->capacity) {
+        size_t cap = set->capacity ? set->capacity * 2 : 16;
+        disasm_stats_t **slots = (disasm_stats_t **)realloc(
+            set->slots, cap * sizeof(*slots));
+        if (!slots) {
+            pthread_mutex_unlock(&set->lock);
+            free(stats);
+            return NULL;
+        }
+        set->slots = slots;
+        set->capacity = cap;
+    }
+    set->slots[set->count++] = stats;
+    pthread_mutex_unlock(&set->lock);
+
+    local.set = set;
+    local.stats = stats;
+    return stats;
+}
+
+void stats_add(disasm_stats_t *dst, const disasm_stats_t *src)
+{
+    uint64_t *d = (uint64_t *)dst;
+    const uint64_t *s = (const uint64_t *)src;
+    for (size_t i = 0; i < sizeof(*dst) / sizeof(uint64_t); i++) {
+        d[i] += s[i];
+    }
+}
+
+void stats_set_merge(stats_set_t *set, disasm_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&set->lock);
+    for (size_t i = 0; i < set->count; i++) {
+        stats_add(out, set->slots[i]);
+    }
+    pthread_mutex_unlock(&set->lock);
+}
+
+static double percent(uint64_t n, uint64_t total)
+{
+    return total ? 100.0 * (double)n / (double)total : 0.0;
+}
+
+typedef struct {
+    uint64_t count;
+    uint16_t map;
+    uint8_t opcode;
+} opcode_row_t;
+
+static int cmp_row(const void *a, const void *b)
+{
+    const opcode_row_t *x = (const opcode_row_t *)a;
+    const opcode_row_t *y = (const opcode_row_t *)b;
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    if (x->map != y->map) {
+        return x->map - y->map;
+    }
+    return x->opcode - y->opcode;
+}
+
+void stats_fprint(FILE *out, const disasm_stats_t *stats)
+{
+    uint64_t attempts = stats->instrs + stats->failed;
+    fprintf(out, "%llu files, %llu bytes, %llu instructions, %llu failed "
+                 "(%.2f%%)\n",
+        (unsigned long long)stats->files, (unsigned long long)stats->bytes,
+        (unsigned long long)stats->instrs, (unsigned long long)stats->failed,
+        percent(stats->failed, attempts));
+
+    fprintf(out, "\ninstruction types:\n");
+    for (int t = 0; t <= AIR_EXT; t++) {
+        if (stats->types[t]) {
+            fprintf(out, "  %-12s %12llu %6.2f%%\n",
+                get_instr_type_name((air_instr_type_t)t),
+                (unsigned long long)stats->types[t],
+                percent(stats->types[t], stats->instrs));
+        }
+    }
+
+    fprintf(out, "\nlengths:\n");
+    for (int len = 1; len < 16; len++) {
+        if (stats->lengths[len]) {
+            fprintf(out, "  %-12d %12llu %6.2f%%\n", len,
+                (unsigned long long)stats->lengths[len],
+                percent(stats->lengths[len], stats->instrs));
+        }
+    }
+
+    fprintf(out, "\nprefixes:\n");
+    for (int p = 0; p < STATS_PREFIXES; p++) {
+        if (stats->prefixes[p]) {
+            fprintf(out, "  %-12s %12llu %6.2f%%\n", prefix_names[p],
+                (unsigned long long)stats->prefixes[p],
+                percent(stats->prefixes[p], stats->instrs));
+        }
+    }
+
+    fprintf(out, "\nmemory operands:\n");
+    for (int m = 0; m < STATS_MEM_MODES; m++) {
+        fprintf(out, "  %-12s %12llu %6.2f%%\n", mem_mode_names[m],
+            (unsigned long long)stats->mem_modes[m],
+            percent(stats->mem_modes[m], stats->instrs));
+    }
+
+    opcode_row_t rows[STATS_OPCODE_MAPS * 256];
+    size_t n = 0;
+    for (int map = 0; map < STATS_OPCODE_MAPS; map++) {
+        for (int op = 0; op < 256; op++) {
+            if (stats->opcodes[map][op]) {
+                rows[n].count = stats->opcodes[map][op];
+                rows[n].map = (uint16_t)map;
+                rows[n].opcode = (uint8_t)op;
+                n++;
+            }
+        }
+    }
+    qsort(rows, n, sizeof(*rows), cmp_row);
+
+    // attempts rather than instructions: failed decodes are counted too
+    fprintf(out, "\nopcodes:\n");
+    for (size_t i = 0; i < n; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "%s%02x",
+            opcode_map_prefixes[rows[i].map], rows[i].opcode);
+        fprintf(out, "  %-12s %12llu %6.2f%%\n", name,
+            (unsigned long long)rows[i].count,
+            percent(rows[i].count, attempts));
+    }
+}
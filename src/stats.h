@@ -0,0 +1,71 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "air.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define STATS_CACHE_LINE 64
+
+// prefix counters: one per instr_prefix_flag_t bit, then these
+#define STATS_PREFIX_FLAGS 13
+#define STATS_REX (STATS_PREFIX_FLAGS + 0)
+#define STATS_REX_W (STATS_PREFIX_FLAGS + 1)
+#define STATS_VEX (STATS_PREFIX_FLAGS + 2)
+#define STATS_PREFIXES (STATS_PREFIX_FLAGS + 3)
+
+// how an instruction's memory operand is addressed
+typedef enum {
+    STATS_MEM_NONE, // no memory operand
+    STATS_MEM_BASE, // [reg]
+    STATS_MEM_BASE_DISP,
+    STATS_MEM_SIB,      // a SIB byte with a base or index
+    STATS_MEM_RIP,      // [rip+disp]
+    STATS_MEM_ABSOLUTE, // ds:disp32, no base or index
+    STATS_MEM_MODES,
+} stats_mem_t;
+
+// rows of `opcodes`: one-byte opcodes, then the 0F, 0F 38 and 0F 3A maps
+#define STATS_OPCODE_MAPS 4
+
+/*
+ * aggregate counters of a decode, filled by disasm_count() without
+ * building any AIR. only uint64_t counters, so merging is a word-wise sum.
+ * each thread owns one, aligned so no two threads share a cache line
+ */
+typedef struct disasm_stats_s {
+    uint64_t files;
+    uint64_t bytes;
+    uint64_t instrs;
+    uint64_t failed; // decode attempts that ended in an error
+    // every decode attempt by its opcode, whether it decoded or not
+    uint64_t opcodes[STATS_OPCODE_MAPS][256];
+    uint64_t prefixes[STATS_PREFIXES];
+    uint64_t mem_modes[STATS_MEM_MODES];
+    uint64_t lengths[16];
+    uint64_t types[AIR_EXT + 1];
+} __attribute__((aligned(STATS_CACHE_LINE))) disasm_stats_t;
+
+// the per-thread counters of one run
+typedef struct {
+    pthread_mutex_t lock;
+    disasm_stats_t **slots;
+    size_t count;
+    size_t capacity;
+} stats_set_t;
+
+void stats_set_init(stats_set_t *set);
+void stats_set_destroy(stats_set_t *set);
+// the calling thread's counters in `set`, created on first use. NULL when
+// out of memory
+disasm_stats_t *stats_set_local(stats_set_t *set);
+// sums every thread's counters into `out`
+void stats_set_merge(stats_set_t *set, disasm_stats_t *out);
+
+void stats_add(disasm_stats_t *dst, const disasm_stats_t *src);
+void stats_fprint(FILE *out, const disasm_stats_t *stats);
+
+#endif // STATS_H
@@ -0,0 +1,155 @@
+#include "stream.h"
+#include "disasm.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// bytes decoded between two hand-offs to the consumer, and between two
+// MADV_DONTNEED calls behind the cursor
+#define STREAM_SLICE (1u << 20)
+
+typedef struct {
+    int fd;
+    uint64_t size;
+    size_t page_size;
+    stream_consume_fn consume;
+    void *arg;
+    air_instr_list_t instrs;
+} stream_t;
+
+/*
+ * decodes instructions starting in the first `stop` bytes of `code`, a
+ * buffer of `len` bytes at file offset `base`. every such instruction has
+ * DISASM_MAX_INSTR_LEN bytes in front of it unless the file ends first, so
+ * it decodes as it would in one contiguous buffer. `behind`, if set, is the
+ * page-aligned mapping holding `code`, released as the cursor moves on
+ */
+static bool decode_range(stream_t *st, const uint8_t *code, size_t len,
+    size_t stop, uint64_t base, uint8_t *behind, size_t *consumed)
+{
+    disasm_session_t session;
+    disasm_session_init(&session, code, len, &st->instrs);
+    size_t done = 0;
+
+    while (done < stop) {
+        size_t budget =
+            stop - done < STREAM_SLICE ? stop - done : STREAM_SLICE;
+        air_instr_list_reset(&st->instrs);
+        size_t n = disasm_session_run(&session, DISASM_UNLIMITED, budget);
+        if (!n) {
+            return false; // out of memory
+        }
+        done += n;
+        st->consume(&st->instrs, base, st->arg);
+
+        if (behind) {
+            size_t drop =
+                (size_t)(code + done - behind) & ~(st->page_size - 1);
+            madvise(behind, drop, MADV_DONTNEED);
+        }
+    }
+    *consumed = done;
+    return true;
+}
+
+// returns an errno value
+static int stream_windows(stream_t *st, size_t window)
+{
+    // an instruction starting in the last DISASM_MAX_INSTR_LEN - 1 bytes of
+    // a window is decoded from `carry`: that tail, plus the head of the
+    // next window
+    uint8_t carry[2 * DISASM_MAX_INSTR_LEN];
+    size_t carry_len = 0;
+    uint64_t pos = 0; // where the next instruction starts
+
+    for (uint64_t win = 0; win < st->size; win += window) {
+        size_t len =
+            st->size - win < window ? (size_t)(st->size - win) : window;
+        bool last = win + len == st->size;
+
+        uint8_t *map = (uint8_t *)mmap(
+            NULL, len, PROT_READ, MAP_PRIVATE, st->fd, (off_t)win);
+        if (map == MAP_FAILED) {
+            return errno;
+        }
+        madvise(map, len, MADV_SEQUENTIAL);
+
+        size_t consumed;
+        if (carry_len) {
+            size_t head =
+                len < DISASM_MAX_INSTR_LEN ? len : DISASM_MAX_INSTR_LEN;
+            memcpy(carry + carry_len, map, head);
+            if (!decode_range(st, carry, carry_len + head, carry_len, pos,
+                    NULL, &consumed)) {
+                munmap(map, len);
+                return ENOMEM;
+            }
+            pos += consumed;
+            carry_len = 0;
+        }
+
+        // the carry may have decoded into this window already
+        size_t from = (size_t)(pos - win);
+        size_t avail = len - from;
+        size_t stop = avail;
+        if (!last) {
+            stop = avail >= DISASM_MAX_INSTR_LEN
+                       ? avail - (DISASM_MAX_INSTR_LEN - 1)
+                       : 0;
+        }
+        if (!decode_range(st, map + from, avail, stop, pos, map, &consumed)) {
+            munmap(map, len);
+            return ENOMEM;
+        }
+        pos += consumed;
+
+        if (!last) {
+            carry_len = (size_t)(win + len - pos);
+            memcpy(carry, map + (pos - win), carry_len);
+        }
+        munmap(map, len);
+    }
+    return 0;
+}
+
+bool stream_disasm_file(
+    const char *path, size_t window, stream_consume_fn consume, void *arg)
+{
+    stream_t st;
+    memset(&st, 0, sizeof(st));
+    st.consume = consume;
+    st.arg = arg;
+    st.page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+    st.fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (st.fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(st.fd, &sb) < 0 || !S_ISREG(sb.st_mode)) {
+        fprintf(stderr, "%s: not a regular file\n", path);
+        close(st.fd);
+        return false;
+    }
+    st.size = (uint64_t)sb.st_size;
+
+    window = (window + st.page_size - 1) & ~(st.page_size - 1);
+    if (!window) {
+        window = st.page_size;
+    }
+
+    air_instr_list_init(&st.instrs);
+    int err = stream_windows(&st, window);
+    if (err) {
+        fprintf(stderr, "%s: %s\n", path, strerror(err));
+    }
+    air_instr_list_destroy(&st.instrs);
+    close(st.fd);
+    return err == 0;
+}
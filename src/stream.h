@@ -0,0 +1,22 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "air.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define STREAM_DEFAULT_WINDOW (64u << 20)
+
+// receives the instructions decoded since the previous call. their offsets
+// are relative to `base`, a file offset. the list is reused afterwards
+typedef void (*stream_consume_fn)(
+    const air_instr_list_t *instrs, uint64_t base, void *arg);
+
+// decodes `path` through mmap windows of `window` bytes (rounded up to
+// whole pages), so memory use doesn't grow with the file. the result is
+// the same as decoding the whole file as one buffer
+bool stream_disasm_file(
+    const char *path, size_t window, stream_consume_fn consume, void *arg);
+
+#endif // STREAM_H
@@ -0,0 +1,179 @@
+#include "symbols.h"
+#include <elf.h>
+#include <stdlib.h>
+#include <string.h>
+
+// how far a lookup walks back past small or unsized symbols looking for
+// one that encloses the address
+#define SYM_ENCLOSING_SCAN 8
+
+typedef struct {
+    sym_t sym;
+    uint8_t bind;
+} sym_entry_t;
+
+typedef struct {
+    sym_entry_t *items;
+    size_t count;
+    size_t capacity;
+    bool failed;
+} sym_collect_t;
+
+static void collect_symbol(const char *name, uint64_t addr, uint64_t size,
+    uint8_t type, uint8_t bind, void *arg)
+{
+    sym_collect_t *c = (sym_collect_t *)arg;
+    if (c->failed || addr == 0) {
+        return;
+    }
+
+    if (c->count == c->capacity) {
+        size_t cap = c->capacity ? c->capacity * 2 : 256;
+        sym_entry_t *items =
+            (sym_entry_t *)realloc(c->items, cap * sizeof(*items));
+        if (!items) {
+            c->failed = true;
+            return;
+        }
+        c->items = items;
+        c->capacity = cap;
+    }
+
+    sym_entry_t *e = &c->items[c->count++];
+    e->sym.addr = addr;
+    e->sym.size = size;
+    e->sym.name = name;
+    e->sym.type = type;
+    e->bind = bind;
+}
+
+// lower is better: sized before unsized, global before local, code and
+// data before the rest
+static int sym_rank(const sym_entry_t *e)
+{
+    int rank = 0;
+    if (!e->sym.size) {
+        rank += 4;
+    }
+    if (e->bind == STB_LOCAL) {
+        rank += 2;
+    }
+    if (e->sym.type != STT_FUNC && e->sym.type != STT_OBJECT) {
+        rank += 1;
+    }
+    return rank;
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+    const sym_entry_t *x = (const sym_entry_t *)a;
+    const sym_entry_t *y = (const sym_entry_t *)b;
+    if (x->sym.addr != y->sym.addr) {
+        return x->sym.addr < y->sym.addr ? -1 : 1;
+    }
+    int rx = sym_rank(x);
+    int ry = sym_rank(y);
+    if (rx != ry) {
+        return rx - ry;
+    }
+    return strcmp(x->sym.name, y->sym.name);
+}
+
+// lays the sorted addresses out in BFS order of an implicit binary tree
+static size_t eyt_fill(sym_index_t *idx, size_t i, size_t k)
+{
+    if (k <= idx->count) {
+        i = eyt_fill(idx, i, 2 * k);
+        idx->eyt[k] = idx->syms[i].addr;
+        idx->eyt_pos[k] = (uint32_t)i;
+        i++;
+        i = eyt_fill(idx, i, 2 * k + 1);
+    }
+    return i;
+}
+
+bool sym_index_build(sym_index_t *idx, const elf_file_t *elf)
+{
+    memset(idx, 0, sizeof(*idx));
+
+    sym_collect_t c = {0};
+    elf_for_each_symbol(elf, collect_symbol, &c);
+    if (c.failed || c.count > UINT32_MAX) {
+        free(c.items);
+        return false;
+    }
+    if (c.count == 0) {
+        return true;
+    }
+
+    qsort(c.items, c.count, sizeof(*c.items), cmp_entry);
+
+    idx->syms = (sym_t *)malloc(c.count * sizeof(*idx->syms));
+    if (!idx->syms) {
+        free(c.items);
+        return false;
+    }
+
+    // one symbol per address, the best ranked one sorts first
+    for (size_t i = 0; i < c.count; i++) {
+        if (idx->count &&
+            idx->syms[idx->count - 1].addr == c.items[i].sym.addr) {
+            continue;
+        }
+        idx->syms[idx->count++] = c.items[i].sym;
+    }
+    free(c.items);
+
+    idx->eyt = (uint64_t *)malloc((idx->count + 1) * sizeof(*idx->eyt));
+    idx->eyt_pos =
+        (uint32_t *)malloc((idx->count + 1) * sizeof(*idx->eyt_pos));
+    if (!idx->eyt || !idx->eyt_pos) {
+        sym_index_destroy(idx);
+        return false;
+    }
+    eyt_fill(idx, 0, 1);
+    return true;
+}
+
+void sym_index_destroy(sym_index_t *idx)
+{
+    free(idx->syms);
+    free(idx->eyt);
+    free(idx->eyt_pos);
+    memset(idx, 0, sizeof(*idx));
+}
+
+static bool sym_covers(const sym_t *sym, uint64_t addr)
+{
+    if (!sym->size) {
+        return addr == sym->addr;
+    }
+    return addr - sym->addr < sym->size;
+}
+
+const sym_t *sym_index_lookup(const sym_index_t *idx, uint64_t addr)
+{
+    size_t n = idx->count;
+    if (!n) {
+        return NULL;
+    }
+
+    // descend to the first address greater than `addr`. the path bits
+    // encode the turns; stripping the trailing right turns (ones) and the
+    // final left turn yields that node, 0 when every address is <= addr
+    size_t k = 1;
+    while (k <= n) {
+        k = 2 * k + (idx->eyt[k] <= addr);
+    }
+    k >>= __builtin_ffsll(~(long long)k);
+
+    size_t upper = k ? idx->eyt_pos[k] : n;
+    for (size_t i = upper, scanned = 0; i > 0 && scanned < SYM_ENCLOSING_SCAN;
+        i--, scanned++) {
+        const sym_t *sym = &idx->syms[i - 1];
+        if (sym_covers(sym, addr)) {
+            return sym;
+        }
+    }
+    return NULL;
+}
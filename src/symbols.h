@@ -0,0 +1,33 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include "elf_file.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint64_t addr;
+    uint64_t size;
+    const char *name; // points into the ELF image
+    uint8_t type;     // STT_*
+} sym_t;
+
+// symbols sorted by address, plus an Eytzinger (BFS order) copy of the
+// addresses so a lookup walks a cache-friendly implicit tree
+typedef struct {
+    sym_t *syms;
+    size_t count;
+    uint64_t *eyt;     // 1-based, eyt[0] unused
+    uint32_t *eyt_pos; // index into `syms` of each eyt node
+} sym_index_t;
+
+// the ELF image must outlive the index
+bool sym_index_build(sym_index_t *idx, const elf_file_t *elf);
+void sym_index_destroy(sym_index_t *idx);
+
+// the symbol covering `addr`: addr lies in [sym.addr, sym.addr + size), or
+// equals sym.addr for unsized symbols. NULL when nothing covers it
+const sym_t *sym_index_lookup(const sym_index_t *idx, uint64_t addr);
+
+#endif // SYMBOLS_H
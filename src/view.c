@@ -0,0 +1,135 @@
+#include "view.h"
+#include "disasm.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool disasm_view_init(
+    disasm_view_t *view, const uint8_t *code, size_t len, size_t stride)
+{
+    memset(view, 0, sizeof(*view));
+    if (!stride) {
+        stride = VIEW_DEFAULT_STRIDE;
+    }
+    // a checkpoint must fall inside its window
+    if (stride < DISASM_MAX_INSTR_LEN) {
+        stride = DISASM_MAX_INSTR_LEN;
+    }
+
+    view->code = code;
+    view->len = len;
+    view->stride = stride;
+    view->windows = len / stride + (len % stride != 0);
+    view->checkpoints =
+        (size_t *)malloc((view->windows + 1) * sizeof(*view->checkpoints));
+    if (!view->checkpoints) {
+        return false;
+    }
+    view->checkpoints[0] = 0;
+    view->known = 1;
+
+    for (size_t i = 0; i < VIEW_CACHE_WINDOWS; i++) {
+        view->slots[i].window = SIZE_MAX;
+        air_instr_list_init(&view->slots[i].instrs);
+    }
+    return true;
+}
+
+void disasm_view_destroy(disasm_view_t *view)
+{
+    for (size_t i = 0; i < VIEW_CACHE_WINDOWS; i++) {
+        air_instr_list_destroy(&view->slots[i].instrs);
+    }
+    free(view->checkpoints);
+    memset(view, 0, sizeof(*view));
+}
+
+static view_slot_t *lru_slot(disasm_view_t *view)
+{
+    view_slot_t *victim = &view->slots[0];
+    for (size_t i = 1; i < VIEW_CACHE_WINDOWS; i++) {
+        if (view->slots[i].used < victim->used) {
+            victim = &view->slots[i];
+        }
+    }
+    return victim;
+}
+
+// decodes window `w`, whose checkpoint is known, into the least recently
+// used slot and learns the next checkpoint
+static view_slot_t *load_window(disasm_view_t *view, size_t w)
+{
+    view_slot_t *slot = lru_slot(view);
+    slot->window = SIZE_MAX;
+    air_instr_list_reset(&slot->instrs);
+
+    size_t from = view->checkpoints[w];
+    size_t until = (w + 1) * view->stride;
+    if (until > view->len) {
+        until = view->len;
+    }
+
+    disasm_session_t session;
+    disasm_session_init(&session, view->code, view->len, &slot->instrs);
+    disasm_session_seek(&session, from);
+    if (from < until) {
+        disasm_session_run(&session, DISASM_UNLIMITED, until - from);
+    }
+    size_t next = (size_t)(session.ctx.current - view->code);
+    if (next < until) {
+        return NULL; // out of memory
+    }
+
+    if (w + 1 == view->known) {
+        view->checkpoints[view->known++] = next;
+    }
+    slot->window = w;
+    slot->used = ++view->clock;
+    return slot;
+}
+
+static const air_instr_list_t *get_window(disasm_view_t *view, size_t w)
+{
+    for (size_t i = 0; i < VIEW_CACHE_WINDOWS; i++) {
+        if (view->slots[i].window == w) {
+            view->slots[i].used = ++view->clock;
+            return &view->slots[i].instrs;
+        }
+    }
+
+    // walk forward from the last checkpoint; the windows passed on the way
+    // stay cached for scrolling back
+    while (view->known <= w) {
+        if (!load_window(view, view->known - 1)) {
+            return NULL;
+        }
+    }
+    view_slot_t *slot = load_window(view, w);
+    return slot ? &slot->instrs : NULL;
+}
+
+size_t disasm_view_read(
+    disasm_view_t *view, size_t offset, air_instr_t *out, size_t max)
+{
+    size_t n = 0;
+    for (size_t w = offset / view->stride; n < max && w < view->windows;
+        w++) {
+        const air_instr_list_t *instrs = get_window(view, w);
+        if (!instrs) {
+            break;
+        }
+
+        air_instr_iter_t it;
+        air_instr_iter_init(&it, instrs);
+        const air_instr_t *run;
+        size_t count;
+        while (n < max && (run = air_instr_iter_next(&it, &count))) {
+            for (size_t i = 0; n < max && i < count; i++) {
+                if (run[i].offset >= offset) {
+                    out[n++] = run[i];
+                }
+            }
+        }
+        air_instr_iter_done(&it);
+    }
+    return n;
+}
@@ -0,0 +1,48 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include "air.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define VIEW_DEFAULT_STRIDE 4096
+#define VIEW_CACHE_WINDOWS 8
+
+typedef struct {
+    size_t window; // SIZE_MAX while the slot is empty
+    uint64_t used; // view clock at the last hit
+    air_instr_list_t instrs;
+} view_slot_t;
+
+/*
+ * random access to the instructions of a buffer without decoding all of it
+ * up front. the buffer is cut into windows of `stride` bytes: window i holds
+ * the instructions from checkpoint i, the first instruction boundary at or
+ * after i * stride, up to checkpoint i + 1. checkpoints are learned as
+ * windows get decoded, always from a known one, so the instructions are
+ * the ones disasm() finds. the last few windows are kept decoded
+ */
+typedef struct {
+    const uint8_t *code;
+    size_t len;
+    size_t stride;
+    size_t windows;      // len / stride, rounded up
+    size_t *checkpoints; // windows + 1 entries, the first `known` are set
+    size_t known;
+    uint64_t clock;
+    view_slot_t slots[VIEW_CACHE_WINDOWS];
+} disasm_view_t;
+
+// `code` must outlive the view. stride 0 picks VIEW_DEFAULT_STRIDE
+bool disasm_view_init(
+    disasm_view_t *view, const uint8_t *code, size_t len, size_t stride);
+void disasm_view_destroy(disasm_view_t *view);
+
+// copies up to `max` instructions, from the first one starting at or after
+// `offset`, to `out` and returns how many. only the windows up to the last
+// one copied are decoded, the ones before `offset` just once
+size_t disasm_view_read(
+    disasm_view_t *view, size_t offset, air_instr_t *out, size_t max);
+
+#endif // VIEW_H
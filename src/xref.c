@@ -0,0 +1,329 @@
+#include "xref.h"
+#include "pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+// LSD radix sort on the target, 8 bits per pass
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1u << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+// below this many tuples the sort runs on the calling thread alone
+#define XREF_PARALLEL_MIN (1u << 16)
+
+void xref_buf_init(xref_buf_t *buf)
+{
+    memset(buf, 0, sizeof(*buf));
+}
+
+void xref_buf_destroy(xref_buf_t *buf)
+{
+    free(buf->items);
+    xref_buf_init(buf);
+}
+
+static bool push(xref_buf_t *buf, uint64_t source, uint64_t target,
+    xref_kind_t kind)
+{
+    if (buf->count == buf->capacity) {
+        size_t cap = buf->capacity ? buf->capacity * 2 : 64;
+        xref_t *items = (xref_t *)realloc(buf->items, cap * sizeof(*items));
+        if (!items) {
+            return false;
+        }
+        buf->items = items;
+        buf->capacity = cap;
+    }
+    xref_t *x = &buf->items[buf->count++];
+    x->source = source;
+    x->target = target;
+    x->kind = (uint8_t)kind;
+    return true;
+}
+
+bool xref_collect(
+    xref_buf_t *buf, const air_instr_list_t *list, uint64_t base)
+{
+    air_instr_iter_t it;
+    air_instr_iter_init(&it, list);
+    const air_instr_t *run;
+    size_t n;
+    bool ok = true;
+    while (ok && (run = air_instr_iter_next(&it, &n))) {
+        for (size_t i = 0; ok && i < n; i++) {
+            const air_instr_t *instr = &run[i];
+            uint64_t source = base + instr->offset;
+            uint64_t target;
+            const air_operand_t *rip;
+
+            if (air_branch_target(instr, base, &target)) {
+                xref_kind_t kind =
+                    instr->type == AIR_CALL ? XREF_CALL : XREF_JMP;
+                ok = push(buf, source, target, kind);
+            }
+            else if ((rip = air_instr_rip_operand(instr))) {
+                target = air_rip_target(instr, rip, base);
+                ok = push(buf, source, target, XREF_DATA);
+            }
+        }
+    }
+    ok = ok && !it.failed;
+    air_instr_iter_done(&it);
+    return ok;
+}
+
+/*
+ * parallel radix sort. every pass, each worker counts the digits of its
+ * slice, the counts are turned into per-worker output offsets, then each
+ * worker scatters its slice. slices keep their order, so the sort is stable
+ */
+typedef struct {
+    const xref_t *in;
+    xref_t *out;
+    size_t begin;
+    size_t end;
+    unsigned shift;
+    size_t counts[RADIX_BUCKETS];
+} radix_part_t;
+
+static void count_task(void *arg)
+{
+    radix_part_t *part = (radix_part_t *)arg;
+    memset(part->counts, 0, sizeof(part->counts));
+    for (size_t i = part->begin; i < part->end; i++) {
+        part->counts[(part->in[i].target >> part->shift) & 0xff]++;
+    }
+}
+
+static void scatter_task(void *arg)
+{
+    radix_part_t *part = (radix_part_t *)arg;
+    for (size_t i = part->begin; i < part->end; i++) {
+        const xref_t *x = &part->in[i];
+        part->out[part->counts[(x->target >> part->shift) & 0xff]++] = *x;
+    }
+}
+
+static void run_parts(pool_t *pool, radix_part_t *parts, unsigned nparts,
+    pool_task_fn fn)
+{
+    for (unsigned p = 0; p < nparts; p++) {
+        if (!pool || !pool_submit(pool, fn, &parts[p])) {
+            fn(&parts[p]);
+        }
+    }
+    if (pool) {
+        pool_wait(pool);
+    }
+}
+
+// returns the buffer holding the sorted tuples, `a` or `b`
+static xref_t *radix_sort(xref_t *a, xref_t *b, size_t n, unsigned threads)
+{
+    unsigned nparts = n < XREF_PARALLEL_MIN || threads < 1 ? 1 : threads;
+    radix_part_t local;
+    radix_part_t *parts = NULL;
+    if (nparts > 1) {
+        parts = (radix_part_t *)calloc(nparts, sizeof(*parts));
+    }
+    if (!parts) {
+        parts = &local;
+        nparts = 1;
+    }
+    pool_t *pool = nparts > 1 ? pool_new(nparts) : NULL;
+
+    for (unsigned pass = 0; pass < RADIX_PASSES; pass++) {
+        for (unsigned p = 0; p < nparts; p++) {
+            parts[p].in = a;
+            parts[p].out = b;
+            parts[p].begin = n * p / nparts;
+            parts[p].end = n * (p + 1) / nparts;
+            parts[p].shift = pass * RADIX_BITS;
+        }
+        run_parts(pool, parts, nparts, count_task);
+
+        // skip digits every tuple shares, like the high bytes of addresses
+        bool trivial = false;
+        for (unsigned d = 0; d < RADIX_BUCKETS && !trivial; d++) {
+            size_t total = 0;
+            for (unsigned p = 0; p < nparts; p++) {
+                total += parts[p].counts[d];
+            }
+            trivial = total == n;
+        }
+        if (trivial) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (unsigned d = 0; d < RADIX_BUCKETS; d++) {
+            for (unsigned p = 0; p < nparts; p++) {
+                size_t c = parts[p].counts[d];
+                parts[p].counts[d] = offset;
+                offset += c;
+            }
+        }
+        run_parts(pool, parts, nparts, scatter_task);
+
+        xref_t *t = a;
+        a = b;
+        b = t;
+    }
+
+    if (pool) {
+        pool_free(pool);
+    }
+    if (parts != &local) {
+        free(parts);
+    }
+    return a;
+}
+
+static uint64_t hash_target(uint64_t target)
+{
+    return (target * 0x9e3779b97f4a7c15ull) >> 17;
+}
+
+static bool build_slots(xref_index_t *idx)
+{
+    size_t cap = 16;
+    while (cap < idx->rows * 2) {
+        cap *= 2;
+    }
+    idx->slot_keys = (uint64_t *)malloc(cap * sizeof(*idx->slot_keys));
+    idx->slot_rows = (uint32_t *)malloc(cap * sizeof(*idx->slot_rows));
+    if (!idx->slot_keys || !idx->slot_rows) {
+        return false;
+    }
+    idx->slot_mask = cap - 1;
+    for (size_t i = 0; i < cap; i++) {
+        idx->slot_rows[i] = UINT32_MAX;
+    }
+
+    for (size_t r = 0; r < idx->rows; r++) {
+        size_t s = hash_target(idx->targets[r]) & idx->slot_mask;
+        while (idx->slot_rows[s] != UINT32_MAX) {
+            s = (s + 1) & idx->slot_mask;
+        }
+        idx->slot_keys[s] = idx->targets[r];
+        idx->slot_rows[s] = (uint32_t)r;
+    }
+    return true;
+}
+
+bool xref_index_build(xref_index_t *idx, const xref_buf_t *bufs,
+    size_t nbufs, unsigned threads)
+{
+    memset(idx, 0, sizeof(*idx));
+
+    size_t n = 0;
+    for (size_t i = 0; i < nbufs; i++) {
+        n += bufs[i].count;
+    }
+    if (n >= UINT32_MAX) {
+        return false;
+    }
+
+    xref_t *a = (xref_t *)malloc((n ? n : 1) * sizeof(*a));
+    xref_t *b = (xref_t *)malloc((n ? n : 1) * sizeof(*b));
+    if (!a || !b) {
+        free(a);
+        free(b);
+        return false;
+    }
+    size_t at = 0;
+    for (size_t i = 0; i < nbufs; i++) {
+        if (bufs[i].count == 0) {
+            continue; // items may be NULL
+        }
+        memcpy(a + at, bufs[i].items, bufs[i].count * sizeof(*a));
+        at += bufs[i].count;
+    }
+
+    const xref_t *sorted = radix_sort(a, b, n, threads);
+
+    size_t rows = 0;
+    for (size_t i = 0; i < n; i++) {
+        rows += i == 0 || sorted[i].target != sorted[i - 1].target;
+    }
+
+    idx->targets = (uint64_t *)malloc((rows ? rows : 1) * sizeof(uint64_t));
+    idx->first = (size_t *)malloc((rows + 1) * sizeof(size_t));
+    idx->sources = (uint64_t *)malloc((n ? n : 1) * sizeof(uint64_t));
+    idx->kinds = (uint8_t *)malloc(n ? n : 1);
+    bool ok = idx->targets && idx->first && idx->sources && idx->kinds;
+
+    if (ok) {
+        size_t r = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (i == 0 || sorted[i].target != sorted[i - 1].target) {
+                idx->targets[r] = sorted[i].target;
+                idx->first[r++] = i;
+            }
+            idx->sources[i] = sorted[i].source;
+            idx->kinds[i] = sorted[i].kind;
+        }
+        idx->first[rows] = n;
+        idx->rows = rows;
+        idx->count = n;
+        ok = build_slots(idx);
+    }
+
+    free(a);
+    free(b);
+    if (!ok) {
+        xref_index_destroy(idx);
+    }
+    return ok;
+}
+
+void xref_index_destroy(xref_index_t *idx)
+{
+    free(idx->targets);
+    free(idx->first);
+    free(idx->sources);
+    free(idx->kinds);
+    free(idx->slot_keys);
+    free(idx->slot_rows);
+    memset(idx, 0, sizeof(*idx));
+}
+
+ptrdiff_t xref_index_find(const xref_index_t *idx, uint64_t target)
+{
+    if (!idx->slot_rows) {
+        return -1;
+    }
+    size_t s = hash_target(target) & idx->slot_mask;
+    while (idx->slot_rows[s] != UINT32_MAX) {
+        if (idx->slot_keys[s] == target) {
+            return (ptrdiff_t)idx->slot_rows[s];
+        }
+        s = (s + 1) & idx->slot_mask;
+    }
+    return -1;
+}
+
+// first row whose target is >= addr
+static size_t lower_bound(const xref_index_t *idx, uint64_t addr)
+{
+    size_t lo = 0;
+    size_t hi = idx->rows;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx->targets[mid] < addr) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+size_t xref_index_range(
+    const xref_index_t *idx, uint64_t lo, uint64_t hi, size_t *first_row)
+{
+    size_t begin = lower_bound(idx, lo);
+    size_t end = hi > lo ? lower_bound(idx, hi) : begin;
+    *first_row = begin;
+    return end - begin;
+}
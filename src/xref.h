@@ -0,0 +1,67 @@
+#ifndef XREF_H
+#define XREF_H
+
+#include "air.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    XREF_CALL,
+    XREF_JMP,
+    XREF_DATA, // RIP-relative memory operand
+} xref_kind_t;
+
+typedef struct {
+    uint64_t source; // address of the referencing instruction
+    uint64_t target;
+    uint8_t kind; // xref_kind_t
+} xref_t;
+
+// tuples gathered by one decoder, no locking
+typedef struct {
+    xref_t *items;
+    size_t count;
+    size_t capacity;
+} xref_buf_t;
+
+void xref_buf_init(xref_buf_t *buf);
+void xref_buf_destroy(xref_buf_t *buf);
+
+// appends the references made by `list`, decoded from address `base`
+bool xref_collect(
+    xref_buf_t *buf, const air_instr_list_t *list, uint64_t base);
+
+/*
+ * references grouped by target (CSR): row r holds the references to
+ * targets[r], in sources[first[r]] .. sources[first[r + 1]] with the
+ * matching kinds. rows ascend by target, sources ascend within a row
+ */
+typedef struct {
+    uint64_t *targets;
+    size_t *first; // rows + 1 entries
+    uint64_t *sources;
+    uint8_t *kinds;
+    size_t rows;
+    size_t count;
+
+    // open addressing from target to row, for constant-time lookups
+    uint64_t *slot_keys;
+    uint32_t *slot_rows;
+    size_t slot_mask;
+} xref_index_t;
+
+// sorts the tuples of `bufs` on `threads` workers. each buffer's sources
+// must ascend, and the buffers must be in address order
+bool xref_index_build(xref_index_t *idx, const xref_buf_t *bufs,
+    size_t nbufs, unsigned threads);
+void xref_index_destroy(xref_index_t *idx);
+
+// the row holding references to `target`, or -1 when there are none
+ptrdiff_t xref_index_find(const xref_index_t *idx, uint64_t target);
+
+// rows with targets in [lo, hi): *first_row and the number of rows
+size_t xref_index_range(
+    const xref_index_t *idx, uint64_t lo, uint64_t hi, size_t *first_row);
+
+#endif // XREF_H